@@ -0,0 +1,55 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// Throughput and latency percentiles of the logging macros with the
+// ImGuiLogSink as the current sink, i.e. the cost of ImGuiLogSink::_sink_it()
+// on the logging threads. A thread stands for the UI thread and moves the
+// staged records to the records store once per frame. Same cases and options
+// as common/bench/logging_bench.cpp.
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <common/bench/logging_bench.h>
+#include <ui/log/sink.h>
+
+using asap::bench::Options;
+using asap::bench::Result;
+using asap::debug::ui::ImGuiLogSink;
+using asap::logging::Registry;
+
+namespace {
+
+/// Time between two frames of the UI thread.
+constexpr auto FRAME_TIME = std::chrono::milliseconds(16);
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  auto options = Options::Parse(argc, argv);
+  std::vector<Result> results;
+  asap::bench::PrintHeader();
+
+  auto sink = std::make_shared<ImGuiLogSink>();
+  std::atomic<bool> stop{false};
+  std::thread ui_thread([&sink, &stop]() {
+    while (!stop.load()) {
+      sink->Update();
+      std::this_thread::sleep_for(FRAME_TIME);
+    }
+  });
+
+  Registry::PushSink(sink);
+  asap::bench::RunLoggingCases("imgui", options, options.messages,
+                               [&sink]() { sink->flush(); }, results);
+  Registry::PopSink();
+
+  stop.store(true);
+  ui_thread.join();
+  return asap::bench::WriteResults(options, "imgui_sink", results);
+}
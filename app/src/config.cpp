@@ -18,6 +18,11 @@ bfs::path GetPathFor(Location id) {
       p /= ".asap";
       return p;
     }
+    case Location::D_USER_LOGS: {
+      auto p = GetPathFor(Location::D_USER_CONFIG);
+      p /= "logs";
+      return p;
+    }
     case Location::F_DISPLAY_SETTINGS: {
       auto p = GetPathFor(Location::D_USER_CONFIG);
       p /= "display.yaml";
@@ -45,6 +50,7 @@ bfs::path GetPathFor(Location id) {
 
 void CreateDirectories() {
   bfs::create_directories(GetPathFor(Location::D_USER_CONFIG));
+  bfs::create_directories(GetPathFor(Location::D_USER_LOGS));
 }
 
 }  // namespace fs
@@ -12,6 +12,7 @@ namespace fs {
 
 enum class Location {
   D_USER_CONFIG,
+  D_USER_LOGS,
 
   F_DISPLAY_SETTINGS,
   F_LOG_SETTINGS,
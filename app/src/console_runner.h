@@ -7,29 +7,19 @@
 
 #include <runner_base.h>
 
-namespace boost {
-namespace asio {
-class io_context;
-class signal_set;
-}  // namespace asio
-}  // namespace boost
-
 namespace asap {
 
 class ConsoleRunner : public RunnerBase {
  public:
-  explicit ConsoleRunner(shutdown_function_type f);
+  explicit ConsoleRunner(shutdown_function_type f,
+                         unsigned io_threads = DEFAULT_IO_THREADS);
 
-  ~ConsoleRunner() override;
+  ~ConsoleRunner() override = default;
   ConsoleRunner(const ConsoleRunner &) = delete;
   ConsoleRunner &operator=(const ConsoleRunner &) = delete;
 
+  /// Run the io_context until a termination signal is caught.
   void Run() override;
-
- private:
-  boost::asio::io_context *io_context_;
-  /// The signal_set is used to register for process termination notifications.
-  boost::asio::signal_set *signals_;
 };
 
 }  // namespace asap
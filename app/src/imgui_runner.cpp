@@ -5,6 +5,7 @@
 
 #include <imgui_runner.h>
 
+#include <algorithm>  // for std::max
 #include <fstream>
 
 #include <boost/asio.hpp>
@@ -22,6 +23,7 @@
 #include <yaml-cpp/yaml.h>
 
 #include <common/assert.h>
+#include <common/profiler.h>
 #include <ui/application.h>
 #include <config.h>
 
@@ -36,30 +38,20 @@ void glfw_error_callback(int error, const char *description) {
 
 namespace asap {
 
-ImGuiRunner::ImGuiRunner(RunnerBase::shutdown_function_type f)
-    : RunnerBase(std::move(f)) {
-  SetupSignalHandler();
-  InitGraphics();
-}
+// -------------------------------------------------------------------------
+// Static members initialization
+// -------------------------------------------------------------------------
 
-ImGuiRunner::~ImGuiRunner() {
-  if (!io_context_->stopped()) io_context_->stop();
-  delete signals_;
-  delete io_context_;
-}
+const int ImGuiRunner::EXTRA_FRAMES = 3;
 
-void ImGuiRunner::SetupSignalHandler() {
-  ASLOG(info, "Setup termination signal handlers");
-  // Set signal handler
-  io_context_ = new boost::asio::io_context(1);
-  signals_ = new boost::asio::signal_set(*io_context_);
-  // Register to handle the signals that indicate when the server should exit.
-  // It is safe to register for the same signal multiple times in a program,
-  // provided all registration for the specified signal is made through Asio.
-  signals_->add(SIGINT);
-  signals_->add(SIGTERM);
+ImGuiRunner::ImGuiRunner(RunnerBase::shutdown_function_type f,
+                         unsigned io_threads)
+    : RunnerBase(std::move(f), io_threads) {
+  InitGraphics();
 }
 
+ImGuiRunner::~ImGuiRunner() = default;
+
 void ImGuiRunner::InitGraphics() {
   ASLOG(info, "Initialize graphical subsystem...");
   // Setup window
@@ -94,11 +86,90 @@ void ImGuiRunner::InitImGui() {
   // Keyboard Controls io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
   // // Enable Gamepad Controls
 
-  ImGui_ImplGlfw_InitForOpenGL(window, true);
+  ImGui_ImplGlfw_InitForOpenGL(window, false);
+  InstallCallbacks();
   ImGui_ImplOpenGL3_Init();
   ASLOG(debug, "  ImGui init done");
 }
 
+namespace {
+ImGuiRunner *RunnerOf(GLFWwindow *window) {
+  return static_cast<ImGuiRunner *>(glfwGetWindowUserPointer(window));
+}
+}  // namespace
+
+void ImGuiRunner::InstallCallbacks() {
+  glfwSetWindowUserPointer(window, this);
+
+  // Inputs are forwarded to ImGui
+  glfwSetMouseButtonCallback(
+      window, [](GLFWwindow *w, int button, int action, int mods) {
+        ImGui_ImplGlfw_MouseButtonCallback(w, button, action, mods);
+        RunnerOf(w)->OnActivity();
+      });
+  glfwSetScrollCallback(window, [](GLFWwindow *w, double x, double y) {
+    ImGui_ImplGlfw_ScrollCallback(w, x, y);
+    RunnerOf(w)->OnActivity();
+  });
+  glfwSetKeyCallback(
+      window, [](GLFWwindow *w, int key, int scancode, int action, int mods) {
+        ImGui_ImplGlfw_KeyCallback(w, key, scancode, action, mods);
+        RunnerOf(w)->OnActivity();
+      });
+  glfwSetCharCallback(window, [](GLFWwindow *w, unsigned int c) {
+    ImGui_ImplGlfw_CharCallback(w, c);
+    RunnerOf(w)->OnActivity();
+  });
+
+  // ImGui reads the cursor position and the window state itself, at the
+  // start of the frame; they only need a new frame
+  glfwSetCursorPosCallback(window, [](GLFWwindow *w, double, double) {
+    RunnerOf(w)->OnActivity();
+  });
+  glfwSetCursorEnterCallback(
+      window, [](GLFWwindow *w, int) { RunnerOf(w)->OnActivity(); });
+  glfwSetWindowFocusCallback(
+      window, [](GLFWwindow *w, int) { RunnerOf(w)->OnActivity(); });
+  glfwSetWindowIconifyCallback(
+      window, [](GLFWwindow *w, int) { RunnerOf(w)->OnActivity(); });
+  glfwSetFramebufferSizeCallback(
+      window, [](GLFWwindow *w, int, int) { RunnerOf(w)->OnActivity(); });
+  glfwSetWindowRefreshCallback(
+      window, [](GLFWwindow *w) { RunnerOf(w)->OnActivity(); });
+}
+
+void ImGuiRunner::Invalidate() {
+  // Avoid posting a wake up per call when invalidated at a high rate
+  if (invalidated_.load(std::memory_order_relaxed)) return;
+  if (invalidated_.exchange(true)) return;
+  // Called by any thread, e.g. through the change callback of the log sink,
+  // possibly while the main loop exits and GLFW is terminated
+  std::lock_guard<std::mutex> lock(wake_up_mutex_);
+  if (running_) glfwPostEmptyEvent();
+}
+
+void ImGuiRunner::RedrawAfter(std::chrono::milliseconds delay) {
+  redraw_at_ = std::min(redraw_at_, std::chrono::steady_clock::now() + delay);
+}
+
+void ImGuiRunner::PostToUi(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(ui_tasks_mutex_);
+    ui_tasks_.push_back(std::move(task));
+  }
+  Invalidate();
+}
+
+void ImGuiRunner::RunUiTasks() {
+  {
+    std::lock_guard<std::mutex> lock(ui_tasks_mutex_);
+    // Both keep their capacity, so that posting does not allocate
+    running_ui_tasks_.swap(ui_tasks_);
+  }
+  for (auto &task : running_ui_tasks_) task();
+  running_ui_tasks_.clear();
+}
+
 void ImGuiRunner::Windowed(int width, int height, char const *title) {
   window_title_ = title;
 
@@ -255,66 +326,112 @@ void ImGuiRunner::Run() {
 
   // Main loop
   bool interrupted = false;
-  bool sleep_when_inactive = true;
+  bool can_idle = true;
+  signals_->async_wait(
+      [this, &interrupted](boost::system::error_code /*ec*/, int /*signo*/) {
+        ASLOG(info, "Signal caught");
+        PostToUi([&interrupted]() { interrupted = true; });
+      });
+  asap::Profiler::SetThreadName("main");
+  StartIoThreads();
+  {
+    std::lock_guard<std::mutex> lock(wake_up_mutex_);
+    running_ = true;
+  }
+  frames_to_render_ = EXTRA_FRAMES;
   while (!glfwWindowShouldClose(window) && !interrupted) {
-    signals_->async_wait(
-        [this, &interrupted](boost::system::error_code /*ec*/, int /*signo*/) {
-          ASLOG(info, "Signal caught");
-          // Once all operations have finished the io_context::run() call will
-          // exit.
-          interrupted = true;
-          io_context_->stop();
-        });
-
-    if (sleep_when_inactive && !glfwGetWindowAttrib(window, GLFW_FOCUSED)) {
-      static float wanted_fps = 5.0f;
-      float current_fps = ImGui::GetIO().Framerate;
-      float frame_time = 1000 / current_fps;
-      auto wait_time = std::lround(1000 / wanted_fps - frame_time);
-      if (wanted_fps < current_fps) {
-        io_context_->run_for(std::chrono::milliseconds(wait_time));
+    // When there is nothing left to render, wait for the next event; the
+    // callbacks of the input and window events request new frames. Without
+    // events, only wait until the frame requested by the time-driven UI.
+    if (frames_to_render_ == 0 && can_idle) {
+      auto now = std::chrono::steady_clock::now();
+      if (redraw_at_ == std::chrono::steady_clock::time_point::max()) {
+        glfwWaitEvents();
+      } else if (redraw_at_ > now) {
+        glfwWaitEventsTimeout(
+            std::chrono::duration<double>(redraw_at_ - now).count());
       }
-    } else {
-      io_context_->poll_one();
+      if (std::chrono::steady_clock::now() >= redraw_at_) {
+        frames_to_render_ = std::max(frames_to_render_, 1);
+      }
+    }
+
+    ASAP_PROFILE_SCOPE("Frame");
+    {
+      ASAP_PROFILE_SCOPE("Poll");
+      // Poll and handle events (inputs, window resize, etc.)
+      // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to
+      // tell if dear imgui wants to use your inputs.
+      // - When io.WantCaptureMouse is true, do not dispatch mouse input data
+      // to your main application.
+      // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input
+      // data to your main application. Generally you may always pass all
+      // inputs to dear imgui, and hide them from your application based on
+      // those two flags.
+      glfwPollEvents();
+      if (invalidated_.exchange(false)) {
+        frames_to_render_ = std::max(frames_to_render_, EXTRA_FRAMES);
+      }
+      // Results of the background work, posted by the io threads
+      RunUiTasks();
     }
+    if (interrupted) break;
+    if (frames_to_render_ == 0 && can_idle) continue;
+    if (frames_to_render_ > 0) --frames_to_render_;
 
-    // Poll and handle events (inputs, window resize, etc.)
-    // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to
-    // tell if dear imgui wants to use your inputs.
-    // - When io.WantCaptureMouse is true, do not dispatch mouse input data
-    // to your main application.
-    // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input
-    // data to your main application. Generally you may always pass all
-    // inputs to dear imgui, and hide them from your application based on
-    // those two flags.
-    glfwPollEvents();
-
-	// Skip frame rendering if the window width or heigh is 0
-	// Not doing so will cause the docking system to lose its mind
-	int size[2];
-	GetWindowSize(size);
-	if (size[0] == 0 || size[1] == 0) continue;
+    // Skip frame rendering if the window width or heigh is 0
+    // Not doing so will cause the docking system to lose its mind
+    int size[2];
+    GetWindowSize(size);
+    if (size[0] == 0 || size[1] == 0) continue;
 
     // Start the ImGui frame
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
+    {
+      ASAP_PROFILE_SCOPE("NewFrame");
+      ImGui_ImplOpenGL3_NewFrame();
+      ImGui_ImplGlfw_NewFrame();
+      ImGui::NewFrame();
+    }
 
-    // Draw the Application
-    sleep_when_inactive = app.Draw();
+    // Draw the Application, which renews its requests for timed redraws
+    {
+      ASAP_PROFILE_SCOPE("Draw");
+      redraw_at_ = std::chrono::steady_clock::time_point::max();
+      can_idle = app.Draw();
+    }
 
     // Rendering
-    ImGui::Render();
-    int display_w, display_h;
-    glfwMakeContextCurrent(window);
-    glfwGetFramebufferSize(window, &display_w, &display_h);
-    glViewport(0, 0, display_w, display_h);
-    glClearColor(0, 0, 0, 255);
-    glClear(GL_COLOR_BUFFER_BIT);
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-    glfwMakeContextCurrent(window);
-    glfwSwapBuffers(window);
+    {
+      ASAP_PROFILE_SCOPE("Render");
+      ImGui::Render();
+    }
+    {
+      ASAP_PROFILE_SCOPE("RenderDrawData");
+      int display_w, display_h;
+      glfwMakeContextCurrent(window);
+      glfwGetFramebufferSize(window, &display_w, &display_h);
+      glViewport(0, 0, display_w, display_h);
+      glClearColor(0, 0, 0, 255);
+      glClear(GL_COLOR_BUFFER_BIT);
+      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+
+    {
+      ASAP_PROFILE_SCOPE("SwapBuffers");
+      glfwMakeContextCurrent(window);
+      glfwSwapBuffers(window);
+    }
+  }
+  {
+    // No wake up is posted past this point, GLFW is terminated in CleanUp()
+    std::lock_guard<std::mutex> lock(wake_up_mutex_);
+    running_ = false;
+  }
+  // No background work on the application once it is shut down
+  StopIoThreads();
+  {
+    std::lock_guard<std::mutex> lock(ui_tasks_mutex_);
+    ui_tasks_.clear();
   }
 
   SaveSetting();
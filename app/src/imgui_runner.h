@@ -5,23 +5,42 @@
 
 #pragma once
 
-#include <runner_base.h>
+#include <atomic>      // for the invalidation flag
+#include <chrono>      // for the timed redraws
+#include <functional>  // for the UI tasks
+#include <mutex>       // for the UI tasks
+#include <vector>      // for the UI tasks
 
-namespace boost {
-namespace asio {
-class io_context;
-class signal_set;
-}  // namespace asio
-}  // namespace boost
+#include <runner_base.h>
 
 struct GLFWwindow;
 struct GLFWmonitor;
 
 namespace asap {
 
+/*!
+ * @brief Runs the application in a GLFW window, drawn with ImGui.
+ *
+ * Frames are only rendered when something may have changed: on input, on
+ * window events, or when Invalidate() is called. A few extra frames follow
+ * each of them, for the ImGui animations and layout changes to settle. Past
+ * those, the runner waits for the next event and barely uses any CPU or GPU.
+ * The parts of the UI that change with time alone, while they are shown, ask
+ * for a frame at a later time with RedrawAfter(). The application can ask
+ * for continuous rendering by returning false from Draw().
+ *
+ * The io_context runs on its own threads, so that background work is not
+ * limited by the frame rate. Its handlers hand their results over to the UI
+ * thread with PostToUi().
+ */
 class ImGuiRunner : public RunnerBase {
  public:
-  explicit ImGuiRunner(shutdown_function_type f);
+  /// Number of frames rendered after an input, a window event or an
+  /// invalidation.
+  static const int EXTRA_FRAMES;
+
+  explicit ImGuiRunner(shutdown_function_type f,
+                       unsigned io_threads = DEFAULT_IO_THREADS);
 
   ~ImGuiRunner() override;
   ImGuiRunner(const ImGuiRunner &) = delete;
@@ -41,6 +60,35 @@ class ImGuiRunner : public RunnerBase {
 
   void Run() override;
 
+  /*!
+   * @brief Request new frames to be rendered, because something drawn has
+   * changed. Wakes up the runner if it is idle.
+   *
+   * Thread safe; can be called at any rate, as the wake up is only posted
+   * once until the next frame.
+   */
+  void Invalidate();
+
+  /*!
+   * @brief Request a frame to be rendered after the given delay, even without
+   * input, for a part of the UI that changes with time alone.
+   *
+   * Only called from the UI thread, while drawing a frame. Requests do not
+   * outlive the next frame: a view renews its request each time it is drawn,
+   * and the runner goes fully idle once none is drawn. The earliest request
+   * wins.
+   */
+  void RedrawAfter(std::chrono::milliseconds delay);
+
+  /*!
+   * @brief Run a task on the UI thread, before the next frame is drawn.
+   *
+   * Thread safe; meant for the handlers running on the io threads. The tasks
+   * are run in the order they were posted. Tasks still pending when the main
+   * loop exits are discarded.
+   */
+  void PostToUi(std::function<void()> task);
+
   std::string const &GetWindowTitle() const;
   bool IsFullScreen() const { return full_screen_; };
   bool IsWindowed() const { return windowed_; };
@@ -56,17 +104,21 @@ class ImGuiRunner : public RunnerBase {
 
 
  private:
-  void SetupSignalHandler();
   void InitGraphics();
   void SetupContext();
   void InitImGui();
   void CleanUp();
 
-  GLFWwindow *window{nullptr};
+  /// Chain the input callbacks of the ImGui binding with ours, which wake up
+  /// the rendering.
+  void InstallCallbacks();
+  /// An input or a window event happened: render the next frames. Only called
+  /// from the main thread.
+  void OnActivity() { frames_to_render_ = EXTRA_FRAMES; }
+  /// Run the tasks posted to the UI thread since the last frame.
+  void RunUiTasks();
 
-  boost::asio::io_context *io_context_;
-  /// The signal_set is used to register for process termination notifications.
-  boost::asio::signal_set *signals_;
+  GLFWwindow *window{nullptr};
 
   std::string window_title_;
   bool full_screen_{false};
@@ -76,6 +128,26 @@ class ImGuiRunner : public RunnerBase {
   int samples_{-1};
 
   mutable int saved_position_[2]{-1, -1};
+
+  /// Frames still to render before going idle. Only used by the main thread.
+  int frames_to_render_{0};
+  /// When to render a frame without input, as requested with RedrawAfter().
+  /// Only used by the main thread.
+  std::chrono::steady_clock::time_point redraw_at_{
+      std::chrono::steady_clock::time_point::max()};
+  /// Set by Invalidate() until the main loop picks it up.
+  std::atomic<bool> invalidated_{false};
+  /// Serializes the wake ups posted by Invalidate() with the termination of
+  /// GLFW.
+  std::mutex wake_up_mutex_;
+  /// Whether the main loop runs, i.e. whether wake ups can be posted.
+  /// Guarded by wake_up_mutex_.
+  bool running_{false};
+
+  std::mutex ui_tasks_mutex_;
+  std::vector<std::function<void()>> ui_tasks_;
+  /// Only used by the main thread, to run the tasks outside of the lock.
+  std::vector<std::function<void()>> running_ui_tasks_;
 };
 
 }  // namespace asap
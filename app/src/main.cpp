@@ -3,12 +3,16 @@
 //    (See accompanying file LICENSE or copy at
 //   https://opensource.org/licenses/BSD-3-Clause)
 
+#include <ctime>    // for naming the crash record
 #include <fstream>  // to check if a file exists
 #include <iostream>
 
 #include <boost/program_options.hpp>
+#include <yaml-cpp/yaml.h>
 
+#include <common/crash_handler.h>
 #include <common/logging.h>
+#include <common/rotating_file_sink.h>
 #include <console_runner.h>
 #include <imgui_runner.h>
 #include <config.h>
@@ -20,6 +24,73 @@ using asap::ConsoleRunner;
 using asap::ImGuiRunner;
 using asap::RunnerBase;
 
+/*!
+ * @brief Create the log file sink from the 'logging/file' section of the
+ * logging settings.
+ *
+ * @return the sink, or nullptr if logging to a file is not enabled.
+ */
+std::shared_ptr<asap::logging::RotatingFileSink> CreateLogFileSink() {
+  auto &logger = asap::logging::Registry::GetLogger(asap::logging::Id::MAIN);
+  auto log_settings = asap::fs::GetPathFor(asap::fs::Location::F_LOG_SETTINGS);
+  if (!boost::filesystem::exists(log_settings)) return nullptr;
+
+  try {
+    auto file = YAML::LoadFile(log_settings.string())["logging"]["file"];
+    if (!file || (file["enabled"] && !file["enabled"].as<bool>())) {
+      return nullptr;
+    }
+
+    asap::logging::RotatingFileSink::Options options;
+    auto logs_dir = asap::fs::GetPathFor(asap::fs::Location::D_USER_LOGS);
+    options.path = (logs_dir / "asap.log").string();
+    if (file["path"]) options.path = file["path"].as<std::string>();
+    if (file["max-size-mb"]) {
+      options.max_size = file["max-size-mb"].as<std::size_t>() * 1024 * 1024;
+    }
+    if (file["max-age-hours"]) {
+      options.max_age = std::chrono::hours(file["max-age-hours"].as<int>());
+    }
+    if (file["max-files"]) {
+      options.max_files = file["max-files"].as<std::size_t>();
+    }
+    if (file["compress"]) options.compress = file["compress"].as<bool>();
+    if (file["buffer-kb"]) {
+      options.buffer_size = file["buffer-kb"].as<std::size_t>() * 1024;
+    }
+    if (file["flush-interval-ms"]) {
+      options.flush_interval =
+          std::chrono::milliseconds(file["flush-interval-ms"].as<int>());
+    }
+    auto sink = std::make_shared<asap::logging::RotatingFileSink>(options);
+    ASLOG_TO_LOGGER(logger, info, "logging to file {}", options.path);
+    return sink;
+  } catch (std::exception const &ex) {
+    ASLOG_TO_LOGGER(logger, error, "logging to file disabled: {}", ex.what());
+  }
+  return nullptr;
+}
+
+/*!
+ * @brief Record crashes in the logs directory, in a file named after the
+ * current date and time.
+ *
+ * The file is only created if the application crashes. Crash records are
+ * symbolized offline.
+ */
+void InstallCrashHandler() {
+  auto &logger = asap::logging::Registry::GetLogger(asap::logging::Id::MAIN);
+  auto now = std::time(nullptr);
+  char name[32];
+  std::strftime(name, sizeof(name), "crash-%Y%m%d-%H%M%S.dump",
+                std::localtime(&now));
+  auto path =
+      (asap::fs::GetPathFor(asap::fs::Location::D_USER_LOGS) / name).string();
+  if (!asap::CrashHandler::Install(path)) {
+    ASLOG_TO_LOGGER(logger, warn, "crashes will not be recorded in {}", path);
+  }
+}
+
 void Shutdown() {
   auto &logger = asap::logging::Registry::GetLogger(asap::logging::Id::MAIN);
   // Shutdown
@@ -30,9 +101,20 @@ int main(int argc, char **argv) {
   auto &logger = asap::logging::Registry::GetLogger(asap::logging::Id::MAIN);
 
   asap::fs::CreateDirectories();
-
+  InstallCrashHandler();
 
   bool show_debug_gui{false};
+  bool async_log{false};
+  bool buffer_log{false};
+  unsigned io_threads{RunnerBase::DEFAULT_IO_THREADS};
+  // Log to a file next to the console or GUI, if configured
+  auto file_sink = CreateLogFileSink();
+  auto file_branch = asap::logging::FanOutSink::BranchId{0};
+  if (file_sink) file_branch = asap::logging::Registry::AddSink(file_sink);
+  auto remove_file_sink = [&file_sink, file_branch]() {
+    if (file_sink) asap::logging::Registry::RemoveSink(file_branch);
+  };
+
   try {
     // Command line arguments
     bpo::options_description desc("Allowed options");
@@ -40,7 +122,14 @@ int main(int argc, char **argv) {
     desc.add_options()
         ("help", "show the help message")
         ("debug-ui,d", bpo::value<bool>(&show_debug_gui)->default_value(false),
-         "show the debug UI");
+         "show the debug UI")
+        ("async-log,a", bpo::value<bool>(&async_log)->default_value(false),
+         "log from a dedicated thread instead of the calling thread")
+        ("buffer-log,b", bpo::value<bool>(&buffer_log)->default_value(false),
+         "buffer log messages in each thread and write them in batches")
+        ("io-threads,t", bpo::value<unsigned>(&io_threads)
+             ->default_value(RunnerBase::DEFAULT_IO_THREADS),
+         "number of threads running the asynchronous operations");
     // clang-format on
 
     bpo::variables_map bpo_vm;
@@ -48,34 +137,58 @@ int main(int argc, char **argv) {
 
     if (bpo_vm.count("help")) {
       std::cout << desc << std::endl;
+      remove_file_sink();
+      asap::CrashHandler::Uninstall();
       return 0;
     }
 
     bpo::notify(bpo_vm);
 
+    if (async_log) {
+      asap::logging::Registry::EnableAsync();
+      ASLOG_TO_LOGGER(logger, info, "asynchronous logging enabled");
+    }
+    if (buffer_log) {
+      asap::logging::Registry::EnableThreadBuffering();
+      ASLOG_TO_LOGGER(logger, info, "per-thread log buffering enabled");
+    }
+
     if (!show_debug_gui) {
       ASLOG_TO_LOGGER(logger, info, "starting in console mode...");
       //
       // Start the console runner
       //
-      ConsoleRunner runner(Shutdown);
+      ConsoleRunner runner(Shutdown, io_threads);
       runner.Run();
     } else {
       ASLOG_TO_LOGGER(logger, info, "starting in GUI mode...");
       //
       // Start the ImGui runner
       //
-      ImGuiRunner runner(Shutdown);
+      ImGuiRunner runner(Shutdown, io_threads);
       runner.LoadSetting();
       runner.Run();
     }
   } catch (std::exception &e) {
     ASLOG_TO_LOGGER(logger, error, "Error: {}", e.what());
+    asap::logging::Registry::DisableThreadBuffering();
+    asap::logging::Registry::DisableAsync();
+    remove_file_sink();
+    asap::CrashHandler::Uninstall();
     return -1;
   } catch (...) {
     ASLOG_TO_LOGGER(logger, error, "Unknown error!");
+    asap::logging::Registry::DisableThreadBuffering();
+    asap::logging::Registry::DisableAsync();
+    remove_file_sink();
+    asap::CrashHandler::Uninstall();
     return -1;
   }
 
+  // Make sure all pending log messages are written before we exit
+  asap::logging::Registry::DisableThreadBuffering();
+  asap::logging::Registry::DisableAsync();
+  remove_file_sink();
+  asap::CrashHandler::Uninstall();
   return 0;
 }
@@ -0,0 +1,77 @@
+//    Copyright The asap Project Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <runner_base.h>
+
+#include <algorithm>  // for std::max
+
+#include <boost/asio.hpp>
+
+#include <common/crash_handler.h>
+#include <common/profiler.h>
+
+namespace asap {
+
+// -------------------------------------------------------------------------
+// Static members initialization
+// -------------------------------------------------------------------------
+
+const unsigned RunnerBase::DEFAULT_IO_THREADS = 2;
+
+class RunnerBase::WorkGuard {
+ public:
+  explicit WorkGuard(boost::asio::io_context &io_context)
+      : guard_(boost::asio::make_work_guard(io_context)) {}
+
+ private:
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      guard_;
+};
+
+RunnerBase::RunnerBase(shutdown_function_type func, unsigned io_threads)
+    : shutdown_function_(std::move(func)),
+      io_threads_count_(std::max(1u, io_threads)) {
+  io_context_ =
+      new boost::asio::io_context(static_cast<int>(io_threads_count_));
+  signals_ = new boost::asio::signal_set(*io_context_);
+  // Register to handle the signals that indicate when the server should exit.
+  // It is safe to register for the same signal multiple times in a program,
+  // provided all registration for the specified signal is made through Asio.
+  signals_->add(SIGINT);
+  signals_->add(SIGTERM);
+}
+
+RunnerBase::~RunnerBase() {
+  StopIoThreads();
+  delete signals_;
+  delete io_context_;
+}
+
+void RunnerBase::StartIoThreads() {
+  ASLOG(info, "Starting {} io threads", io_threads_count_);
+  work_guard_.reset(new WorkGuard(*io_context_));
+  for (auto ii = 0u; ii < io_threads_count_; ++ii) {
+    io_threads_.emplace_back([this, ii]() {
+      asap::CrashHandler::InstallThreadStack();
+      asap::Profiler::SetThreadName("io " + std::to_string(ii));
+      io_context_->run();
+    });
+  }
+}
+
+void RunnerBase::ReleaseIoThreads() { work_guard_.reset(); }
+
+void RunnerBase::JoinIoThreads() {
+  for (auto &thread : io_threads_) thread.join();
+  io_threads_.clear();
+}
+
+void RunnerBase::StopIoThreads() {
+  work_guard_.reset();
+  if (!io_context_->stopped()) io_context_->stop();
+  JoinIoThreads();
+}
+
+}  // namespace asap
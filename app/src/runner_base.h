@@ -6,24 +6,80 @@
 #pragma once
 
 #include <functional>  // for std::function
+#include <memory>      // for std::unique_ptr
+#include <thread>      // for the io threads
+#include <vector>      // for the io threads
 
 #include <common/logging.h>
 
+namespace boost {
+namespace asio {
+class io_context;
+class signal_set;
+}  // namespace asio
+}  // namespace boost
+
 namespace asap {
 
+/*!
+ * @brief Base of the runners, which own the io_context of the application.
+ *
+ * The io_context is run by a pool of threads, independently of the main
+ * thread. Subsystems that need their handlers serialized use their own strand
+ * on it. The pool keeps running, even when it has no pending operation,
+ * until the runner stops it.
+ */
 class RunnerBase : public asap::logging::Loggable<asap::logging::Id::MAIN> {
  public:
   using shutdown_function_type = std::function<void()>;
 
-  explicit RunnerBase(shutdown_function_type func)
-      : shutdown_function_(std::move(func)) {}
+  /// Default number of threads running the io_context.
+  static const unsigned DEFAULT_IO_THREADS;
+
+  /*!
+   * @brief Create the io_context and register for the termination signals.
+   *
+   * @param [in] func called once the runner is shut down.
+   * @param [in] io_threads number of threads running the io_context, at
+   * least 1.
+   */
+  RunnerBase(shutdown_function_type func, unsigned io_threads);
 
-  virtual ~RunnerBase() = default;
+  /// Stops the io threads if they are still running.
+  virtual ~RunnerBase();
+  RunnerBase(const RunnerBase &) = delete;
+  RunnerBase &operator=(const RunnerBase &) = delete;
 
   virtual void Run() = 0;
 
+  /// The io_context for the asynchronous operations of the application.
+  boost::asio::io_context &IoContext() { return *io_context_; }
+
  protected:
+  /// Start the threads running the io_context, which keep running until
+  /// StopIoThreads() or a call to io_context::stop().
+  void StartIoThreads();
+  /// Let the threads running the io_context finish once it has no pending
+  /// operation left.
+  void ReleaseIoThreads();
+  /// Wait for the threads running the io_context to finish.
+  void JoinIoThreads();
+  /// Stop the io_context and wait for its threads to finish.
+  void StopIoThreads();
+
   shutdown_function_type shutdown_function_;
+
+  boost::asio::io_context *io_context_;
+  /// The signal_set is used to register for process termination notifications.
+  boost::asio::signal_set *signals_;
+
+ private:
+  /// Keeps the io_context running while it has no pending operation.
+  class WorkGuard;
+
+  unsigned io_threads_count_;
+  std::unique_ptr<WorkGuard> work_guard_;
+  std::vector<std::thread> io_threads_;
 };
 
 }  // namespace asap
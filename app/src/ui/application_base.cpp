@@ -3,28 +3,96 @@
 //    (See accompanying file LICENSE or copy at
 //   https://opensource.org/licenses/BSD-3-Clause)
 
-#include <cmath>  // for rounding frame rate
+#include <algorithm>  // for sorting the journals
+#include <chrono>     // for refreshing the live views
+#include <cmath>      // for rounding frame rate
+#include <ctime>      // for naming the session journal
 #include <sstream>
+#include <vector>
 
 #include <GLFW/glfw3.h>
+#include <boost/filesystem.hpp>
 #include <imgui.h>
 
+#include <common/dedup_sink.h>
+#include <common/profiler.h>
+
 #include <imgui/imgui_dock.h>
 #include <imgui_runner.h>
 #include <ui/application_base.h>
 #include <ui/fonts/material_design_icons.h>
 #include <ui/log/sink.h>
 #include <ui/style/theme.h>
+#include <config.h>
+
+namespace bfs = boost::filesystem;
 
 namespace asap {
 namespace debug {
 namespace ui {
 
+namespace {
+
+/// Number of session journals kept in the logs directory.
+const std::size_t MAX_SESSION_JOURNALS = 10;
+
+/// Refresh period of the views of live data, which change without input.
+const std::chrono::milliseconds LIVE_VIEWS_REFRESH(250);
+
+/// Remove the oldest session journals, keeping the most recent ones.
+void PruneSessionJournals(const bfs::path &logs_dir, std::size_t keep) {
+  std::vector<bfs::path> journals;
+  boost::system::error_code ec;
+  for (bfs::directory_iterator it(logs_dir, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (it->path().extension() == ImGuiLogSink::JOURNAL_EXTENSION) {
+      journals.push_back(it->path());
+    }
+  }
+  if (journals.size() <= keep) return;
+  // Journal names start with their date
+  std::sort(journals.begin(), journals.end());
+  for (std::size_t ii = 0; ii < journals.size() - keep; ++ii) {
+    bfs::remove(journals[ii], ec);
+  }
+}
+
+/// Path of a new session journal, named after the current date and time.
+std::string SessionJournalPath(const bfs::path &logs_dir) {
+  auto now = std::time(nullptr);
+  char name[32];
+  std::strftime(name, sizeof(name), "session-%Y%m%d-%H%M%S",
+                std::localtime(&now));
+  return (logs_dir / (name + std::string(ImGuiLogSink::JOURNAL_EXTENSION)))
+      .string();
+}
+
+}  // namespace
+
 ApplicationBase::ApplicationBase(ImGuiRunner &runner) : runner_(runner) {}
 
 void ApplicationBase::Init() {
   sink_ = std::make_shared<asap::debug::ui::ImGuiLogSink>();
-  asap::logging::Registry::PushSink(sink_);
+  // New records are drawn even when there is no input
+  sink_->SetChangeCallback([this]() { runner_.Invalidate(); });
+
+  // Also record the session in a journal, that can be reopened later in the
+  // log view
+  auto logs_dir = asap::fs::GetPathFor(asap::fs::Location::D_USER_LOGS);
+  PruneSessionJournals(logs_dir, MAX_SESSION_JOURNALS - 1);
+  try {
+    journal_sink_ = std::make_shared<asap::logging::JournalSink>(
+        SessionJournalPath(logs_dir));
+  } catch (std::exception const &ex) {
+    ASLOG(error, "session journal disabled: {}", ex.what());
+  }
+  if (journal_sink_) {
+    journal_branch_ = asap::logging::Registry::AddSink(journal_sink_);
+  }
+  // Collapse the repeated messages of failure storms, which would otherwise
+  // fill up the history of the log view
+  asap::logging::Registry::PushSink(
+      std::make_shared<asap::logging::DedupSink>(sink_));
 
   sink_->LoadSettings();
 
@@ -40,6 +108,7 @@ void ApplicationBase::Init() {
 void ApplicationBase::ShutDown() {
   // Restore the original log sink
   asap::logging::Registry::PopSink();
+  if (journal_sink_) asap::logging::Registry::RemoveSink(journal_branch_);
 
   // Call derived class for any custom shutdown logic before we shutdown the
   // app. We do this before to stay consistent with the initialization order.
@@ -58,6 +127,7 @@ void ApplicationBase::ShutDown() {
 }
 
 bool ApplicationBase::Draw() {
+  asap::Profiler::Enable(show_profiler_);
   if (ImGui::GetIO().DisplaySize.y > 0) {
 	auto menu_height = DrawMainMenu();
 	auto pos = ImVec2(0, menu_height);
@@ -67,15 +137,23 @@ bool ApplicationBase::Draw() {
 
     DrawStatusBar(size.x, 16.0f, 0.0f, size.y);
 
+    // Collect new log records even when the log view is hidden
+    sink_->Update();
     if (show_logs_) DrawLogView();
     if (show_settings_) DrawSettings();
     if (show_docks_debug_) DrawDocksDebug();
     if (show_imgui_metrics_) DrawImGuiMetrics();
+    if (show_profiler_) DrawProfiler();
     if (show_imgui_demos_) DrawImGuiDemos();
+
+    // Only the live views are drawn again without input
+    if ((show_profiler_ && !profiler_view_.Paused()) || show_imgui_metrics_) {
+      runner_.RedrawAfter(LIVE_VIEWS_REFRESH);
+    }
   }
 
-  // Return true to indicate that we are not doing any calculation and we can
-  // sleep if the application window is not focused.
+  // Return true to indicate that we are not doing any calculation and the
+  // runner can wait for input before drawing the next frame.
   return true;
 }
 
@@ -103,6 +181,9 @@ float ApplicationBase::DrawMainMenu() {
       if (ImGui::MenuItem("Show ImGui Metrics", "CTRL+SHIFT+M", &show_imgui_metrics_)) {
         DrawImGuiMetrics();
       }
+      if (ImGui::MenuItem("Show Profiler", "CTRL+SHIFT+P", &show_profiler_)) {
+        DrawProfiler();
+      }
       if (ImGui::MenuItem("Show ImGui Demos", "CTRL+SHIFT+G", &show_imgui_demos_)) {
         DrawImGuiDemos();
       }
@@ -152,6 +233,13 @@ void ApplicationBase::DrawImGuiMetrics() {
   ImGui::ShowMetricsWindow();
 }
 
+void ApplicationBase::DrawProfiler() {
+  if (ImGui::BeginDock("Profiler", &show_profiler_)) {
+    profiler_view_.Draw();
+  }
+  ImGui::EndDock();
+}
+
 void ApplicationBase::DrawImGuiDemos() {
     ImGui::ShowDemoWindow(&show_imgui_demos_);
 }
@@ -9,6 +9,7 @@
 
 #include <ui/abstract_application.h>
 #include <ui/log/sink.h>
+#include <ui/profiler/profiler_view.h>
 
 namespace asap {
 class ImGuiRunner;
@@ -47,6 +48,7 @@ class ApplicationBase : public AbstractApplication,
   void DrawSettings();
   void DrawDocksDebug();
   void DrawImGuiMetrics();
+  void DrawProfiler();
   void DrawImGuiDemos();
 
  private:
@@ -54,9 +56,15 @@ class ApplicationBase : public AbstractApplication,
   bool show_logs_{true};
   bool show_settings_{true};
   bool show_imgui_metrics_{false};
+  /// The profiler only records zones while its view is shown.
+  bool show_profiler_{false};
   bool show_imgui_demos_{false};
 
   std::shared_ptr<ImGuiLogSink> sink_;
+  ProfilerView profiler_view_;
+  /// Journal of the current session, nullptr if it could not be created.
+  std::shared_ptr<asap::logging::JournalSink> journal_sink_;
+  asap::logging::FanOutSink::BranchId journal_branch_{0};
   ImGuiRunner &runner_;
 };
 
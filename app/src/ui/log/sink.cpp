@@ -3,9 +3,12 @@
 //    (See accompanying file LICENSE or copy at
 //   https://opensource.org/licenses/BSD-3-Clause)
 
+#include <algorithm>  // for std::max, std::sort, std::upper_bound
 #include <array>
+#include <chrono>  // for polling the index rebuild
+#include <cstdio>  // for std::snprintf
 #include <fstream>
-#include <sstream>  // for log record formatting
+#include <thread>   // for std::thread::hardware_concurrency
 
 #include <date/date.h>  // for time formatting
 #include <yaml-cpp/yaml.h>
@@ -30,9 +33,7 @@ YAML::Emitter &operator<<(YAML::Emitter &out,
     out << YAML::Key << "name";
     out << YAML::Value << log.Name();
     out << YAML::Key << "id";
-    out << YAML::Value
-        << static_cast<typename std::underlying_type<asap::logging::Id>::type>(
-               log.Id());
+    out << YAML::Value << log.Handle().Index();
     out << YAML::Key << "level";
     out << YAML::Value << log.Level();
   }
@@ -48,36 +49,250 @@ namespace ui {
 const ImVec4 ImGuiLogSink::COLOR_WARN{0.9f, 0.7f, 0.0f, 1.0f};
 const ImVec4 ImGuiLogSink::COLOR_ERROR{1.0f, 0.0f, 0.0f, 1.0f};
 
+const std::size_t ImGuiLogSink::DEFAULT_MAX_RECORDS = 100000;
+const std::size_t ImGuiLogSink::DEFAULT_MAX_MEMORY = 64 * 1024 * 1024;
+const std::size_t ImGuiLogSink::DEFAULT_STAGING_SIZE = 16384;
+const char *const ImGuiLogSink::JOURNAL_EXTENSION = ".journal";
+
+namespace {
+/// Minimum number of records filtered by each thread of an index rebuild,
+/// also the interval at which cancellation is checked.
+constexpr std::size_t MIN_FILTER_SEGMENT_SIZE = 16384;
+
+/// Number of decimals of the fraction of a second of the record times.
+constexpr int TimeDecimals() {
+  int decimals = 0;
+  for (auto den = spdlog::log_clock::period::den; den > 1; den /= 10) {
+    ++decimals;
+  }
+  return decimals;
+}
+
+/*!
+ * Format the time of a record in a buffer, the same way as in the displayed
+ * prefix (`%D %T %Z`), without the allocations of date::format(), as it is
+ * done for each record when filtering.
+ */
+void FormatTime(spdlog::log_clock::time_point time, char (&buffer)[48]) {
+  auto day = date::floor<date::days>(time);
+  date::year_month_day ymd(day);
+  auto tod = date::make_time(time - day);
+  std::snprintf(buffer, sizeof(buffer),
+                "%02u/%02u/%02d %02d:%02d:%02d.%0*lld UTC",
+                static_cast<unsigned>(ymd.month()),
+                static_cast<unsigned>(ymd.day()),
+                static_cast<int>(ymd.year()) % 100,
+                static_cast<int>(tod.hours().count()),
+                static_cast<int>(tod.minutes().count()),
+                static_cast<int>(tod.seconds().count()), TimeDecimals(),
+                static_cast<long long>(tod.subseconds().count()));
+}
+}  // namespace
+
+ImGuiLogSink::ImGuiLogSink()
+    : staging_(DEFAULT_STAGING_SIZE),
+      overflow_max_records_(DEFAULT_MAX_RECORDS),
+      overflow_max_bytes_(DEFAULT_MAX_MEMORY),
+      records_(DEFAULT_MAX_RECORDS, DEFAULT_MAX_MEMORY) {}
+
+ImGuiLogSink::~ImGuiLogSink() { CancelIndexRebuild(); }
+
+void ImGuiLogSink::Update() {
+  // Defer to the next frame rather than wait for an index rebuild reading the
+  // records; the staging queue holds the new records meanwhile.
+  std::unique_lock<std::shared_timed_mutex> lock(records_mutex_,
+                                                 std::try_to_lock);
+  if (!lock.owns_lock()) return;
+  auto push = [this](StagedRecord &staged) {
+    records_.Push(staged.header_, staged.message_.data(),
+                  staged.message_.size());
+  };
+  // Records queued before the overflow started come first
+  auto drained = false;
+  while (staging_.TryPop(push)) drained = true;
+  if (overflowing_.load(std::memory_order_acquire)) {
+    std::deque<StagedRecord> overflow;
+    {
+      std::lock_guard<std::mutex> overflow_lock(overflow_mutex_);
+      overflow.swap(overflow_);
+      overflow_bytes_ = 0;
+      overflowing_.store(false, std::memory_order_release);
+    }
+    // The logging threads go back to the queue meanwhile, which is only
+    // drained with the next update
+    for (auto &staged : overflow) push(staged);
+    drained = true;
+  }
+  if (drained) scroll_to_bottom_ = true;
+}
+
 void ImGuiLogSink::Clear() {
+  CancelIndexRebuild();
+  std::unique_lock<std::shared_timed_mutex> lock(records_mutex_);
+  while (staging_.TryPop([](StagedRecord &) {})) {
+  }
+  {
+    std::lock_guard<std::mutex> overflow_lock(overflow_mutex_);
+    overflow_.clear();
+    overflow_bytes_ = 0;
+    overflowing_.store(false, std::memory_order_release);
+  }
+  dropped_.store(0, std::memory_order_relaxed);
+  records_.Clear();
+  display_rows_.clear();
+  row_offsets_.clear();
+  indexed_end_ = records_.EndSequence();
+}
+
+void ImGuiLogSink::SetHistoryLimits(std::size_t max_records,
+                                    std::size_t max_memory) {
+  CancelIndexRebuild();
   std::unique_lock<std::shared_timed_mutex> lock(records_mutex_);
-  records_.clear();
+  records_.SetLimits(max_records, max_memory);
+  std::lock_guard<std::mutex> overflow_lock(overflow_mutex_);
+  overflow_max_records_ = records_.MaxRecords();
+  overflow_max_bytes_ = records_.MaxBytes();
 }
 
 void ImGuiLogSink::ShowLogLevelsPopup() {
   ImGui::MenuItem("Logging Levels", nullptr, false, false);
 
   std::vector<int> levels;
-  for (auto &a_logger : asap::logging::Registry::Loggers()) {
-    levels.push_back(a_logger.Level());
+  for (auto *a_logger : asap::logging::Registry::Loggers()) {
+    levels.push_back(a_logger->Level());
     auto format = std::string("%u (")
-                      .append(spdlog::level::to_str(a_logger.Level()))
+                      .append(spdlog::level::to_str(a_logger->Level()))
                       .append(")");
-    if (ImGui::SliderInt(a_logger.Name().c_str(), &levels.back(), 0, 6,
+    if (ImGui::SliderInt(a_logger->Name().c_str(), &levels.back(), 0, 6,
                          format.c_str())) {
-      a_logger.Level(spdlog::level::level_enum(levels.back()));
+      a_logger->Level(spdlog::level::level_enum(levels.back()));
     }
   }
 }
 
 void ImGuiLogSink::ShowLogFormatPopup() {
   ImGui::MenuItem("Logging Format", nullptr, false, false);
-  ImGui::Checkbox("Time", &show_time_);
+  auto changed = ImGui::Checkbox("Time", &show_time_);
   ImGui::SameLine();
-  ImGui::Checkbox("Thread", &show_thread_);
+  changed |= ImGui::Checkbox("Thread", &show_thread_);
   ImGui::SameLine();
-  ImGui::Checkbox("Level", &show_level_);
+  changed |= ImGui::Checkbox("Level", &show_level_);
   ImGui::SameLine();
-  ImGui::Checkbox("Logger", &show_logger_);
+  changed |= ImGui::Checkbox("Logger", &show_logger_);
+  // Prefixes are formatted when drawn, so this applies to all records
+  if (changed) ++format_version_;
+}
+
+void ImGuiLogSink::ShowJournalsPopup() {
+  ImGui::MenuItem("Session Journals", nullptr, false, false);
+
+  std::vector<bfs::path> journals;
+  boost::system::error_code ec;
+  auto logs_dir = asap::fs::GetPathFor(asap::fs::Location::D_USER_LOGS);
+  for (bfs::directory_iterator it(logs_dir, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (it->path().extension() == JOURNAL_EXTENSION) {
+      journals.push_back(it->path());
+    }
+  }
+  if (journals.empty()) {
+    ImGui::MenuItem("No journal found", nullptr, false, false);
+  }
+  // Journal names start with their date, show the most recent first
+  std::sort(journals.rbegin(), journals.rend());
+  for (auto const &journal : journals) {
+    if (ImGui::MenuItem(journal.filename().string().c_str(), nullptr,
+                        journal.string() == journal_path_)) {
+      OpenJournal(journal.string());
+    }
+  }
+}
+
+bool ImGuiLogSink::OpenJournal(const std::string &path) {
+  std::unique_ptr<asap::logging::JournalReader> reader;
+  try {
+    reader.reset(new asap::logging::JournalReader(path));
+  } catch (std::exception const &ex) {
+    ASLOG(error, "could not open journal: {}", ex.what());
+    return false;
+  }
+  CancelIndexRebuild();
+  journal_ = std::move(reader);
+  journal_path_ = path;
+  ASLOG(info, "showing journal {} ({} records)", path, journal_->Size());
+  OnViewChanged();
+  return true;
+}
+
+void ImGuiLogSink::CloseJournal() {
+  if (!journal_) return;
+  CancelIndexRebuild();
+  journal_.reset();
+  journal_path_.clear();
+  OnViewChanged();
+}
+
+void ImGuiLogSink::OnViewChanged() {
+  journal_heights_.clear();
+  journal_heights_width_ = -1.0f;
+  display_rows_.clear();
+  row_offsets_.clear();
+  indexed_end_ = FirstSequence();
+  // Sequence numbers now designate other records
+  ++format_version_;
+  OnFilterChanged();
+}
+
+std::size_t ImGuiLogSink::FirstSequence() const {
+  return journal_ ? 0 : records_.FirstSequence();
+}
+
+std::size_t ImGuiLogSink::EndSequence() const {
+  return journal_ ? journal_->Size() : records_.EndSequence();
+}
+
+ImGuiLogSink::RecordView ImGuiLogSink::ViewAt(std::size_t seq) const {
+  if (journal_) return journal_->At(seq);
+
+  auto const &record = records_.HeaderAt(seq);
+  RecordView view;
+  view.time = record.time_;
+  view.thread_id = record.thread_id_;
+  view.level = record.level_;
+  view.logger = record.logger_name_->c_str();
+  view.file = record.source_ ? record.source_->File() : nullptr;
+  view.line = record.source_ ? record.source_->Line() : 0;
+  view.function = record.source_ ? record.source_->Function() : nullptr;
+  view.message = records_.TextAt(seq);
+  view.message_size = records_.TextSizeAt(seq);
+  return view;
+}
+
+float ImGuiLogSink::RowHeight(std::size_t seq, float wrap_width,
+                              float default_height) const {
+  if (journal_) {
+    if (journal_heights_width_ != wrap_width || journal_heights_[seq] <= 0.0f) {
+      return default_height;
+    }
+    return journal_heights_[seq];
+  }
+  auto const &record = records_.HeaderAt(seq);
+  return record.height_width_ == wrap_width ? record.height_ : default_height;
+}
+
+void ImGuiLogSink::SetRowHeight(std::size_t seq, float wrap_width,
+                                float height) {
+  if (journal_) {
+    if (journal_heights_width_ != wrap_width) {
+      journal_heights_.assign(journal_->Size(), 0.0f);
+      journal_heights_width_ = wrap_width;
+    }
+    journal_heights_[seq] = height;
+    return;
+  }
+  auto &record = records_.HeaderAt(seq);
+  record.height_ = height;
+  record.height_width_ = wrap_width;
 }
 
 void ImGuiLogSink::Draw(const char *title, bool *open) {
@@ -140,6 +355,26 @@ void ImGuiLogSink::Draw(const char *title, bool *open) {
       ImGui::SetTooltip("Discard all messages");
     }
 
+    ImGui::SameLine();
+    if (ImGui::Button(ICON_MDI_HISTORY " Journals")) {
+      ImGui::OpenPopup("LogJournalsPopup");
+    }
+    if (ImGui::IsItemHovered()) {
+      ImGui::SetTooltip("Show the messages of a previous session");
+    }
+    if (ImGui::BeginPopup("LogJournalsPopup")) {
+      ShowJournalsPopup();
+      ImGui::EndPopup();
+    }
+    if (journal_) {
+      ImGui::SameLine();
+      if (ImGui::Button(ICON_MDI_CLOSE " Live")) CloseJournal();
+      if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Showing %s\nGo back to the live messages",
+                          journal_path_.c_str());
+      }
+    }
+
     ImGui::SameLine();
     bool need_pop_style_var = false;
     if (wrap_) {
@@ -177,7 +412,18 @@ void ImGuiLogSink::Draw(const char *title, bool *open) {
     }
 
     ImGui::SameLine();
-    display_filter_.Draw(ICON_MDI_FILTER " Filter", -100.0f);
+    if (display_filter_.Draw(ICON_MDI_FILTER " Filter", -100.0f)) {
+      OnFilterChanged();
+    }
+
+    auto dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped > 0) {
+      ImGui::SameLine();
+      ImGui::TextColored(COLOR_WARN, ICON_MDI_ALERT " %zu", dropped);
+      if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Messages dropped while the view was not updated");
+      }
+    }
   }
   // Restore the button color
   ImGui::PopStyleColor();
@@ -193,84 +439,76 @@ void ImGuiLogSink::Draw(const char *title, bool *open) {
   {
     ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 1));
 
+    // Resolve the fonts once per frame, not once per row
     Font font("Inconsolata");
     font.MediumSize();
+    auto *regular_font = font.Regular().ImGuiFont();
+    auto *bold_font = font.Bold().ImGuiFont();
+    ImGui::PushFont(regular_font);
+    auto line_height = ImGui::GetTextLineHeightWithSpacing();
+    ImGui::PopFont();
+
+    // The UI thread is the only one modifying the records, no lock needed
+    // to read them
+    Update();
+    UpdateDisplayIndex();
+    auto rows_count = DisplayRowsCount();
 
-    std::shared_lock<std::shared_timed_mutex> lock(records_mutex_);
-    for (auto const &record : records_) {
-      if (!display_filter_.IsActive() ||
-          display_filter_.PassFilter(
-              record.properties_.c_str(),
-              record.properties_.c_str() + record.properties_.size()) ||
-          display_filter_.PassFilter(
-              record.source_.c_str(),
-              record.source_.c_str() + record.source_.size()) ||
-          display_filter_.PassFilter(
-              record.message_.c_str(),
-              record.message_.c_str() + record.message_.size())) {
-        ImGui::BeginGroup();
-        if (record.emphasis_) {
-          font.Bold();
-        } else {
-          font.Regular();
-        }
-        ImGui::PushFont(font.ImGuiFont());
-
-        if (record.color_range_start_ > 0) {
-          auto props_len = record.properties_.size();
-
-          ASAP_ASSERT_VAL(record.color_range_start_ < props_len,
-                          record.color_range_start_);
-          ASAP_ASSERT(record.color_range_end_ > record.color_range_start_);
-          ASAP_ASSERT_VAL(record.color_range_end_ < props_len,
-                          record.color_range_end_);
-
-          std::string part =
-              record.properties_.substr(0, record.color_range_start_);
-          ImGui::TextUnformatted(part.c_str());
-          ImGui::SameLine();
-
-          part = record.properties_.substr(
-              record.color_range_start_,
-              record.color_range_end_ - record.color_range_start_);
-          ImGui::TextColored(record.color_, "%s", part.c_str());
-
-          part = record.properties_.substr(record.color_range_end_,
-                                           props_len - record.color_range_end_);
-          ImGui::SameLine();
-          ImGui::TextUnformatted(part.c_str());
-
-        } else {
-          if (record.color_range_end_ == 1) {
-            ImGui::TextColored(record.color_, "%s", record.properties_.c_str());
-          } else {
-            ImGui::TextUnformatted(record.properties_.c_str());
-          }
+    if (wrap_) {
+      // Rows have variable heights: skip and reserve the space of invisible
+      // rows using their cached heights, or a single line if not measured yet
+      // at the current wrap width.
+      auto wrap_width = ImGui::GetContentRegionAvail().x;
+      UpdateRowOffsets(rows_count, wrap_width, line_height);
+      auto origin = ImGui::GetCursorPosY();
+      auto visible_top = ImGui::GetScrollY();
+      auto visible_bottom = visible_top + ImGui::GetWindowHeight();
+
+      // The first row ending below the top of the window
+      auto first_visible = std::upper_bound(
+          row_offsets_.begin(), row_offsets_.end(),
+          visible_top - origin + row_offsets_base_,
+          [](float y, const RowOffset &offset) { return y < offset.bottom_; });
+      auto row = static_cast<std::size_t>(first_visible - row_offsets_.begin());
+      auto y = origin + RowTop(row);
+      ImGui::SetCursorPosY(y);
+
+      auto first_changed = rows_count;
+      for (; row < rows_count && y < visible_bottom; ++row) {
+        auto seq = DisplayRowSequence(row);
+        auto cached_height = RowHeight(seq, wrap_width, line_height);
+        DrawRecord(seq, regular_font, bold_font);
+        auto new_y = ImGui::GetCursorPosY();
+        if (new_y - y != cached_height && first_changed == rows_count) {
+          first_changed = row;
         }
+        SetRowHeight(seq, wrap_width, new_y - y);
+        y = new_y;
+      }
+      if (first_changed < rows_count) {
+        row_offsets_.resize(first_changed);
+        UpdateRowOffsets(rows_count, wrap_width, line_height);
+      }
 
-        if (record.color_range_end_ == 1) {
-          ImGui::SameLine();
-          if (wrap_) ImGui::PushTextWrapPos(0.0f);
-          ImGui::TextColored(record.color_, "%s", record.message_.c_str());
-          if (wrap_) ImGui::PopTextWrapPos();
-        } else {
-          ImGui::SameLine();
-          if (wrap_) ImGui::PushTextWrapPos(0.0f);
-          ImGui::TextUnformatted(record.message_.c_str());
-          if (wrap_) ImGui::PopTextWrapPos();
-        }
-        ImGui::EndGroup();
-        if (ImGui::IsItemHovered()) {
-          ImGui::SetTooltip("%s", record.source_.c_str());
+      auto remaining = RowTop(rows_count) - RowTop(row);
+      // Dummy() adds the item spacing itself
+      if (remaining > 0.0f) ImGui::Dummy(ImVec2(0.0f, remaining - 1.0f));
+    } else {
+      // All rows are exactly one line high
+      ImGuiListClipper clipper(static_cast<int>(rows_count), line_height);
+      while (clipper.Step()) {
+        for (auto row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+          DrawRecord(DisplayRowSequence(static_cast<std::size_t>(row)),
+                     regular_font, bold_font);
         }
-
-        ImGui::PopFont();
       }
     }
   }
   ImGui::PopStyleVar();
 
-  if (!scroll_lock_ && scroll_to_bottom_) ImGui::SetScrollHere(1.0f);
+  if (!journal_ && !scroll_lock_ && scroll_to_bottom_) {
+    ImGui::SetScrollHere(1.0f);
+  }
   scroll_to_bottom_ = false;
   ImGui::EndChild();
 
@@ -280,111 +518,313 @@ void ImGuiLogSink::Draw(const char *title, bool *open) {
   }
 }
 
-void ImGuiLogSink::_sink_it(const spdlog::details::log_msg &msg) {
-  auto ostr = std::ostringstream();
-  std::size_t color_range_start = 0;
-  std::size_t color_range_end = 0;
-  ImVec4 const *color = nullptr;
-  auto emphasis = false;
+bool ImGuiLogSink::PassFilter(const ImGuiTextFilter &filter,
+                              std::size_t seq) const {
+  // The fields of the prefix are formatted on the stack, the cached prefix
+  // is only for the UI thread
+  auto record = ViewAt(seq);
+  if (filter.PassFilter(record.message,
+                        record.message + record.message_size) ||
+      (record.file && filter.PassFilter(record.file)) ||
+      filter.PassFilter(record.logger) ||
+      filter.PassFilter(spdlog::level::to_short_str(record.level))) {
+    return true;
+  }
+  char thread_id[24];
+  std::snprintf(thread_id, sizeof(thread_id), "%zu", record.thread_id);
+  if (filter.PassFilter(thread_id)) return true;
+  char time[48];
+  FormatTime(record.time, time);
+  return filter.PassFilter(time);
+}
+
+void ImGuiLogSink::CancelIndexRebuild() {
+  if (!index_rebuild_.valid()) return;
+  index_rebuild_cancel_->store(true);
+  index_rebuild_.wait();
+  index_rebuild_ = std::future<DisplayIndex>();
+}
+
+void ImGuiLogSink::OnFilterChanged() {
+  CancelIndexRebuild();
+  if (!display_filter_.IsActive()) {
+    display_rows_.clear();
+    row_offsets_.clear();
+    return;
+  }
+  // The filter used by the rebuild is built from the text, as the ranges of
+  // an ImGuiTextFilter point into its own input buffer.
+  index_rebuild_cancel_ = std::make_shared<std::atomic<bool>>(false);
+  index_rebuild_ =
+      std::async(std::launch::async, &ImGuiLogSink::RebuildDisplayIndex, this,
+                 std::string(display_filter_.InputBuf), index_rebuild_cancel_);
+}
+
+ImGuiLogSink::DisplayIndex ImGuiLogSink::RebuildDisplayIndex(
+    std::string filter_text, std::shared_ptr<std::atomic<bool>> cancel) const {
+  ImGuiTextFilter filter(filter_text.c_str());
+
+  std::shared_lock<std::shared_timed_mutex> lock(records_mutex_);
+  DisplayIndex index;
+  auto first = FirstSequence();
+  index.end_ = EndSequence();
+
+  // Split the records in segments filtered in parallel
+  auto count = index.end_ - first;
+  auto segments = std::min<std::size_t>(
+      std::max(1u, std::thread::hardware_concurrency()),
+      count / MIN_FILTER_SEGMENT_SIZE + 1);
+  auto segment_size = count / segments + 1;
+  std::vector<std::future<std::vector<std::size_t>>> parts;
+  for (auto from = first; from < index.end_; from += segment_size) {
+    auto to = std::min(from + segment_size, index.end_);
+    parts.push_back(std::async(
+        std::launch::async, [this, &filter, &cancel, from, to]() {
+          std::vector<std::size_t> rows;
+          for (auto seq = from; seq != to; ++seq) {
+            if (seq % MIN_FILTER_SEGMENT_SIZE == 0 && cancel->load()) break;
+            if (PassFilter(filter, seq)) rows.push_back(seq);
+          }
+          return rows;
+        }));
+  }
+  for (auto &part : parts) {
+    auto rows = part.get();
+    index.rows_.insert(index.rows_.end(), rows.begin(), rows.end());
+  }
+  // The result is picked up with the next frame
+  if (on_change_) on_change_();
+  return index;
+}
+
+void ImGuiLogSink::UpdateDisplayIndex() {
+  if (index_rebuild_.valid() &&
+      index_rebuild_.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    auto index = index_rebuild_.get();
+    display_rows_ = std::move(index.rows_);
+    row_offsets_.clear();
+    indexed_end_ = index.end_;
+  }
+  if (!display_filter_.IsActive()) return;
+
+  // Forget evicted records
+  while (!display_rows_.empty() &&
+         display_rows_.front() < FirstSequence()) {
+    display_rows_.pop_front();
+  }
+  // Keep showing the previous results until the rebuild is done
+  if (index_rebuild_.valid()) return;
+
+  // Index the records added since the last frame
+  auto seq = std::max(indexed_end_, FirstSequence());
+  for (; seq < EndSequence(); ++seq) {
+    if (PassFilter(display_filter_, seq)) display_rows_.push_back(seq);
+  }
+  indexed_end_ = seq;
+}
+
+void ImGuiLogSink::UpdateRowOffsets(std::size_t rows_count, float wrap_width,
+                                    float default_height) {
+  if (row_offsets_width_ != wrap_width) {
+    row_offsets_.clear();
+    row_offsets_width_ = wrap_width;
+  }
+  // Forget the evicted rows
+  auto first_seq = rows_count > 0 ? DisplayRowSequence(0) : 0;
+  while (!row_offsets_.empty() && row_offsets_.front().seq_ < first_seq) {
+    row_offsets_base_ = row_offsets_.front().bottom_;
+    row_offsets_.pop_front();
+  }
+  if (row_offsets_.size() > rows_count ||
+      (!row_offsets_.empty() && row_offsets_.front().seq_ != first_seq)) {
+    row_offsets_.clear();
+  }
+  if (row_offsets_.empty()) {
+    row_offsets_base_ = 0.0f;
+  } else if (row_offsets_base_ >
+             row_offsets_.back().bottom_ - row_offsets_base_) {
+    // Keep the offsets small, for their precision. Amortized over the
+    // evictions, which trimmed more rows than are left.
+    for (auto &offset : row_offsets_) offset.bottom_ -= row_offsets_base_;
+    row_offsets_base_ = 0.0f;
+  }
 
+  auto bottom =
+      row_offsets_.empty() ? row_offsets_base_ : row_offsets_.back().bottom_;
+  for (auto row = row_offsets_.size(); row < rows_count; ++row) {
+    auto seq = DisplayRowSequence(row);
+    bottom += RowHeight(seq, wrap_width, default_height);
+    row_offsets_.push_back({seq, bottom});
+  }
+}
+
+float ImGuiLogSink::RowTop(std::size_t row) const {
+  if (row == 0) return 0.0f;
+  return row_offsets_[row - 1].bottom_ - row_offsets_base_;
+}
+
+std::size_t ImGuiLogSink::DisplayRowsCount() const {
+  return display_filter_.IsActive() ? display_rows_.size()
+                                    : EndSequence() - FirstSequence();
+}
+
+std::size_t ImGuiLogSink::DisplayRowSequence(std::size_t row) const {
+  return display_filter_.IsActive() ? display_rows_[row]
+                                    : FirstSequence() + row;
+}
+
+const ImGuiLogSink::RecordPrefix &ImGuiLogSink::FormatPrefix(
+    std::size_t seq) {
+  auto &prefix = prefix_cache_[seq % PREFIX_CACHE_SIZE];
+  if (prefix.seq_ == seq && prefix.format_version_ == format_version_) {
+    return prefix;
+  }
+
+  auto record = ViewAt(seq);
+  prefix.seq_ = seq;
+  prefix.format_version_ = format_version_;
+  prefix.text_.clear();
+  prefix.level_start_ = prefix.level_end_ = 0;
   if (show_time_) {
-    ostr << "[" << date::format("%D %T %Z", msg.time) << "] ";
+    prefix.text_.append("[")
+        .append(date::format("%D %T %Z", record.time))
+        .append("] ");
   }
   if (show_thread_) {
-    ostr << "[" << msg.thread_id << "] ";
+    prefix.text_.append("[")
+        .append(std::to_string(record.thread_id))
+        .append("] ");
   }
   if (show_level_) {
-    color_range_start = static_cast<std::size_t>(ostr.tellp());
-    ostr << "[" << spdlog::level::to_short_str(msg.level) << "] ";
-    color_range_end = static_cast<std::size_t>(ostr.tellp());
+    prefix.level_start_ = prefix.text_.size();
+    prefix.text_.append("[")
+        .append(spdlog::level::to_short_str(record.level))
+        .append("] ");
+    prefix.level_end_ = prefix.text_.size();
   }
   if (show_logger_) {
-    ostr << "[" << *msg.logger_name << "] ";
-  }
-  auto properties = ostr.str();
-
-  // Strip the filename:line from the message and put it in a separate string
-  auto msg_str = msg.raw.str();
-  auto skip_to = msg_str.begin();
-  if (*skip_to == '[') {
-    // skip spaces
-    while (skip_to != msg_str.end() && *skip_to != ']') ++skip_to;
-    if (skip_to == msg_str.end()) {
-      skip_to = msg_str.begin();
-    } else {
-      auto saved_skip_to = skip_to + 1;
-      while (skip_to != msg_str.begin()) {
-        --skip_to;
-        if (*skip_to == ':' || !std::isdigit(*skip_to)) break;
-      }
-      if (*skip_to == ':') skip_to = ++saved_skip_to;  // Add one space
-    }
+    prefix.text_.append("[").append(record.logger).append("] ");
   }
-  // Ignore the '[' and ']'
-  auto source = msg_str.substr(1, skip_to - msg_str.begin() - 3);
+  return prefix;
+}
+
+void ImGuiLogSink::DrawRecord(std::size_t seq, ImFont *regular_font,
+                              ImFont *bold_font) {
+  auto record = ViewAt(seq);
+  auto const &prefix = FormatPrefix(seq);
+  auto const *prefix_begin = prefix.text_.data();
+  auto const *prefix_end = prefix_begin + prefix.text_.size();
+  auto const *text = record.message;
+  auto const *text_end = text + record.message_size;
 
   // Select display color and colored text range based on level
-  switch (msg.level) {
+  ImVec4 const *color = nullptr;
+  auto whole_record = false;
+  switch (record.level) {
     case spdlog::level::trace:
       color = &ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled);
-      // the entire message
-      color_range_start = 0;
-      color_range_end = 1;
+      whole_record = true;
       break;
-
     case spdlog::level::debug:
       color = &ImGui::GetStyleColorVec4(ImGuiCol_Text);
-      // The level part if show, otherwise no coloring
       break;
-
     case spdlog::level::info:
       color = &ImGui::GetStyleColorVec4(ImGuiCol_NavHighlight);
-      // The level part if show, otherwise no coloring
       break;
-
     case spdlog::level::warn:
       color = &COLOR_WARN;
-      // the entire message
-      color_range_start = 0;
-      color_range_end = 1;
+      whole_record = true;
       break;
-
     case spdlog::level::err:
-      color = &COLOR_ERROR;
-      // the entire message
-      color_range_start = 0;
-      color_range_end = 1;
-      break;
-
     case spdlog::level::critical:
       color = &COLOR_ERROR;
-      emphasis = true;
-      // the entire message
-      color_range_start = 0;
-      color_range_end = 1;
+      whole_record = true;
       break;
-
     default:
-        // Nothing
-        ;
+      color = &ImGui::GetStyleColorVec4(ImGuiCol_Text);
   }
 
-  auto record = LogRecord{properties,
-                          source,
-                          msg_str.substr(skip_to - msg_str.begin()),
-                          color_range_start,
-                          color_range_end,
-                          *color,
-                          emphasis};
-  {
-    std::unique_lock<std::shared_timed_mutex> lock(records_mutex_);
-    records_.push_back(std::move(record));
+  ImGui::BeginGroup();
+  ImGui::PushFont(record.level == spdlog::level::critical ? bold_font
+                                                          : regular_font);
+
+  if (whole_record) {
+    ImGui::TextColored(*color, "%.*s",
+                       static_cast<int>(prefix_end - prefix_begin),
+                       prefix_begin);
+  } else if (prefix.level_end_ > prefix.level_start_) {
+    // Only the level part is colored
+    ImGui::TextUnformatted(prefix_begin, prefix_begin + prefix.level_start_);
+    ImGui::SameLine();
+    ImGui::TextColored(
+        *color, "%.*s",
+        static_cast<int>(prefix.level_end_ - prefix.level_start_),
+        prefix_begin + prefix.level_start_);
+    ImGui::SameLine();
+    ImGui::TextUnformatted(prefix_begin + prefix.level_end_, prefix_end);
+  } else {
+    ImGui::TextUnformatted(prefix_begin, prefix_end);
+  }
+
+  ImGui::SameLine();
+  if (wrap_) ImGui::PushTextWrapPos(0.0f);
+  if (whole_record) {
+    ImGui::TextColored(*color, "%.*s", static_cast<int>(text_end - text),
+                       text);
+  } else {
+    ImGui::TextUnformatted(text, text_end);
+  }
+  if (wrap_) ImGui::PopTextWrapPos();
+
+  ImGui::EndGroup();
+  if (record.file && ImGui::IsItemHovered()) {
+    ImGui::SetTooltip("%s:%d\n%s", record.file, record.line,
+                      record.function ? record.function : "");
+  }
+
+  ImGui::PopFont();
+}
+
+void ImGuiLogSink::_sink_it(const spdlog::details::log_msg &msg) {
+  // Only the raw fields are stored; the prefix is formatted when drawn.
+  // The location comes as structured fields; only skip its text prefix.
+  auto source = asap::logging::SourceLocation::Current();
+  auto skip = source ? source->PrefixLength() : 0;
+  if (skip > msg.raw.size()) skip = 0;
+
+  auto stage = [&msg, source, skip](StagedRecord &record) {
+    record.header_ = LogRecord();
+    record.header_.source_ = source;
+    record.header_.time_ = msg.time;
+    record.header_.thread_id_ = msg.thread_id;
+    record.header_.level_ = msg.level;
+    record.header_.logger_name_ = msg.logger_name;
+    // assign() reuses the capacity already held by the slot
+    record.message_.assign(msg.raw.data() + skip, msg.raw.size() - skip);
+  };
+  // Hand the record over to the UI thread, without waiting for it unless the
+  // queue is full
+  if (overflowing_.load(std::memory_order_acquire) ||
+      !staging_.TryPush(stage)) {
+    std::lock_guard<std::mutex> overflow_lock(overflow_mutex_);
+    overflow_.emplace_back();
+    stage(overflow_.back());
+    overflow_bytes_ += overflow_.back().message_.size();
+    // The oldest records would be evicted from the history by the newer ones
+    while (overflow_.size() > overflow_max_records_ ||
+           (overflow_.size() > 1 && overflow_bytes_ > overflow_max_bytes_)) {
+      overflow_bytes_ -= overflow_.front().message_.size();
+      overflow_.pop_front();
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    overflowing_.store(true, std::memory_order_release);
   }
-  scroll_to_bottom_ = true;
+  if (on_change_) on_change_();
 }
 
 void ImGuiLogSink::_flush() {
-  // Your code here
+  // Records are flushed by the UI thread, once per frame
 }
 
 namespace {
@@ -452,12 +892,14 @@ void ImGuiLogSink::LoadSettings() {
 
     if (logging["loggers"]) {
       for (auto const &logger_settings : logging["loggers"]) {
-        ASLOG(debug, "logger '{}' with id '{}' will have level '{}'",
-              logger_settings["name"].as<std::string>(),
-              logger_settings["id"].as<int>(),
+        auto name = logger_settings["name"].as<std::string>();
+        ASLOG(debug, "logger '{}' will have level '{}'", name,
               logger_settings["level"].as<int>());
+        // Handles depend on the registration order, loggers are found by
+        // name. Loggers not registered yet are, to get their level when they
+        // are used.
         auto &logger = asap::logging::Registry::GetLogger(
-            static_cast<asap::logging::Id>(logger_settings["id"].as<int>()));
+            asap::logging::Registry::RegisterLogger(name));
         logger.set_level(static_cast<spdlog::level::level_enum>(
             logger_settings["level"].as<int>()));
       }
@@ -485,10 +927,35 @@ void ImGuiLogSink::LoadSettings() {
     if (logging["soft-wrap"]) {
       wrap_ = logging["soft-wrap"].as<bool>();
     }
+    ++format_version_;
+
+    if (logging["history"]) {
+      auto history = logging["history"];
+      auto max_records = DEFAULT_MAX_RECORDS;
+      auto max_memory = DEFAULT_MAX_MEMORY;
+      if (history["max-records"]) {
+        max_records = history["max-records"].as<std::size_t>();
+      }
+      if (history["max-memory-mb"]) {
+        max_memory = history["max-memory-mb"].as<std::size_t>() * 1024 * 1024;
+      }
+      SetHistoryLimits(max_records, max_memory);
+    }
   }
 }
 
 void ImGuiLogSink::SaveSettings() {
+  // The log file settings are not edited here, keep them as they are
+  YAML::Node file_settings;
+  auto log_settings = asap::fs::GetPathFor(asap::fs::Location::F_LOG_SETTINGS);
+  if (bfs::exists(log_settings)) {
+    try {
+      file_settings = YAML::LoadFile(log_settings.string())["logging"]["file"];
+    } catch (std::exception const &) {
+      // Nothing to keep from an invalid file
+    }
+  }
+
   YAML::Emitter out;
   out << YAML::BeginMap;
   {
@@ -496,7 +963,9 @@ void ImGuiLogSink::SaveSettings() {
     out << YAML::BeginMap;
     {
       out << YAML::Key << "loggers";
-      out << logging::Registry::Loggers();
+      out << YAML::BeginSeq;
+      for (auto const *log : logging::Registry::Loggers()) out << *log;
+      out << YAML::EndSeq;
       out << YAML::Key << "format";
       out << YAML::BeginMap;
       {
@@ -515,15 +984,28 @@ void ImGuiLogSink::SaveSettings() {
       out << YAML::Value << scroll_lock_;
       out << YAML::Key << "soft-wrap";
       out << YAML::Value << wrap_;
+
+      out << YAML::Key << "history";
+      out << YAML::BeginMap;
+      {
+        out << YAML::Key << "max-records";
+        out << YAML::Value << records_.MaxRecords();
+        out << YAML::Key << "max-memory-mb";
+        out << YAML::Value << records_.MaxBytes() / (1024 * 1024);
+      }
+      out << YAML::EndMap;
+
+      if (file_settings) {
+        out << YAML::Key << "file";
+        out << YAML::Value << file_settings;
+      }
     }
     out << YAML::EndMap;
   }
   out << YAML::EndMap;
 
-  auto display_settings =
-      asap::fs::GetPathFor(asap::fs::Location::F_LOG_SETTINGS);
   auto ofs = std::ofstream();
-  ofs.open(display_settings.string());
+  ofs.open(log_settings.string());
   ofs << out.c_str() << std::endl;
   ofs.close();
 }
@@ -5,28 +5,114 @@
 
 #pragma once
 
-#include <shared_mutex>  // for locking the records vector
-#include <vector>        // for the records vector
+#include <array>         // for the prefix cache
+#include <atomic>        // for cancelling the index rebuild
+#include <deque>         // for the display index and the staging overflow
+#include <functional>    // for the change callback
+#include <future>        // for the index rebuild
+#include <memory>        // for std::shared_ptr
+#include <mutex>         // for the staging overflow
+#include <shared_mutex>  // for locking the records store
+#include <string>        // for std::string
+#include <vector>        // for the index segments and row heights
 
+#include <spdlog/details/null_mutex.h>
 #include <spdlog/sinks/sink.h>
 #include <spdlog/spdlog.h>
 
+#include <common/include/common/bounded_queue.h>
+#include <common/include/common/journal.h>
 #include <common/include/common/logging.h>
+#include <common/include/common/record_store.h>
 #include <imgui.h>
 
 namespace asap {
 namespace debug {
 namespace ui {
 
-class ImGuiLogSink : public spdlog::sinks::base_sink<std::mutex>,
+/*!
+ * @brief A logging sink that keeps the log records in memory and displays them
+ * in an ImGui window.
+ *
+ * Logging threads never wait for the UI: _sink_it() only copies the message
+ * into a lock-free staging queue (hence the null mutex of the base sink).
+ * The UI thread moves the staged records into the records store once per
+ * frame, in Update(). When the staging queue is full, e.g. during a burst or
+ * while an index rebuild delays the updates, the records go to a locked
+ * overflow list instead, until the UI thread catches up. The UI thread only
+ * holds its lock to take the whole list. The overflow list does not grow past
+ * the history limits: its oldest records, which the newer ones would evict
+ * from the history anyway, are dropped and counted.
+ *
+ * As the UI only draws frames when something changed, the sink notifies the
+ * UI of new records, and of finished index rebuilds, through its change
+ * callback.
+ */
+class ImGuiLogSink
+    : public spdlog::sinks::base_sink<spdlog::details::null_mutex>,
                      asap::logging::Loggable<asap::logging::Id::MAIN> {
  public:
+  /// Default maximum number of records kept by the sink.
+  static const std::size_t DEFAULT_MAX_RECORDS;
+  /// Default maximum amount of memory used for the text of the records.
+  static const std::size_t DEFAULT_MAX_MEMORY;
+  /// Number of slots in the queue of records waiting for the UI thread.
+  static const std::size_t DEFAULT_STAGING_SIZE;
+  /// Extension of the session journal files.
+  static const char *const JOURNAL_EXTENSION;
+
+  ImGuiLogSink();
+
+  /// Cancels a running index rebuild.
+  ~ImGuiLogSink() override;
+
+  /*!
+   * @brief Move the records logged since the last call into the records
+   * store. Must be called once per frame from the UI thread, even when the
+   * log view is not drawn (Draw() calls it too).
+   */
+  void Update();
+
+  /*!
+   * @brief Set the function called when there is something new to draw.
+   * Must be set before the sink is added to the loggers, as it is called by
+   * the logging threads.
+   */
+  void SetChangeCallback(std::function<void()> callback) {
+    on_change_ = std::move(callback);
+  }
+
   void Clear();
 
+  /*!
+   * @brief Change the limits of the records history. When a limit is reached,
+   * the oldest records are discarded.
+   *
+   * @param [in] max_records maximum number of records kept.
+   * @param [in] max_memory maximum amount of memory (in bytes) used for the
+   * text of the records.
+   */
+  void SetHistoryLimits(std::size_t max_records, std::size_t max_memory);
+
   void ShowLogLevelsPopup();
 
   void ShowLogFormatPopup();
 
+  /// List the session journals found in the logs directory.
+  void ShowJournalsPopup();
+
+  /*!
+   * @brief Show the records of a journal instead of the live records. New
+   * records are still collected meanwhile.
+   *
+   * @param [in] path path of the journal file.
+   * @return false if the file could not be opened as a journal.
+   */
+  bool OpenJournal(const std::string &path);
+
+  /// Go back to showing the live records.
+  void CloseJournal();
+
   void ToggleWrap() { wrap_ = !wrap_; }
 
   void ToggleScrollLock() { scroll_lock_ = !scroll_lock_; }
@@ -45,20 +131,166 @@ class ImGuiLogSink : public spdlog::sinks::base_sink<std::mutex>,
   static const ImVec4 COLOR_WARN;
   static const ImVec4 COLOR_ERROR;
 
+  /*!
+   * @brief Fixed-size header of a record in the store, holding the raw
+   * fields of the log message. The record text is the message itself.
+   */
   struct LogRecord {
-    std::string properties_;
-    std::string source_;
+    /// Location of the log statement, nullptr if not logged through the
+    /// logging macros.
+    asap::logging::SourceLocation const *source_{nullptr};
+    spdlog::log_clock::time_point time_;
+    std::size_t thread_id_{0};
+    spdlog::level::level_enum level_{spdlog::level::off};
+    /// Loggers live as long as the Registry, so the name can be kept by
+    /// address.
+    const std::string *logger_name_{nullptr};
+    /// Height of the row when last drawn with soft wraps, only valid if
+    /// height_width_ matches the current wrap width. Only used by the UI
+    /// thread.
+    float height_{0.0f};
+    float height_width_{-1.0f};
+  };
+
+  /// The fields of a displayed record, from the records store or from the
+  /// opened journal.
+  using RecordView = asap::logging::JournalReader::Entry;
+
+  /// @name Access to the displayed records, live or from the journal
+  //@{
+  std::size_t FirstSequence() const;
+  std::size_t EndSequence() const;
+  RecordView ViewAt(std::size_t seq) const;
+  /// Cached height of a row with soft wraps, or default_height if unknown.
+  float RowHeight(std::size_t seq, float wrap_width,
+                  float default_height) const;
+  void SetRowHeight(std::size_t seq, float wrap_width, float height);
+  /// Reset the display state after switching between live and journal.
+  void OnViewChanged();
+  //@}
+
+  /// The formatted properties shown in front of a message.
+  struct RecordPrefix {
+    /// Sequence number of the record, or SIZE_MAX for an empty entry.
+    std::size_t seq_{static_cast<std::size_t>(-1)};
+    unsigned format_version_{0};
+    std::string text_;
+    /// Range of the level in text_, empty if not shown.
+    std::size_t level_start_{0};
+    std::size_t level_end_{0};
+  };
+  /// Number of entries in the prefix cache, more than the visible rows.
+  static constexpr std::size_t PREFIX_CACHE_SIZE = 256;
+
+  /// Get the prefix of a record from the cache, formatting it if needed.
+  const RecordPrefix &FormatPrefix(std::size_t seq);
+
+  /// The sequence numbers of the records passing the display filter, up to
+  /// (but not including) end_.
+  struct DisplayIndex {
+    std::deque<std::size_t> rows_;
+    std::size_t end_{0};
+  };
+
+  /// Whether the record passes the given filter.
+  bool PassFilter(const ImGuiTextFilter &filter, std::size_t seq) const;
+  /// Start rebuilding the display index in the background.
+  void OnFilterChanged();
+  /// Stop the background index rebuild, if any, and discard its result.
+  void CancelIndexRebuild();
+  /*!
+   * @brief Filter all records, in parallel. Runs in the background and holds
+   * a shared lock on the records for its duration.
+   */
+  DisplayIndex RebuildDisplayIndex(
+      std::string filter_text, std::shared_ptr<std::atomic<bool>> cancel) const;
+  /*!
+   * @brief Pick up the result of a finished rebuild, drop evicted records and
+   * filter the records added since the last frame. Called by the UI thread,
+   * which reads the records without the lock as it is the only one modifying
+   * them.
+   */
+  void UpdateDisplayIndex();
+  /// Number of rows to display.
+  std::size_t DisplayRowsCount() const;
+  /// Sequence number of the record displayed at the given row.
+  std::size_t DisplayRowSequence(std::size_t row) const;
+  /// Draw a single record as a row of the log view.
+  void DrawRecord(std::size_t seq, ImFont *regular_font, ImFont *bold_font);
+  /// Bring the offsets of the rows with soft wraps up to date with the
+  /// displayed rows, using their cached heights.
+  void UpdateRowOffsets(std::size_t rows_count, float wrap_width,
+                        float default_height);
+  /// Offset of the top of a row from the top of the first row, up to
+  /// rows_count for the bottom of the last row.
+  float RowTop(std::size_t row) const;
+
+  /// A log record waiting in the staging queue for the UI thread.
+  struct StagedRecord {
+    LogRecord header_;
     std::string message_;
-    std::size_t color_range_start_{0};
-    std::size_t color_range_end_{0};
-    const ImVec4 &color_;
-    bool emphasis_{false};
   };
-  std::vector<LogRecord> records_;
+  asap::BoundedQueue<StagedRecord> staging_;
+  /// @name Records staged after the queue filled up, in order
+  //@{
+  std::mutex overflow_mutex_;
+  std::deque<StagedRecord> overflow_;
+  /// Size of the messages in overflow_.
+  std::size_t overflow_bytes_{0};
+  /// The history limits, also applied to overflow_.
+  std::size_t overflow_max_records_;
+  std::size_t overflow_max_bytes_;
+  /// Set while overflow_ is not empty: the records are staged there, after
+  /// the older ones, rather than in the queue.
+  std::atomic<bool> overflowing_{false};
+  //@}
+  /// Number of records dropped from the overflow list.
+  std::atomic<std::size_t> dropped_{0};
+  std::function<void()> on_change_;
+
+  /// Only modified by the UI thread.
+  asap::RecordStore<LogRecord> records_;
+  /// @name Journal being shown instead of the live records
+  //@{
+  std::unique_ptr<asap::logging::JournalReader> journal_;
+  std::string journal_path_;
+  /// Row heights with soft wraps, allocated when first measured.
+  std::vector<float> journal_heights_;
+  float journal_heights_width_{-1.0f};
+  //@}
+
+  /// @name Offsets of the rows with soft wraps
+  //@{
+  /// A displayed row, and the offset of its bottom.
+  struct RowOffset {
+    std::size_t seq_;
+    float bottom_;
+  };
+  /// Prefix sums of the heights of the displayed rows, to find the visible
+  /// rows without walking all the rows every frame. Extended with the new
+  /// rows, trimmed of the evicted ones, cut from the first row whose height
+  /// changed, and cleared when the displayed rows or the wrap width change.
+  std::deque<RowOffset> row_offsets_;
+  /// Bottom of the rows trimmed from the front of row_offsets_.
+  float row_offsets_base_{0.0f};
+  float row_offsets_width_{-1.0f};
+  //@}
+
+  /// @name Display index, used when the filter is active
+  //@{
+  /// Sequence numbers of the displayed records.
+  std::deque<std::size_t> display_rows_;
+  /// Sequence number of the first record not indexed yet.
+  std::size_t indexed_end_{0};
+  std::future<DisplayIndex> index_rebuild_;
+  std::shared_ptr<std::atomic<bool>> index_rebuild_cancel_;
+  //@}
+  /// Held exclusively by the UI thread when modifying the records, and shared
+  /// by the background index rebuild.
   mutable std::shared_timed_mutex records_mutex_;
   ImGuiTextFilter display_filter_;
 
-  bool scroll_to_bottom_;
+  bool scroll_to_bottom_{false};
   bool wrap_{false};
   bool scroll_lock_{false};
 
@@ -68,7 +300,14 @@ class ImGuiLogSink : public spdlog::sinks::base_sink<std::mutex>,
   bool show_thread_{true};
   bool show_level_{true};
   bool show_logger_{true};
+  /// Incremented whenever the format flags change, to invalidate the cached
+  /// prefixes.
+  unsigned format_version_{0};
   //@}
+
+  /// Direct mapped cache of formatted prefixes, indexed by sequence number.
+  /// Only used by the UI thread.
+  std::array<RecordPrefix, PREFIX_CACHE_SIZE> prefix_cache_;
 };
 
 }  // namespace ui
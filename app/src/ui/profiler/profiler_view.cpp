@@ -0,0 +1,181 @@
+//    Copyright The asap Project Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <ui/profiler/profiler_view.h>
+
+#include <algorithm>   // for std::max, std::min, std::find_if
+#include <cstdio>      // for formatting the frame time
+#include <cstring>     // for comparing zone names
+#include <functional>  // for hashing zone names
+#include <string>
+
+namespace asap {
+namespace debug {
+namespace ui {
+
+namespace {
+
+const float NS_PER_MS = 1e6f;
+
+bool IsFrame(const asap::ProfileZone &zone) {
+  return std::strcmp(zone.name, ProfilerView::FRAME_ZONE) == 0;
+}
+
+float DurationMs(const asap::ProfileZone &zone) {
+  return static_cast<float>(zone.end - zone.begin) / NS_PER_MS;
+}
+
+/// A stable color per zone name.
+ImU32 ZoneColor(const char *name) {
+  auto hash = std::hash<std::string>()(name);
+  auto hue = static_cast<float>(hash % 360) / 360.0f;
+  return ImColor::HSV(hue, 0.5f, 0.7f);
+}
+
+}  // namespace
+
+// -------------------------------------------------------------------------
+// Static members initialization
+// -------------------------------------------------------------------------
+
+const char *const ProfilerView::FRAME_ZONE = "Frame";
+const std::size_t ProfilerView::FRAME_HISTORY = 120;
+const ImVec4 ProfilerView::COLOR_OVER_BUDGET{1.0f, 0.0f, 0.0f, 1.0f};
+const float ProfilerView::ROW_HEIGHT = 18.0f;
+
+void ProfilerView::Draw() {
+  ImGui::Checkbox("Pause", &paused_);
+  ImGui::SameLine();
+  ImGui::PushItemWidth(120.0f);
+  ImGui::SliderFloat("Span (ms)", &span_ms_, 5.0f, 500.0f, "%.0f");
+  ImGui::SameLine();
+  ImGui::SliderFloat("Budget (ms)", &budget_ms_, 1.0f, 100.0f, "%.1f");
+  ImGui::PopItemWidth();
+
+  if (!paused_) {
+    profiles_ = asap::Profiler::Snapshot();
+    snapshot_end_ = 0;
+    for (auto const &profile : profiles_) {
+      for (auto const &zone : profile.zones) {
+        snapshot_end_ = std::max(snapshot_end_, zone.end);
+      }
+    }
+  }
+
+  DrawFrames();
+  ImGui::Separator();
+  DrawTimeline();
+}
+
+void ProfilerView::DrawFrames() {
+  // Frames are all recorded by the thread running the main loop
+  asap::ThreadProfile const *frames_thread = nullptr;
+  asap::ProfileZone const *last_frame = nullptr;
+  for (auto const &profile : profiles_) {
+    auto found = std::find_if(profile.zones.rbegin(), profile.zones.rend(),
+                              IsFrame);
+    if (found != profile.zones.rend()) {
+      frames_thread = &profile;
+      last_frame = &*found;
+      break;
+    }
+  }
+  if (last_frame == nullptr) {
+    ImGui::TextDisabled("No frame recorded yet");
+    return;
+  }
+
+  // Frame times history
+  std::vector<float> frame_times;
+  for (auto const &zone : frames_thread->zones) {
+    if (IsFrame(zone)) frame_times.push_back(DurationMs(zone));
+  }
+  if (frame_times.size() > FRAME_HISTORY) {
+    frame_times.erase(frame_times.begin(),
+                      frame_times.end() - static_cast<long>(FRAME_HISTORY));
+  }
+  char overlay[32];
+  std::snprintf(overlay, sizeof(overlay), "%.3f ms", DurationMs(*last_frame));
+  ImGui::PlotHistogram("##frames", frame_times.data(),
+                       static_cast<int>(frame_times.size()), 0, overlay,
+                       0.0f, 2.0f * budget_ms_,
+                       ImVec2(ImGui::GetContentRegionAvail().x, 60.0f));
+
+  // Phases of the last frame, against the budget
+  ImGui::Columns(3, "phases", false);
+  ImGui::SetColumnWidth(0, 160.0f);
+  ImGui::SetColumnWidth(1, 80.0f);
+  auto draw_phase = [this](const asap::ProfileZone &zone) {
+    auto ms = DurationMs(zone);
+    ImGui::Text("%*s%s", 2 * zone.depth, "", zone.name);
+    ImGui::NextColumn();
+    if (ms > budget_ms_) {
+      ImGui::TextColored(COLOR_OVER_BUDGET, "%.3f ms", ms);
+    } else {
+      ImGui::Text("%.3f ms", ms);
+    }
+    ImGui::NextColumn();
+    ImGui::ProgressBar(std::min(ms / budget_ms_, 1.0f), ImVec2(-1.0f, 0.0f),
+                       "");
+    ImGui::NextColumn();
+  };
+  draw_phase(*last_frame);
+  for (auto const &zone : frames_thread->zones) {
+    if (zone.depth == last_frame->depth + 1 &&
+        zone.begin >= last_frame->begin && zone.end <= last_frame->end) {
+      draw_phase(zone);
+    }
+  }
+  ImGui::Columns(1);
+}
+
+void ProfilerView::DrawTimeline() {
+  auto span = static_cast<std::int64_t>(span_ms_ * NS_PER_MS);
+  auto start = snapshot_end_ - span;
+  auto *draw_list = ImGui::GetWindowDrawList();
+
+  for (auto const &profile : profiles_) {
+    // Only the threads with zones in the span
+    auto rows = 0;
+    for (auto const &zone : profile.zones) {
+      if (zone.end >= start) rows = std::max(rows, zone.depth + 1);
+    }
+    if (rows == 0) continue;
+
+    ImGui::TextUnformatted(profile.thread_name.c_str());
+    auto origin = ImGui::GetCursorScreenPos();
+    auto width = ImGui::GetContentRegionAvail().x;
+    auto height = static_cast<float>(rows) * ROW_HEIGHT;
+    auto scale = width / static_cast<float>(span);
+    draw_list->PushClipRect(origin, ImVec2(origin.x + width, origin.y + height),
+                            true);
+    for (auto const &zone : profile.zones) {
+      if (zone.end < start) continue;
+      auto min = ImVec2(
+          origin.x + static_cast<float>(zone.begin - start) * scale,
+          origin.y + static_cast<float>(zone.depth) * ROW_HEIGHT);
+      // At least a pixel wide, to see the short zones
+      auto max = ImVec2(
+          std::max(min.x + 1.0f,
+                   origin.x + static_cast<float>(zone.end - start) * scale),
+          min.y + ROW_HEIGHT - 1.0f);
+      draw_list->AddRectFilled(min, max, ZoneColor(zone.name));
+      auto text_size = ImGui::CalcTextSize(zone.name);
+      if (max.x - min.x > text_size.x + 4.0f) {
+        draw_list->AddText(ImVec2(min.x + 2.0f, min.y + 1.0f),
+                           IM_COL32(255, 255, 255, 255), zone.name);
+      }
+      if (ImGui::IsMouseHoveringRect(min, max)) {
+        ImGui::SetTooltip("%s\n%.3f ms", zone.name, DurationMs(zone));
+      }
+    }
+    draw_list->PopClipRect();
+    ImGui::Dummy(ImVec2(width, height));
+  }
+}
+
+}  // namespace ui
+}  // namespace debug
+}  // namespace asap
@@ -0,0 +1,59 @@
+//    Copyright The asap Project Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <cstdint>  // for std::int64_t
+#include <vector>   // for the snapshot
+
+#include <common/profiler.h>
+#include <imgui.h>
+
+namespace asap {
+namespace debug {
+namespace ui {
+
+/*!
+ * @brief Displays the zones recorded by the profiler: the time spent in the
+ * phases of the last frame against the frame budget, the history of the frame
+ * times, and a timeline of the zones of all the threads.
+ *
+ * Frames are the zones named "Frame" (see ImGuiRunner::Run()), their phases
+ * the zones directly nested in them.
+ */
+class ProfilerView {
+ public:
+  /// Name of the zones of the frames.
+  static const char *const FRAME_ZONE;
+  /// Number of frames in the frame times history.
+  static const std::size_t FRAME_HISTORY;
+
+  void Draw();
+
+  /// Whether the view shows a frozen snapshot rather than the live zones.
+  bool Paused() const { return paused_; }
+
+ private:
+  static const ImVec4 COLOR_OVER_BUDGET;
+  /// Height of a row of zones in the timeline.
+  static const float ROW_HEIGHT;
+
+  /// Draw the phases of the last frame and the frame times history.
+  void DrawFrames();
+  /// Draw the zones of the threads which ended in the displayed span.
+  void DrawTimeline();
+
+  std::vector<asap::ThreadProfile> profiles_;
+  /// End of the latest zone in the snapshot, in profiler time.
+  std::int64_t snapshot_end_{0};
+
+  bool paused_{false};
+  float span_ms_{50.0f};
+  float budget_ms_{1000.0f / 60.0f};
+};
+
+}  // namespace ui
+}  // namespace debug
+}  // namespace asap
@@ -0,0 +1,98 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// Measures what passing assertions cost a hot function. The ASAP_ASSERT_VAL
+// macro, with its failure path out of line and cold, is compared with the
+// inline expansion it replaced, which built its std::stringstream in the
+// function: time per call, and size of the hot code of the function.
+
+#include <cstdio>
+#include <sstream>  // for std::stringstream
+#include <vector>
+
+#include <common/assert.h>
+#include <common/bench/logging_bench.h>
+
+namespace {
+
+constexpr std::size_t ITERATIONS = 200000;
+constexpr int VALUES = 64;
+
+// The ASAP_ASSERT_VAL expansion before the failure paths were made cold.
+#define LEGACY_ASSERT_VAL(x, y)                                  \
+  do {                                                           \
+    if (x) {                                                     \
+    } else {                                                     \
+      std::stringstream __s__;                                   \
+      __s__ << #y ": " << y;                                     \
+      asap::assert_fail(#x, __LINE__, __FILE__, ASAP_FUNCTION,   \
+                        __s__.str().c_str(), 0);                 \
+    }                                                            \
+  }                                                              \
+  ASAP_WHILE_0
+
+// The functions compared are in their own sections, whose sizes are given by
+// the linker, when it is a GNU one.
+#if defined __GNUC__ && defined ASAP_LINUX
+#define HAS_SECTION_SIZES 1
+#define IN_SECTION(name) __attribute__((section(#name), noinline))
+extern "C" char __start_asap_bench_legacy[], __stop_asap_bench_legacy[];
+extern "C" char __start_asap_bench_cold[], __stop_asap_bench_cold[];
+#else
+#define HAS_SECTION_SIZES 0
+#define IN_SECTION(name) ASAP_COLD
+#endif
+
+IN_SECTION(asap_bench_legacy)
+long SumLegacy(std::vector<int> const &values, int limit) {
+  long sum = 0;
+  for (auto value : values) {
+    LEGACY_ASSERT_VAL(value >= 0, value);
+    LEGACY_ASSERT_VAL(value < limit, limit);
+    sum += value;
+  }
+  LEGACY_ASSERT_VAL(sum >= 0, sum);
+  return sum;
+}
+
+IN_SECTION(asap_bench_cold)
+long SumCold(std::vector<int> const &values, int limit) {
+  long sum = 0;
+  for (auto value : values) {
+    ASAP_ASSERT_VAL(value >= 0, value);
+    ASAP_ASSERT_VAL(value < limit, limit);
+    sum += value;
+  }
+  ASAP_ASSERT_VAL(sum >= 0, sum);
+  return sum;
+}
+
+}  // namespace
+
+int main() {
+  std::vector<int> values;
+  for (auto ii = 0; ii < VALUES; ++ii) values.push_back(ii);
+
+  long total = 0;  // keeps the calls from being elided
+  // Warm up both
+  total += SumLegacy(values, VALUES) + SumCold(values, VALUES);
+  auto legacy = asap::bench::MeasureCall(
+      ITERATIONS, [&](std::size_t) { total += SumLegacy(values, VALUES); });
+  auto cold = asap::bench::MeasureCall(
+      ITERATIONS, [&](std::size_t) { total += SumCold(values, VALUES); });
+
+  std::printf("%-24s %16s %16s\n", "case", "inline failure", "cold failure");
+  std::printf("%-24s %13.1f ns %13.1f ns\n", "sum of 64 checked values",
+              legacy, cold);
+#if HAS_SECTION_SIZES
+  std::printf("%-24s %10ld bytes %10ld bytes\n", "hot code size",
+              static_cast<long>(__stop_asap_bench_legacy -
+                                __start_asap_bench_legacy),
+              static_cast<long>(__stop_asap_bench_cold -
+                                __start_asap_bench_cold));
+#endif  // HAS_SECTION_SIZES
+
+  return total == 0 ? 1 : 0;
+}
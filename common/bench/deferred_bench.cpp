@@ -0,0 +1,72 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// Measures the cost of a log call on the logging thread when logging is
+// asynchronous, with the message formatted by the logging thread (eager) or
+// by the drain thread (deferred, see ASAP_LOG_DEFERRED_FORMAT).
+
+#include <cstdio>
+#include <string>
+
+#include <spdlog/sinks/null_sink.h>
+
+#include <common/bench/logging_bench.h>
+#include <common/logging.h>
+
+using asap::logging::Id;
+using asap::logging::LogDeferred;
+using asap::logging::Registry;
+using asap::logging::StaticString;
+
+namespace {
+
+/// Messages logged between two flushes, to stay below the async queue size.
+constexpr std::size_t BURST = 4096;
+constexpr std::size_t BURSTS = 250;
+
+/// Log BURSTS bursts of messages with the given body, and return the cost of
+/// one call in ns. The time taken by the drain thread to catch up between
+/// bursts is not counted.
+template <typename Body>
+double Measure(spdlog::logger &logger, Body body) {
+  return asap::bench::MeasureCall(BURST * BURSTS, BURST, body,
+                                  [&logger]() { logger.flush(); });
+}
+
+}  // namespace
+
+int main() {
+  // Messages go nowhere, we only measure the cost of producing them
+  Registry::PushSink(std::make_shared<spdlog::sinks::null_sink_mt>());
+  Registry::EnableAsync();
+  auto &logger = Registry::GetLogger(Id::TESTING);
+  logger.set_level(spdlog::level::trace);
+
+  std::string name("value");
+  std::printf("%-24s %16s %16s\n", "case", "eager", "deferred");
+
+  auto eager = Measure(logger, [&logger](std::size_t ii) {
+    logger.debug("{}message {}", LOG_PREFIX, ii);
+  });
+  auto deferred = Measure(logger, [&logger](std::size_t ii) {
+    LogDeferred(logger, spdlog::level::debug, "{}message {}",
+                StaticString(LOG_PREFIX), ii);
+  });
+  std::printf("%-24s %13.1f ns %13.1f ns\n", "one integer", eager, deferred);
+
+  eager = Measure(logger, [&logger, &name](std::size_t ii) {
+    logger.debug("{}{} {} is {:.3f}", LOG_PREFIX, name, ii, ii * 0.5);
+  });
+  deferred = Measure(logger, [&logger, &name](std::size_t ii) {
+    LogDeferred(logger, spdlog::level::debug, "{}{} {} is {:.3f}",
+                StaticString(LOG_PREFIX), name, ii, ii * 0.5);
+  });
+  std::printf("%-24s %13.1f ns %13.1f ns\n", "string, int, double", eager,
+              deferred);
+
+  Registry::DisableAsync();
+  Registry::PopSink();
+  return 0;
+}
@@ -0,0 +1,81 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// Throughput and latency percentiles of ASLOG, ASLOG_MISC and ASLOG_TO_LOGGER
+// with a null sink, the console sink and a file sink, from 1..64 threads, for
+// messages above and below the logging level threshold. Progress is printed
+// on stderr and the results are written as JSON (see --help).
+//
+// The console case writes a lot to stdout: use --output and redirect stdout
+// to a terminal or to /dev/null depending on what is measured.
+
+#include <algorithm>  // for std::max
+#include <cstdio>     // for std::remove
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <spdlog/sinks/null_sink.h>
+
+#include <common/bench/logging_bench.h>
+#include <common/logging.h>
+#include <common/rotating_file_sink.h>
+
+using asap::bench::Options;
+using asap::bench::Result;
+using asap::logging::Registry;
+
+namespace {
+
+const char *const LOG_PATH = "logging_bench.log";
+
+/// Console output is much slower than the other sinks.
+constexpr std::size_t CONSOLE_MESSAGES_DIVISOR = 10;
+
+/// Run all the logging cases with the given sink as the current sink.
+void RunSink(const std::string &name, spdlog::sink_ptr sink,
+             const Options &options, std::size_t messages,
+             std::vector<Result> &results) {
+  Registry::PushSink(sink);
+  // Flushing is part of the cost of writing messages
+  asap::bench::RunLoggingCases(name, options, messages,
+                               [&sink]() { sink->flush(); }, results);
+  Registry::PopSink();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  auto options = Options::Parse(argc, argv);
+  std::vector<Result> results;
+  asap::bench::PrintHeader();
+
+  RunSink("null", std::make_shared<spdlog::sinks::null_sink_mt>(), options,
+          options.messages, results);
+
+#if defined _WIN32 && !defined(__cplusplus_winrt)
+  auto console = std::make_shared<spdlog::sinks::wincolor_stdout_sink_mt>();
+#else
+  auto console = std::make_shared<spdlog::sinks::ansicolor_stdout_sink_mt>();
+#endif
+  RunSink("console", console, options,
+          std::max<std::size_t>(options.messages / CONSOLE_MESSAGES_DIVISOR, 1),
+          results);
+
+  {
+    asap::logging::RotatingFileSink::Options file_options;
+    file_options.path = LOG_PATH;
+    // Rotating is not what we measure here
+    file_options.max_size = std::size_t{1} << 40;
+    file_options.max_files = 0;
+    std::remove(LOG_PATH);
+    RunSink("file",
+            std::make_shared<asap::logging::RotatingFileSink>(file_options),
+            options, options.messages, results);
+    std::remove(LOG_PATH);
+  }
+
+  return asap::bench::WriteResults(options, "logging", results);
+}
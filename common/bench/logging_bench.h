@@ -0,0 +1,388 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// Harness of the logging benchmark suites: runs the logging macros against a
+// sink from 1..N threads, measures their throughput and latency percentiles,
+// and writes the results as JSON so that they can be compared between
+// releases. Its timing functions are shared by the other benchmarks.
+
+#pragma once
+
+#include <algorithm>  // for std::sort, std::max
+#include <atomic>
+#include <chrono>
+#include <cstdint>  // for std::uint64_t
+#include <cstdio>
+#include <cstdlib>  // for std::atoi, std::exit
+#include <cstring>  // for std::strcmp
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <common/logging.h>
+
+namespace asap {
+namespace bench {
+
+// ---------------------------------------------------------------------------
+// Options
+// ---------------------------------------------------------------------------
+
+/// Parameters of a benchmark suite run, from the command line.
+struct Options {
+  /// Cases are run with 1, 2, 4... threads, up to this number.
+  int max_threads{64};
+  /// Number of messages logged by each thread in each case.
+  std::size_t messages{20000};
+  /// Path of the JSON results file, written to stdout if empty.
+  std::string output;
+
+  /// Parse the command line, exit with a usage message on error.
+  static Options Parse(int argc, char **argv) {
+    Options options;
+    for (auto ii = 1; ii < argc; ++ii) {
+      auto has_value = ii + 1 < argc;
+      if (std::strcmp(argv[ii], "--max-threads") == 0 && has_value) {
+        options.max_threads = std::max(1, std::atoi(argv[++ii]));
+      } else if (std::strcmp(argv[ii], "--messages") == 0 && has_value) {
+        options.messages =
+            static_cast<std::size_t>(std::max(1, std::atoi(argv[++ii])));
+      } else if (std::strcmp(argv[ii], "--output") == 0 && has_value) {
+        options.output = argv[++ii];
+      } else {
+        std::fprintf(stderr,
+                     "usage: %s [--max-threads N] [--messages N] "
+                     "[--output results.json]\n",
+                     argv[0]);
+        std::exit(std::strcmp(argv[ii], "--help") == 0 ? 0 : 1);
+      }
+    }
+    return options;
+  }
+
+  /// The thread counts of the cases: 1, 2, 4... max_threads.
+  std::vector<int> ThreadCounts() const {
+    std::vector<int> counts;
+    for (auto threads = 1; threads < max_threads; threads *= 2) {
+      counts.push_back(threads);
+    }
+    counts.push_back(max_threads);
+    return counts;
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Result
+// ---------------------------------------------------------------------------
+
+/// Throughput and latency distribution of a benchmark case.
+struct Result {
+  std::string sink;
+  std::string macro;
+  /// "logged" or "suppressed", whether the level is above the threshold.
+  std::string level;
+  int threads{0};
+  /// Messages logged by each thread.
+  std::size_t messages{0};
+  /// Messages per second, all threads together.
+  double throughput{0};
+  /// @name Latency of one call, in nanoseconds
+  //@{
+  double p50{0};
+  double p90{0};
+  double p99{0};
+  double p999{0};
+  double max{0};
+  //@}
+};
+
+/*!
+ * @brief Run a body in several threads, started together.
+ *
+ * @param [in] threads number of threads.
+ * @param [in] calls number of calls made by each thread.
+ * @param [in] body the call, given the index of the thread and of the call.
+ * @param [in] done called once all the threads are done, before stopping the
+ * clock (e.g. to flush the sink).
+ * @return the elapsed time, in seconds.
+ */
+template <typename Body, typename Done>
+double RunThreads(int threads, std::size_t calls, Body body, Done done) {
+  using Clock = std::chrono::steady_clock;
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> workers;
+  workers.reserve(static_cast<std::size_t>(threads));
+  for (auto ii = 0; ii < threads; ++ii) {
+    workers.emplace_back([&, ii]() {
+      ready.fetch_add(1);
+      while (!go.load()) std::this_thread::yield();
+      for (std::size_t jj = 0; jj < calls; ++jj) body(ii, jj);
+    });
+  }
+  while (ready.load() < threads) std::this_thread::yield();
+  auto start = Clock::now();
+  go.store(true);
+  for (auto &worker : workers) worker.join();
+  done();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/*!
+ * @brief Measure the throughput of a call made from several threads.
+ *
+ * @param [in] threads number of threads.
+ * @param [in] calls number of calls made by each thread.
+ * @param [in] body the call, given its index.
+ * @return the calls per second, all threads together.
+ */
+template <typename Body>
+double MeasureThroughput(int threads, std::size_t calls, Body body) {
+  auto elapsed = RunThreads(
+      threads, calls, [&body](int, std::size_t index) { body(index); },
+      []() {});
+  return static_cast<double>(calls) * threads / std::max(elapsed, 1e-9);
+}
+
+/*!
+ * @brief Measure the average time of a call made by the calling thread.
+ *
+ * The calls are made in bursts, between which `between` is called without
+ * being timed (e.g. to let a drain thread catch up).
+ *
+ * @param [in] calls number of calls.
+ * @param [in] burst number of calls in a burst.
+ * @param [in] body the call, given its index.
+ * @param [in] between called after each burst.
+ * @return the time of one call, in nanoseconds.
+ */
+template <typename Body, typename Between>
+double MeasureCall(std::size_t calls, std::size_t burst, Body body,
+                   Between between) {
+  using Clock = std::chrono::steady_clock;
+  std::chrono::duration<double, std::nano> elapsed{0};
+  for (std::size_t first = 0; first < calls; first += burst) {
+    auto end = std::min(first + burst, calls);
+    auto start = Clock::now();
+    for (auto index = first; index < end; ++index) body(index);
+    elapsed += Clock::now() - start;
+    between();
+  }
+  return elapsed.count() / static_cast<double>(calls);
+}
+
+/// Measure the average time of a call made `calls` times in a row by the
+/// calling thread, in nanoseconds.
+template <typename Body>
+double MeasureCall(std::size_t calls, Body body) {
+  return MeasureCall(calls, calls, body, []() {});
+}
+
+/*!
+ * @brief Run a benchmark case.
+ *
+ * The case is run twice: once to measure the throughput, and once to measure
+ * the latency of each call, which adds the cost of reading the clock around
+ * each call.
+ *
+ * @param [in] threads number of logging threads.
+ * @param [in] messages number of calls made by each thread.
+ * @param [in] body the call, given the index of the message.
+ * @param [in] done called once all the threads are done, before stopping the
+ * clock (e.g. to flush the sink).
+ */
+template <typename Body, typename Done>
+Result Measure(int threads, std::size_t messages, Body body, Done done) {
+  using Clock = std::chrono::steady_clock;
+
+  Result result;
+  result.threads = threads;
+  result.messages = messages;
+  auto elapsed = RunThreads(
+      threads, messages, [&body](int, std::size_t index) { body(index); },
+      done);
+  result.throughput =
+      static_cast<double>(messages) * threads / std::max(elapsed, 1e-9);
+
+  std::vector<std::vector<std::uint64_t>> latencies(
+      static_cast<std::size_t>(threads), std::vector<std::uint64_t>(messages));
+  RunThreads(threads, messages,
+             [&body, &latencies](int thread, std::size_t index) {
+               auto start = Clock::now();
+               body(index);
+               latencies[static_cast<std::size_t>(thread)][index] =
+                   static_cast<std::uint64_t>(
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           Clock::now() - start)
+                           .count());
+             },
+             done);
+  std::vector<std::uint64_t> all;
+  all.reserve(messages * static_cast<std::size_t>(threads));
+  for (auto const &samples : latencies) {
+    all.insert(all.end(), samples.begin(), samples.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto percentile = [&all](double rank) {
+    auto index = static_cast<std::size_t>(rank * (all.size() - 1));
+    return static_cast<double>(all[index]);
+  };
+  result.p50 = percentile(0.5);
+  result.p90 = percentile(0.9);
+  result.p99 = percentile(0.99);
+  result.p999 = percentile(0.999);
+  result.max = static_cast<double>(all.back());
+  return result;
+}
+
+// ---------------------------------------------------------------------------
+// Reporting
+// ---------------------------------------------------------------------------
+
+/// Print the header of the progress table, on stderr.
+inline void PrintHeader() {
+  std::fprintf(stderr, "%-10s %-16s %-11s %7s %14s %9s %9s %9s %11s\n",
+               "sink", "macro", "level", "threads", "msg/s", "p50 ns",
+               "p99 ns", "p99.9 ns", "max ns");
+}
+
+/// Print a result as a row of the progress table, on stderr.
+inline void PrintResult(const Result &result) {
+  std::fprintf(stderr, "%-10s %-16s %-11s %7d %14.0f %9.0f %9.0f %9.0f %11.0f\n",
+               result.sink.c_str(), result.macro.c_str(),
+               result.level.c_str(), result.threads, result.throughput,
+               result.p50, result.p99, result.p999, result.max);
+}
+
+/*!
+ * @brief Write the results of a suite as JSON.
+ *
+ * @param [in] out the output stream.
+ * @param [in] suite name of the benchmark suite.
+ * @param [in] results the results of all the cases.
+ */
+inline void WriteJson(std::ostream &out, const std::string &suite,
+                      const std::vector<Result> &results) {
+  // Names are plain identifiers, nothing to escape
+  out << "{\n";
+  out << "  \"suite\": \"" << suite << "\",\n";
+  out << "  \"build\": {\n";
+#if defined(__clang__)
+  out << "    \"compiler\": \"clang " << __clang_version__ << "\",\n";
+#elif defined(__GNUC__)
+  out << "    \"compiler\": \"gcc " << __VERSION__ << "\",\n";
+#elif defined(_MSC_VER)
+  out << "    \"compiler\": \"msvc " << _MSC_VER << "\",\n";
+#endif
+#ifdef NDEBUG
+  out << "    \"debug\": false,\n";
+#else
+  out << "    \"debug\": true,\n";
+#endif  // NDEBUG
+  out << "    \"log_active_level\": " << ASAP_LOG_ACTIVE_LEVEL << ",\n";
+  out << "    \"log_deferred_format\": "
+      << (ASAP_LOG_DEFERRED_FORMAT ? "true" : "false") << "\n";
+  out << "  },\n";
+  out << "  \"hardware_concurrency\": " << std::thread::hardware_concurrency()
+      << ",\n";
+  out << "  \"results\": [";
+  for (std::size_t ii = 0; ii < results.size(); ++ii) {
+    auto const &result = results[ii];
+    out << (ii == 0 ? "\n" : ",\n");
+    out << "    {\"sink\": \"" << result.sink << "\", \"macro\": \""
+        << result.macro << "\", \"level\": \"" << result.level
+        << "\", \"threads\": " << result.threads
+        << ", \"messages\": " << result.messages
+        << ", \"throughput\": " << static_cast<std::uint64_t>(result.throughput)
+        << ", \"latency_ns\": {\"p50\": " << result.p50
+        << ", \"p90\": " << result.p90 << ", \"p99\": " << result.p99
+        << ", \"p99.9\": " << result.p999 << ", \"max\": " << result.max
+        << "}}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+/// Write the results to the output file of the options, or to stdout.
+inline int WriteResults(const Options &options, const std::string &suite,
+                        const std::vector<Result> &results) {
+  if (options.output.empty()) {
+    WriteJson(std::cout, suite, results);
+    return 0;
+  }
+  std::ofstream file(options.output);
+  WriteJson(file, suite, results);
+  if (!file) {
+    std::fprintf(stderr, "could not write %s\n", options.output.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Logging cases
+// ---------------------------------------------------------------------------
+
+/// Logs through the logger of a class, like most of the code.
+class LoggingClass : asap::logging::Loggable<asap::logging::Id::TESTING> {
+ public:
+  static void Log(std::size_t index) {
+    ASLOG(debug, "benchmark message {} ({:.2f})", index, index * 0.5);
+  }
+};
+
+/*!
+ * @brief Run the cases of all the logging macros, with messages above and
+ * below the logging level threshold, with 1..max_threads threads.
+ *
+ * The sink under test must be the current sink of the Registry.
+ *
+ * @param [in] sink name of the sink under test, for the results.
+ * @param [in] options the suite options.
+ * @param [in] messages number of messages logged by each thread.
+ * @param [in] done called at the end of each run, before stopping the clock.
+ * @param [in,out] results where the results are added.
+ */
+template <typename Done>
+void RunLoggingCases(const std::string &sink, const Options &options,
+                     std::size_t messages, Done done,
+                     std::vector<Result> &results) {
+  using asap::logging::Id;
+  using asap::logging::Registry;
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+
+  auto add = [&](const char *macro, bool logged, int threads, auto body) {
+    // Suppressed messages are debug messages with an info threshold
+    Registry::SetLogLevel(logged ? spdlog::level::trace : spdlog::level::info);
+    auto result = Measure(threads, messages, body, done);
+    result.sink = sink;
+    result.macro = macro;
+    result.level = logged ? "logged" : "suppressed";
+    PrintResult(result);
+    results.push_back(result);
+  };
+
+  for (auto logged : {true, false}) {
+    for (auto threads : options.ThreadCounts()) {
+      add("ASLOG", logged, threads,
+          [](std::size_t index) { LoggingClass::Log(index); });
+      add("ASLOG_MISC", logged, threads, [](std::size_t index) {
+        ASLOG_MISC(debug, "benchmark message {} ({:.2f})", index,
+                   index * 0.5);
+      });
+      add("ASLOG_TO_LOGGER", logged, threads,
+          [&test_logger](std::size_t index) {
+            ASLOG_TO_LOGGER(test_logger, debug,
+                            "benchmark message {} ({:.2f})", index,
+                            index * 0.5);
+          });
+    }
+  }
+  Registry::SetLogLevel(spdlog::level::trace);
+}
+
+}  // namespace bench
+}  // namespace asap
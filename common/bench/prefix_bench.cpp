@@ -0,0 +1,76 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// Measures the cost of the "[file:line] " prefix added to log messages in
+// debug builds. The compile-time SourceLocationPrefix used by LOG_PREFIX is
+// compared with the std::ostringstream based formatting it replaced.
+
+#include <cstdio>
+#include <iomanip>  // for std::setw
+#include <sstream>  // for std::ostringstream
+#include <string>
+
+#include <spdlog/sinks/null_sink.h>
+
+#include <common/bench/logging_bench.h>
+#include <common/logging.h>
+
+using asap::bench::MeasureCall;
+using asap::logging::Id;
+using asap::logging::Registry;
+
+namespace {
+
+constexpr std::size_t ITERATIONS = 1000000;
+
+#define DO_STRINGIZE(x) STRINGIZE(x)
+#define STRINGIZE(x) #x
+#define LINE_STRING DO_STRINGIZE(__LINE__)
+
+/// The prefix formatting as it was before SourceLocationPrefix.
+std::string FormatFileAndLine(char const *file, char const *line) {
+  constexpr static int FILE_MAX_LENGTH = 70;
+  std::ostringstream ostr;
+  std::string fstr(file);
+  if (fstr.length() > FILE_MAX_LENGTH) {
+    fstr = fstr.substr(0, 7).append("...").append(fstr.substr(
+        fstr.length() - FILE_MAX_LENGTH + 10, FILE_MAX_LENGTH - 10));
+  }
+  ostr << "[" << std::setw(FILE_MAX_LENGTH) << std::right << fstr << ":"
+       << std::setw(5) << std::setfill('0') << std::right << line << "] ";
+  return ostr.str();
+}
+
+}  // namespace
+
+int main() {
+  // Messages go nowhere, we only measure the cost of producing them
+  Registry::PushSink(std::make_shared<spdlog::sinks::null_sink_mt>());
+  auto &logger = Registry::GetLogger(Id::TESTING);
+  logger.set_level(spdlog::level::trace);
+
+  std::size_t total = 0;  // keeps the prefix computation from being elided
+  auto formatted = MeasureCall(ITERATIONS, [&total](std::size_t) {
+    total += FormatFileAndLine(__FILE__, LINE_STRING).size();
+  });
+  auto compile_time = MeasureCall(ITERATIONS, [&total](std::size_t) {
+    total += std::char_traits<char>::length(LOG_PREFIX);
+  });
+  std::printf("%-24s %16s %16s\n", "case", "ostringstream", "compile-time");
+  std::printf("%-24s %13.1f ns %13.1f ns\n", "prefix only", formatted,
+              compile_time);
+
+  formatted = MeasureCall(ITERATIONS, [&logger](std::size_t ii) {
+    logger.debug("{}message {}", FormatFileAndLine(__FILE__, LINE_STRING), ii);
+  });
+  compile_time = MeasureCall(ITERATIONS, [&logger](std::size_t ii) {
+    logger.debug("{}message {}", LOG_PREFIX, ii);
+  });
+  std::printf("%-24s %13.1f ns %13.1f ns\n", "log to null sink", formatted,
+              compile_time);
+
+  Registry::PopSink();
+  return total == 0 ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// Measures the contended throughput of logger lookups through the Registry,
+// as done by every ASLOG_MISC call, with 1..N threads. The lock-free lookup
+// of Registry::GetLogger() is compared with a lookup serialized through a
+// recursive mutex, which is how GetLogger() used to be implemented, for a
+// predefined logger and for a logger registered at runtime.
+
+#include <algorithm>  // for std::max
+#include <cstdio>
+#include <cstdlib>  // for std::atoi
+#include <mutex>
+#include <thread>
+
+#include <spdlog/sinks/null_sink.h>
+
+#include <common/bench/logging_bench.h>
+#include <common/logging.h>
+
+using asap::logging::Id;
+using asap::logging::LoggerHandle;
+using asap::logging::Registry;
+
+namespace {
+
+constexpr std::size_t ITERATIONS_PER_THREAD = 1000000;
+
+std::recursive_mutex locked_lookup_mutex;
+
+/// Logger lookup as it was before the lock-free table.
+spdlog::logger &LockedGetLogger(LoggerHandle handle) {
+  std::lock_guard<std::recursive_mutex> lock(locked_lookup_mutex);
+  return Registry::GetLogger(handle);
+}
+
+#define GET_LOCKED_MISC_LOGGER() LockedGetLogger(asap::logging::Id::MISC)
+#define ASLOG_LOCKED_MISC(LEVEL, ...) \
+  ASLOG_TO_LOGGER(GET_LOCKED_MISC_LOGGER(), LEVEL, __VA_ARGS__)
+
+/*!
+ * Run the given body in `threads` threads, each doing `iterations` calls, and
+ * return the aggregate throughput in millions of calls per second.
+ */
+template <typename Body>
+double Measure(int threads, std::size_t iterations, Body body) {
+  return asap::bench::MeasureThroughput(threads, iterations, body) / 1e6;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  auto max_threads = static_cast<int>(
+      std::max(1u, std::thread::hardware_concurrency()));
+  if (argc > 1) max_threads = std::max(1, std::atoi(argv[1]));
+
+  // Messages go nowhere, we only measure the cost of getting there
+  Registry::PushSink(std::make_shared<spdlog::sinks::null_sink_mt>());
+  static auto const registered = Registry::RegisterLogger("registered");
+
+  std::printf("%-8s %-24s %14s %14s\n", "threads", "case", "locked (M/s)",
+              "lock-free (M/s)");
+  for (auto threads = 1; threads <= max_threads; threads *= 2) {
+    // Suppressed messages: the lookup and the level check are the whole cost
+    Registry::SetLogLevel(spdlog::level::info);
+    auto locked = Measure(threads, ITERATIONS_PER_THREAD, [](std::size_t ii) {
+      ASLOG_LOCKED_MISC(debug, "suppressed {}", ii);
+    });
+    auto lock_free = Measure(threads, ITERATIONS_PER_THREAD, [](std::size_t ii) {
+      ASLOG_MISC(debug, "suppressed {}", ii);
+    });
+    std::printf("%-8d %-24s %14.2f %14.2f\n", threads, "ASLOG_MISC suppressed",
+                locked, lock_free);
+    locked = Measure(threads, ITERATIONS_PER_THREAD, [](std::size_t ii) {
+      ASLOG_TO_LOGGER(LockedGetLogger(registered), debug, "suppressed {}", ii);
+    });
+    lock_free = Measure(threads, ITERATIONS_PER_THREAD, [](std::size_t ii) {
+      ASLOG_TO_LOGGER(Registry::GetLogger(registered), debug, "suppressed {}",
+                      ii);
+    });
+    std::printf("%-8d %-24s %14.2f %14.2f\n", threads, "registered suppressed",
+                locked, lock_free);
+
+    // Logged messages, formatted and sent to the null sink
+    Registry::SetLogLevel(spdlog::level::trace);
+    locked = Measure(threads, ITERATIONS_PER_THREAD / 10, [](std::size_t ii) {
+      ASLOG_LOCKED_MISC(debug, "logged {}", ii);
+    });
+    lock_free = Measure(threads, ITERATIONS_PER_THREAD / 10, [](std::size_t ii) {
+      ASLOG_MISC(debug, "logged {}", ii);
+    });
+    std::printf("%-8d %-24s %14.2f %14.2f\n", threads, "ASLOG_MISC null sink",
+                locked, lock_free);
+  }
+
+  Registry::PopSink();
+  return 0;
+}
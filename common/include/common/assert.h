@@ -5,6 +5,12 @@
 
 #pragma once
 
+#include <atomic>   // for the assertion failure counters
+#include <chrono>   // for the report time
+#include <cstdint>  // for std::uint64_t
+#include <thread>   // for the report thread
+#include <vector>   // for the queries
+
 #include <common/config.h>
 
 #if defined __GNUC__ || defined __clang__
@@ -22,6 +28,21 @@
 namespace asap {
 void print_backtrace(char* out, int len, int max_depth = 0,
                      void* ctx = nullptr);
+
+/*!
+ * @brief Print the raw return addresses of the current stack, preceded by
+ * where the modules holding them are loaded, without symbolizing anything.
+ *
+ * The output is made of `module <start>-<end> <offset> <path>` lines (one per
+ * executable segment holding frames, found with dl_iterate_phdr) followed by
+ * `frame <index> <address>` lines, and is symbolized offline by the
+ * asap-symbolize tool. Much faster and more reliable than print_backtrace()
+ * in a failing process.
+ *
+ * When built with ASAP_RAW_BACKTRACES, assertion failures print this instead
+ * of the symbolized backtrace. Only supported on Linux.
+ */
+void print_backtrace_raw(char* out, int len, int max_depth = 0);
 }  // namespace asap
 #endif
 
@@ -40,7 +61,85 @@ void print_backtrace(char* out, int len, int max_depth = 0,
 // clang-format on
 
 namespace asap {
-// declarations of the two functions
+
+/*!
+ * @brief An assertion of the code, with the number of times it failed.
+ *
+ * Each assertion macro has its own static site, constant initialized, so that
+ * counting a failure is a single atomic increment.
+ */
+struct assert_site {
+  constexpr assert_site(char const* expr, char const* source_file,
+                        char const* function_name, int source_line,
+                        int assert_kind)
+      : expression(expr),
+        file(source_file),
+        function(function_name),
+        line(source_line),
+        kind(assert_kind) {}
+
+  char const* const expression;
+  char const* const file;
+  char const* const function;
+  int const line;
+  /// 1 for preconditions, 0 for the others.
+  int const kind;
+  /// Number of failures.
+  std::atomic<std::uint64_t> hits{0};
+  /// Next site in the list of the sites which failed, see hot_asserts().
+  assert_site* next{nullptr};
+};
+
+/// Maximum number of reports kept, the older ones are overwritten.
+constexpr std::size_t ASSERT_REPORTS_CAPACITY = 64;
+/// Maximum length of the value of a report.
+constexpr std::size_t ASSERT_REPORT_VALUE_LENGTH = 255;
+/// Maximum number of frames of a report.
+constexpr int ASSERT_REPORT_FRAMES = 16;
+
+/*!
+ * @brief A full report of an assertion failure.
+ *
+ * With ASAP_PRODUCTION_ASSERTS, only the first ASAP_ASSERT_REPORTS_PER_SITE
+ * failures of a site are reported, into a preallocated ring of
+ * ASSERT_REPORTS_CAPACITY reports; the later ones are only counted.
+ */
+struct assert_report {
+  assert_site const* site;
+  /// Which failure of the site it is, from 1.
+  std::uint64_t hit;
+  std::chrono::system_clock::time_point time;
+  std::thread::id thread;
+  /// The value given to ASAP_ASSERT_VAL, truncated.
+  char value[ASSERT_REPORT_VALUE_LENGTH + 1];
+  /// The raw return addresses of the failing thread, innermost first.
+  void* frames[ASSERT_REPORT_FRAMES];
+  int frame_count;
+};
+
+/// The number of failures of an assertion site.
+struct assert_site_hits {
+  assert_site const* site;
+  std::uint64_t hits;
+};
+
+/*!
+ * @brief The assertion sites which failed, the ones failing the most first.
+ *
+ * @param [in] max_sites maximum number of sites returned, 0 for all.
+ */
+std::vector<assert_site_hits> hot_asserts(std::size_t max_sites = 0);
+
+/// The kept assertion failure reports, oldest first.
+std::vector<assert_report> recent_assert_reports();
+
+/*!
+ * @brief Print the assertion sites which failed, the ones failing the most
+ * first, one per line.
+ */
+void print_hot_asserts(char* out, int len, std::size_t max_sites = 0);
+
+// declarations of the internal functions
 
 // internal
 void assert_print(char const* fmt, ...) ASAP_FORMAT(1, 2);
@@ -49,63 +148,96 @@ void assert_print(char const* fmt, ...) ASAP_FORMAT(1, 2);
 void assert_fail(const char* expr, int line, char const* file,
                  char const* function, char const* val, int kind = 0);
 
+// internal: count a failure, returns its number among the failures of the
+// site if it is to be reported, 0 otherwise
+std::uint64_t assert_hit(assert_site& site);
+
+// internal: report the failure number hit, as counted by assert_hit()
+void assert_fail(assert_site& site, std::uint64_t hit, char const* val);
+
+// internal: count and report a failure without value
+ASAP_COLD void assert_site_failed(assert_site& site);
+
+// internal: keep a report in the ring
+void record_assert_report(assert_site const& site, std::uint64_t hit,
+                          char const* val);
+
 }  // namespace asap
 
 #if ASAP_USE_ASSERTS
 
-#ifdef ASAP_PRODUCTION_ASSERTS
-extern char const* asap_assert_log;
-#endif
-
 #if ASAP_USE_IOSTREAM
 #include <sstream>
 #endif
 
 #ifndef ASAP_USE_SYSTEM_ASSERTS
 
-#define ASAP_ASSERT_PRECOND(x)                                             \
-  do {                                                                        \
-    if (x) {                                                                  \
-    } else                                                                    \
-      asap::assert_fail(#x, __LINE__, __FILE__, ASAP_FUNCTION, nullptr, \
-                           1);                                                \
-  }                                                                           \
+// The static site of an assertion, named asap_assert_site_
+#define ASAP_ASSERT_SITE(x, kind)                                       \
+  static asap::assert_site asap_assert_site_(#x, __FILE__, ASAP_FUNCTION, \
+                                             __LINE__, kind)
+
+// The failure paths are out of line and cold: a passing assertion costs its
+// condition and a predicted branch, whatever it reports when it fails. The
+// value of the _VAL assertions is formatted in a cold lambda.
+
+#define ASAP_ASSERT_PRECOND(x)                      \
+  do {                                              \
+    if (ASAP_LIKELY(x)) {                           \
+    } else {                                        \
+      ASAP_ASSERT_SITE(x, 1);                       \
+      asap::assert_site_failed(asap_assert_site_);  \
+    }                                               \
+  }                                                 \
   ASAP_WHILE_0
 
-#define ASAP_ASSERT(x)                                                     \
-  do {                                                                        \
-    if (x) {                                                                  \
-    } else                                                                    \
-      asap::assert_fail(#x, __LINE__, __FILE__, ASAP_FUNCTION, nullptr, \
-                           0);                                                \
-  }                                                                           \
+#define ASAP_ASSERT(x)                              \
+  do {                                              \
+    if (ASAP_LIKELY(x)) {                           \
+    } else {                                        \
+      ASAP_ASSERT_SITE(x, 0);                       \
+      asap::assert_site_failed(asap_assert_site_);  \
+    }                                               \
+  }                                                 \
   ASAP_WHILE_0
 
-#define ASAP_ASSERT_VAL(x, y)                                     \
-  do {                                                               \
-    if (x) {                                                         \
-    } else {                                                         \
-      std::stringstream __s__;                                       \
-      __s__ << #y ": " << y;                                         \
-      asap::assert_fail(#x, __LINE__, __FILE__, ASAP_FUNCTION, \
-                           __s__.str().c_str(), 0);                  \
-    }                                                                \
-  }                                                                  \
+#define ASAP_ASSERT_VAL(x, y)                                         \
+  do {                                                                \
+    if (ASAP_LIKELY(x)) {                                             \
+    } else {                                                          \
+      ASAP_ASSERT_SITE(x, 0);                                         \
+      [&]() ASAP_COLD {                                               \
+        if (auto __hit__ = asap::assert_hit(asap_assert_site_)) {     \
+          std::stringstream __s__;                                    \
+          __s__ << #y ": " << y;                                      \
+          asap::assert_fail(asap_assert_site_, __hit__,               \
+                            __s__.str().c_str());                     \
+        }                                                             \
+      }();                                                            \
+    }                                                                 \
+  }                                                                   \
   ASAP_WHILE_0
 
-#define ASAP_ASSERT_FAIL_VAL(y)                                  \
+#define ASAP_ASSERT_FAIL_VAL(y)                                     \
   do {                                                              \
-    std::stringstream __s__;                                        \
-    __s__ << #y ": " << y;                                          \
-    asap::assert_fail("<unconditional>", __LINE__, __FILE__,     \
-                         ASAP_FUNCTION, __s__.str().c_str(), 0); \
+    ASAP_ASSERT_SITE(<unconditional>, 0);                           \
+    [&]() ASAP_COLD {                                               \
+      if (auto __hit__ = asap::assert_hit(asap_assert_site_)) {     \
+        std::stringstream __s__;                                    \
+        __s__ << #y ": " << y;                                      \
+        asap::assert_fail(asap_assert_site_, __hit__,               \
+                          __s__.str().c_str());                     \
+      }                                                             \
+    }();                                                            \
   }                                                                 \
   ASAP_WHILE_0
 
-
-#define ASAP_ASSERT_FAIL()                                 \
-  asap::assert_fail("<unconditional>", __LINE__, __FILE__, \
-                       ASAP_FUNCTION, nullptr, 0)
+#define ASAP_ASSERT_FAIL()                          \
+  do {                                              \
+    ASAP_ASSERT_SITE(<unconditional>, 0);           \
+    asap::assert_site_failed(asap_assert_site_);    \
+  }                                                 \
+  ASAP_WHILE_0
 
 #else
 #include <cassert>
@@ -0,0 +1,224 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <array>               // for the producer slots
+#include <atomic>              // for counters and flags
+#include <chrono>              // for std::chrono::milliseconds
+#include <condition_variable>  // for waking up the drain thread
+#include <mutex>               // for std::mutex
+#include <string>              // for std::string
+#include <thread>              // for the drain thread
+
+#include <spdlog/sinks/sink.h>
+#include <spdlog/spdlog.h>
+
+#include <common/bounded_queue.h>
+#include <common/message_record.h>
+#include <common/non_copiable.h>
+#include <common/source_location.h>
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// AsyncSink
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief A logging sink that hands log messages over to a dedicated thread
+ * which then feeds them to a delegate sink.
+ *
+ * Calling threads only copy the already formatted message (or, when its
+ * formatting is deferred, its raw arguments) into a slot of a bounded
+ * lock-free ring buffer; the delegate's I/O (console, GUI, ...) and its own
+ * locking happen on the drain thread. Slots keep their string buffers
+ * between uses so that, once warmed up, enqueuing does not allocate.
+ *
+ * When the ring buffer is full, the behavior is selected by the
+ * OverflowPolicy given at construction. Messages that are discarded are
+ * counted and the counters can be queried at any time.
+ *
+ * flush() is synchronous: it returns only after every message enqueued before
+ * the call has been processed by the delegate and the delegate itself has
+ * been flushed. This is what guarantees that critical messages (loggers
+ * flush on critical) and messages logged right before shutdown are not lost.
+ *
+ * This sink is not meant to be used directly. It is installed by the Registry
+ * in front of its FanOutSink when asynchronous logging is enabled.
+ *
+ * @see Registry::EnableAsync()
+ */
+class AsyncSink : public spdlog::sinks::sink, private asap::NonCopiable {
+ public:
+  /// What to do when a message is logged while the ring buffer is full.
+  enum class OverflowPolicy {
+    /// Wait until the drain thread frees a slot. Nothing is ever lost.
+    BLOCK,
+    /// Discard the message being logged.
+    DROP_NEWEST,
+    /// Discard the oldest message still waiting in the ring buffer.
+    DROP_OLDEST
+  };
+
+  /// Default number of slots in the ring buffer.
+  static const std::size_t DEFAULT_QUEUE_SIZE;
+
+  /*!
+   * @brief Create an AsyncSink and start its drain thread.
+   *
+   * @param [in] delegate the sink that will receive the log messages on the
+   * drain thread.
+   * @param [in] queue_size number of slots in the ring buffer (rounded up to
+   * a power of 2).
+   * @param [in] policy the overflow policy.
+   */
+  AsyncSink(spdlog::sink_ptr delegate, std::size_t queue_size,
+            OverflowPolicy policy);
+
+  /// Not move constructible
+  AsyncSink(AsyncSink &&) = delete;
+  /// Not move assignable
+  AsyncSink &operator=(AsyncSink &&) = delete;
+
+  /// Stops the drain thread after processing all pending messages.
+  ~AsyncSink() override;
+
+  /// @name sink interface
+  //@{
+  /*!
+   * @brief Enqueue the given log message for processing on the drain thread.
+   *
+   * @param msg log message to be processed.
+   */
+  void log(const spdlog::details::log_msg &msg) override;
+
+  /// Wait until all previously enqueued messages are processed, then flush
+  /// the delegate.
+  void flush() override;
+  //@}
+
+  /*!
+   * @brief Have the drain thread process the pending messages and flush the
+   * delegate, and wait for it, up to a timeout.
+   *
+   * Unlike flush(), only atomics and sleeps are used on the calling thread,
+   * which makes it async-signal-safe: it is meant for crash handlers. Messages
+   * logged meanwhile by other threads are waited for as well.
+   *
+   * @param [in] timeout maximum time to wait.
+   * @return true if the delegate was flushed in time.
+   */
+  bool FlushFromSignal(std::chrono::milliseconds timeout);
+
+  /*!
+   * @brief Use the given sink as a new delegate and return the old one.
+   *
+   * All messages enqueued before the call are delivered to the old delegate.
+   *
+   * @param sink the new delegate.
+   * @return the previously used delegate.
+   */
+  spdlog::sink_ptr SwapSink(spdlog::sink_ptr sink);
+
+  /*!
+   * @brief Get the current delegate.
+   *
+   * @return the sink fed by the drain thread.
+   */
+  spdlog::sink_ptr Delegate() {
+    std::lock_guard<std::mutex> lock(delegate_mutex_);
+    return sink_delegate_;
+  }
+
+  /*!
+   * @brief Process all pending messages, flush the delegate and terminate the
+   * drain thread.
+   *
+   * Messages logged after Stop() are delivered synchronously on the calling
+   * thread.
+   */
+  void Stop();
+
+  /// The overflow policy used by this sink.
+  OverflowPolicy Policy() const { return policy_; }
+
+  /// Number of messages discarded under the DROP_NEWEST policy.
+  std::size_t DroppedNewest() const {
+    return dropped_newest_.load(std::memory_order_relaxed);
+  }
+
+  /// Number of messages discarded under the DROP_OLDEST policy.
+  std::size_t DroppedOldest() const {
+    return dropped_oldest_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /// The log messages stored in the ring buffer.
+  using Record = MessageRecord;
+
+  class ProducerGuard;
+
+  /// Push a message to the queue, applying the overflow policy.
+  void Enqueue(const spdlog::details::log_msg &msg,
+               SourceLocation const *source, DeferredMessage const *deferred);
+  /// Body of the drain thread.
+  void Drain();
+  /// Wake the drain thread up if it is waiting for messages.
+  void WakeUp();
+  /// Deliver a message to the current delegate, with its source location
+  /// and deferred formatting published as the current ones.
+  void Dispatch(const spdlog::details::log_msg &msg,
+                SourceLocation const *source, DeferredMessage const *deferred);
+  /// Deliver the messages left in the queue, from Stop().
+  void DispatchRemaining();
+
+  BoundedQueue<Record> queue_;
+  OverflowPolicy policy_;
+
+  /// The delegate sink, only used from the drain thread except when swapped.
+  spdlog::sink_ptr sink_delegate_;
+  std::mutex delegate_mutex_;
+
+  /// Number of enqueued messages that have been dispatched or discarded.
+  std::atomic<std::size_t> processed_{0};
+  std::atomic<std::size_t> dropped_newest_{0};
+  std::atomic<std::size_t> dropped_oldest_{0};
+  /// @name Flushes requested by FlushFromSignal(), and done by the drain
+  /// thread
+  //@{
+  std::atomic<std::size_t> flush_requests_{0};
+  std::atomic<std::size_t> flushes_done_{0};
+  //@}
+
+  /// @name Drain thread state
+  //@{
+  std::thread worker_;
+  std::thread::id worker_id_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> stopped_{false};
+  /// Number of producer slots. Threads are spread over the slots, and only
+  /// share one when there are more threads than slots.
+  static constexpr std::size_t PRODUCER_SLOTS = 32;
+  /// The log() calls of a slot, padded so that the counters of two slots are
+  /// never in the same cache line.
+  struct ProducerSlot {
+    /// Number of log() calls of the threads of the slot that may still
+    /// enqueue, i.e. that did not see stopped_.
+    std::atomic<std::size_t> producers_{0};
+    char padding_[128 - sizeof(producers_)];
+  };
+  /// Stop() waits for the producers of all the slots before the final drain.
+  std::array<ProducerSlot, PRODUCER_SLOTS> producer_slots_;
+  std::atomic<bool> sleeping_{false};
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  std::mutex stop_mutex_;
+  //@}
+};
+
+}  // namespace logging
+}  // namespace asap
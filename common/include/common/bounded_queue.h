@@ -0,0 +1,171 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <atomic>   // for std::atomic
+#include <cstddef>  // for std::size_t
+#include <cstdint>  // for std::intptr_t
+#include <memory>   // for std::unique_ptr
+
+#include <common/non_copiable.h>
+
+namespace asap {
+
+/*!
+ * @brief A bounded, lock-free, multi-producer multi-consumer queue.
+ *
+ * This is an implementation of Dmitry Vyukov's bounded MPMC queue. Each slot
+ * carries a sequence number that tells producers and consumers whether the
+ * slot is ready for them, so a push or a pop is a single CAS on a shared
+ * position plus a release store on the slot.
+ *
+ * Slots are allocated once, at construction, and are never destroyed until
+ * the queue is. Data is written and read in place through callables which
+ * receive a reference to the slot's value. This allows values that own heap
+ * memory (e.g. std::string) to keep and reuse their capacity from one use of
+ * the slot to the next, which keeps the steady state free of allocations.
+ *
+ * The callables passed to TryPush() and TryPop() must not throw. A slot that
+ * has been claimed is always published, whatever the callable does.
+ *
+ * @tparam T the type of the values stored in the queue. It must be default
+ * constructible.
+ */
+template <typename T>
+class BoundedQueue : private asap::NonCopiable {
+ public:
+  /*!
+   * @brief Create a queue that can hold at least the given number of values.
+   *
+   * @param [in] capacity requested capacity, rounded up to the next power of 2
+   * (minimum 2).
+   */
+  explicit BoundedQueue(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) size <<= 1;
+    mask_ = size - 1;
+    buffer_.reset(new Cell[size]);
+    for (std::size_t ii = 0; ii < size; ++ii) {
+      buffer_[ii].sequence_.store(ii, std::memory_order_relaxed);
+    }
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  /// Not move constructible
+  BoundedQueue(BoundedQueue &&) = delete;
+  /// Not move assignable
+  BoundedQueue &operator=(BoundedQueue &&) = delete;
+
+  /// Default trivial destructor
+  ~BoundedQueue() override = default;
+
+  /*!
+   * @brief Try to claim a free slot and fill it with the given callable.
+   *
+   * @param [in] produce callable invoked with a `T &` to the claimed slot.
+   * @return true if a slot was claimed and published; false if the queue was
+   * full.
+   */
+  template <typename Producer>
+  bool TryPush(Producer &&produce) {
+    Cell *cell;
+    auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &buffer_[pos & mask_];
+      auto seq = cell->sequence_.load(std::memory_order_acquire);
+      auto diff =
+          static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    produce(cell->data_);
+    cell->sequence_.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /*!
+   * @brief Try to take the oldest published value and hand it to the given
+   * callable.
+   *
+   * @param [in] consume callable invoked with a `T &` to the slot. The slot is
+   * released for reuse as soon as the callable returns.
+   * @return true if a value was consumed; false if the queue was empty.
+   */
+  template <typename Consumer>
+  bool TryPop(Consumer &&consume) {
+    Cell *cell;
+    auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &buffer_[pos & mask_];
+      auto seq = cell->sequence_.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq) -
+                  static_cast<std::intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    consume(cell->data_);
+    cell->sequence_.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// The number of slots in the queue.
+  std::size_t Capacity() const { return mask_ + 1; }
+
+  /*!
+   * @brief The total number of slots claimed by producers since the queue was
+   * created.
+   *
+   * This is a monotonic counter that can be used as a ticket: once the number
+   * of values consumed reaches it, everything pushed before the call has been
+   * consumed.
+   */
+  std::size_t PushCount() const {
+    return enqueue_pos_.load(std::memory_order_acquire);
+  }
+
+  /// Approximate emptiness check, only exact when no push or pop is ongoing.
+  bool Empty() const {
+    return dequeue_pos_.load(std::memory_order_acquire) >=
+           enqueue_pos_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr std::size_t CACHE_LINE_SIZE = 64;
+  using CacheLinePad = char[CACHE_LINE_SIZE];
+
+  struct Cell {
+    std::atomic<std::size_t> sequence_;
+    T data_;
+  };
+
+  CacheLinePad pad0_{};
+  std::unique_ptr<Cell[]> buffer_;
+  std::size_t mask_{0};
+  CacheLinePad pad1_{};
+  std::atomic<std::size_t> enqueue_pos_;
+  CacheLinePad pad2_{};
+  std::atomic<std::size_t> dequeue_pos_;
+  CacheLinePad pad3_{};
+};
+
+}  // namespace asap
@@ -14,6 +14,20 @@
 #endif
 
 
+// Branch prediction hints, and a cold attribute for the code of the branches
+// which are almost never taken (failures), which is kept out of line, away
+// from the hot code.
+#if defined __GNUC__ || defined __clang__
+#define ASAP_LIKELY(x) __builtin_expect(!!(x), 1)
+#define ASAP_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define ASAP_COLD __attribute__((cold, noinline))
+#else
+#define ASAP_LIKELY(x) (x)
+#define ASAP_UNLIKELY(x) (x)
+#define ASAP_COLD
+#endif
+
+
 #ifndef ASAP_USE_ASSERTS
 #define ASAP_USE_ASSERTS 1
 #endif  // ASAP_USE_ASSERTS
@@ -22,3 +36,22 @@
 #ifndef ASAP_USE_EXECINFO
 #define ASAP_USE_EXECINFO 0
 #endif
+
+
+// Assertion failures print raw backtraces, to be symbolized offline.
+#ifndef ASAP_RAW_BACKTRACES
+#define ASAP_RAW_BACKTRACES 0
+#endif
+
+
+// With ASAP_PRODUCTION_ASSERTS, the number of failures of each assertion that
+// are fully reported, the later ones are only counted.
+#ifndef ASAP_ASSERT_REPORTS_PER_SITE
+#define ASAP_ASSERT_REPORTS_PER_SITE 3
+#endif
+
+
+// Compile in the zones of the profiler (see ASAP_PROFILE_SCOPE).
+#ifndef ASAP_USE_PROFILER
+#define ASAP_USE_PROFILER 1
+#endif
@@ -0,0 +1,208 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <chrono>   // for the log flush timeout
+#include <cstdint>  // for the record fields
+#include <istream>  // for reading records
+#include <string>   // for std::string
+#include <vector>   // for the record frames
+
+namespace asap {
+
+// ---------------------------------------------------------------------------
+// Crash record format
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief Layout of the binary crash records written by the CrashHandler.
+ *
+ * A record starts with a FileHeader, followed by sections. Each section is a
+ * SectionHeader followed by `size` bytes of payload. A record that ends with
+ * an END section is complete. All the values are in the byte order of the
+ * machine that crashed.
+ */
+namespace crash_record {
+
+/// First bytes of a crash record file.
+constexpr char MAGIC[8] = {'A', 'S', 'A', 'P', 'C', 'R', 'S', 'H'};
+/// Version of the record layout.
+constexpr std::uint32_t VERSION = 1;
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  /// Size of a pointer on the machine that crashed, 4 or 8.
+  std::uint32_t pointer_size;
+};
+
+enum class SectionType : std::uint32_t {
+  /// A SignalInfo.
+  SIGNAL = 1,
+  /// The return addresses of the crashed thread, innermost first, as
+  /// std::uint64_t values.
+  FRAMES = 2,
+  /// Part of the text of /proc/self/maps, which gives where each module was
+  /// loaded. The text is split over several sections.
+  MAPS = 3,
+  /// Text describing the crash, see CrashHandler::SetCrashMessage().
+  MESSAGE = 4,
+  /// End of the record, without payload.
+  END = 5,
+  /// The address of the instruction interrupted by the signal, as a
+  /// std::uint64_t. It is in the frames, and unlike them it is not a return
+  /// address.
+  INSTRUCTION = 6
+};
+
+struct SectionHeader {
+  SectionType type;
+  std::uint32_t size;
+};
+
+struct SignalInfo {
+  std::int32_t signal;
+  /// The si_code of the signal.
+  std::int32_t code;
+  /// The faulting address, for SIGSEGV, SIGBUS, SIGILL and SIGFPE.
+  std::uint64_t address;
+  std::int64_t pid;
+  /// The kernel thread id of the crashed thread, 0 if unknown.
+  std::int64_t tid;
+  /// Time of the crash, since the epoch.
+  std::int64_t time_sec;
+  std::int64_t time_nsec;
+};
+
+}  // namespace crash_record
+
+/*!
+ * @brief The content of a crash record, read back by the offline tools.
+ */
+struct CrashRecord {
+  crash_record::SignalInfo signal{};
+  std::vector<std::uint64_t> frames;
+  /// The instruction interrupted by the signal, 0 if unknown.
+  std::uint64_t instruction{0};
+  std::string maps;
+  std::string message;
+  /// Whether the record has its END section, i.e. the handler completed.
+  bool complete{false};
+
+  /*!
+   * @brief Read a crash record.
+   *
+   * Sections of unknown types are skipped.
+   *
+   * @param [in] in the stream to read from, opened in binary mode.
+   * @param [out] record the record read.
+   * @return false if the stream does not start with a crash record of a
+   * supported version. A truncated record is read as far as possible and
+   * left incomplete.
+   */
+  static bool Read(std::istream &in, CrashRecord &record);
+};
+
+// ---------------------------------------------------------------------------
+// CrashHandler
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief Writes a crash record when the process receives a fatal signal
+ * (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT).
+ *
+ * The handler only uses async-signal-safe operations:
+ *   - the record goes to a file created when the crash happens, with
+ *     open(2) and write(2), so that no file is left behind otherwise. A file
+ *     descriptor is reserved at installation and released for the record,
+ *     so that the record is written even when the process ran out of file
+ *     descriptors,
+ *   - the frames are captured into a preallocated buffer, with a backtrace()
+ *     warmed up at installation so that it does not allocate anymore,
+ *   - the handler runs on a preallocated alternate stack, so that stack
+ *     overflows are recorded too. Alternate stacks are per thread: Install()
+ *     sets one up for the calling thread only, and the other threads that
+ *     may overflow their stack must call InstallThreadStack(),
+ *   - the frames are not symbolized: the record holds their raw addresses
+ *     and the module map of the process, for the asap-symbolize tool to
+ *     symbolize offline.
+ *
+ * After the record is written, the handler lets the asynchronous logging
+ * drain thread deliver the messages pending in its ring buffer and flush the
+ * sinks (see logging::Registry::FlushFromSignal()), then restores the
+ * previous handler and lets the signal terminate the process. Messages below
+ * the error level that are still buffered elsewhere may be lost.
+ *
+ * Only supported on POSIX platforms; Install() fails on the others.
+ */
+class CrashHandler {
+ public:
+  /// Default maximum time given to logging to flush after a crash.
+  static const std::chrono::milliseconds DEFAULT_FLUSH_TIMEOUT;
+
+  /*!
+   * @brief Install the handler, with crash records written to the given file.
+   *
+   * The file is only created when a crash is recorded, replacing an existing
+   * one. Installing checks that it can be created, without leaving it behind.
+   *
+   * @param [in] path the crash record file.
+   * @param [in] flush_timeout maximum time given to logging to flush.
+   * @return false if the file cannot be created, no file descriptor can be
+   * reserved for it, or the platform is not supported.
+   */
+  static bool Install(
+      const std::string &path,
+      std::chrono::milliseconds flush_timeout = DEFAULT_FLUSH_TIMEOUT);
+
+  /// Restore the previous signal handlers.
+  static void Uninstall();
+
+  /*!
+   * @brief Set up an alternate stack for the calling thread, so that the
+   * handler can record an overflow of its stack.
+   *
+   * To be called by each thread when it starts; the thread calling Install()
+   * already has one. The stack is released when the thread exits. Can be
+   * called before Install().
+   *
+   * @return false if the platform is not supported or the stack could not be
+   * set up.
+   */
+  static bool InstallThreadStack();
+
+  /*!
+   * @brief Set a text describing the crash, written in the crash record if
+   * the process crashes afterwards (e.g. by a failed assertion).
+   *
+   * The text is copied into a preallocated buffer, truncated to
+   * MAX_MESSAGE_LENGTH characters. Not meant to be called concurrently.
+   */
+  static void SetCrashMessage(char const *message);
+
+  /// Maximum length of the crash message.
+  static constexpr std::size_t MAX_MESSAGE_LENGTH = 2047;
+  /// Maximum number of frames in a crash record.
+  static constexpr int MAX_FRAMES = 128;
+
+  /*!
+   * @brief Write a crash record to a file descriptor, as the signal handler
+   * does.
+   *
+   * Async-signal-safe, exposed for testing and for custom handlers.
+   *
+   * @param [in] fd the file descriptor.
+   * @param [in] signal the signal number.
+   * @param [in] code the si_code of the signal.
+   * @param [in] address the faulting address.
+   * @param [in] instruction the instruction interrupted by the signal, if
+   * known.
+   */
+  static void WriteRecord(int fd, int signal, int code, void *address,
+                          void *instruction = nullptr);
+};
+
+}  // namespace asap
@@ -0,0 +1,157 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <atomic>              // for the collapsed messages counter
+#include <chrono>              // for std::chrono::milliseconds
+#include <condition_variable>  // for waking up the reporting thread
+#include <cstdint>             // for std::uint64_t
+#include <mutex>               // for std::mutex
+#include <string>              // for std::string
+#include <thread>              // for the reporting thread
+
+#include <spdlog/sinks/sink.h>
+#include <spdlog/spdlog.h>
+
+#include <common/non_copiable.h>
+#include <common/source_location.h>
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// DedupSink
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief A logging sink that collapses identical consecutive log messages
+ * before they reach a delegate sink.
+ *
+ * A message is identical to the previous one when it has the same logger,
+ * level, source location and text. Only the first one of a run of identical
+ * messages is delivered; the others are counted, and a single
+ * "last message repeated N times" message is delivered instead:
+ *   - when a different message is logged,
+ *   - by a background thread, the configured delay after the run started,
+ *     even if nothing is logged anymore (a run that goes on is then reported
+ *     again later),
+ *   - when the sink is flushed or destroyed.
+ *
+ * This bounds what a failure storm costs the delegate (e.g. the records of
+ * the GUI log viewer) to a message per delay. Messages are compared on their
+ * text, so the sink must receive formatted messages: use it to wrap a sink
+ * given to Registry::PushSink() or Registry::AddSink(), not in front of the
+ * Registry sinks.
+ *
+ * The repeated messages report is formatted with Registry::Formatter(). It
+ * refers to the logger of the repeated message by address, as the message
+ * itself does, so it is valid as long as the logger is; the report made when
+ * the sink is destroyed has an empty logger name.
+ *
+ * The lock of the sink only guards the comparison with the last message: the
+ * delegate is called outside of it, so that logging threads (and the
+ * background thread) do not wait for each other in the delegate.
+ */
+class DedupSink : public spdlog::sinks::sink, private asap::NonCopiable {
+ public:
+  /// Default delay after which a run of repeated messages is reported.
+  static const std::chrono::milliseconds DEFAULT_MAX_DELAY;
+
+  /*!
+   * @brief Create a DedupSink and start its background thread.
+   *
+   * @param [in] delegate the sink receiving the collapsed messages.
+   * @param [in] max_delay delay after which a run of repeated messages is
+   * reported.
+   */
+  explicit DedupSink(spdlog::sink_ptr delegate,
+                     std::chrono::milliseconds max_delay = DEFAULT_MAX_DELAY);
+
+  /// Not move constructible
+  DedupSink(DedupSink &&) = delete;
+  /// Not move assignable
+  DedupSink &operator=(DedupSink &&) = delete;
+
+  /// Stops the background thread and reports the pending repeated messages,
+  /// if any, without their logger name.
+  ~DedupSink() override;
+
+  /// @name sink interface
+  //@{
+  /*!
+   * @brief Deliver the given log message, unless it repeats the previous one.
+   *
+   * @param msg log message to be processed.
+   */
+  void log(const spdlog::details::log_msg &msg) override;
+
+  /// Report the pending repeated messages, then flush the delegate.
+  void flush() override;
+  //@}
+
+  /// The sink receiving the collapsed messages.
+  spdlog::sink_ptr Delegate() const { return delegate_; }
+
+  /// Number of messages that were not delivered since the sink was created.
+  std::uint64_t Collapsed() const {
+    return collapsed_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /// The report of a run of repeated messages, to be delivered.
+  struct RepeatsReport {
+    std::size_t repeats_{0};
+    const std::string *logger_{nullptr};
+    spdlog::level::level_enum level_{spdlog::level::trace};
+    std::size_t thread_id_{0};
+    spdlog::log_clock::time_point time_;
+  };
+
+  /// Whether the message repeats the last one. Called with mutex_ held.
+  bool IsRepeat(const spdlog::details::log_msg &msg,
+                SourceLocation const *source) const;
+  /// Take the report of the pending repeated messages, if any. Called with
+  /// mutex_ held.
+  RepeatsReport TakeRepeats(spdlog::log_clock::time_point time);
+  /// Deliver a report, if it has repeats. Called without mutex_ held.
+  void Deliver(const RepeatsReport &report);
+  /// Body of the background thread, reporting the runs of repeated messages
+  /// once they are older than max_delay_.
+  void Work();
+
+  spdlog::sink_ptr delegate_;
+  std::chrono::milliseconds max_delay_;
+
+  /// Guards the last message and its repeats.
+  std::mutex mutex_;
+  /// @name The last delivered message
+  //@{
+  bool has_last_{false};
+  /// The name of the logger, kept by address as in the log messages.
+  const std::string *last_logger_{nullptr};
+  spdlog::level::level_enum last_level_{spdlog::level::trace};
+  std::size_t last_thread_id_{0};
+  SourceLocation const *last_source_{nullptr};
+  std::string last_text_;
+  //@}
+  /// Number of repeats of the last message not reported yet.
+  std::size_t repeats_{0};
+  /// When the current run of repeats started.
+  spdlog::log_clock::time_point run_start_;
+
+  /// @name Background thread state, guarded by mutex_
+  //@{
+  bool stop_{false};
+  /// Notified when a run of repeats starts, and to stop.
+  std::condition_variable wake_;
+  std::thread worker_;
+  //@}
+
+  std::atomic<std::uint64_t> collapsed_{0};
+};
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,289 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <cstddef>      // for std::size_t
+#include <cstring>      // for std::memcpy, std::strlen
+#include <string>       // for std::string
+#include <tuple>        // for the decoded arguments
+#include <type_traits>  // for argument type traits
+#include <utility>      // for std::index_sequence
+
+#include <spdlog/spdlog.h>
+
+#include <common/non_copiable.h>
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// StaticString
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief A string with static storage duration, such as LOG_PREFIX, passed to
+ * a deferred log call by address instead of by value.
+ */
+struct StaticString {
+  constexpr explicit StaticString(char const *str) : str_(str) {}
+  char const *str_;
+};
+
+// ---------------------------------------------------------------------------
+// DeferredArg
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief How a log argument of type T is stored in a deferred message.
+ *
+ * Only the argument types that can be captured as a few raw bytes are
+ * supported: arithmetic types, `void` pointers, strings (their characters are
+ * copied) and StaticString (only the address is copied). Messages with an
+ * argument of any other type are formatted right away.
+ */
+template <typename T, typename Enable = void>
+struct DeferredArg {
+  static constexpr bool SUPPORTED = false;
+};
+
+/// Arithmetic values and `void` pointers are stored as they are.
+template <typename T>
+struct DeferredArg<
+    T, typename std::enable_if<std::is_arithmetic<T>::value ||
+                               std::is_same<T, void *>::value ||
+                               std::is_same<T, const void *>::value>::type> {
+  static constexpr bool SUPPORTED = true;
+  using Decoded = T;
+
+  static void Encode(std::string &out, T value) {
+    out.append(reinterpret_cast<char const *>(&value), sizeof(T));
+  }
+  static Decoded Decode(char const *&in) {
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+  }
+};
+
+/// Static strings are stored by address.
+template <>
+struct DeferredArg<StaticString> {
+  static constexpr bool SUPPORTED = true;
+  using Decoded = char const *;
+
+  static void Encode(std::string &out, StaticString value) {
+    out.append(reinterpret_cast<char const *>(&value.str_),
+               sizeof(value.str_));
+  }
+  static Decoded Decode(char const *&in) {
+    char const *value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return value;
+  }
+};
+
+/// Other strings have their characters copied, null terminated, after their
+/// length.
+struct DeferredStringArg {
+  static constexpr bool SUPPORTED = true;
+  using Decoded = char const *;
+
+  static void Encode(std::string &out, char const *str, std::size_t length) {
+    out.append(reinterpret_cast<char const *>(&length), sizeof(length));
+    out.append(str, length);
+    out.push_back('\0');
+  }
+  static Decoded Decode(char const *&in) {
+    std::size_t length;
+    std::memcpy(&length, in, sizeof(length));
+    auto const *value = in + sizeof(length);
+    in = value + length + 1;
+    return value;
+  }
+};
+
+template <>
+struct DeferredArg<char const *> : DeferredStringArg {
+  static void Encode(std::string &out, char const *str) {
+    DeferredStringArg::Encode(out, str != nullptr ? str : "",
+                              str != nullptr ? std::strlen(str) : 0);
+  }
+};
+
+template <>
+struct DeferredArg<char *> : DeferredArg<char const *> {};
+
+template <std::size_t N>
+struct DeferredArg<char[N]> : DeferredStringArg {
+  static void Encode(std::string &out, char const (&str)[N]) {
+    std::size_t length = 0;
+    while (length < N && str[length] != '\0') ++length;
+    DeferredStringArg::Encode(out, str, length);
+  }
+};
+
+template <>
+struct DeferredArg<std::string> : DeferredStringArg {
+  static void Encode(std::string &out, const std::string &str) {
+    DeferredStringArg::Encode(out, str.data(), str.size());
+  }
+};
+
+/// Whether the formatting of a message with these argument types can be
+/// deferred.
+template <typename... Args>
+struct DeferredArgsSupported : std::true_type {};
+
+template <typename Arg, typename... Args>
+struct DeferredArgsSupported<Arg, Args...>
+    : std::integral_constant<bool, DeferredArg<Arg>::SUPPORTED &&
+                                       DeferredArgsSupported<Args...>::value> {
+};
+
+// ---------------------------------------------------------------------------
+// DeferredMessage
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief A log message whose formatting is deferred: the format string, the
+ * raw bytes of its arguments and the function that knows how to decode them.
+ *
+ * With ASAP_LOG_DEFERRED_FORMAT, the logging macros capture their arguments in
+ * a DeferredMessage instead of formatting them with fmt on the calling thread,
+ * and hand an empty spdlog message over to the sinks. Like the SourceLocation,
+ * the DeferredMessage is published for the duration of the logging call in a
+ * thread local variable, where sinks can get it with Current().
+ *
+ * Sinks that process messages later or on another thread (AsyncSink,
+ * ThreadBufferSink) only copy it and publish it again when they dispatch the
+ * message. The FanOutSink of the Registry, in front of all the other sinks,
+ * formats the text of the message, which therefore happens on the drain thread
+ * when logging is asynchronous.
+ *
+ * The format string must have static storage duration, which is the case of
+ * the string literals used with the logging macros.
+ */
+class DeferredMessage {
+ public:
+  /// Formats a message from its format string and encoded arguments.
+  using WriteFunction = void (*)(spdlog::details::log_msg &msg,
+                                 char const *format, char const *args);
+
+  /*!
+   * @brief Capture a message for deferred formatting.
+   *
+   * @param [in] format format string, with static storage duration.
+   * @param [in] args the arguments, all of supported types.
+   */
+  template <typename... Args>
+  void Encode(char const *format, const Args &... args) {
+    static_assert(DeferredArgsSupported<Args...>::value,
+                  "unsupported argument type for deferred formatting");
+    format_ = format;
+    write_ = &WriteArgs<Args...>;
+    // Keeps the capacity: no allocation once the buffer is warmed up
+    args_.clear();
+    int expand[] = {0, (DeferredArg<Args>::Encode(args_, args), 0)...};
+    (void)expand;
+  }
+
+  /// Copy another message, reusing the capacity of the argument buffer.
+  void Assign(const DeferredMessage &other) {
+    format_ = other.format_;
+    write_ = other.write_;
+    args_.assign(other.args_);
+  }
+
+  /// Forget the message.
+  void Reset() {
+    format_ = nullptr;
+    write_ = nullptr;
+    args_.clear();
+  }
+
+  /// Whether this holds no message.
+  bool Empty() const { return write_ == nullptr; }
+
+  /*!
+   * @brief Format the text of the message into the raw text of a log message.
+   *
+   * Formatting errors are reported in the text of the message, as spdlog does.
+   *
+   * @param [out] msg the log message which raw text is replaced.
+   */
+  void Write(spdlog::details::log_msg &msg) const;
+
+  /*!
+   * @brief Get the deferred message being logged by the current thread.
+   *
+   * @return the message, or nullptr if the message being logged, if any, is
+   * already formatted.
+   */
+  static DeferredMessage const *Current() { return current_(); }
+
+  /*!
+   * @brief Get the message reused by the current thread for its deferred log
+   * calls.
+   */
+  static DeferredMessage &Local() {
+    static thread_local DeferredMessage local;
+    return local;
+  }
+
+  /*!
+   * @brief Publishes a message as the current one for its lifetime and
+   * restores the previous one when destroyed.
+   */
+  class Scope : private asap::NonCopiable {
+   public:
+    explicit Scope(DeferredMessage const *message) : saved_(current_()) {
+      current_() = message;
+    }
+    ~Scope() override { current_() = saved_; }
+
+   private:
+    DeferredMessage const *saved_;
+  };
+
+ private:
+  /// The thread local storage for the current message.
+  static DeferredMessage const *&current_() {
+    static thread_local DeferredMessage const *current = nullptr;
+    return current;
+  }
+
+  template <typename... Args>
+  static void WriteArgs(spdlog::details::log_msg &msg, char const *format,
+                        char const *args) {
+    (void)args;  // not used without arguments
+    // Braced initialization decodes the arguments in order
+    std::tuple<typename DeferredArg<Args>::Decoded...> values{
+        DeferredArg<Args>::Decode(args)...};
+    WriteTuple(msg, format, values, std::index_sequence_for<Args...>());
+  }
+
+  template <typename Tuple, std::size_t... Indexes>
+  static void WriteTuple(spdlog::details::log_msg &msg, char const *format,
+                         const Tuple &values, std::index_sequence<Indexes...>) {
+    msg.raw.write(format, std::get<Indexes>(values)...);
+  }
+
+  /// Without arguments, the message is not a format string (as in spdlog).
+  template <typename Tuple>
+  static void WriteTuple(spdlog::details::log_msg &msg, char const *format,
+                         const Tuple &, std::index_sequence<>) {
+    msg.raw << format;
+  }
+
+  char const *format_{nullptr};
+  WriteFunction write_{nullptr};
+  std::string args_;
+};
+
+}  // namespace logging
+}  // namespace asap
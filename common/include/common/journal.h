@@ -0,0 +1,271 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <cstddef>        // for std::size_t
+#include <cstdint>        // for fixed size integers
+#include <memory>         // for std::unique_ptr
+#include <mutex>          // for std::mutex
+#include <string>         // for std::string
+#include <unordered_map>  // for the strings interned in a block
+#include <vector>         // for the blocks index
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/spdlog.h>
+
+#include <common/non_copiable.h>
+
+namespace asap {
+namespace logging {
+
+/*!
+ * @brief On-disk layout of a log journal, shared by JournalSink and
+ * JournalReader.
+ *
+ * A journal starts with a FileHeader, padded to HEADER_AREA_SIZE, followed by
+ * fixed-size blocks. Each block starts with a BlockHeader and an array of
+ * fixed-size Record entries growing forward; the strings referenced by the
+ * records live in a heap growing backward from the end of the block. A block
+ * is full when the two meet.
+ *
+ * Every block header carries the index of its first record and its time
+ * range, and blocks are at fixed offsets: the block headers are the journal
+ * index. Finding a record is a binary search on the block headers followed
+ * by an array access, without reading anything else from the file.
+ *
+ * All integers are stored in the native byte order.
+ */
+namespace journal {
+
+/// Magic number at the start of a journal file.
+constexpr char FILE_MAGIC[8] = {'A', 'S', 'A', 'P', 'J', 'R', 'N', 'L'};
+/// Current version of the journal format.
+constexpr std::uint32_t VERSION = 1;
+/// Magic number at the start of each block.
+constexpr std::uint32_t BLOCK_MAGIC = 0x4b4c4254;  // "TBLK"
+/// Size of the file header area, a multiple of the mapping granularity of
+/// all supported platforms (64K on Windows).
+constexpr std::size_t HEADER_AREA_SIZE = 64 * 1024;
+/// Offset value used for a string that is not present.
+constexpr std::uint32_t NO_STRING = 0xffffffff;
+
+struct FileHeader {
+  char magic_[8];
+  std::uint32_t version_;
+  std::uint32_t block_size_;
+};
+
+struct BlockHeader {
+  std::uint32_t magic_;
+  /// Number of complete records in the block, updated after each record.
+  std::uint32_t record_count_;
+  /// Offset of the start of the strings heap, relative to the block.
+  std::uint32_t heap_start_;
+  std::uint32_t reserved_;
+  /// Index of the first record of the block in the journal.
+  std::uint64_t first_record_;
+  /// Time of the first and last records (nanoseconds since the epoch).
+  std::int64_t first_time_;
+  std::int64_t last_time_;
+};
+
+struct Record {
+  /// Nanoseconds since the epoch of spdlog::log_clock.
+  std::int64_t time_;
+  std::uint64_t thread_id_;
+  /// Offsets relative to the block. Strings other than the message are
+  /// null-terminated.
+  std::uint32_t message_;
+  std::uint32_t message_size_;
+  std::uint32_t logger_;
+  std::uint32_t file_;
+  std::uint32_t function_;
+  std::int32_t line_;
+  std::uint32_t level_;
+  std::uint32_t reserved_;
+};
+
+}  // namespace journal
+
+// ---------------------------------------------------------------------------
+// JournalSink
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief A logging sink that appends log messages to a binary, memory-mapped
+ * journal file.
+ *
+ * Messages are copied in the current block of the file, which is mapped in
+ * memory; there is no formatting and no write system call. When the block is
+ * full, the file is extended by one block and the new block is mapped. The
+ * logger name and the source location (file and function) are stored once
+ * per block and shared by the records referencing them.
+ *
+ * The record count of a block is updated after the record is complete, so a
+ * journal left by a process that crashed can still be read up to its last
+ * complete record.
+ *
+ * A message too long to fit in an empty block is truncated.
+ *
+ * @see JournalReader
+ */
+class JournalSink : public spdlog::sinks::base_sink<std::mutex>,
+                    private asap::NonCopiable {
+ public:
+  /// Default size of the journal blocks.
+  static const std::size_t DEFAULT_BLOCK_SIZE;
+
+  /*!
+   * @brief Create a new journal file, replacing any existing file with the
+   * same name.
+   *
+   * @param [in] path path of the journal file.
+   * @param [in] block_size size of the blocks, rounded up to a multiple of
+   * journal::HEADER_AREA_SIZE.
+   * @throw std::runtime_error if the file cannot be created or mapped.
+   */
+  explicit JournalSink(std::string path,
+                       std::size_t block_size = DEFAULT_BLOCK_SIZE);
+
+  /// Not move constructible
+  JournalSink(JournalSink &&) = delete;
+  /// Not move assignable
+  JournalSink &operator=(JournalSink &&) = delete;
+
+  /// Flushes the current block to disk.
+  ~JournalSink() override;
+
+  /// The path of the journal file.
+  const std::string &Path() const { return path_; }
+
+ protected:
+  /// @name base_sink interface
+  //@{
+  void _sink_it(const spdlog::details::log_msg &msg) override;
+  /// Schedule the write of the current block to disk.
+  void _flush() override;
+  //@}
+
+ private:
+  /// Extend the file by one block and map it.
+  void StartBlock();
+  /*!
+   * @brief Copy a null-terminated string into the block heap, once per block.
+   *
+   * @param [in] str the string.
+   * @param [in,out] interned the strings already in the block.
+   * @param [in] key the key of the string in `interned`.
+   * @return the offset of the string in the block.
+   */
+  template <typename Key>
+  std::uint32_t Intern(const char *str,
+                       std::unordered_map<Key, std::uint32_t> &interned,
+                       const Key &key);
+  /// Space needed in the heap to intern a string, 0 if already interned.
+  template <typename Key>
+  static std::size_t InternCost(
+      const char *str, const std::unordered_map<Key, std::uint32_t> &interned,
+      const Key &key);
+  /// Reserve space in the block heap and return its offset.
+  std::uint32_t HeapAlloc(std::size_t size);
+  /// Free space between the records array and the heap.
+  std::size_t FreeSpace() const;
+
+  journal::BlockHeader *Block() const {
+    return static_cast<journal::BlockHeader *>(region_->get_address());
+  }
+
+  std::string path_;
+  std::size_t block_size_;
+  std::uint64_t block_count_{0};
+  std::uint64_t record_count_{0};
+  boost::interprocess::file_mapping mapping_;
+  std::unique_ptr<boost::interprocess::mapped_region> region_;
+  /// @name Offsets of the strings already copied in the current block
+  //@{
+  /// Logger names, by value as loggers may come and go.
+  std::unordered_map<std::string, std::uint32_t> interned_loggers_;
+  /// Source files and functions, by address as they are static strings.
+  std::unordered_map<const char *, std::uint32_t> interned_sources_;
+  //@}
+};
+
+// ---------------------------------------------------------------------------
+// JournalReader
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief Read-only access to the records of a journal file.
+ *
+ * The whole file is mapped in memory and only the block headers are read when
+ * it is opened, so opening a journal of millions of records is immediate.
+ * Records are then read in place, on demand; pages that are never accessed
+ * are never read from disk.
+ */
+class JournalReader : private asap::NonCopiable {
+ public:
+  /// A record of the journal. The strings point into the mapped file.
+  struct Entry {
+    spdlog::log_clock::time_point time;
+    std::size_t thread_id;
+    spdlog::level::level_enum level;
+    const char *logger;
+    /// Source location, file and function are nullptr if unknown.
+    const char *file;
+    int line;
+    const char *function;
+    /// The message text (not null-terminated).
+    const char *message;
+    std::size_t message_size;
+  };
+
+  /*!
+   * @brief Open and map a journal file.
+   *
+   * @param [in] path path of the journal file.
+   * @throw std::runtime_error if the file cannot be mapped or is not a
+   * journal.
+   */
+  explicit JournalReader(const std::string &path);
+
+  /// Not move constructible
+  JournalReader(JournalReader &&) = delete;
+  /// Not move assignable
+  JournalReader &operator=(JournalReader &&) = delete;
+
+  /// Default trivial destructor
+  ~JournalReader() override = default;
+
+  /// Number of records in the journal.
+  std::size_t Size() const { return size_; }
+
+  /*!
+   * @brief Get a record.
+   *
+   * @param [in] index index of the record, less than Size().
+   * @return the record.
+   */
+  Entry At(std::size_t index) const;
+
+ private:
+  const char *BlockAt(std::size_t block) const {
+    return base_ + journal::HEADER_AREA_SIZE + block * block_size_;
+  }
+
+  boost::interprocess::file_mapping mapping_;
+  boost::interprocess::mapped_region region_;
+  const char *base_{nullptr};
+  std::size_t block_size_{0};
+  std::size_t size_{0};
+  /// Index of the first record of each complete or partial block.
+  std::vector<std::size_t> block_first_;
+};
+
+}  // namespace logging
+}  // namespace asap
@@ -5,11 +5,25 @@
 
 #pragma once
 
-#include <stack>   // for stacking sinks
-#include <string>  // for std::string
-#include <thread>  // for std::mutex
+#include <array>        // for the loggers table
+#include <atomic>       // for the FanOutSink branch list
+#include <chrono>       // for the rate limited logging
+#include <cstdint>      // for the rate limited logging
+#include <deque>        // for the registered loggers
+#include <exception>    // for std::exception
+#include <limits>       // for the rate limited logging
+#include <stack>        // for stacking sinks
+#include <string>       // for std::string
+#include <thread>       // for std::mutex
+#include <type_traits>  // for std::integral_constant
+#include <vector>       // for the FanOutSink branches
 
+#include <common/async_sink.h>
+#include <common/config.h>
+#include <common/deferred_format.h>
 #include <common/non_copiable.h>
+#include <common/source_location.h>
+#include <common/thread_buffer_sink.h>
 #include <spdlog/fmt/ostr.h>  // for user defined objects logging
 #include <spdlog/spdlog.h>
 
@@ -21,11 +35,11 @@ namespace logging {
 // ---------------------------------------------------------------------------
 
 /*!
- * @brief Exhaustive list of logger ids that can be used in declaring
- * Loggable<ID> classes.
+ * @brief The predefined loggers, always registered first and in this order,
+ * that can be used in declaring Loggable<ID> classes.
  *
- * Apart from this use case, the rest of the logging macros only use
- * logger names.
+ * Other loggers are registered at runtime by name, see
+ * Registry::RegisterLogger() and NamedLoggable.
  */
 enum class Id {
   MISC,
@@ -35,6 +49,39 @@ enum class Id {
   INVALID_  // MUST BE THE LAST ONE
 };
 
+/*!
+ * @brief Identifies a registered logger, for constant time access to it with
+ * Registry::GetLogger().
+ *
+ * Handles are obtained from Registry::RegisterLogger() and stay valid for the
+ * lifetime of the program, loggers are never unregistered. An Id converts
+ * implicitly to the handle of its predefined logger.
+ */
+class LoggerHandle {
+ public:
+  /// The handle of a predefined logger.
+  constexpr LoggerHandle(Id id)  // NOLINT: implicit on purpose
+      : index_(static_cast<std::size_t>(id)) {}
+
+  /// Position of the logger in the registration order.
+  constexpr std::size_t Index() const { return index_; }
+
+  constexpr bool operator==(LoggerHandle other) const {
+    return index_ == other.index_;
+  }
+  constexpr bool operator!=(LoggerHandle other) const {
+    return index_ != other.index_;
+  }
+
+ private:
+  explicit constexpr LoggerHandle(std::size_t index) : index_(index) {}
+
+  std::size_t index_;
+
+  /// Handles of other loggers are created only by the Registry class.
+  friend class Registry;
+};
+
 // ---------------------------------------------------------------------------
 // Logger
 // ---------------------------------------------------------------------------
@@ -62,7 +109,7 @@ class Logger : private asap::NonCopiable {
 
   /// Move constructor
   Logger(Logger &&other) noexcept
-      : id_(other.id_), logger_(std::move(other.logger_)),
+      : handle_(other.handle_), logger_(std::move(other.logger_)),
         logger_mutex_(std::move(other.logger_mutex_)){};
 
   /// Move assignment
@@ -89,12 +136,12 @@ class Logger : private asap::NonCopiable {
   const std::string &Name() const { return logger_->name(); }
 
   /*!
-   * @brief Get this logger's id.
+   * @brief Get this logger's handle.
    *
-   * @return the logger id.
-   * @see Id
+   * @return the logger handle.
+   * @see LoggerHandle
    */
-  logging::Id Id() const { return id_; }
+  LoggerHandle Handle() const { return handle_; }
 
   /*!
    * @brief Set the logging level for this logger (e.g. debug, warning...).
@@ -115,7 +162,7 @@ class Logger : private asap::NonCopiable {
    * for its log messages.
    *
    * Logger objects cannot be created directly. Instead, use the Registry class
-   * to obtain a Logger for a specific ID.
+   * to register a Logger and obtain it by its handle.
    *
    * In spdlog, loggers get assigned a sink or several sinks only at creation
    * and have to continue using that sink for the rest of their lifetime.
@@ -123,15 +170,15 @@ class Logger : private asap::NonCopiable {
    * switch the current sink. See Registry::PushSink() and Registry::PopSink().
    *
    * @param [in] name the logger name.
+   * @param [in] handle the logger handle.
    * @param [in] sink the sink to be used by this logger.
    *
-   * @see Registry::GetLogger(Id)
-   * @see Id
+   * @see Registry::RegisterLogger()
    */
-  Logger(std::string name, logging::Id id, spdlog::sink_ptr sink);
+  Logger(std::string name, LoggerHandle handle, spdlog::sink_ptr sink);
 
-  /// The logger id
-  logging::Id id_;
+  /// The logger handle
+  LoggerHandle handle_;
   /// The underlying spdlog::logger instance.
   std::shared_ptr<spdlog::logger> logger_;
   /// Synchronization lock used to synchronize logging over this logger from
@@ -143,80 +190,152 @@ class Logger : private asap::NonCopiable {
 };
 
 // ---------------------------------------------------------------------------
-// DelegatingSink
+// FanOutSink
 // ---------------------------------------------------------------------------
 
 /*!
- * @brief A logging sink implementation that delegates all its logging calls
- * to an encapsulated delegate.
+ * @brief A logging sink that dispatches each log message to several branch
+ * sinks, each with its own level threshold and its own set of loggers.
  *
  * This class is used to work around the limitation of spdlog that forces the
- * same sink(s) to be used for the lifetime of a logger. Two important
- * application scenarios require the sink to be changed after the logger object
- * is created:
- *   - If the application starts logging early to console and then later needs
- *     to log to some different sink after the proper resources for that sink
- *     have been initialized (e.g. GUI),
- *   - If the application needs to temporarily switch logging output to a
- *     different sink (e.g. dumping diagnostic data) and then switch back to
- *     original sink after it's done. This requires two loggers in the current
- *     implementation.
+ * same sink(s) to be used for the lifetime of a logger: the loggers always
+ * use the same FanOutSink, and branches can be added, replaced or removed at
+ * any time. Typical scenarios are:
+ *   - logging to console early and then later to some different sink after
+ *     the proper resources for that sink have been initialized (e.g. GUI),
+ *   - logging to console, file and GUI at the same time, with e.g. only the
+ *     warnings of a noisy logger going to the file.
  *
- * The DelegatingSink class supports switching its delegate at any time.
+ * The branch list is copy-on-write: modifying it builds a new list that is
+ * atomically published, so dispatching a message never takes a lock and
+ * never waits for a modification. A modification waits, however, until no
+ * thread is still dispatching through the previous list before releasing it
+ * (and the sinks only referenced by it). As a consequence, a branch sink must
+ * not modify the FanOutSink it is called from.
+ *
+ * Unless told otherwise at construction, a FanOutSink formats the messages
+ * whose formatting was deferred (see DeferredMessage) before dispatching
+ * them, so that its branch sinks always get the text of the messages.
  */
-class DelegatingSink : public spdlog::sinks::base_sink<std::mutex>,
-                       private NonCopiable {
+class FanOutSink : public spdlog::sinks::sink, private NonCopiable {
  public:
+  /// Identifies a branch, returned when it is added.
+  using BranchId = std::size_t;
+  /// The loggers whose messages go to a branch, all of them if empty.
+  using LoggerIds = std::vector<LoggerHandle>;
+
   /*!
-   * @brief Create a DelegatingSink which delegates all its logging to the given
-   * delegate sink.
+   * @brief Create a FanOutSink without any branch.
    *
-   * @param [in] delegate the sink to which logging calls will be delegated.
+   * @param [in] format_deferred whether to format the messages whose
+   * formatting was deferred, or to dispatch them as they are.
    */
-  explicit DelegatingSink(spdlog::sink_ptr delegate)
-      : sink_delegate_(std::move(delegate)) {}
+  explicit FanOutSink(bool format_deferred = true);
 
   /// Move constructor
-  DelegatingSink(DelegatingSink &&) = delete;
+  FanOutSink(FanOutSink &&) = delete;
 
   /// Move assignment
-  DelegatingSink &operator=(DelegatingSink &&) = delete;
+  FanOutSink &operator=(FanOutSink &&) = delete;
 
-  /// Default trivial destructor
-  DelegatingSink() = default;
+  /// Releases the branch list.
+  ~FanOutSink() override;
 
   /*!
-   * @brief Use the given sink as a new delegate and return the old one.
+   * @brief Add a branch.
    *
-   * @param sink the new delegate.
-   * @return the previously used delegate.
+   * @param [in] sink the sink of the branch.
+   * @param [in] level the minimum level of the messages sent to the branch.
+   * @param [in] ids the loggers whose messages are sent to the branch, all of
+   * them if empty. Messages are matched to their logger by the address of
+   * their logger name, without locking: messages of loggers that are not
+   * registered only go to the branches of all the loggers.
+   * @return the branch id, to modify or remove the branch later.
    */
-  spdlog::sink_ptr SwapSink(spdlog::sink_ptr sink) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    auto tmp = sink_delegate_;
-    sink_delegate_ = std::move(sink);
-    return tmp;
-  }
+  BranchId AddSink(spdlog::sink_ptr sink,
+                   spdlog::level::level_enum level = spdlog::level::trace,
+                   const LoggerIds &ids = LoggerIds());
 
- protected:
-  /// @name base_sink interface
+  /*!
+   * @brief Remove a branch. Does nothing if the branch does not exist.
+   *
+   * @return the sink of the removed branch, nullptr if not found.
+   */
+  spdlog::sink_ptr RemoveSink(BranchId branch);
+
+  /*!
+   * @brief Use the given sink in a branch and return the old one, keeping the
+   * branch level and loggers.
+   *
+   * @return the previous sink of the branch, nullptr if not found.
+   */
+  spdlog::sink_ptr SwapSink(BranchId branch, spdlog::sink_ptr sink);
+
+  /// Change the minimum level of the messages sent to a branch.
+  void SetBranchLevel(BranchId branch, spdlog::level::level_enum level);
+
+  /// Get the sink of a branch, nullptr if not found.
+  spdlog::sink_ptr Sink(BranchId branch) const;
+
+  /// @name sink interface
   //@{
   /*!
-   * @brief Process the given log message.
+   * @brief Dispatch the given log message to the matching branches.
    *
    * @param msg log message to be processed.
    */
-  void _sink_it(const spdlog::details::log_msg &msg) override {
-    sink_delegate_->log(msg);
-  }
+  void log(const spdlog::details::log_msg &msg) override;
 
-  /// Called when this sink needs to flush any buffered log messages.
-  void _flush() override { sink_delegate_->flush(); }
+  /// Flush all the branches.
+  void flush() override;
   //@}
 
  private:
-  /// The deleagte sink.
-  spdlog::sink_ptr sink_delegate_;
+  struct Branch {
+    BranchId id_;
+    spdlog::sink_ptr sink_;
+    spdlog::level::level_enum level_;
+    /// Element i is set if the messages of the logger with the handle of
+    /// index i go to the branch.
+    std::vector<bool> ids_;
+    bool all_ids_;
+  };
+  using BranchList = std::vector<Branch>;
+
+  /// Marks the calling thread as reading the branch list for its lifetime.
+  class ReadGuard;
+
+  /// Send a message to the matching branches.
+  void Dispatch(const spdlog::details::log_msg &msg);
+
+  /// Publish a new branch list and release the previous one once no reader
+  /// uses it anymore. Called with modify_mutex_ held.
+  void Publish(BranchList *branches);
+  /// Copy the current branch list. Called with modify_mutex_ held.
+  BranchList *CopyBranches() const;
+
+  /// The current branch list, never null.
+  std::atomic<BranchList *> branches_;
+  /// @name Grace period tracking
+  //@{
+  /// Number of reader slots. Threads are spread over the slots, and only
+  /// share one when there are more threads than slots.
+  static constexpr std::size_t READER_SLOTS = 32;
+  /// The readers of a slot, padded so that the counters of two slots are
+  /// never in the same cache line.
+  struct ReaderSlot {
+    /// Number of threads of the slot reading the branch list, by epoch
+    /// parity.
+    std::array<std::atomic<std::size_t>, 2> readers_{};
+    char padding_[128 - sizeof(readers_)];
+  };
+  std::atomic<unsigned> epoch_{0};
+  std::array<ReaderSlot, READER_SLOTS> reader_slots_;
+  //@}
+  /// Serializes the modifications of the branch list.
+  mutable std::mutex modify_mutex_;
+  BranchId next_branch_id_{0};
+  bool format_deferred_;
 };
 
 // ---------------------------------------------------------------------------
@@ -229,15 +348,23 @@ class DelegatingSink : public spdlog::sinks::base_sink<std::mutex>,
  *
  * The logging registry creates and manages all the named loggers in the
  * application. It can be used to:
- *   - obtain any registered logger by its ID,
+ *   - register loggers by name at runtime, in addition to the predefined ones
+ *     of the Id enum,
+ *   - obtain any registered logger by its handle,
  *   - set logging level for all registered loggers,
  *   - change the logging format,
  *   - manage a stack of sinks where the current sink can be temporarily
  *     swapped with another sink, to be restored later
+ *   - add sinks that receive log messages next to the current sink, with
+ *     their own level threshold and loggers
+ *   - switch logging to asynchronous mode, where sinks are fed from a
+ *     dedicated thread
+ *   - buffer log messages per thread, and feed the sinks with batches
  *
  * The Registry creates a default sink at startup to be used by all registered
  * loggers, until an explicit call to PushSink() is made. The default sink is
- * a console logger (color).
+ * a console logger (color). All the sinks are branches of a FanOutSink, so
+ * that changing them never blocks the logging threads.
  *
  * Example:
  * ```
@@ -283,19 +410,84 @@ class Registry {
   static void SetLogFormat(const std::string &log_format);
 
   /*!
-   * Get a registered logger by ID.
+   * @brief Get the formatter used by the registered loggers, to format the
+   * messages that sinks produce themselves.
+   *
+   * @return the formatter of the format last set with SetLogFormat().
+   */
+  static spdlog::formatter_ptr Formatter();
+
+  /// Maximum number of registered loggers, predefined ones included.
+  static constexpr std::size_t MAX_LOGGERS = 256;
+
+  /*!
+   * @brief Give a log message its id (log_msg::msg_id, `%i` in the log
+   * format), before it is formatted.
+   *
+   * While thread buffering is enabled, the id is a global sequence number
+   * giving the order in which the messages were logged across threads.
+   * Otherwise, the id set by spdlog is kept, and this only costs a relaxed
+   * load. The registered loggers call it for every message.
+   *
+   * @param [in,out] msg the message about to be formatted.
+   */
+  static void AssignMessageId(spdlog::details::log_msg &msg) {
+    if (sequence_messages_.load(std::memory_order_relaxed)) {
+      msg.msg_id = static_cast<std::size_t>(
+          message_sequence_.fetch_add(1, std::memory_order_relaxed));
+    }
+  }
+
+  /*!
+   * @brief Register a logger with the given name, or find it if it is
+   * already registered.
+   *
+   * The logger gets the level last set with SetLogLevel() and the current
+   * format. Registering takes a lock, the handle is meant to be cached (see
+   * NamedLoggable).
+   *
+   * @param [in] name the logger name.
+   * @return the handle of the logger.
+   * @throw std::runtime_error if MAX_LOGGERS loggers are already registered.
+   */
+  static LoggerHandle RegisterLogger(const std::string &name);
+
+  /*!
+   * @brief Find a registered logger by name.
+   *
+   * The name of a log message (log_msg::logger_name) points to the name of
+   * its logger: it is first looked up by address, in constant time and
+   * without locking, and then compared with the names of the registered
+   * loggers.
+   *
+   * @param [in] name the logger name.
+   * @param [out] handle the handle of the logger, if found.
+   * @return true if the logger is registered.
+   */
+  static bool FindLogger(const std::string &name, LoggerHandle &handle);
+
+  /*!
+   * Get a registered logger by handle.
+   *
+   * @param [in] handle the handle of the logger, from RegisterLogger() or an
+   * Id.
    *
-   * @param [in] id the unique identifier of the logger to fetch. Logger ids are
-   * defined once as part of the Id enum class.
+   * @return The logger corresponding to the given handle. It is always
+   * guaranteed to succeed as handles only exist for registered loggers, and
+   * the predefined loggers are created as soon as any attempt is made to use
+   * the registry.
    *
-   * @return The logger corresponding to the given id. It is always guaranteed
-   * to succeed as all loggers are known at compile time and are created as soon
-   * as any attempt is made to use the registry.
+   * This is on the hot path of the logging macros and does not lock: the
+   * table of loggers is only ever appended to, so the lookup is an indexed
+   * load.
    */
-  static spdlog::logger &GetLogger(Id id);
+  static spdlog::logger &GetLogger(LoggerHandle handle) {
+    return *LoggerTable()[handle.Index()].load(std::memory_order_acquire);
+  }
 
-  /// API access to the collection of registered loggers.
-  static std::vector<Logger> &Loggers();
+  /// API access to the collection of registered loggers, in registration
+  /// order. Loggers registered later are not in the returned list.
+  static std::vector<Logger *> Loggers();
 
   /*!
    * @brief Use the given sink for all subsequent logging operations until a
@@ -319,6 +511,145 @@ class Registry {
    */
   static void PopSink();
 
+  /*!
+   * @brief Send log messages to the given sink too, in addition to the
+   * current sink and the other added sinks.
+   *
+   * Sinks added this way are not affected by PushSink() and PopSink().
+   *
+   * @param [in] sink the sink to add.
+   * @param [in] level the minimum level of the messages sent to the sink.
+   * @param [in] ids the loggers whose messages are sent to the sink, all of
+   * them if empty.
+   * @return an id to use with RemoveSink() and SetSinkLevel().
+   *
+   * @see FanOutSink
+   */
+  static FanOutSink::BranchId AddSink(
+      spdlog::sink_ptr sink,
+      spdlog::level::level_enum level = spdlog::level::trace,
+      const FanOutSink::LoggerIds &ids = FanOutSink::LoggerIds());
+
+  /*!
+   * @brief Stop sending log messages to a sink added with AddSink().
+   *
+   * The sink is flushed before it is released.
+   *
+   * @param [in] branch the id returned by AddSink().
+   */
+  static void RemoveSink(FanOutSink::BranchId branch);
+
+  /*!
+   * @brief Change the minimum level of the messages sent to a sink added with
+   * AddSink().
+   */
+  static void SetSinkLevel(FanOutSink::BranchId branch,
+                           spdlog::level::level_enum level);
+
+  /*!
+   * @brief Switch all registered loggers to asynchronous logging.
+   *
+   * Log messages are handed over to a dedicated drain thread through a bounded
+   * ring buffer and all the sinks (current, added, and any sink pushed later)
+   * are fed from that thread. Flushing a logger (explicitly or automatically on critical
+   * messages) waits until all pending messages have been processed.
+   *
+   * This is meant to be called once at startup. Calling it when asynchronous
+   * logging is already enabled has no effect.
+   *
+   * @param [in] queue_size number of messages the ring buffer can hold.
+   * @param [in] policy what to do when the ring buffer is full.
+   *
+   * @see DisableAsync()
+   * @see AsyncSink
+   */
+  static void EnableAsync(
+      std::size_t queue_size = AsyncSink::DEFAULT_QUEUE_SIZE,
+      AsyncSink::OverflowPolicy policy = AsyncSink::OverflowPolicy::BLOCK);
+
+  /*!
+   * @brief Process all pending messages, stop the drain thread and go back to
+   * synchronous logging.
+   *
+   * Must be called before the application exits if EnableAsync() was called.
+   */
+  static void DisableAsync();
+
+  /*!
+   * @brief Get the asynchronous logging backend.
+   *
+   * @return the AsyncSink in use, which can be queried for overflow counters,
+   * or nullptr if logging is synchronous.
+   */
+  static std::shared_ptr<AsyncSink> AsyncBackend();
+
+  /*!
+   * @brief Tell whether the formatting of the messages is worth deferring,
+   * which is the case while logging is asynchronous.
+   *
+   * Only costs a relaxed load, unlike AsyncBackend(). When logging is
+   * synchronous, a deferred message would still be formatted on the calling
+   * thread, after the extra work of capturing its arguments.
+   *
+   * @see DeferredMessage
+   */
+  static bool DeferFormatting() {
+    return defer_formatting_.load(std::memory_order_relaxed);
+  }
+
+  /*!
+   * @brief Deliver the messages pending in the asynchronous logging ring
+   * buffer and flush the sinks, from a signal handler.
+   *
+   * Async-signal-safe: the drain thread does the work while the calling
+   * thread waits (see AsyncSink::FlushFromSignal()). Does nothing when
+   * logging is synchronous, as the messages are then already delivered.
+   *
+   * Messages still buffered elsewhere are not flushed: in the batches of the
+   * logging threads (see EnableThreadBuffering()), and, when logging is
+   * synchronous, in the buffer of a RotatingFileSink. Both pass the messages
+   * at the error level and above through right away, so only lower level
+   * messages may be lost.
+   *
+   * @param [in] timeout maximum time to wait for the drain thread.
+   * @return false if the ring buffer could not be flushed in time.
+   */
+  static bool FlushFromSignal(std::chrono::milliseconds timeout);
+
+  /*!
+   * @brief Buffer the log messages in each logging thread, and feed the
+   * sinks with batches of messages.
+   *
+   * Logging threads then no longer contend on the sinks for each message.
+   * Batches are handed over when full, when they are too old, on error and
+   * critical messages, at thread exit and when a logger is flushed. Messages of
+   * different threads may reach the sinks out of order; their log_msg::msg_id
+   * (`%i` in the log format) is a global sequence number giving their order
+   * (see AssignMessageId()).
+   *
+   * Calling it when thread buffering is already enabled has no effect. It can
+   * be combined with EnableAsync().
+   *
+   * @param [in] batch_size number of messages in a batch.
+   * @param [in] max_delay maximum time a message waits in a batch.
+   *
+   * @see DisableThreadBuffering()
+   * @see ThreadBufferSink
+   */
+  static void EnableThreadBuffering(
+      std::size_t batch_size = ThreadBufferSink::DEFAULT_BATCH_SIZE,
+      std::chrono::milliseconds max_delay =
+          ThreadBufferSink::DEFAULT_MAX_DELAY);
+
+  /*!
+   * @brief Hand over all the pending batches and go back to delivering the
+   * messages as they are logged.
+   *
+   * Must be called before the application exits if EnableThreadBuffering()
+   * was called.
+   */
+  static void DisableThreadBuffering();
+
  private:
   // The following methods all use a simple pattern to implement static data
   // members for this singleton class. An implementation detail method does the
@@ -327,11 +658,35 @@ class Registry {
   // provides the API to access the static data member. That second method also
   // caches the static member to optimize the call.
 
-  /// Internal initialization of the static collection of loggers.
-  static std::vector<Logger> &all_loggers_();
-  /// A synchronization object for concurrent access to the collection of
-  /// loggers.
-  static std::recursive_mutex loggers_mutex_;
+  /// The collection of registered loggers, guarded by loggers_mutex_. Loggers
+  /// are only ever appended, so references to them stay valid.
+  static std::deque<Logger> &all_loggers_();
+  /// A synchronization object for the registration of loggers and for the
+  /// changes applied to all of them.
+  static std::mutex loggers_mutex_;
+  /// The level of the loggers registered from now on, guarded by
+  /// loggers_mutex_.
+  static spdlog::level::level_enum log_level_;
+
+  /// Table of the underlying spdlog loggers, indexed by handle.
+  using logger_table_type =
+      std::array<std::atomic<spdlog::logger *>, MAX_LOGGERS>;
+
+  /// API access to the table of spdlog loggers used by GetLogger(). Entries
+  /// are published once, when their logger is registered, and never change
+  /// afterwards, so the table can be read without locking.
+  static logger_table_type &LoggerTable() {
+    static auto &table_static = logger_table_();
+    return table_static;
+  }
+  /// Internal initialization of the static table of spdlog loggers, with the
+  /// predefined loggers.
+  static logger_table_type &logger_table_();
+
+  /// Create a logger and publish it in the given table. Called with
+  /// loggers_mutex_ held.
+  static LoggerHandle AddLogger(logger_table_type &table,
+                                const std::string &name);
 
   /// API access to the stack of sinks. We don't do any expensive initialization
   /// here, so no need for a second level of access.
@@ -339,10 +694,38 @@ class Registry {
   /// A sunchronization object for concurrent access to the collection of sinks.
   static std::mutex sinks_mutex_;
 
-  /// API access to the delegating sink.
-  static std::shared_ptr<DelegatingSink> &delegating_sink();
-  /// Internal initialization of the static delegating sink.
-  static DelegatingSink *delegating_sink_();
+  /// API access to the asynchronous logging backend (nullptr when logging is
+  /// synchronous).
+  static std::shared_ptr<AsyncSink> &async_sink();
+  /// Whether the formatting of the messages is deferred, set while logging
+  /// is asynchronous.
+  static std::atomic<bool> defer_formatting_;
+
+  /// API access to the thread buffering sink (nullptr when disabled).
+  static std::shared_ptr<ThreadBufferSink> &thread_buffer_sink();
+  /// Whether the messages get a global sequence number, set while thread
+  /// buffering is enabled.
+  static std::atomic<bool> sequence_messages_;
+  /// The global sequence number of the next message.
+  static std::atomic<std::uint64_t> message_sequence_;
+
+  /// API access to the sink used by all loggers. Its single branch is the
+  /// fan out sink, possibly preceded by the ThreadBufferSink and the
+  /// AsyncSink, in that order.
+  static std::shared_ptr<FanOutSink> &root_sink();
+  /// Internal initialization of the static root sink.
+  static FanOutSink *root_sink_();
+
+  /// API access to the sink holding all the sinks as branches.
+  static std::shared_ptr<FanOutSink> &fan_out_sink();
+  /// Internal initialization of the static fan out sink.
+  static FanOutSink *fan_out_sink_();
+
+  /// Branch of the fan out sink replaced by PushSink() and PopSink(), the
+  /// first one.
+  static constexpr FanOutSink::BranchId CURRENT_BRANCH = 0;
+  /// The single branch of the root sink.
+  static constexpr FanOutSink::BranchId ROOT_BRANCH = 0;
 };
 
 // ---------------------------------------------------------------------------
@@ -367,15 +750,272 @@ class Loggable {
   }
 };
 
-// Convert the line macro to a string literal for concatenation in log macros.
-#define DO_STRINGIZE(x) STRINGIZE(x)
-#define STRINGIZE(x) #x
-#define LINE_STRING DO_STRINGIZE(__LINE__)
+/*!
+ * @brief Mixin class that allows any class to peform logging with a logger
+ * registered at runtime.
+ *
+ * The logger is registered the first time the class logs, and then used
+ * without any lookup. Its name is given by the `LOGGER_NAME` member of the
+ * NAME type:
+ * ```
+ * struct NetworkLogger {
+ *   static constexpr char const *LOGGER_NAME = "network";
+ * };
+ * class Connection : asap::logging::NamedLoggable<NetworkLogger> { ... };
+ * ```
+ */
+template <typename NAME>
+class NamedLoggable {
+ protected:
+  /*!
+   * @brief Do not use this directly, use macros defined below.
+   * @return spdlog::logger& the static log instance to use for class local
+   * logging.
+   */
+  static spdlog::logger &__log_do_not_use_read_comment() {
+    static spdlog::logger &instance =
+        Registry::GetLogger(Registry::RegisterLogger(NAME::LOGGER_NAME));
+    return instance;
+  }
+};
+
+/*!
+ * @brief Check a logging level against a compile-time threshold.
+ *
+ * @param [in] level the level of a log statement.
+ * @param [in] active_level the threshold (see ASAP_LOG_ACTIVE_LEVEL).
+ * @return true if statements at this level must be compiled in.
+ */
+constexpr bool IsLevelActive(enum Logger::Level level, int active_level) {
+  return static_cast<int>(level) >= active_level;
+}
+
+// ---------------------------------------------------------------------------
+// Deferred formatting
+// ---------------------------------------------------------------------------
+
+/// Pass log arguments as they are to eager formatting.
+template <typename T>
+const T &EagerArg(const T &arg) {
+  return arg;
+}
+
+/// Static strings are formatted as regular strings.
+inline char const *EagerArg(StaticString arg) { return arg.str_; }
+
+/// Log a message that can not have its formatting deferred.
+template <typename... Args>
+void DoLogDeferred(std::false_type, spdlog::logger &logger,
+                   spdlog::level::level_enum level, char const *format,
+                   const Args &... args) {
+  logger.log(level, format, EagerArg(args)...);
+}
+
+/// Log a message, capturing its arguments for deferred formatting.
+template <typename... Args>
+void DoLogDeferred(std::true_type, spdlog::logger &logger,
+                   spdlog::level::level_enum level, char const *format,
+                   const Args &... args) {
+  // Only the drain thread of asynchronous logging formats the messages out
+  // of the way. Critical messages make the loggers flush, and a message
+  // logged while another one is dispatched would overwrite it: format all of
+  // them right away
+  if (!Registry::DeferFormatting() || level >= spdlog::level::critical ||
+      DeferredMessage::Current() != nullptr) {
+    DoLogDeferred(std::false_type(), logger, level, format, args...);
+    return;
+  }
+
+  auto &deferred = DeferredMessage::Local();
+  deferred.Encode(format, args...);
+  // What spdlog::logger does, without formatting the message
+  spdlog::details::log_msg msg(&logger.name(), level);
+  Registry::AssignMessageId(msg);
+  DeferredMessage::Scope scope(&deferred);
+  try {
+    for (auto const &sink : logger.sinks()) {
+      if (sink->should_log(level)) sink->log(msg);
+    }
+  } catch (const std::exception &ex) {
+    logger.error_handler()(ex.what());
+  }
+}
+
+/*!
+ * @brief Do not use this directly, use the logging macros with
+ * ASAP_LOG_DEFERRED_FORMAT.
+ *
+ * Log a message without formatting it when all its arguments are of a type
+ * supported by DeferredArg, and format it right away otherwise.
+ */
+template <typename... Args>
+void LogDeferred(spdlog::logger &logger, spdlog::level::level_enum level,
+                 char const *format, const Args &... args) {
+  DoLogDeferred(typename DeferredArgsSupported<Args...>::type(), logger, level,
+                format, args...);
+}
+
+// ---------------------------------------------------------------------------
+// Rate limiting
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief Lets one call out of N through, starting with the first one.
+ *
+ * Like the other rate limiters, it is meant to be a static variable of a log
+ * statement (see ASLOG_EVERY_N) and is constant initialized: it costs a
+ * relaxed atomic operation per call and no initialization guard.
+ */
+class EveryNLimiter {
+ public:
+  constexpr EveryNLimiter() = default;
+
+  /// Whether this call is one of the calls to log.
+  bool Allow(std::uint64_t n) {
+    return count_.fetch_add(1, std::memory_order_relaxed) % (n == 0 ? 1 : n) ==
+           0;
+  }
+
+ private:
+  std::atomic<std::uint64_t> count_{0};
+};
+
+/*!
+ * @brief Lets one call through per period, starting with the first one.
+ */
+class EveryMsLimiter {
+ public:
+  constexpr EveryMsLimiter() = default;
+
+  /// Whether this call is one of the calls to log.
+  bool Allow(std::int64_t period_ms) {
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count();
+    auto next = next_.load(std::memory_order_relaxed);
+    // Only one of the threads racing for the same period wins
+    return now >= next &&
+           next_.compare_exchange_strong(next, now + period_ms,
+                                         std::memory_order_relaxed);
+  }
+
+ private:
+  /// When the next call can be let through, in ms of the steady clock.
+  std::atomic<std::int64_t> next_{std::numeric_limits<std::int64_t>::min()};
+};
+
+/*!
+ * @brief Lets the first call through, and no other.
+ */
+class OnceLimiter {
+ public:
+  constexpr OnceLimiter() = default;
+
+  /// Whether this call is the call to log.
+  bool Allow() {
+    // The exchange is only paid until the call is done
+    return !done_.load(std::memory_order_relaxed) &&
+           !done_.exchange(true, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<bool> done_{false};
+};
+
+// ---------------------------------------------------------------------------
+// SourceLocationPrefix
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief The `[file:line] ` prefix of log messages, computed at compile time.
+ *
+ * File and line of a log statement are compile-time constants, and so is the
+ * prefix built from them. Declared `static constexpr` at the call site (see
+ * LOG_PREFIX), it is a string literal in the binary and logging a message
+ * costs no formatting and no allocation for it.
+ *
+ * The file path is right aligned on FILE_MAX_LENGTH characters. Longer paths
+ * are truncated to their first 7 and last FILE_MAX_LENGTH - 10 characters,
+ * joined by "...". The line number is zero-padded on 5 digits.
+ */
+class SourceLocationPrefix {
+ public:
+  /// Width of the file path part of the prefix.
+  static constexpr std::size_t FILE_MAX_LENGTH = 70;
+
+  /*!
+   * @brief Build the prefix for the given source location.
+   *
+   * @param [in] file source file path, typically `__FILE__`.
+   * @param [in] line line number, typically `__LINE__`.
+   */
+  constexpr SourceLocationPrefix(char const *file, int line) : prefix_{} {
+    std::size_t file_length = 0;
+    while (file[file_length] != '\0') ++file_length;
+
+    std::size_t pos = 0;
+    prefix_[pos++] = '[';
+    if (file_length > FILE_MAX_LENGTH) {
+      for (std::size_t ii = 0; ii < 7; ++ii) prefix_[pos++] = file[ii];
+      for (std::size_t ii = 0; ii < 3; ++ii) prefix_[pos++] = '.';
+      for (auto ii = file_length - (FILE_MAX_LENGTH - 10); ii < file_length;
+           ++ii) {
+        prefix_[pos++] = file[ii];
+      }
+    } else {
+      for (auto ii = file_length; ii < FILE_MAX_LENGTH; ++ii) {
+        prefix_[pos++] = ' ';
+      }
+      for (std::size_t ii = 0; ii < file_length; ++ii) prefix_[pos++] = file[ii];
+    }
+    prefix_[pos++] = ':';
+
+    char digits[LINE_MAX_DIGITS]{};
+    std::size_t count = 0;
+    auto value = static_cast<unsigned int>(line < 0 ? 0 : line);
+    do {
+      digits[count++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value != 0 && count < LINE_MAX_DIGITS);
+    for (auto ii = count; ii < 5; ++ii) prefix_[pos++] = '0';
+    while (count > 0) prefix_[pos++] = digits[--count];
+
+    prefix_[pos++] = ']';
+    prefix_[pos++] = ' ';
+    prefix_[pos] = '\0';
+  }
+
+  /// The prefix as a null-terminated string.
+  constexpr char const *c_str() const { return prefix_; }
+
+  /*!
+   * @brief Length of the prefix for a given line, which does not depend on the
+   * file path.
+   *
+   * @param [in] line line number.
+   * @return the number of characters in the prefix.
+   */
+  static constexpr std::size_t Length(int line) {
+    std::size_t digits = 1;
+    for (auto value = line < 0 ? 0 : line; value >= 10; value /= 10) ++digits;
+    return 1 + FILE_MAX_LENGTH + 1 + (digits < 5 ? 5 : digits) + 2;
+  }
+
+ private:
+  static constexpr std::size_t LINE_MAX_DIGITS = 10;
+  /// "[" file ":" line "] " and the terminating null character.
+  char prefix_[1 + FILE_MAX_LENGTH + 1 + LINE_MAX_DIGITS + 2 + 1];
+};
+
 #ifndef NDEBUG
-std::string FormatFileAndLine(char const *file, char const *line);
-//#define LOG_PREFIX "[" __FILE__ ":" LINE_STRING "] "
-//#define LOG_PREFIX " "
-#define LOG_PREFIX asap::logging::FormatFileAndLine(__FILE__, LINE_STRING)
+// The lambda gives the prefix static storage while keeping LOG_PREFIX usable
+// as an expression. Being constexpr, it is fully computed at compile time.
+#define LOG_PREFIX                                                  \
+  ([]() -> char const * {                                           \
+    static constexpr asap::logging::SourceLocationPrefix prefix__{  \
+        __FILE__, __LINE__};                                        \
+    return prefix__.c_str();                                        \
+  }())
 #else
 #define LOG_PREFIX " "
 #endif  // NDEBUG
@@ -391,9 +1031,39 @@ std::string FormatFileAndLine(char const *file, char const *line);
  * convenience macros below rather than invoke these directly.
  */
 
-#define ASLOG_COMP_LEVEL(LOGGER, LEVEL)    \
-  (static_cast<spdlog::level::level_enum>( \
-       asap::logging::Logger::Level::LEVEL) >= LOGGER.level())
+// Compile-time threshold: log statements below this level are compiled out,
+// arguments included. Levels use the spdlog numbering: trace = 0, debug = 1,
+// info = 2, warn = 3, error = 4, critical = 5, off = 6. The default keeps
+// everything and leaves filtering to the runtime level of each logger.
+// Because it is checked where the macros are expanded, it can be set for the
+// whole build (see ASAP_LOG_ACTIVE_LEVEL in CMake) or per translation unit.
+#ifndef ASAP_LOG_ACTIVE_LEVEL
+#define ASAP_LOG_ACTIVE_LEVEL 0
+#endif  // ASAP_LOG_ACTIVE_LEVEL
+
+// The threshold check is forced to be a constant expression so that, when it
+// fails, the whole log statement is dead code even in unoptimized builds.
+#define ASLOG_ACTIVE_LEVEL(LEVEL)                                       \
+  (std::integral_constant<bool, asap::logging::IsLevelActive(          \
+                                    asap::logging::Logger::Level::LEVEL, \
+                                    ASAP_LOG_ACTIVE_LEVEL)>::value)
+
+#define ASLOG_SPDLOG_LEVEL(LEVEL) \
+  static_cast<spdlog::level::level_enum>(asap::logging::Logger::Level::LEVEL)
+
+#define ASLOG_COMP_LEVEL(LOGGER, LEVEL) \
+  (ASLOG_ACTIVE_LEVEL(LEVEL) && ASLOG_SPDLOG_LEVEL(LEVEL) >= LOGGER.level())
+
+// Deferred formatting: log statements only capture the format string and the
+// raw bytes of their arguments, and the text of the message is formatted by
+// the sinks on the drain thread (see DeferredMessage). Messages logged while
+// logging is synchronous, with arguments of other types than numbers and
+// strings, and critical messages, are still formatted right away. Like the
+// compile-time level, it can be set for the whole build (see
+// ASAP_LOG_DEFERRED_FORMAT in CMake) or per translation unit.
+#ifndef ASAP_LOG_DEFERRED_FORMAT
+#define ASAP_LOG_DEFERRED_FORMAT 0
+#endif  // ASAP_LOG_DEFERRED_FORMAT
 
 // Compare levels before invoking logger. This is an optimization to avoid
 // executing expressions computing log contents when they would be suppressed.
@@ -409,26 +1079,59 @@ std::string FormatFileAndLine(char const *file, char const *line);
 
 #define _ASLOG_1(LOGGER) LOGGER.debug("no logger level - no message")
 #define _ASLOG_2(LOGGER, LEVEL) LOGGER.LEVEL("no message")
+#if ASAP_LOG_DEFERRED_FORMAT
+#define _ASLOG_3(LOGGER, LEVEL, MSG)                                    \
+  asap::logging::LogDeferred(LOGGER, ASLOG_SPDLOG_LEVEL(LEVEL), "{}" MSG, \
+                             asap::logging::StaticString(LOG_PREFIX))
+#define _ASLOG_N(LOGGER, LEVEL, MSG, ...)                               \
+  asap::logging::LogDeferred(LOGGER, ASLOG_SPDLOG_LEVEL(LEVEL), "{}" MSG, \
+                             asap::logging::StaticString(LOG_PREFIX),   \
+                             __VA_ARGS__)
+#else  // ASAP_LOG_DEFERRED_FORMAT
 #define _ASLOG_3(LOGGER, LEVEL, MSG) LOGGER.LEVEL("{}" MSG, LOG_PREFIX)
 #define _ASLOG_N(LOGGER, LEVEL, MSG, ...) \
   LOGGER.LEVEL("{}" MSG, LOG_PREFIX, __VA_ARGS__)
+#endif  // ASAP_LOG_DEFERRED_FORMAT
 
+// Declare the structured source location of the log statement and publish it
+// to the sinks for the duration of the logging call.
+// @see SourceLocation
+#define ASLOG_SOURCE_LOCATION_SCOPE(PREFIX_LENGTH)                       \
+  static constexpr asap::logging::SourceLocation asap_source_location__{ \
+      __FILE__, __LINE__, ASAP_FUNCTION, PREFIX_LENGTH};                 \
+  asap::logging::SourceLocation::Scope asap_source_location_scope__(     \
+      &asap_source_location__)
+
+// Log with the source location, without checking the level. Declares
+// variables, so must be used in a block of its own.
 #ifndef NDEBUG
-#define ASLOG_COMP_AND_LOG(LOGGER, LEVEL, ...) \
-  do {                                         \
-    if (ASLOG_COMP_LEVEL(LOGGER, LEVEL)) {     \
-      AS_DO_LOG(LOGGER, LEVEL, __VA_ARGS__);   \
-    }                                          \
-  } while (0)
+#define _ASLOG_WITH_LOCATION(LOGGER, LEVEL, ...)                   \
+  ASLOG_SOURCE_LOCATION_SCOPE(                                     \
+      asap::logging::SourceLocationPrefix::Length(__LINE__));      \
+  AS_DO_LOG(LOGGER, LEVEL, __VA_ARGS__)
 #else  // NDEBUG
-#define ASLOG_COMP_AND_LOG(LOGGER, LEVEL, ...) \
-  do {                                         \
-    if (ASLOG_COMP_LEVEL(LOGGER, LEVEL)) {     \
-      LOGGER.LEVEL(__VA_ARGS__);               \
-    }                                          \
-  } while (0)
+#if ASAP_LOG_DEFERRED_FORMAT
+#define _ASLOG_NO_PREFIX(LOGGER, LEVEL, ...) \
+  asap::logging::LogDeferred(LOGGER, ASLOG_SPDLOG_LEVEL(LEVEL), __VA_ARGS__)
+#else  // ASAP_LOG_DEFERRED_FORMAT
+#define _ASLOG_NO_PREFIX(LOGGER, LEVEL, ...) LOGGER.LEVEL(__VA_ARGS__)
+#endif  // ASAP_LOG_DEFERRED_FORMAT
+#define _ASLOG_WITH_LOCATION(LOGGER, LEVEL, ...) \
+  ASLOG_SOURCE_LOCATION_SCOPE(0);                 \
+  _ASLOG_NO_PREFIX(LOGGER, LEVEL, __VA_ARGS__)
 #endif  // NDEBUG
 
+// Log if the level is enabled and, only then, the condition is true.
+#define ASLOG_COMP_AND_LOG_IF(LOGGER, LEVEL, CONDITION, ...) \
+  do {                                                       \
+    if (ASLOG_COMP_LEVEL(LOGGER, LEVEL) && (CONDITION)) {    \
+      _ASLOG_WITH_LOCATION(LOGGER, LEVEL, __VA_ARGS__);       \
+    }                                                        \
+  } while (0)
+
+#define ASLOG_COMP_AND_LOG(LOGGER, LEVEL, ...) \
+  ASLOG_COMP_AND_LOG_IF(LOGGER, LEVEL, true, __VA_ARGS__)
+
 #define ASLOG_CHECK_LEVEL(LEVEL) ASLOG_COMP_LEVEL(ASLOGGER(), LEVEL)
 
 /**
@@ -464,6 +1167,43 @@ std::string FormatFileAndLine(char const *file, char const *line);
 #define ASLOG_MISC(LEVEL, ...) \
   ASLOG_TO_LOGGER(GET_MISC_LOGGER(), LEVEL, __VA_ARGS__)
 
+// Rate limited logging: each log statement has its own static limiter, so
+// that a statement in a tight loop cannot flood the sinks. Only the calls
+// that pass the level checks count. The logger expression is evaluated once.
+#define ASLOG_LIMITED_TO_LOGGER(LIMITER, ALLOW, LOGGER, LEVEL, ...)  \
+  do {                                                             \
+    static asap::logging::LIMITER asap_limiter__;                  \
+    auto &asap_limited_logger__ = (LOGGER);                        \
+    ASLOG_COMP_AND_LOG_IF(asap_limited_logger__, LEVEL,            \
+                          asap_limiter__.ALLOW, __VA_ARGS__);      \
+  } while (0)
+
+/**
+ * Convenience macros to log only the 1st, N+1th, 2N+1th... time.
+ */
+#define ASLOG_TO_LOGGER_EVERY_N(LOGGER, LEVEL, N, ...)                  \
+  ASLOG_LIMITED_TO_LOGGER(EveryNLimiter, Allow(N), LOGGER, LEVEL, \
+                          __VA_ARGS__)
+#define ASLOG_EVERY_N(LEVEL, N, ...) \
+  ASLOG_TO_LOGGER_EVERY_N(ASLOGGER(), LEVEL, N, __VA_ARGS__)
+
+/**
+ * Convenience macros to log at most once every MS milliseconds.
+ */
+#define ASLOG_TO_LOGGER_EVERY_MS(LOGGER, LEVEL, MS, ...)                  \
+  ASLOG_LIMITED_TO_LOGGER(EveryMsLimiter, Allow(MS), LOGGER, LEVEL, \
+                          __VA_ARGS__)
+#define ASLOG_EVERY_MS(LEVEL, MS, ...) \
+  ASLOG_TO_LOGGER_EVERY_MS(ASLOGGER(), LEVEL, MS, __VA_ARGS__)
+
+/**
+ * Convenience macros to log only the first time.
+ */
+#define ASLOG_TO_LOGGER_ONCE(LOGGER, LEVEL, ...) \
+  ASLOG_LIMITED_TO_LOGGER(OnceLimiter, Allow(), LOGGER, LEVEL, __VA_ARGS__)
+#define ASLOG_ONCE(LEVEL, ...) \
+  ASLOG_TO_LOGGER_ONCE(ASLOGGER(), LEVEL, __VA_ARGS__)
+
 //@}
 
 }  // namespace logging
@@ -0,0 +1,88 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <string>  // for std::string
+
+#include <spdlog/spdlog.h>
+
+#include <common/deferred_format.h>
+#include <common/source_location.h>
+
+namespace asap {
+namespace logging {
+
+/*!
+ * @brief A copy of the spdlog::details::log_msg fields, for the sinks that
+ * keep log messages to process them later (log_msg itself is neither
+ * copyable nor movable).
+ *
+ * Records are meant to be reused: Assign() reuses the capacity already held
+ * by the strings, so that copying a message into a warmed up record does not
+ * allocate.
+ *
+ * A message whose formatting is deferred is kept as it is, unformatted, and
+ * must be published again with its DeferredMessage when processed.
+ */
+struct MessageRecord {
+  const std::string *logger_name_{nullptr};
+  spdlog::level::level_enum level_{spdlog::level::off};
+  spdlog::log_clock::time_point time_;
+  std::size_t thread_id_{0};
+  std::size_t msg_id_{0};
+  std::string raw_;
+  std::string formatted_;
+  std::size_t color_range_start_{0};
+  std::size_t color_range_end_{0};
+  /// Location of the log statement, published again when the message is
+  /// processed.
+  SourceLocation const *source_{nullptr};
+  /// The message arguments when its formatting is deferred.
+  DeferredMessage deferred_;
+
+  /// Copy a log message, its source location and its deferred formatting (if
+  /// any) into this record.
+  void Assign(const spdlog::details::log_msg &msg,
+              SourceLocation const *source, DeferredMessage const *deferred) {
+    logger_name_ = msg.logger_name;
+    level_ = msg.level;
+    time_ = msg.time;
+    thread_id_ = msg.thread_id;
+    msg_id_ = msg.msg_id;
+    raw_.assign(msg.raw.data(), msg.raw.size());
+    formatted_.assign(msg.formatted.data(), msg.formatted.size());
+    color_range_start_ = msg.color_range_start;
+    color_range_end_ = msg.color_range_end;
+    source_ = source;
+    if (deferred != nullptr) {
+      deferred_.Assign(*deferred);
+    } else {
+      deferred_.Reset();
+    }
+  }
+
+  /// Rebuild a log message and its deferred formatting from this record and
+  /// return its source location.
+  SourceLocation const *Extract(spdlog::details::log_msg &msg,
+                                DeferredMessage &deferred) const {
+    msg.logger_name = logger_name_;
+    msg.level = level_;
+    msg.time = time_;
+    msg.thread_id = thread_id_;
+    msg.msg_id = msg_id_;
+    msg.raw.clear();
+    msg.raw << raw_;
+    msg.formatted.clear();
+    msg.formatted << formatted_;
+    msg.color_range_start = color_range_start_;
+    msg.color_range_end = color_range_end_;
+    deferred.Assign(deferred_);
+    return source_;
+  }
+};
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,130 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <atomic>   // for the enabled flag
+#include <cstddef>  // for std::size_t
+#include <cstdint>  // for std::int64_t
+#include <string>   // for the thread names
+#include <vector>   // for the snapshots
+
+#include <common/config.h>
+
+namespace asap {
+
+/// A timed scope, as recorded by the profiler.
+struct ProfileZone {
+  /// Name of the zone, a string literal.
+  const char *name;
+  /// Start and end of the zone, in nanoseconds (see Profiler::Now()).
+  std::int64_t begin;
+  std::int64_t end;
+  /// Number of enclosing zones in the same thread.
+  int depth;
+};
+
+/// The zones recorded by a thread, oldest first.
+struct ThreadProfile {
+  /// Number of the thread, in the order threads first recorded a zone.
+  std::size_t thread_index;
+  std::string thread_name;
+  std::vector<ProfileZone> zones;
+};
+
+/*!
+ * @brief A lightweight profiler of the CPU time spent in named scopes.
+ *
+ * Zones are declared with ASAP_PROFILE_SCOPE("name"). When the profiler is
+ * enabled, the end of a zone writes its name and timestamps to a ring buffer
+ * of the thread, without locking or allocating; only the most recent
+ * ZONES_PER_THREAD zones of each thread are kept. When it is disabled, a zone
+ * costs a relaxed load.
+ *
+ * Snapshot() copies the zones of all the threads, concurrently with the
+ * threads recording new ones. The buffer of a thread is kept after the
+ * thread exits, so that its zones can still be shown.
+ */
+class Profiler {
+ public:
+  /// Number of zones kept for each thread.
+  static const std::size_t ZONES_PER_THREAD;
+
+  static void Enable(bool enable = true) {
+    enabled_.store(enable, std::memory_order_relaxed);
+  }
+  static bool IsEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  /// Current time of the profiler clock, in nanoseconds.
+  static std::int64_t Now();
+
+  /// Name the calling thread in the snapshots.
+  static void SetThreadName(std::string name);
+
+  /// Copy the zones recorded by all the threads.
+  static std::vector<ThreadProfile> Snapshot();
+
+  /// Discard the zones recorded so far.
+  static void Clear();
+
+  /// @name Used by ProfileScope
+  //@{
+  /// Start a zone in the calling thread, returns its depth.
+  static int EnterZone();
+  /// End the innermost zone of the calling thread and record it.
+  static void LeaveZone(const char *name, std::int64_t begin, int depth);
+  //@}
+
+ private:
+  class ThreadBuffer;
+  struct Registry;
+  static Registry &Buffers();
+  static ThreadBuffer &CurrentThreadBuffer();
+
+  static std::atomic<bool> enabled_;
+};
+
+/*!
+ * @brief Records the time spent in its scope as a zone of the profiler, if
+ * the profiler was enabled when the scope started.
+ */
+class ProfileScope {
+ public:
+  /// @param [in] name the name of the zone, must be a string literal.
+  explicit ProfileScope(const char *name) : name_(name) {
+    if (ASAP_UNLIKELY(Profiler::IsEnabled())) {
+      depth_ = Profiler::EnterZone();
+      begin_ = Profiler::Now();
+    }
+  }
+
+  ~ProfileScope() {
+    if (ASAP_UNLIKELY(depth_ >= 0)) Profiler::LeaveZone(name_, begin_, depth_);
+  }
+
+  // Not NonCopiable, whose virtual destructor would cost every zone a vtable
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+ private:
+  const char *name_;
+  std::int64_t begin_{0};
+  /// -1 if the zone is not recorded.
+  int depth_{-1};
+};
+
+}  // namespace asap
+
+#define ASAP_PROFILE_CONCAT_IMPL(a, b) a##b
+#define ASAP_PROFILE_CONCAT(a, b) ASAP_PROFILE_CONCAT_IMPL(a, b)
+
+#if ASAP_USE_PROFILER
+/// Record the time spent in the enclosing scope as a zone named NAME, which
+/// must be a string literal.
+#define ASAP_PROFILE_SCOPE(NAME) \
+  asap::ProfileScope ASAP_PROFILE_CONCAT(asap_profile_scope_, __LINE__)(NAME)
+#else
+#define ASAP_PROFILE_SCOPE(NAME) static_cast<void>(0)
+#endif  // ASAP_USE_PROFILER
@@ -0,0 +1,281 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <algorithm>  // for std::max
+#include <cstddef>    // for std::size_t
+#include <cstring>    // for std::memcpy
+#include <deque>      // for the blocks ring
+#include <memory>     // for std::unique_ptr
+#include <vector>     // for the headers ring
+
+#include <common/non_copiable.h>
+
+namespace asap {
+
+/*!
+ * @brief A bounded store of records made of a fixed-size header and a
+ * variable-size text, optimized for append at the back and eviction at the
+ * front.
+ *
+ * Record headers live in a ring that grows by doubling until it reaches the
+ * maximum number of records. The text of the records is appended into large
+ * contiguous blocks; a header only keeps a pointer to its text and the index
+ * of the block holding it. A block is released (or kept as a spare for the
+ * next allocation) as soon as the oldest live record no longer lives in it.
+ * This keeps the number of heap allocations proportional to the amount of
+ * text rather than to the number of records, and makes evicting the oldest
+ * record O(1).
+ *
+ * Records are identified by a sequence number that increases monotonically
+ * for the lifetime of the store and is never reused, even after Clear(). The
+ * live records are those in [FirstSequence(), EndSequence()).
+ *
+ * When appending a record would exceed the maximum number of records or the
+ * maximum amount of text memory, the oldest records are evicted first. Text
+ * memory is accounted by block, so evicting for memory releases a whole block
+ * worth of records at once.
+ *
+ * This class is not thread safe.
+ *
+ * @tparam Header the type of the record headers. It must be default
+ * constructible and copyable.
+ */
+template <typename Header>
+class RecordStore : private asap::NonCopiable {
+ public:
+  /// Default size of the blocks in which record text is stored.
+  static constexpr std::size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+  /*!
+   * @brief Create an empty store; no memory is allocated until the first
+   * record is added.
+   *
+   * @param [in] max_records maximum number of records kept (minimum 1).
+   * @param [in] max_bytes maximum amount of memory used for text blocks. A
+   * single record larger than this is still accepted, alone.
+   * @param [in] block_size size of the blocks in which text is stored. Texts
+   * larger than a block get a block of their own.
+   */
+  RecordStore(std::size_t max_records, std::size_t max_bytes,
+              std::size_t block_size = DEFAULT_BLOCK_SIZE)
+      : max_records_(std::max<std::size_t>(max_records, 1)),
+        max_bytes_(max_bytes),
+        block_size_(std::max<std::size_t>(block_size, 1)) {}
+
+  /// Not move constructible
+  RecordStore(RecordStore &&) = delete;
+  /// Not move assignable
+  RecordStore &operator=(RecordStore &&) = delete;
+
+  /// Default trivial destructor
+  ~RecordStore() override = default;
+
+  /*!
+   * @brief Append a record and let the given callable write its text in
+   * place.
+   *
+   * @param [in] header the record header.
+   * @param [in] size the size of the record text.
+   * @param [in] write callable invoked with a `char *` to `size` bytes of
+   * storage for the text.
+   * @return the sequence number of the new record.
+   */
+  template <typename Writer>
+  std::size_t Emplace(const Header &header, std::size_t size,
+                      Writer &&write) {
+    while (count_ >= max_records_) EvictOldest();
+    auto *text = Allocate(size);
+    write(text);
+    if (count_ == slots_.size()) GrowSlots();
+    auto &slot = slots_[end_ & mask_];
+    slot.header_ = header;
+    slot.text_ = text;
+    slot.size_ = size;
+    slot.block_ = first_block_ + blocks_.size() - 1;
+    ++count_;
+    return end_++;
+  }
+
+  /*!
+   * @brief Append a record with a copy of the given text.
+   *
+   * @param [in] header the record header.
+   * @param [in] text the record text (not necessarily null-terminated).
+   * @param [in] size the size of the record text.
+   * @return the sequence number of the new record.
+   */
+  std::size_t Push(const Header &header, const char *text, std::size_t size) {
+    return Emplace(header, size, [text, size](char *dest) {
+      if (size > 0) std::memcpy(dest, text, size);
+    });
+  }
+
+  /// Discard all records. The last block is kept for reuse.
+  void Clear() {
+    first_ = end_;
+    count_ = 0;
+    if (blocks_.empty()) return;
+    ReleaseBlocks(first_block_ + blocks_.size() - 1);
+    blocks_.back().used_ = 0;
+  }
+
+  /*!
+   * @brief Change the limits, evicting the oldest records if needed.
+   *
+   * @param [in] max_records maximum number of records kept (minimum 1).
+   * @param [in] max_bytes maximum amount of memory used for text blocks.
+   */
+  void SetLimits(std::size_t max_records, std::size_t max_bytes) {
+    max_records_ = std::max<std::size_t>(max_records, 1);
+    max_bytes_ = max_bytes;
+    while (count_ > max_records_ || (count_ > 0 && bytes_ > max_bytes_)) {
+      EvictOldest();
+    }
+  }
+
+  /// @name Accessors
+  //@{
+  /// Number of live records.
+  std::size_t Size() const { return count_; }
+  /// Whether there are no live records.
+  bool Empty() const { return count_ == 0; }
+  /// Sequence number of the oldest live record.
+  std::size_t FirstSequence() const { return first_; }
+  /// Sequence number that the next record will get.
+  std::size_t EndSequence() const { return end_; }
+  /// Whether the record with the given sequence number is still live.
+  bool Contains(std::size_t seq) const { return seq >= first_ && seq < end_; }
+
+  /// The header of a live record.
+  const Header &HeaderAt(std::size_t seq) const {
+    return slots_[seq & mask_].header_;
+  }
+  /// The header of a live record.
+  Header &HeaderAt(std::size_t seq) { return slots_[seq & mask_].header_; }
+  /// The text of a live record (not null-terminated).
+  const char *TextAt(std::size_t seq) const {
+    return slots_[seq & mask_].text_;
+  }
+  /// The size of the text of a live record.
+  std::size_t TextSizeAt(std::size_t seq) const {
+    return slots_[seq & mask_].size_;
+  }
+
+  /// Maximum number of records kept.
+  std::size_t MaxRecords() const { return max_records_; }
+  /// Maximum amount of memory used for text blocks.
+  std::size_t MaxBytes() const { return max_bytes_; }
+  /// Memory currently held by the store, headers and spare block included.
+  std::size_t MemoryUsage() const {
+    return bytes_ + (spare_.data_ ? spare_.capacity_ : 0) +
+           slots_.capacity() * sizeof(Slot);
+  }
+  //@}
+
+ private:
+  struct Slot {
+    Header header_{};
+    const char *text_{nullptr};
+    std::size_t size_{0};
+    /// Sequence number of the block holding the text.
+    std::size_t block_{0};
+  };
+
+  struct Block {
+    std::unique_ptr<char[]> data_;
+    std::size_t capacity_{0};
+    std::size_t used_{0};
+  };
+
+  /// Reserve `size` bytes of text storage at the end of the last block.
+  char *Allocate(std::size_t size) {
+    if (!blocks_.empty()) {
+      auto &last = blocks_.back();
+      if (last.capacity_ - last.used_ >= size) {
+        auto *text = last.data_.get() + last.used_;
+        last.used_ += size;
+        return text;
+      }
+    }
+
+    auto capacity = std::max(block_size_, size);
+    while (count_ > 0 && bytes_ + capacity > max_bytes_) EvictOldest();
+
+    Block block;
+    if (spare_.data_ && spare_.capacity_ >= capacity) {
+      block = std::move(spare_);
+      spare_ = Block();
+    } else {
+      block.data_.reset(new char[capacity]);
+      block.capacity_ = capacity;
+    }
+    block.used_ = size;
+    bytes_ += block.capacity_;
+    blocks_.push_back(std::move(block));
+    return blocks_.back().data_.get();
+  }
+
+  /// Evict the oldest live record and release the blocks it leaves unused.
+  void EvictOldest() {
+    ++first_;
+    --count_;
+    ReleaseBlocks(count_ == 0 ? first_block_ + blocks_.size()
+                              : slots_[first_ & mask_].block_);
+  }
+
+  /// Release all blocks with a sequence number lower than `until`.
+  void ReleaseBlocks(std::size_t until) {
+    while (first_block_ < until) {
+      auto &front = blocks_.front();
+      bytes_ -= front.capacity_;
+      // Keep one regular block around to avoid allocating on the next one
+      if (front.capacity_ == block_size_) spare_ = std::move(front);
+      blocks_.pop_front();
+      ++first_block_;
+    }
+  }
+
+  /// Double the capacity of the headers ring, keeping the live records.
+  void GrowSlots() {
+    auto new_size = std::max<std::size_t>(slots_.size() * 2, 16);
+    std::vector<Slot> slots(new_size);
+    auto new_mask = new_size - 1;
+    for (auto seq = first_; seq != end_; ++seq) {
+      slots[seq & new_mask] = std::move(slots_[seq & mask_]);
+    }
+    slots_.swap(slots);
+    mask_ = new_mask;
+  }
+
+  std::size_t max_records_;
+  std::size_t max_bytes_;
+  std::size_t block_size_;
+
+  /// @name Headers ring
+  //@{
+  std::vector<Slot> slots_;
+  std::size_t mask_{0};
+  std::size_t first_{0};
+  std::size_t end_{0};
+  std::size_t count_{0};
+  //@}
+
+  /// @name Text blocks
+  //@{
+  std::deque<Block> blocks_;
+  /// Sequence number of the first block in blocks_.
+  std::size_t first_block_{0};
+  /// Sum of the capacities of the blocks in blocks_.
+  std::size_t bytes_{0};
+  Block spare_;
+  //@}
+};
+
+template <typename Header>
+constexpr std::size_t RecordStore<Header>::DEFAULT_BLOCK_SIZE;
+
+}  // namespace asap
@@ -0,0 +1,175 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <atomic>              // for the count of lost messages
+#include <chrono>              // for the rotation and flush intervals
+#include <condition_variable>  // for waking up the background thread
+#include <cstdio>              // for std::FILE
+#include <deque>               // for the segments waiting to be archived
+#include <mutex>               // for std::mutex
+#include <string>              // for std::string
+#include <thread>              // for the background thread
+#include <vector>              // for the write buffer
+
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/spdlog.h>
+
+#include <common/non_copiable.h>
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// RotatingFileSink
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief A logging sink that writes formatted log messages to a file, and
+ * starts a new file when the current one is too big or too old.
+ *
+ * Messages are accumulated in a large buffer, written to the file in a single
+ * call when the buffer is full, when the sink is flushed, periodically (so
+ * that a quiet application still gets its log on disk) and when an error is
+ * logged (so that it survives a crash).
+ *
+ * When the current file is rotated, it is only renamed on the logging thread.
+ * A background thread then archives it: the previous archives are shifted
+ * (`app.1.log.gz` becomes `app.2.log.gz`, ...), the oldest ones beyond the
+ * configured count are removed and the new segment is compressed into
+ * `app.1.log.gz`. The logging thread never waits for the compression.
+ *
+ * Compression uses gzip and is only available when the library was built
+ * with zlib (see CompressionSupported()); otherwise the archives are kept
+ * uncompressed.
+ *
+ * If a new file cannot be opened when rotating, opening it is retried each
+ * time the buffer is written, i.e. when it is full or flushed. Meanwhile,
+ * the buffered messages are dropped and counted (see Dropped()), as are the
+ * messages that could not be completely written.
+ *
+ * The sink can be used like any other sink, e.g. with
+ * Registry::PushSink().
+ */
+class RotatingFileSink : public spdlog::sinks::base_sink<std::mutex>,
+                         private asap::NonCopiable {
+ public:
+  /// Configuration of the sink.
+  struct Options {
+    /// Path of the current log file. Archives are named after it.
+    std::string path;
+    /// Rotate when the file would grow beyond this size (in bytes).
+    std::size_t max_size{10 * 1024 * 1024};
+    /// Rotate when the file is older than this, never if zero.
+    std::chrono::seconds max_age{0};
+    /// Number of archived files kept, the oldest are removed.
+    std::size_t max_files{5};
+    /// Compress the archived files, if supported.
+    bool compress{true};
+    /// Size of the write buffer (in bytes).
+    std::size_t buffer_size{256 * 1024};
+    /// Maximum time a message stays in the buffer, never flushed
+    /// periodically if zero.
+    std::chrono::milliseconds flush_interval{1000};
+    /// Messages at or above this level are written right away, with the
+    /// buffered ones, so that they are on disk if the process crashes.
+    spdlog::level::level_enum write_through_level{spdlog::level::err};
+  };
+
+  /*!
+   * @brief Open (or create) the log file and start the background thread.
+   *
+   * Messages are appended to an existing file.
+   *
+   * @param [in] options the sink configuration.
+   * @throw std::runtime_error if the file cannot be opened.
+   */
+  explicit RotatingFileSink(Options options);
+
+  /// Not move constructible
+  RotatingFileSink(RotatingFileSink &&) = delete;
+  /// Not move assignable
+  RotatingFileSink &operator=(RotatingFileSink &&) = delete;
+
+  /// Writes the pending messages and waits for the pending archives.
+  ~RotatingFileSink() override;
+
+  /// Whether archives can be compressed in this build.
+  static bool CompressionSupported();
+
+  /// The configuration of the sink.
+  const Options &GetOptions() const { return options_; }
+
+  /*!
+   * @brief Path of an archived file.
+   *
+   * @param [in] index index of the archive, 1 being the most recent.
+   * @return the path of the archive, with the `.gz` extension when
+   * compressed.
+   */
+  std::string ArchivePath(std::size_t index) const;
+
+  /// Block until all the rotated files have been archived.
+  void WaitForArchives();
+
+  /// Number of messages dropped because the log file could not be opened or
+  /// written.
+  std::size_t Dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  /// @name base_sink interface
+  //@{
+  void _sink_it(const spdlog::details::log_msg &msg) override;
+  /// Write the buffered messages to the file.
+  void _flush() override;
+  //@}
+
+ private:
+  /// Path of an archived file, compressed or not.
+  std::string ArchivePath(std::size_t index, bool compressed) const;
+  /// Open the log file, return false if it could not be opened.
+  bool OpenFile();
+  /// Write the buffer to the file, or drop what cannot be written.
+  void WriteBuffer();
+  /// Close the current file, hand it over to the background thread and open
+  /// a new one.
+  void Rotate();
+  /// Body of the background thread.
+  void Work();
+  /// Shift the archives, compress a rotated file into the first one.
+  void Archive(const std::string &segment);
+
+  Options options_;
+  bool compress_;
+
+  /// @name Current file, guarded by the base_sink mutex
+  //@{
+  std::FILE *file_{nullptr};
+  std::vector<char> buffer_;
+  /// Number of messages in buffer_.
+  std::size_t buffered_{0};
+  std::size_t file_size_{0};
+  spdlog::log_clock::time_point file_start_;
+  std::size_t rotations_{0};
+  //@}
+  std::atomic<std::size_t> dropped_{0};
+
+  /// @name Background thread state
+  //@{
+  std::thread worker_;
+  std::mutex work_mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable archived_cv_;
+  std::deque<std::string> segments_;
+  bool archiving_{false};
+  bool stop_{false};
+  //@}
+};
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,96 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <cstddef>  // for std::size_t
+
+#include <common/non_copiable.h>
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// SourceLocation
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief Source file, line and function of a log statement, as structured
+ * fields that sinks can use directly.
+ *
+ * The logging macros declare one `static constexpr` SourceLocation per log
+ * statement, so a location costs nothing at runtime and a pointer to it stays
+ * valid for the lifetime of the program.
+ *
+ * spdlog messages have no room for extra fields. The location of the message
+ * being logged is therefore published for the duration of the logging call in
+ * a thread local variable, where sinks can get it with Current(). Sinks that
+ * process messages on another thread (e.g. AsyncSink) must carry the pointer
+ * along and publish it again, with a Scope, before dispatching.
+ */
+class SourceLocation {
+ public:
+  /*!
+   * @brief Create a source location.
+   *
+   * @param [in] file source file path, typically `__FILE__`.
+   * @param [in] line line number, typically `__LINE__`.
+   * @param [in] function function name, typically `ASAP_FUNCTION`.
+   * @param [in] prefix_length number of characters at the start of the message
+   * text taken by the `[file:line] ` prefix, or 0 if the message has none.
+   */
+  constexpr SourceLocation(char const *file, int line, char const *function,
+                           std::size_t prefix_length)
+      : file_(file), line_(line), function_(function),
+        prefix_length_(prefix_length) {}
+
+  /// The source file path.
+  constexpr char const *File() const { return file_; }
+  /// The line number.
+  constexpr int Line() const { return line_; }
+  /// The function name.
+  constexpr char const *Function() const { return function_; }
+  /// Length of the location prefix in the message text (0 if none).
+  constexpr std::size_t PrefixLength() const { return prefix_length_; }
+
+  /*!
+   * @brief Get the location of the message being logged by the current
+   * thread.
+   *
+   * @return the location, or nullptr if the message was not logged through
+   * the logging macros.
+   */
+  static SourceLocation const *Current() { return current_(); }
+
+  /*!
+   * @brief Publishes a location as the current one for its lifetime and
+   * restores the previous one when destroyed.
+   */
+  class Scope : private asap::NonCopiable {
+   public:
+    explicit Scope(SourceLocation const *location) : saved_(current_()) {
+      current_() = location;
+    }
+    ~Scope() override { current_() = saved_; }
+
+   private:
+    SourceLocation const *saved_;
+  };
+
+ private:
+  /// The thread local storage for the current location.
+  static SourceLocation const *&current_() {
+    static thread_local SourceLocation const *current = nullptr;
+    return current;
+  }
+
+  char const *file_;
+  int line_;
+  char const *function_;
+  std::size_t prefix_length_;
+};
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,166 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <cstdint>  // for std::uint64_t
+#include <map>      // for the modules and the cache
+#include <memory>   // for std::unique_ptr
+#include <string>   // for std::string
+#include <utility>  // for std::pair
+#include <vector>   // for the mappings and frames
+
+#include <common/non_copiable.h>
+
+namespace asap {
+
+// ---------------------------------------------------------------------------
+// ModuleMap
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief Where the modules (executable and shared libraries) of a process
+ * were loaded, to find which module and which address in the module a
+ * runtime address corresponds to.
+ */
+class ModuleMap {
+ public:
+  /// A range of runtime addresses mapped from a module file.
+  struct Mapping {
+    std::uint64_t start;
+    std::uint64_t end;
+    /// Offset in the file of the byte mapped at start.
+    std::uint64_t offset;
+    std::string path;
+  };
+
+  void Add(Mapping mapping);
+
+  /*!
+   * @brief Add the file backed executable mappings of a /proc/<pid>/maps
+   * text, as found in crash records.
+   */
+  void AddProcMaps(const std::string &maps);
+
+  /*!
+   * @brief Parse a `module <start>-<end> <offset> <path>` line of a raw
+   * backtrace (see print_backtrace_raw()) and add its mapping.
+   *
+   * @return false if the line is not a module line.
+   */
+  bool AddModuleLine(const std::string &line);
+
+  /// The mapping holding an address, nullptr if none does.
+  Mapping const *Find(std::uint64_t address) const;
+
+  bool Empty() const { return mappings_.empty(); }
+
+ private:
+  std::vector<Mapping> mappings_;
+};
+
+/*!
+ * @brief Parse a `frame <index> <address>` line of a raw backtrace (see
+ * print_backtrace_raw()).
+ *
+ * @return false if the line is not a frame line.
+ */
+bool ParseFrameLine(const std::string &line, int &index,
+                    std::uint64_t &address);
+
+// ---------------------------------------------------------------------------
+// Symbolizer
+// ---------------------------------------------------------------------------
+
+/// What a runtime address was resolved to.
+struct SymbolizedFrame {
+  std::uint64_t address{0};
+  /// Path of the module holding the address, empty if not found.
+  std::string module;
+  /// The address looked up in the module, as in its symbol table.
+  std::uint64_t module_address{0};
+  /// Demangled name of the function, empty if not found.
+  std::string function;
+  /// Source file and line, empty and 0 if not found.
+  std::string file;
+  int line{0};
+};
+
+/*!
+ * @brief Resolves runtime addresses to function, source file and line, from
+ * the ELF symbol tables and the DWARF line tables of the modules.
+ *
+ * Modules are only read when an address is not found in the cache, and then
+ * kept in memory for the next addresses. The results are cached by module
+ * identity (path, size and modification time) and address; the cache can be
+ * saved to a file and loaded by the next symbolizer, so that symbolizing the
+ * same frames again does not read the modules at all.
+ *
+ * The function is the one holding the address in the symbol table, not the
+ * functions inlined into it; the line is the one of the innermost inlined
+ * code. Compressed debug sections are not supported: modules with such
+ * sections are symbolized without lines.
+ *
+ * Only supported on Linux; elsewhere, frames are left unresolved.
+ */
+class Symbolizer : private asap::NonCopiable {
+ public:
+  /*!
+   * @brief Create a Symbolizer.
+   *
+   * @param [in] cache_path the file to load the cache from and save it to,
+   * empty for no persistent cache.
+   */
+  explicit Symbolizer(std::string cache_path = "");
+
+  ~Symbolizer();
+
+  /*!
+   * @brief Resolve an address found in a backtrace.
+   *
+   * @param [in] modules where the modules were loaded.
+   * @param [in] address the address.
+   * @param [in] return_address whether the address is a return address, in
+   * which case the address looked up is the one before, i.e. the call
+   * instruction. Only the instruction interrupted by a signal is not.
+   */
+  SymbolizedFrame Symbolize(const ModuleMap &modules, std::uint64_t address,
+                            bool return_address = true);
+
+  /*!
+   * @brief Save the cache to its file, if it has one and it changed.
+   *
+   * @throw std::runtime_error if the file cannot be written.
+   */
+  void SaveCache();
+
+  /// Number of modules read since the creation of the symbolizer.
+  std::size_t ModulesLoaded() const { return modules_.size(); }
+
+ private:
+  struct CachedFrame {
+    std::uint64_t module_address;
+    std::string function;
+    std::string file;
+    int line;
+  };
+
+  class Module;
+
+  /// Identity of the module file at a path, empty if it cannot be read.
+  const std::string &ModuleKey(const std::string &path);
+  /// The module loaded from a path, nullptr if it cannot be read.
+  Module *GetModule(const std::string &path);
+  void LoadCache();
+
+  std::string cache_path_;
+  std::map<std::string, std::string> module_keys_;
+  std::map<std::string, std::unique_ptr<Module>> modules_;
+  /// Resolved addresses, by module identity and offset in the module file.
+  std::map<std::pair<std::string, std::uint64_t>, CachedFrame> cache_;
+  bool cache_changed_{false};
+};
+
+}  // namespace asap
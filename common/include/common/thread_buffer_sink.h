@@ -0,0 +1,143 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <chrono>              // for the batch age
+#include <condition_variable>  // for waking up the flusher thread
+#include <memory>              // for std::shared_ptr
+#include <mutex>               // for std::mutex
+#include <thread>              // for the flusher thread
+#include <vector>              // for the batches
+
+#include <spdlog/sinks/sink.h>
+#include <spdlog/spdlog.h>
+
+#include <common/message_record.h>
+#include <common/non_copiable.h>
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// ThreadBufferSink
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief A logging sink that accumulates the log messages of each thread in
+ * a thread-local batch, and hands whole batches over to a delegate sink.
+ *
+ * Logging threads only copy the already formatted message into their own
+ * batch; they do not contend with each other. A batch is handed over to the
+ * delegate, in one go and under a single lock:
+ *   - when it holds the configured number of messages,
+ *   - when a message is logged and the oldest message of the batch is older
+ *     than the configured delay,
+ *   - when a message at or above the handoff level (critical by default,
+ *     matching the flush level of the loggers) is logged,
+ *   - when the thread exits,
+ *   - when the sink is flushed (all the batches are then handed over).
+ * A background thread also hands over the batches of idle threads once they
+ * are older than the configured delay.
+ *
+ * Batches of different threads reach the delegate in no particular order.
+ * The loggers of the Registry give the messages a global sequence number
+ * while thread buffering is enabled (see Registry::AssignMessageId()), which
+ * gives the order in which the messages were logged across threads.
+ *
+ * This sink is not meant to be used directly. It is installed by the Registry
+ * in front of its sinks when thread buffering is enabled.
+ *
+ * @see Registry::EnableThreadBuffering()
+ */
+class ThreadBufferSink : public spdlog::sinks::sink,
+                         private asap::NonCopiable {
+ public:
+  /// Default number of messages in a batch.
+  static const std::size_t DEFAULT_BATCH_SIZE;
+  /// Default maximum time a message waits in a batch.
+  static const std::chrono::milliseconds DEFAULT_MAX_DELAY;
+
+  /*!
+   * @brief Create a ThreadBufferSink and start its flusher thread.
+   *
+   * @param [in] delegate the sink receiving the batches.
+   * @param [in] batch_size number of messages in a batch.
+   * @param [in] max_delay maximum time a message waits in a batch.
+   * @param [in] handoff_level a message at or above this level is handed over
+   * immediately, with the rest of its batch.
+   */
+  ThreadBufferSink(
+      spdlog::sink_ptr delegate, std::size_t batch_size,
+      std::chrono::milliseconds max_delay,
+      spdlog::level::level_enum handoff_level = spdlog::level::critical);
+
+  /// Not move constructible
+  ThreadBufferSink(ThreadBufferSink &&) = delete;
+  /// Not move assignable
+  ThreadBufferSink &operator=(ThreadBufferSink &&) = delete;
+
+  /// Hands over all the pending batches and stops the flusher thread.
+  ~ThreadBufferSink() override;
+
+  /// @name sink interface
+  //@{
+  /*!
+   * @brief Add the given log message to the batch of the calling thread.
+   *
+   * @param msg log message to be processed.
+   */
+  void log(const spdlog::details::log_msg &msg) override;
+
+  /// Hand over the batches of all the threads, then flush the delegate.
+  void flush() override;
+  //@}
+
+  /*!
+   * @brief Use the given sink as a new delegate and return the old one.
+   *
+   * All the messages logged before the call are delivered to the old
+   * delegate.
+   *
+   * @param sink the new delegate.
+   * @return the previously used delegate.
+   */
+  spdlog::sink_ptr SwapSink(spdlog::sink_ptr sink);
+
+  /// Get the current delegate.
+  spdlog::sink_ptr Delegate();
+
+  /// Hand over all the pending batches and terminate the flusher thread.
+  void Stop();
+
+ private:
+  struct Core;
+  struct Batch;
+  class ThreadBatches;
+
+  /// Get the batch of the calling thread, creating it if needed.
+  Batch &LocalBatch();
+  /// Body of the flusher thread.
+  void FlushIdle();
+
+  std::size_t batch_size_;
+  std::chrono::milliseconds max_delay_;
+  spdlog::level::level_enum handoff_level_;
+
+  /// The state shared with the thread-local batches, which may outlive the
+  /// sink.
+  std::shared_ptr<Core> core_;
+
+  /// @name Flusher thread state
+  //@{
+  std::thread flusher_;
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool stop_{false};
+  //@}
+};
+
+}  // namespace logging
+}  // namespace asap
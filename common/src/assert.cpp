@@ -7,9 +7,11 @@
 
 #include <common/assert.h>
 #include <common/config.h>
+#include <common/crash_handler.h>
 
 #if ASAP_USE_ASSERTS
 
+#include <algorithm>  // for std::min, std::sort
 #include <array>
 #include <cinttypes>  // for PRId64 et.al.
 #include <csignal>
@@ -161,6 +163,105 @@ void print_backtrace(char* out, int len, int /*max_depth*/, void* /* ctx */) {
 
 #endif
 
+#if ASAP_USE_EXECINFO && defined ASAP_LINUX
+#include <execinfo.h>
+#include <link.h>    // for dl_iterate_phdr
+#include <unistd.h>  // for readlink
+
+#include <climits>  // for PATH_MAX
+
+namespace asap {
+
+namespace {
+
+/// State of print_backtrace_raw(), passed through dl_iterate_phdr().
+struct RawBacktrace {
+  void* const* frames;
+  int count;
+  char* out;
+  int len;
+};
+
+/// Append to the output, which is always kept null terminated.
+ASAP_FORMAT(2, 3)
+void Append(RawBacktrace& backtrace, char const* fmt, ...) {
+  if (backtrace.len <= 1) return;
+  va_list va;
+  va_start(va, fmt);
+  int ret = std::vsnprintf(backtrace.out, std::size_t(backtrace.len), fmt, va);
+  va_end(va);
+  if (ret < 0) return;
+  ret = std::min(ret, backtrace.len - 1);
+  backtrace.out += ret;
+  backtrace.len -= ret;
+}
+
+int PrintModule(struct dl_phdr_info* info, std::size_t, void* data) {
+  auto& backtrace = *static_cast<RawBacktrace*>(data);
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    auto const& segment = info->dlpi_phdr[i];
+    if (segment.p_type != PT_LOAD || (segment.p_flags & PF_X) == 0) continue;
+    auto start = std::uintptr_t(info->dlpi_addr + segment.p_vaddr);
+    auto end = start + std::uintptr_t(segment.p_memsz);
+
+    // Only the modules holding frames are needed to symbolize them
+    bool has_frames = false;
+    for (int frame = 0; frame < backtrace.count && !has_frames; ++frame) {
+      auto address = reinterpret_cast<std::uintptr_t>(backtrace.frames[frame]);
+      has_frames = address >= start && address < end;
+    }
+    if (!has_frames) continue;
+
+    // The main executable has no name
+    char const* path = info->dlpi_name;
+    char executable[PATH_MAX];
+    if (path == nullptr || path[0] == '\0') {
+      auto size = ::readlink("/proc/self/exe", executable,
+                             sizeof(executable) - 1);
+      executable[size > 0 ? size : 0] = '\0';
+      path = executable;
+    }
+    Append(backtrace, "module 0x%" PRIxPTR "-0x%" PRIxPTR " 0x%" PRIxPTR
+                      " %s\n",
+           start, end, std::uintptr_t(segment.p_offset), path);
+  }
+  return 0;
+}
+
+}  // namespace
+
+void print_backtrace_raw(char* out, int len, int max_depth) {
+  if (len <= 0) return;
+  out[0] = '\0';
+
+  void* stack[50];
+  int size = ::backtrace(stack, 50);
+  // Skip this function
+  RawBacktrace backtrace{stack + 1, size - 1, out, len};
+  if (max_depth > 0) backtrace.count = std::min(backtrace.count, max_depth);
+
+  ::dl_iterate_phdr(&PrintModule, &backtrace);
+  for (int i = 0; i < backtrace.count; ++i) {
+    Append(backtrace, "frame %d 0x%" PRIxPTR "\n", i + 1,
+           reinterpret_cast<std::uintptr_t>(backtrace.frames[i]));
+  }
+}
+
+}  // namespace asap
+
+#else
+
+namespace asap {
+
+void print_backtrace_raw(char* out, int len, int /*max_depth*/) {
+  out[0] = 0;
+  std::strncat(out, "<not supported>", std::size_t(len));
+}
+
+}  // namespace asap
+
+#endif
+
 #endif
 
 namespace asap {
@@ -169,17 +270,140 @@ namespace asap {
 
 ASAP_FORMAT(1, 2)
 void assert_print(char const* fmt, ...) {
-  FILE* out = stderr;
   va_list va;
   va_start(va, fmt);
-  std::vfprintf(out, fmt, va);
+  std::vfprintf(stderr, fmt, va);
   va_end(va);
+}
 
+// ---------------------------------------------------------------------------
+// Failure counters and reports
+// ---------------------------------------------------------------------------
+
+namespace {
+
+/// Head of the list of the sites which failed, each one added once.
+std::atomic<assert_site*> failed_sites{nullptr};
+
+/// A slot of the reports ring, guarded by a flag so that readers never see
+/// half of a report.
+struct report_slot {
+  std::atomic<bool> busy{false};
+  /// Position of the report in the sequence of reports, 0 if none yet.
+  std::uint64_t sequence{0};
+  assert_report report;
+};
+
+report_slot report_ring[ASSERT_REPORTS_CAPACITY];
+std::atomic<std::uint64_t> reports_count{0};
+
+class slot_lock {
+ public:
+  explicit slot_lock(report_slot& slot) : slot_(slot) {
+    while (slot_.busy.exchange(true, std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  ~slot_lock() { slot_.busy.store(false, std::memory_order_release); }
+  slot_lock(slot_lock const&) = delete;
+  slot_lock& operator=(slot_lock const&) = delete;
+
+ private:
+  report_slot& slot_;
+};
+
+}  // namespace
+
+std::uint64_t assert_hit(assert_site& site) {
+  auto hits = site.hits.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (hits == 1) {
+    auto* head = failed_sites.load(std::memory_order_relaxed);
+    do {
+      site.next = head;
+    } while (!failed_sites.compare_exchange_weak(
+        head, &site, std::memory_order_release, std::memory_order_relaxed));
+  }
 #ifdef ASAP_PRODUCTION_ASSERTS
-  if (out != stderr) fclose(out);
+  return hits <= ASAP_ASSERT_REPORTS_PER_SITE ? hits : 0;
+#else
+  return hits;
+#endif
+}
+
+void record_assert_report(assert_site const& site, std::uint64_t hit,
+                          char const* val) {
+  assert_report report;
+  report.site = &site;
+  report.hit = hit;
+  report.time = std::chrono::system_clock::now();
+  report.thread = std::this_thread::get_id();
+  std::strncpy(report.value, val ? val : "", ASSERT_REPORT_VALUE_LENGTH);
+  report.value[ASSERT_REPORT_VALUE_LENGTH] = '\0';
+#if ASAP_USE_EXECINFO
+  report.frame_count = ::backtrace(report.frames, ASSERT_REPORT_FRAMES);
+#else
+  report.frame_count = 0;
 #endif
+
+  auto sequence = reports_count.fetch_add(1, std::memory_order_relaxed) + 1;
+  auto& slot = report_ring[(sequence - 1) % ASSERT_REPORTS_CAPACITY];
+  slot_lock lock(slot);
+  // A slow writer does not overwrite a newer report
+  if (slot.sequence > sequence) return;
+  slot.sequence = sequence;
+  slot.report = report;
+}
+
+std::vector<assert_site_hits> hot_asserts(std::size_t max_sites) {
+  std::vector<assert_site_hits> sites;
+  for (auto const* site = failed_sites.load(std::memory_order_acquire);
+       site != nullptr; site = site->next) {
+    sites.push_back({site, site->hits.load(std::memory_order_relaxed)});
+  }
+  std::stable_sort(sites.begin(), sites.end(),
+                   [](assert_site_hits const& left,
+                      assert_site_hits const& right) {
+                     return left.hits > right.hits;
+                   });
+  if (max_sites > 0 && sites.size() > max_sites) sites.resize(max_sites);
+  return sites;
+}
+
+std::vector<assert_report> recent_assert_reports() {
+  std::vector<std::pair<std::uint64_t, assert_report>> reports;
+  for (auto& slot : report_ring) {
+    slot_lock lock(slot);
+    if (slot.sequence > 0) reports.emplace_back(slot.sequence, slot.report);
+  }
+  std::sort(reports.begin(), reports.end(),
+            [](std::pair<std::uint64_t, assert_report> const& left,
+               std::pair<std::uint64_t, assert_report> const& right) {
+              return left.first < right.first;
+            });
+  std::vector<assert_report> result;
+  result.reserve(reports.size());
+  for (auto const& report : reports) result.push_back(report.second);
+  return result;
+}
+
+void print_hot_asserts(char* out, int len, std::size_t max_sites) {
+  if (len <= 0) return;
+  out[0] = '\0';
+  for (auto const& site : hot_asserts(max_sites)) {
+    int ret = std::snprintf(out, std::size_t(len),
+                            "%" PRIu64 " failures: %s\n  at %s:%d in %s\n",
+                            site.hits, site.site->expression, site.site->file,
+                            site.site->line, site.site->function);
+    if (ret < 0 || ret >= len) break;
+    out += ret;
+    len -= ret;
+  }
 }
 
+// ---------------------------------------------------------------------------
+// Failures
+// ---------------------------------------------------------------------------
+
 // we deliberately don't want asserts to be marked as no-return, since that
 // would trigger warnings in debug builds of any code coming after the assert
 #ifdef __clang__
@@ -187,17 +411,11 @@ void assert_print(char const* fmt, ...) {
 #pragma clang diagnostic ignored "-Wmissing-noreturn"
 #endif
 
-void assert_fail(char const* expr, int line, char const* file,
-                 char const* function, char const* value, int kind) {
-#ifdef ASAP_PRODUCTION_ASSERTS
-  // no need to flood the assert log with infinite number of asserts
-  if (assert_counter.fetch_add(1) + 1 > 500) return;
-#endif
-
-  char stack[8192];
-  stack[0] = '\0';
-  print_backtrace(stack, sizeof(stack), 0);
+namespace {
 
+void report_failure(char const* expr, int line, char const* file,
+                    char const* function, char const* value, int kind,
+                    std::uint64_t hit) {
   char const* message =
       "Assertion failed. Please file a bugreport at "
       "https://github.com/xxxxxxxxxxx/issues\n";
@@ -209,11 +427,32 @@ void assert_fail(char const* expr, int line, char const* file,
           "This indicates a bug in the client application using asap\n";
   }
 
+#ifdef ASAP_PRODUCTION_ASSERTS
+  // Keep going, without the cost of a backtrace: the report has the raw
+  // frames, see recent_assert_reports()
   assert_print(
       "%s\n"
-#ifdef ASAP_PRODUCTION_ASSERTS
-      "#: %d\n"
+      "#: %" PRIu64 "\n"
+      "file: '%s'\n"
+      "line: %d\n"
+      "function: %s\n"
+      "expression: %s\n"
+      "%s%s\n",
+      message, hit, file, line, function, expr, value ? value : "",
+      value ? "\n" : "");
+#else
+  (void)hit;
+  char stack[8192];
+  stack[0] = '\0';
+#if ASAP_RAW_BACKTRACES
+  // Symbolized offline, by asap-symbolize
+  print_backtrace_raw(stack, sizeof(stack), 0);
+#else
+  print_backtrace(stack, sizeof(stack), 0);
 #endif
+
+  assert_print(
+      "%s\n"
       "file: '%s'\n"
       "line: %d\n"
       "function: %s\n"
@@ -221,16 +460,15 @@ void assert_fail(char const* expr, int line, char const* file,
       "%s%s\n"
       "stack:\n"
       "%s\n",
-      message
-#ifdef ASAP_PRODUCTION_ASSERTS
-      ,
-      assert_counter.load()
-#endif
-          ,
-      file, line, function, expr, value ? value : "", value ? "\n" : "", stack);
-
-  // if production asserts are defined, don't abort, just print the error
-#ifndef ASAP_PRODUCTION_ASSERTS
+      message, file, line, function, expr, value ? value : "",
+      value ? "\n" : "", stack);
+
+  // Tell what happened in the crash record, if a crash handler is installed
+  char crash_message[CrashHandler::MAX_MESSAGE_LENGTH + 1];
+  std::snprintf(crash_message, sizeof(crash_message),
+                "assertion failed: %s\nfile: '%s'\nline: %d\nfunction: %s\n%s",
+                expr, file, line, function, value ? value : "");
+  CrashHandler::SetCrashMessage(crash_message);
 #ifdef ASAP_WINDOWS
   // SIGINT doesn't trigger a break with msvc
   DebugBreak();
@@ -240,7 +478,26 @@ void assert_fail(char const* expr, int line, char const* file,
   ::raise(SIGABRT);
 #endif
   ::abort();
-#endif
+#endif  // ASAP_PRODUCTION_ASSERTS
+}
+
+}  // namespace
+
+void assert_fail(char const* expr, int line, char const* file,
+                 char const* function, char const* value, int kind) {
+  report_failure(expr, line, file, function, value, kind, 0);
+}
+
+void assert_fail(assert_site& site, std::uint64_t hit, char const* value) {
+  // The count of this failure, not the current one: other threads may have
+  // failed at the same site meanwhile
+  record_assert_report(site, hit, value);
+  report_failure(site.expression, site.line, site.file, site.function, value,
+                 site.kind, hit);
+}
+
+void assert_site_failed(assert_site& site) {
+  if (auto hit = assert_hit(site)) assert_fail(site, hit, nullptr);
 }
 
 #ifdef __clang__
@@ -256,6 +513,15 @@ ASAP_FORMAT(1, 2)
 void assert_print(char const*, ...) {}
 void assert_fail(char const*, int, char const*, char const*, char const*, int) {
 }
+std::uint64_t assert_hit(assert_site&) { return 0; }
+void assert_fail(assert_site&, std::uint64_t, char const*) {}
+void assert_site_failed(assert_site&) {}
+void record_assert_report(assert_site const&, std::uint64_t, char const*) {}
+std::vector<assert_site_hits> hot_asserts(std::size_t) { return {}; }
+std::vector<assert_report> recent_assert_reports() { return {}; }
+void print_hot_asserts(char* out, int len, std::size_t) {
+  if (len > 0) out[0] = '\0';
+}
 
 #endif
 
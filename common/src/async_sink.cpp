@@ -0,0 +1,292 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/async_sink.h>
+
+#include <chrono>  // for wait timeouts
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// Static members initialization
+// ---------------------------------------------------------------------------
+
+const std::size_t AsyncSink::DEFAULT_QUEUE_SIZE = 8192;
+constexpr std::size_t AsyncSink::PRODUCER_SLOTS;
+
+namespace {
+
+/// Upper bound on the time the drain thread sleeps when it missed a wake up.
+constexpr auto DRAIN_IDLE_TIMEOUT = std::chrono::milliseconds(50);
+/// Number of empty polls (with a yield) before the drain thread goes to sleep.
+constexpr int DRAIN_SPIN_COUNT = 64;
+
+/// Back off progressively while waiting for the drain thread.
+void Backoff(int &round) {
+  if (round < DRAIN_SPIN_COUNT) {
+    ++round;
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// AsyncSink
+// ---------------------------------------------------------------------------
+
+/*!
+ * Registers a log() call in the counter of the slot of its thread, until it
+ * has enqueued its message or seen stopped_. The counter of a slot is only
+ * modified by its threads, so the logging threads do not contend on it.
+ */
+class AsyncSink::ProducerGuard {
+ public:
+  explicit ProducerGuard(AsyncSink &sink)
+      : producers_(sink.producer_slots_[SlotIndex()].producers_) {
+    producers_.fetch_add(1);
+  }
+  ~ProducerGuard() { producers_.fetch_sub(1, std::memory_order_release); }
+  ProducerGuard(const ProducerGuard &) = delete;
+  ProducerGuard &operator=(const ProducerGuard &) = delete;
+
+ private:
+  /// The producer slot of the calling thread, the same in all the sinks.
+  static std::size_t SlotIndex() {
+    static std::atomic<std::size_t> next_slot{0};
+    thread_local std::size_t slot =
+        next_slot.fetch_add(1, std::memory_order_relaxed) % PRODUCER_SLOTS;
+    return slot;
+  }
+
+  std::atomic<std::size_t> &producers_;
+};
+
+AsyncSink::AsyncSink(spdlog::sink_ptr delegate, std::size_t queue_size,
+                     OverflowPolicy policy)
+    : queue_(queue_size), policy_(policy),
+      sink_delegate_(std::move(delegate)) {
+  worker_ = std::thread([this]() { Drain(); });
+  worker_id_ = worker_.get_id();
+}
+
+AsyncSink::~AsyncSink() { Stop(); }
+
+void AsyncSink::log(const spdlog::details::log_msg &msg) {
+  auto source = SourceLocation::Current();
+  auto deferred = DeferredMessage::Current();
+  {
+    // Registered before checking stopped_, and stopped_ is set before Stop()
+    // checks the producers (both sequentially consistent): either this call
+    // sees stopped_, or Stop() waits for its message.
+    ProducerGuard producer(*this);
+    if (!stopped_.load()) {
+      Enqueue(msg, source, deferred);
+      return;
+    }
+  }
+  std::lock_guard<std::mutex> lock(delegate_mutex_);
+  Dispatch(msg, source, deferred);
+}
+
+void AsyncSink::Enqueue(const spdlog::details::log_msg &msg,
+                        SourceLocation const *source,
+                        DeferredMessage const *deferred) {
+  // Assign() reuses the capacity already held by the slot
+  auto fill = [&msg, source, deferred](Record &record) {
+    record.Assign(msg, source, deferred);
+  };
+
+  int round = 0;
+  while (!queue_.TryPush(fill)) {
+    switch (policy_) {
+      case OverflowPolicy::DROP_NEWEST:
+        dropped_newest_.fetch_add(1, std::memory_order_relaxed);
+        WakeUp();
+        return;
+
+      case OverflowPolicy::DROP_OLDEST:
+        if (queue_.TryPop([](Record &) {})) {
+          dropped_oldest_.fetch_add(1, std::memory_order_relaxed);
+          processed_.fetch_add(1, std::memory_order_release);
+        }
+        break;
+
+      case OverflowPolicy::BLOCK:
+        WakeUp();
+        Backoff(round);
+        break;
+    }
+  }
+  WakeUp();
+}
+
+void AsyncSink::flush() {
+  // A delegate logging from the drain thread must not wait for itself
+  if (std::this_thread::get_id() != worker_id_ &&
+      !stopped_.load(std::memory_order_acquire)) {
+    auto ticket = queue_.PushCount();
+    int round = 0;
+    while (processed_.load(std::memory_order_acquire) < ticket &&
+           !stopped_.load(std::memory_order_acquire)) {
+      WakeUp();
+      Backoff(round);
+    }
+  }
+  std::lock_guard<std::mutex> lock(delegate_mutex_);
+  if (sink_delegate_) sink_delegate_->flush();
+}
+
+bool AsyncSink::FlushFromSignal(std::chrono::milliseconds timeout) {
+  // The drain thread cannot flush for itself, and is gone once stopped
+  if (std::this_thread::get_id() == worker_id_ ||
+      stopped_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  // Waking the drain thread up is not async-signal-safe: it finds the
+  // request when it polls the queue, at least every DRAIN_IDLE_TIMEOUT
+  auto request = flush_requests_.fetch_add(1, std::memory_order_release) + 1;
+  constexpr auto POLL_INTERVAL = std::chrono::milliseconds(1);
+  for (auto waited = std::chrono::milliseconds(0); waited < timeout;
+       waited += POLL_INTERVAL) {
+    if (flushes_done_.load(std::memory_order_acquire) >= request) return true;
+    std::this_thread::sleep_for(POLL_INTERVAL);
+  }
+  return flushes_done_.load(std::memory_order_acquire) >= request;
+}
+
+spdlog::sink_ptr AsyncSink::SwapSink(spdlog::sink_ptr sink) {
+  flush();
+  std::lock_guard<std::mutex> lock(delegate_mutex_);
+  auto tmp = sink_delegate_;
+  sink_delegate_ = std::move(sink);
+  return tmp;
+}
+
+void AsyncSink::Stop() {
+  std::lock_guard<std::mutex> stop_lock(stop_mutex_);
+  if (!worker_.joinable()) return;
+
+  stop_.store(true, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake_cv_.notify_one();
+  }
+  worker_.join();
+  stopped_.store(true);
+
+  // Deliver whatever was enqueued while the drain thread was terminating,
+  // and by the producers that did not see stopped_ yet. Draining while
+  // waiting for them makes room for the ones blocked on a full queue.
+  int round = 0;
+  for (auto const &slot : producer_slots_) {
+    while (slot.producers_.load() != 0) {
+      DispatchRemaining();
+      Backoff(round);
+    }
+  }
+  DispatchRemaining();
+  std::lock_guard<std::mutex> lock(delegate_mutex_);
+  if (sink_delegate_) sink_delegate_->flush();
+}
+
+void AsyncSink::DispatchRemaining() {
+  std::lock_guard<std::mutex> lock(delegate_mutex_);
+  spdlog::details::log_msg msg;
+  DeferredMessage deferred;
+  SourceLocation const *source = nullptr;
+  while (queue_.TryPop([&msg, &deferred, &source](Record &record) {
+    source = record.Extract(msg, deferred);
+  })) {
+    Dispatch(msg, source, deferred.Empty() ? nullptr : &deferred);
+    processed_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+void AsyncSink::WakeUp() {
+  // Pairs with the fence in Drain(): either the drain thread sees the new
+  // message before sleeping, or we see that it is sleeping.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake_cv_.notify_one();
+  }
+}
+
+void AsyncSink::Dispatch(const spdlog::details::log_msg &msg,
+                         SourceLocation const *source,
+                         DeferredMessage const *deferred) {
+  if (sink_delegate_ && sink_delegate_->should_log(msg.level)) {
+    SourceLocation::Scope scope(source);
+    DeferredMessage::Scope deferred_scope(deferred);
+    sink_delegate_->log(msg);
+  }
+}
+
+void AsyncSink::Drain() {
+  // A single log_msg is reused for all records to avoid allocations
+  spdlog::details::log_msg msg;
+  DeferredMessage deferred;
+  SourceLocation const *source = nullptr;
+  auto extract = [&msg, &deferred, &source](Record &record) {
+    source = record.Extract(msg, deferred);
+  };
+
+  int idle_rounds = 0;
+  for (;;) {
+    if (queue_.TryPop(extract)) {
+      {
+        std::lock_guard<std::mutex> lock(delegate_mutex_);
+        Dispatch(msg, source, deferred.Empty() ? nullptr : &deferred);
+      }
+      processed_.fetch_add(1, std::memory_order_release);
+      idle_rounds = 0;
+      continue;
+    }
+
+    // Flush requests are served once the queue is empty
+    auto requests = flush_requests_.load(std::memory_order_acquire);
+    if (requests != flushes_done_.load(std::memory_order_relaxed)) {
+      {
+        std::lock_guard<std::mutex> lock(delegate_mutex_);
+        if (sink_delegate_) sink_delegate_->flush();
+      }
+      flushes_done_.store(requests, std::memory_order_release);
+      continue;
+    }
+
+    if (stop_.load(std::memory_order_acquire)) {
+      // Keep draining until all published messages are processed
+      if (queue_.Empty()) break;
+      std::this_thread::yield();
+      continue;
+    }
+
+    if (idle_rounds < DRAIN_SPIN_COUNT) {
+      ++idle_rounds;
+      std::this_thread::yield();
+      continue;
+    }
+
+    sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_cv_.wait_for(lock, DRAIN_IDLE_TIMEOUT, [this]() {
+        return !queue_.Empty() || stop_.load(std::memory_order_acquire) ||
+               flush_requests_.load(std::memory_order_relaxed) !=
+                   flushes_done_.load(std::memory_order_relaxed);
+      });
+    }
+    sleeping_.store(false, std::memory_order_relaxed);
+    idle_rounds = 0;
+  }
+}
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,378 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/crash_handler.h>
+
+#include <cstring>  // for std::memcmp, std::strncpy
+#include <memory>   // for the stacks of the threads
+
+#include <common/config.h>
+#include <common/logging.h>
+
+#if !defined ASAP_WINDOWS
+#include <atomic>
+#include <cerrno>  // for errno
+#include <csignal>
+#include <ctime>  // for clock_gettime
+
+#include <fcntl.h>   // for open
+#include <unistd.h>  // for write, close
+
+#if ASAP_USE_EXECINFO
+#include <execinfo.h>
+#endif  // ASAP_USE_EXECINFO
+#if defined ASAP_LINUX
+#include <sys/syscall.h>  // for SYS_gettid
+#include <ucontext.h>     // for the interrupted instruction
+#endif  // ASAP_LINUX
+#endif  // !ASAP_WINDOWS
+
+namespace asap {
+
+// ---------------------------------------------------------------------------
+// Static members initialization
+// ---------------------------------------------------------------------------
+
+const std::chrono::milliseconds CrashHandler::DEFAULT_FLUSH_TIMEOUT(1000);
+constexpr std::size_t CrashHandler::MAX_MESSAGE_LENGTH;
+constexpr int CrashHandler::MAX_FRAMES;
+
+// ---------------------------------------------------------------------------
+// CrashRecord
+// ---------------------------------------------------------------------------
+
+namespace {
+
+template <typename T>
+bool ReadValue(std::istream &in, T &value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+}  // namespace
+
+bool CrashRecord::Read(std::istream &in, CrashRecord &record) {
+  crash_record::FileHeader header;
+  if (!ReadValue(in, header) ||
+      std::memcmp(header.magic, crash_record::MAGIC, sizeof(header.magic)) !=
+          0 ||
+      header.version != crash_record::VERSION) {
+    return false;
+  }
+
+  record = CrashRecord();
+  crash_record::SectionHeader section;
+  while (ReadValue(in, section)) {
+    std::string payload(section.size, '\0');
+    if (section.size > 0 && !in.read(&payload[0], section.size)) break;
+    switch (section.type) {
+      case crash_record::SectionType::SIGNAL:
+        if (payload.size() >= sizeof(record.signal)) {
+          std::memcpy(&record.signal, payload.data(), sizeof(record.signal));
+        }
+        break;
+      case crash_record::SectionType::FRAMES:
+        for (std::size_t offset = 0;
+             offset + sizeof(std::uint64_t) <= payload.size();
+             offset += sizeof(std::uint64_t)) {
+          std::uint64_t frame;
+          std::memcpy(&frame, payload.data() + offset, sizeof(frame));
+          record.frames.push_back(frame);
+        }
+        break;
+      case crash_record::SectionType::MAPS:
+        record.maps.append(payload);
+        break;
+      case crash_record::SectionType::INSTRUCTION:
+        if (payload.size() >= sizeof(record.instruction)) {
+          std::memcpy(&record.instruction, payload.data(),
+                      sizeof(record.instruction));
+        }
+        break;
+      case crash_record::SectionType::MESSAGE:
+        record.message.append(payload);
+        break;
+      case crash_record::SectionType::END:
+        record.complete = true;
+        return true;
+    }
+  }
+  return true;
+}
+
+#if !defined ASAP_WINDOWS
+
+// ---------------------------------------------------------------------------
+// CrashHandler
+// ---------------------------------------------------------------------------
+
+namespace {
+
+/// The signals recorded as crashes.
+constexpr int CRASH_SIGNALS[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+constexpr std::size_t CRASH_SIGNALS_COUNT =
+    sizeof(CRASH_SIGNALS) / sizeof(CRASH_SIGNALS[0]);
+
+/// Size of the alternate stack of the handler.
+constexpr std::size_t ALTERNATE_STACK_SIZE = 64 * 1024;
+/// Size of the chunks of /proc/self/maps copied to the record.
+constexpr std::size_t MAPS_CHUNK_SIZE = 4096;
+
+/// @name Preallocated state of the handler
+//@{
+std::string record_path;
+/// A file descriptor reserved at installation and released for the record,
+/// so that it can be opened even when the process ran out of descriptors.
+int spare_fd = -1;
+std::chrono::milliseconds flush_timeout;
+struct sigaction previous_actions[CRASH_SIGNALS_COUNT];
+bool installed = false;
+char alternate_stack[ALTERNATE_STACK_SIZE];
+void *frames[CrashHandler::MAX_FRAMES];
+std::uint64_t frame_values[CrashHandler::MAX_FRAMES];
+char maps_chunk[MAPS_CHUNK_SIZE];
+char crash_message[CrashHandler::MAX_MESSAGE_LENGTH + 1];
+/// Set by the first thread that crashes.
+std::atomic<bool> handling{false};
+//@}
+
+/// Write all the bytes, retrying on interruptions and partial writes.
+void WriteAll(int fd, const void *data, std::size_t size) {
+  auto const *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    auto written = ::write(fd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    bytes += written;
+    size -= static_cast<std::size_t>(written);
+  }
+}
+
+void WriteSection(int fd, crash_record::SectionType type, const void *data,
+                  std::size_t size) {
+  crash_record::SectionHeader header{type, static_cast<std::uint32_t>(size)};
+  WriteAll(fd, &header, sizeof(header));
+  WriteAll(fd, data, size);
+}
+
+/// Write a string on stderr.
+void WriteStderr(const char *text) {
+  WriteAll(STDERR_FILENO, text, std::strlen(text));
+}
+
+/// The instruction interrupted by a signal, nullptr if unknown.
+void *InterruptedInstruction(void *context) {
+#if defined ASAP_LINUX && defined __x86_64__
+  auto const &registers = static_cast<ucontext_t *>(context)->uc_mcontext;
+  return reinterpret_cast<void *>(registers.gregs[REG_RIP]);
+#elif defined ASAP_LINUX && defined __i386__
+  auto const &registers = static_cast<ucontext_t *>(context)->uc_mcontext;
+  return reinterpret_cast<void *>(registers.gregs[REG_EIP]);
+#elif defined ASAP_LINUX && defined __aarch64__
+  auto const &registers = static_cast<ucontext_t *>(context)->uc_mcontext;
+  return reinterpret_cast<void *>(registers.pc);
+#else
+  (void)context;
+  return nullptr;
+#endif
+}
+
+void HandleSignal(int signal, siginfo_t *info, void *context) {
+  // A second crashing thread waits for the first one to terminate the process
+  if (handling.exchange(true)) {
+    for (;;) ::pause();
+  }
+
+  if (spare_fd >= 0) {
+    ::close(spare_fd);
+    spare_fd = -1;
+  }
+  auto record_fd = ::open(record_path.c_str(),
+                          O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (record_fd >= 0) {
+    CrashHandler::WriteRecord(record_fd, signal, info->si_code, info->si_addr,
+                              InterruptedInstruction(context));
+    ::close(record_fd);
+    WriteStderr("*** crash recorded in ");
+    WriteStderr(record_path.c_str());
+    WriteStderr("\n");
+  }
+
+  // The messages logged before the crash are more valuable than ever
+  logging::Registry::FlushFromSignal(flush_timeout);
+
+  // Let the previous handler, or the default action, deal with the signal
+  // when this handler returns (faults) or right away (raised signals)
+  for (std::size_t index = 0; index < CRASH_SIGNALS_COUNT; ++index) {
+    if (CRASH_SIGNALS[index] == signal) {
+      ::sigaction(signal, &previous_actions[index], nullptr);
+    }
+  }
+  if (info->si_code <= 0) ::raise(signal);
+}
+
+}  // namespace
+
+void CrashHandler::WriteRecord(int fd, int signal, int code, void *address,
+                               void *instruction) {
+  crash_record::FileHeader header{};
+  std::memcpy(header.magic, crash_record::MAGIC, sizeof(header.magic));
+  header.version = crash_record::VERSION;
+  header.pointer_size = sizeof(void *);
+  WriteAll(fd, &header, sizeof(header));
+
+  crash_record::SignalInfo signal_info{};
+  signal_info.signal = signal;
+  signal_info.code = code;
+  signal_info.address = reinterpret_cast<std::uintptr_t>(address);
+  signal_info.pid = ::getpid();
+#if defined ASAP_LINUX
+  signal_info.tid = ::syscall(SYS_gettid);
+#endif  // ASAP_LINUX
+  struct timespec now {};
+  ::clock_gettime(CLOCK_REALTIME, &now);
+  signal_info.time_sec = now.tv_sec;
+  signal_info.time_nsec = now.tv_nsec;
+  WriteSection(fd, crash_record::SectionType::SIGNAL, &signal_info,
+               sizeof(signal_info));
+
+  auto message_length = std::strlen(crash_message);
+  if (message_length > 0) {
+    WriteSection(fd, crash_record::SectionType::MESSAGE, crash_message,
+                 message_length);
+  }
+
+#if ASAP_USE_EXECINFO
+  auto count = ::backtrace(frames, MAX_FRAMES);
+  for (auto index = 0; index < count; ++index) {
+    frame_values[index] = reinterpret_cast<std::uintptr_t>(frames[index]);
+  }
+  WriteSection(fd, crash_record::SectionType::FRAMES, frame_values,
+               static_cast<std::size_t>(count) * sizeof(std::uint64_t));
+#endif  // ASAP_USE_EXECINFO
+  if (instruction != nullptr) {
+    std::uint64_t instruction_value =
+        reinterpret_cast<std::uintptr_t>(instruction);
+    WriteSection(fd, crash_record::SectionType::INSTRUCTION,
+                 &instruction_value, sizeof(instruction_value));
+  }
+
+  auto maps_fd = ::open("/proc/self/maps", O_RDONLY);
+  if (maps_fd >= 0) {
+    for (;;) {
+      auto size = ::read(maps_fd, maps_chunk, sizeof(maps_chunk));
+      if (size < 0 && errno == EINTR) continue;
+      if (size <= 0) break;
+      WriteSection(fd, crash_record::SectionType::MAPS, maps_chunk,
+                   static_cast<std::size_t>(size));
+    }
+    ::close(maps_fd);
+  }
+
+  WriteSection(fd, crash_record::SectionType::END, nullptr, 0);
+}
+
+bool CrashHandler::Install(const std::string &path,
+                           std::chrono::milliseconds timeout) {
+  Uninstall();
+
+  // The file is created by the handler; only check that it can be
+  auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+  if (fd < 0) return false;
+  ::close(fd);
+  ::unlink(path.c_str());
+  spare_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (spare_fd < 0) return false;
+  record_path = path;
+  flush_timeout = timeout;
+
+#if ASAP_USE_EXECINFO
+  // The first call loads the unwinder, which allocates
+  ::backtrace(frames, MAX_FRAMES);
+#endif  // ASAP_USE_EXECINFO
+
+  stack_t stack{};
+  stack.ss_sp = alternate_stack;
+  stack.ss_size = sizeof(alternate_stack);
+  ::sigaltstack(&stack, nullptr);
+
+  struct sigaction action {};
+  action.sa_sigaction = &HandleSignal;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  for (std::size_t index = 0; index < CRASH_SIGNALS_COUNT; ++index) {
+    ::sigaction(CRASH_SIGNALS[index], &action, &previous_actions[index]);
+  }
+  installed = true;
+  return true;
+}
+
+void CrashHandler::Uninstall() {
+  if (!installed) return;
+  for (std::size_t index = 0; index < CRASH_SIGNALS_COUNT; ++index) {
+    ::sigaction(CRASH_SIGNALS[index], &previous_actions[index], nullptr);
+  }
+  installed = false;
+  ::close(spare_fd);
+  spare_fd = -1;
+}
+
+namespace {
+/// The alternate stack of a thread, released when the thread exits.
+class ThreadStack {
+ public:
+  bool Install() {
+    if (memory_) return true;
+    std::unique_ptr<char[]> memory(new char[ALTERNATE_STACK_SIZE]);
+    stack_t stack{};
+    stack.ss_sp = memory.get();
+    stack.ss_size = ALTERNATE_STACK_SIZE;
+    if (::sigaltstack(&stack, nullptr) != 0) return false;
+    memory_ = std::move(memory);
+    return true;
+  }
+
+  ~ThreadStack() {
+    if (!memory_) return;
+    stack_t stack{};
+    stack.ss_flags = SS_DISABLE;
+    ::sigaltstack(&stack, nullptr);
+  }
+
+ private:
+  std::unique_ptr<char[]> memory_;
+};
+}  // namespace
+
+bool CrashHandler::InstallThreadStack() {
+  thread_local ThreadStack stack;
+  return stack.Install();
+}
+
+void CrashHandler::SetCrashMessage(char const *message) {
+  std::strncpy(crash_message, message, MAX_MESSAGE_LENGTH);
+  crash_message[MAX_MESSAGE_LENGTH] = '\0';
+}
+
+#else  // !ASAP_WINDOWS
+
+bool CrashHandler::Install(const std::string &, std::chrono::milliseconds) {
+  return false;
+}
+
+void CrashHandler::Uninstall() {}
+
+bool CrashHandler::InstallThreadStack() { return false; }
+
+void CrashHandler::SetCrashMessage(char const *) {}
+
+void CrashHandler::WriteRecord(int, int, int, void *, void *) {}
+
+#endif  // !ASAP_WINDOWS
+
+}  // namespace asap
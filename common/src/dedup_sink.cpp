@@ -0,0 +1,165 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/dedup_sink.h>
+
+#include <cstring>  // for std::memcmp
+
+#include <spdlog/formatter.h>
+
+#include <common/logging.h>
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// Static members initialization
+// ---------------------------------------------------------------------------
+
+const std::chrono::milliseconds DedupSink::DEFAULT_MAX_DELAY(5000);
+
+// ---------------------------------------------------------------------------
+// DedupSink
+// ---------------------------------------------------------------------------
+
+namespace {
+/// Logger name of the reports made when the sink is destroyed, as the loggers
+/// using the sink may be gone by then. Never destroyed, as the reports keep
+/// it by address.
+const std::string *NoLoggerName() {
+  static auto const *name = new std::string();
+  return name;
+}
+}  // namespace
+
+DedupSink::DedupSink(spdlog::sink_ptr delegate,
+                     std::chrono::milliseconds max_delay)
+    : delegate_(std::move(delegate)), max_delay_(max_delay) {
+  worker_ = std::thread(&DedupSink::Work, this);
+}
+
+DedupSink::~DedupSink() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  worker_.join();
+
+  RepeatsReport report;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    report = TakeRepeats(spdlog::log_clock::now());
+  }
+  report.logger_ = NoLoggerName();
+  try {
+    Deliver(report);
+  } catch (const std::exception &) {
+    // Nothing to report the error to
+  }
+}
+
+bool DedupSink::IsRepeat(const spdlog::details::log_msg &msg,
+                         SourceLocation const *source) const {
+  return has_last_ && msg.level == last_level_ && source == last_source_ &&
+         msg.logger_name == last_logger_ &&
+         msg.raw.size() == last_text_.size() &&
+         std::memcmp(msg.raw.data(), last_text_.data(), last_text_.size()) ==
+             0;
+}
+
+void DedupSink::log(const spdlog::details::log_msg &msg) {
+  auto const *source = SourceLocation::Current();
+  RepeatsReport report;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (IsRepeat(msg, source)) {
+      collapsed_.fetch_add(1, std::memory_order_relaxed);
+      last_thread_id_ = msg.thread_id;
+      // The background thread reports the run once it is old enough
+      if (repeats_++ == 0) {
+        run_start_ = msg.time;
+        wake_.notify_one();
+      }
+      return;
+    }
+    report = TakeRepeats(msg.time);
+    has_last_ = true;
+    last_logger_ = msg.logger_name;
+    last_level_ = msg.level;
+    last_thread_id_ = msg.thread_id;
+    last_source_ = source;
+    last_text_.assign(msg.raw.data(), msg.raw.size());
+  }
+
+  Deliver(report);
+  if (delegate_->should_log(msg.level)) delegate_->log(msg);
+}
+
+void DedupSink::flush() {
+  RepeatsReport report;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    report = TakeRepeats(spdlog::log_clock::now());
+  }
+  Deliver(report);
+  delegate_->flush();
+}
+
+DedupSink::RepeatsReport DedupSink::TakeRepeats(
+    spdlog::log_clock::time_point time) {
+  RepeatsReport report;
+  report.repeats_ = repeats_;
+  report.logger_ = last_logger_;
+  report.level_ = last_level_;
+  report.thread_id_ = last_thread_id_;
+  report.time_ = time;
+  repeats_ = 0;
+  return report;
+}
+
+void DedupSink::Work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    if (repeats_ == 0) {
+      wake_.wait(lock);
+      continue;
+    }
+    auto now = spdlog::log_clock::now();
+    auto deadline = run_start_ + max_delay_;
+    if (now < deadline) {
+      wake_.wait_for(lock, deadline - now);
+      continue;
+    }
+
+    auto report = TakeRepeats(now);
+    lock.unlock();
+    try {
+      Deliver(report);
+    } catch (const std::exception &) {
+      // Nothing to report the error to, the next report may do better
+    }
+    lock.lock();
+  }
+}
+
+void DedupSink::Deliver(const RepeatsReport &report) {
+  if (report.repeats_ == 0 || !delegate_->should_log(report.level_)) return;
+
+  spdlog::details::log_msg message;
+  message.logger_name = report.logger_;
+  message.level = report.level_;
+  message.time = report.time_;
+  message.thread_id = report.thread_id_;
+  message.raw << "last message repeated " << report.repeats_
+              << (report.repeats_ == 1 ? " time" : " times");
+  Registry::Formatter()->format(message);
+  // The report has no location prefix
+  SourceLocation::Scope source_scope(nullptr);
+  delegate_->log(message);
+}
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,31 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/deferred_format.h>
+
+#include <exception>  // for std::exception
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// DeferredMessage
+// ---------------------------------------------------------------------------
+
+void DeferredMessage::Write(spdlog::details::log_msg &msg) const {
+  msg.raw.clear();
+  if (write_ == nullptr) return;
+  try {
+    write_(msg, format_, args_.data());
+  } catch (const std::exception &ex) {
+    // Reported like spdlog does when formatting fails in the logger
+    msg.raw.clear();
+    msg.raw << "[*** LOG ERROR ***] " << ex.what() << " (format: " << format_
+            << ")";
+  }
+}
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,276 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/journal.h>
+
+#include <algorithm>  // for std::upper_bound
+#include <chrono>     // for time conversions
+#include <cstring>    // for std::memcpy, std::strlen
+#include <fstream>    // for creating and extending the file
+#include <stdexcept>  // for std::runtime_error
+
+#include <common/source_location.h>
+
+namespace asap {
+namespace logging {
+
+namespace bip = boost::interprocess;
+
+// ---------------------------------------------------------------------------
+// Static members initialization
+// ---------------------------------------------------------------------------
+
+const std::size_t JournalSink::DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
+namespace {
+
+std::int64_t ToNanoseconds(spdlog::log_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+/// Create the journal file with its header area.
+void CreateJournalFile(const std::string &path, std::size_t block_size) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  journal::FileHeader header{};
+  std::memcpy(header.magic_, journal::FILE_MAGIC, sizeof(header.magic_));
+  header.version_ = journal::VERSION;
+  header.block_size_ = static_cast<std::uint32_t>(block_size);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.seekp(static_cast<std::streamoff>(journal::HEADER_AREA_SIZE - 1));
+  file.put('\0');
+  if (!file) throw std::runtime_error("could not create journal " + path);
+}
+
+/// Extend the file to the given size.
+void ExtendFile(const std::string &path, std::size_t size) {
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(static_cast<std::streamoff>(size - 1));
+  file.put('\0');
+  if (!file) throw std::runtime_error("could not extend journal " + path);
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// JournalSink
+// ---------------------------------------------------------------------------
+
+JournalSink::JournalSink(std::string path, std::size_t block_size)
+    : path_(std::move(path)) {
+  auto granularity = journal::HEADER_AREA_SIZE;
+  block_size_ = std::max<std::size_t>(
+      (block_size + granularity - 1) / granularity * granularity, granularity);
+  CreateJournalFile(path_, block_size_);
+  try {
+    mapping_ = bip::file_mapping(path_.c_str(), bip::read_write);
+    StartBlock();
+  } catch (bip::interprocess_exception const &ex) {
+    throw std::runtime_error("could not map journal " + path_ + ": " +
+                             ex.what());
+  }
+}
+
+JournalSink::~JournalSink() {
+  if (region_) region_->flush(0, 0, false);
+}
+
+void JournalSink::StartBlock() {
+  auto offset = journal::HEADER_AREA_SIZE + block_count_ * block_size_;
+  ExtendFile(path_, offset + block_size_);
+  region_.reset(new bip::mapped_region(mapping_, bip::read_write,
+                                       static_cast<bip::offset_t>(offset),
+                                       block_size_));
+  ++block_count_;
+
+  auto *block = Block();
+  block->magic_ = journal::BLOCK_MAGIC;
+  block->record_count_ = 0;
+  block->heap_start_ = static_cast<std::uint32_t>(block_size_);
+  block->reserved_ = 0;
+  block->first_record_ = record_count_;
+  block->first_time_ = 0;
+  block->last_time_ = 0;
+  interned_loggers_.clear();
+  interned_sources_.clear();
+}
+
+std::size_t JournalSink::FreeSpace() const {
+  auto *block = Block();
+  auto records_end = sizeof(journal::BlockHeader) +
+                     (block->record_count_ + 1) * sizeof(journal::Record);
+  return block->heap_start_ > records_end ? block->heap_start_ - records_end
+                                          : 0;
+}
+
+std::uint32_t JournalSink::HeapAlloc(std::size_t size) {
+  auto *block = Block();
+  block->heap_start_ -= static_cast<std::uint32_t>(size);
+  return block->heap_start_;
+}
+
+template <typename Key>
+std::size_t JournalSink::InternCost(
+    const char *str, const std::unordered_map<Key, std::uint32_t> &interned,
+    const Key &key) {
+  if (str == nullptr || interned.count(key) != 0) return 0;
+  return std::strlen(str) + 1;
+}
+
+template <typename Key>
+std::uint32_t JournalSink::Intern(
+    const char *str, std::unordered_map<Key, std::uint32_t> &interned,
+    const Key &key) {
+  if (str == nullptr) return journal::NO_STRING;
+  auto found = interned.find(key);
+  if (found != interned.end()) return found->second;
+  auto size = std::strlen(str) + 1;
+  auto offset = HeapAlloc(size);
+  std::memcpy(static_cast<char *>(region_->get_address()) + offset, str, size);
+  interned.emplace(key, offset);
+  return offset;
+}
+
+void JournalSink::_sink_it(const spdlog::details::log_msg &msg) {
+  auto const *source = SourceLocation::Current();
+  auto skip = source ? source->PrefixLength() : 0;
+  if (skip > msg.raw.size()) skip = 0;
+  auto const *message = msg.raw.data() + skip;
+  auto message_size = msg.raw.size() - skip;
+
+  auto const *file = source ? source->File() : nullptr;
+  auto const *function = source ? source->Function() : nullptr;
+  auto needed = [&]() {
+    return message_size +
+           InternCost(msg.logger_name->c_str(), interned_loggers_,
+                      *msg.logger_name) +
+           InternCost(file, interned_sources_, file) +
+           InternCost(function, interned_sources_, function);
+  };
+  if (needed() > FreeSpace()) {
+    StartBlock();
+    if (needed() > FreeSpace()) {
+      auto overhead = needed() - message_size;
+      message_size = FreeSpace() > overhead ? FreeSpace() - overhead : 0;
+    }
+  }
+
+  journal::Record record{};
+  record.time_ = ToNanoseconds(msg.time);
+  record.thread_id_ = msg.thread_id;
+  record.level_ = static_cast<std::uint32_t>(msg.level);
+  record.logger_ =
+      Intern(msg.logger_name->c_str(), interned_loggers_, *msg.logger_name);
+  record.file_ = Intern(file, interned_sources_, file);
+  record.function_ = Intern(function, interned_sources_, function);
+  record.line_ = source ? source->Line() : 0;
+  record.message_ = HeapAlloc(message_size);
+  record.message_size_ = static_cast<std::uint32_t>(message_size);
+
+  auto *base = static_cast<char *>(region_->get_address());
+  if (message_size > 0) {
+    std::memcpy(base + record.message_, message, message_size);
+  }
+  auto *block = Block();
+  std::memcpy(base + sizeof(journal::BlockHeader) +
+                  block->record_count_ * sizeof(journal::Record),
+              &record, sizeof(record));
+  if (block->record_count_ == 0) block->first_time_ = record.time_;
+  block->last_time_ = record.time_;
+  // Publish the record only once it is complete
+  ++block->record_count_;
+  ++record_count_;
+}
+
+void JournalSink::_flush() { region_->flush(); }
+
+// ---------------------------------------------------------------------------
+// JournalReader
+// ---------------------------------------------------------------------------
+
+JournalReader::JournalReader(const std::string &path) {
+  try {
+    mapping_ = bip::file_mapping(path.c_str(), bip::read_only);
+    region_ = bip::mapped_region(mapping_, bip::read_only);
+  } catch (bip::interprocess_exception const &ex) {
+    throw std::runtime_error("could not map journal " + path + ": " +
+                             ex.what());
+  }
+  base_ = static_cast<const char *>(region_.get_address());
+  auto file_size = region_.get_size();
+
+  journal::FileHeader header{};
+  if (file_size < journal::HEADER_AREA_SIZE) {
+    throw std::runtime_error(path + " is not a journal");
+  }
+  std::memcpy(&header, base_, sizeof(header));
+  if (std::memcmp(header.magic_, journal::FILE_MAGIC, sizeof(header.magic_)) !=
+      0) {
+    throw std::runtime_error(path + " is not a journal");
+  }
+  if (header.version_ != journal::VERSION) {
+    throw std::runtime_error(path + " has an unsupported journal version");
+  }
+  block_size_ = header.block_size_;
+  if (block_size_ < sizeof(journal::BlockHeader) + sizeof(journal::Record)) {
+    throw std::runtime_error(path + " has an invalid block size");
+  }
+
+  // Index the blocks, stopping at the first one that is not consistent (e.g.
+  // the file was being extended when the writer crashed)
+  auto blocks = (file_size - journal::HEADER_AREA_SIZE) / block_size_;
+  for (std::size_t ii = 0; ii < blocks; ++ii) {
+    auto const *block =
+        reinterpret_cast<const journal::BlockHeader *>(BlockAt(ii));
+    auto records_end = sizeof(journal::BlockHeader) +
+                       std::size_t{block->record_count_} *
+                           sizeof(journal::Record);
+    if (block->magic_ != journal::BLOCK_MAGIC ||
+        block->first_record_ != size_ || block->heap_start_ > block_size_ ||
+        records_end > block->heap_start_) {
+      break;
+    }
+    block_first_.push_back(size_);
+    size_ += block->record_count_;
+  }
+}
+
+JournalReader::Entry JournalReader::At(std::size_t index) const {
+  auto found =
+      std::upper_bound(block_first_.begin(), block_first_.end(), index);
+  auto block_index = static_cast<std::size_t>(found - block_first_.begin()) - 1;
+  auto const *block = BlockAt(block_index);
+  auto const *record = reinterpret_cast<const journal::Record *>(
+      block + sizeof(journal::BlockHeader) +
+      (index - block_first_[block_index]) * sizeof(journal::Record));
+
+  auto str = [this, block](std::uint32_t offset) -> const char * {
+    return offset < block_size_ ? block + offset : nullptr;
+  };
+
+  Entry entry;
+  entry.time = spdlog::log_clock::time_point(
+      std::chrono::duration_cast<spdlog::log_clock::duration>(
+          std::chrono::nanoseconds(record->time_)));
+  entry.thread_id = static_cast<std::size_t>(record->thread_id_);
+  entry.level = static_cast<spdlog::level::level_enum>(record->level_);
+  entry.logger = str(record->logger_);
+  if (entry.logger == nullptr) entry.logger = "";
+  entry.file = str(record->file_);
+  entry.line = record->line_;
+  entry.function = str(record->function_);
+  if (std::size_t{record->message_} + record->message_size_ <= block_size_) {
+    entry.message = block + record->message_;
+    entry.message_size = record->message_size_;
+  } else {
+    entry.message = "";
+    entry.message_size = 0;
+  }
+  return entry;
+}
+
+}  // namespace logging
+}  // namespace asap
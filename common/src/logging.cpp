@@ -5,8 +5,12 @@
 
 #include <common/logging.h>
 
-#include <iomanip>  // std::setw
-#include <sstream>  // std::ostringstream
+#include <algorithm>   // for std::find_if
+#include <functional>  // for std::hash
+#include <memory>      // for std::unique_ptr, std::atomic_load
+#include <stdexcept>   // for std::runtime_error
+
+#include <spdlog/formatter.h>
 
 #include <common/assert.h>
 
@@ -23,8 +27,24 @@ const char *Logger::DEFAULT_LOG_FORMAT =
 
 // Synchronization mutex for sinks
 std::mutex Registry::sinks_mutex_;
-// Synchronization mutex for the loggers collection.
-std::recursive_mutex Registry::loggers_mutex_;
+// Synchronization mutex for loggers
+std::mutex Registry::loggers_mutex_;
+// Level of the loggers registered from now on
+spdlog::level::level_enum Registry::log_level_ = spdlog::level::trace;
+// Global sequence of the messages, while thread buffering is enabled
+std::atomic<bool> Registry::defer_formatting_{false};
+std::atomic<bool> Registry::sequence_messages_{false};
+std::atomic<std::uint64_t> Registry::message_sequence_{0};
+// Maximum number of loggers (ODR definition)
+constexpr std::size_t Registry::MAX_LOGGERS;
+// Reader slots of the fan out sinks (ODR definition)
+constexpr std::size_t FanOutSink::READER_SLOTS;
+// Fixed branches of the Registry sinks (ODR definition)
+constexpr FanOutSink::BranchId Registry::CURRENT_BRANCH;
+constexpr FanOutSink::BranchId Registry::ROOT_BRANCH;
+// Width of the file path in log prefixes (ODR definition)
+constexpr std::size_t SourceLocationPrefix::FILE_MAX_LENGTH;
+constexpr std::size_t SourceLocationPrefix::LINE_MAX_DIGITS;
 
 // ---------------------------------------------------------------------------
 // Helpers for dealing with Logger Id
@@ -52,34 +72,285 @@ inline constexpr const char *LoggerName(Id id) {
   return "__INVALID__";
 }
 
+/*!
+ * @brief Index of the registered loggers by address of their name, to find
+ * the logger of a log message in constant time.
+ *
+ * An open addressing hash table that is only ever inserted into, under the
+ * Registry lock, and read without locking: the handle index of an entry is
+ * written before its key is published.
+ */
+class LoggerNameIndex {
+ public:
+  /// Add the name of a logger. Called with the Registry lock held.
+  void Insert(const std::string *name, std::size_t index) {
+    for (auto slot = Slot(name);; slot = (slot + 1) % SLOTS) {
+      if (keys_[slot].load(std::memory_order_relaxed) == nullptr) {
+        indexes_[slot] = index;
+        keys_[slot].store(name, std::memory_order_release);
+        return;
+      }
+    }
+  }
+
+  /// Find the handle index of the logger with this name, by address.
+  bool Find(const std::string *name, std::size_t &index) const {
+    for (auto slot = Slot(name);; slot = (slot + 1) % SLOTS) {
+      auto const *key = keys_[slot].load(std::memory_order_acquire);
+      if (key == nullptr) return false;
+      if (key == name) {
+        index = indexes_[slot];
+        return true;
+      }
+    }
+  }
+
+ private:
+  /// Never more than half full, so that probing stays short and always ends.
+  static constexpr std::size_t SLOTS = 2 * Registry::MAX_LOGGERS;
+
+  static std::size_t Slot(const std::string *name) {
+    // Low bits of the address are the same for all the names
+    return (std::hash<const std::string *>()(name) >> 4) % SLOTS;
+  }
+
+  std::array<std::atomic<const std::string *>, SLOTS> keys_{};
+  std::array<std::size_t, SLOTS> indexes_{};
+};
+
+constexpr std::size_t LoggerNameIndex::SLOTS;
+
+LoggerNameIndex &NameIndex() {
+  static auto *index = new LoggerNameIndex();
+  return *index;
+}
+
+/// The asynchronous logging backend, for FlushFromSignal() which cannot use
+/// the locked Registry state.
+std::atomic<AsyncSink *> signal_async_sink{nullptr};
+
+/// The pattern formatter shared by all the loggers, also used to format the
+/// messages whose formatting was deferred. Accessed with std::atomic_load()
+/// and std::atomic_store().
+spdlog::formatter_ptr &LogFormatter() {
+  static spdlog::formatter_ptr formatter =
+      std::make_shared<spdlog::pattern_formatter>(Logger::DEFAULT_LOG_FORMAT);
+  return formatter;
+}
+
+/// The spdlog logger of the registered loggers, which gives the messages
+/// their id before spdlog formats them.
+class RegisteredLogger : public spdlog::logger {
+ public:
+  using spdlog::logger::logger;
+
+ protected:
+  void _sink_it(spdlog::details::log_msg &msg) override {
+    Registry::AssignMessageId(msg);
+    // Formats the message; spdlog only numbers the messages itself when
+    // built with SPDLOG_ENABLE_MESSAGE_COUNTER, which is not the case
+    spdlog::logger::_sink_it(msg);
+  }
+};
+
 }  // namespace
 
+// ---------------------------------------------------------------------------
+// FanOutSink
+// ---------------------------------------------------------------------------
+
+/*!
+ * Readers register in the counter of the current epoch, in the slot of their
+ * thread, before loading the branch list. A modification publishes the new
+ * list, then flips the epoch and waits for the readers of the previous epoch
+ * in all the slots: any reader that may still use the previous list is one
+ * of them. The counters of a slot are only modified by its threads, so the
+ * logging threads do not contend on them.
+ */
+class FanOutSink::ReadGuard {
+ public:
+  explicit ReadGuard(FanOutSink &sink)
+      : sink_(sink), slot_(sink.reader_slots_[SlotIndex()]) {
+    for (;;) {
+      epoch_ = sink_.epoch_.load() & 1;
+      slot_.readers_[epoch_].fetch_add(1);
+      // Registered in time if the epoch did not change meanwhile
+      if ((sink_.epoch_.load() & 1) == epoch_) break;
+      slot_.readers_[epoch_].fetch_sub(1);
+    }
+  }
+  ~ReadGuard() { slot_.readers_[epoch_].fetch_sub(1); }
+  ReadGuard(const ReadGuard &) = delete;
+  ReadGuard &operator=(const ReadGuard &) = delete;
+
+ private:
+  /// The reader slot of the calling thread, the same in all the sinks.
+  static std::size_t SlotIndex() {
+    static std::atomic<std::size_t> next_slot{0};
+    thread_local std::size_t slot =
+        next_slot.fetch_add(1, std::memory_order_relaxed) % READER_SLOTS;
+    return slot;
+  }
+
+  FanOutSink &sink_;
+  ReaderSlot &slot_;
+  unsigned epoch_;
+};
+
+FanOutSink::FanOutSink(bool format_deferred)
+    : branches_(new BranchList()), format_deferred_(format_deferred) {}
+
+FanOutSink::~FanOutSink() { delete branches_.load(); }
+
+FanOutSink::BranchList *FanOutSink::CopyBranches() const {
+  return new BranchList(*branches_.load());
+}
+
+void FanOutSink::Publish(BranchList *branches) {
+  std::unique_ptr<BranchList> previous(branches_.exchange(branches));
+  auto epoch = epoch_.fetch_add(1) & 1;
+  for (auto const &slot : reader_slots_) {
+    while (slot.readers_[epoch].load() != 0) std::this_thread::yield();
+  }
+  // previous (and the sinks only referenced by it) is released here
+}
+
+FanOutSink::BranchId FanOutSink::AddSink(spdlog::sink_ptr sink,
+                                         spdlog::level::level_enum level,
+                                         const LoggerIds &ids) {
+  std::lock_guard<std::mutex> lock(modify_mutex_);
+  auto branch_id = next_branch_id_++;
+  Branch branch{branch_id, std::move(sink), level, {}, ids.empty()};
+  for (auto handle : ids) {
+    if (handle.Index() >= branch.ids_.size()) {
+      branch.ids_.resize(handle.Index() + 1);
+    }
+    branch.ids_[handle.Index()] = true;
+  }
+  auto *branches = CopyBranches();
+  branches->push_back(std::move(branch));
+  Publish(branches);
+  return branch_id;
+}
+
+spdlog::sink_ptr FanOutSink::RemoveSink(BranchId branch) {
+  std::lock_guard<std::mutex> lock(modify_mutex_);
+  auto *branches = CopyBranches();
+  auto found = std::find_if(
+      branches->begin(), branches->end(),
+      [branch](const Branch &candidate) { return candidate.id_ == branch; });
+  if (found == branches->end()) {
+    delete branches;
+    return nullptr;
+  }
+  auto sink = found->sink_;
+  branches->erase(found);
+  Publish(branches);
+  return sink;
+}
+
+spdlog::sink_ptr FanOutSink::SwapSink(BranchId branch, spdlog::sink_ptr sink) {
+  std::lock_guard<std::mutex> lock(modify_mutex_);
+  auto *branches = CopyBranches();
+  for (auto &candidate : *branches) {
+    if (candidate.id_ == branch) {
+      std::swap(candidate.sink_, sink);
+      Publish(branches);
+      return sink;
+    }
+  }
+  delete branches;
+  return nullptr;
+}
+
+void FanOutSink::SetBranchLevel(BranchId branch,
+                                spdlog::level::level_enum level) {
+  std::lock_guard<std::mutex> lock(modify_mutex_);
+  auto *branches = CopyBranches();
+  for (auto &candidate : *branches) {
+    if (candidate.id_ == branch) candidate.level_ = level;
+  }
+  Publish(branches);
+}
+
+spdlog::sink_ptr FanOutSink::Sink(BranchId branch) const {
+  std::lock_guard<std::mutex> lock(modify_mutex_);
+  for (auto const &candidate : *branches_.load()) {
+    if (candidate.id_ == branch) return candidate.sink_;
+  }
+  return nullptr;
+}
+
+void FanOutSink::log(const spdlog::details::log_msg &msg) {
+  auto const *deferred = DeferredMessage::Current();
+  if (deferred == nullptr || !format_deferred_) {
+    Dispatch(msg);
+    return;
+  }
+
+  // The branch sinks need the text of the message
+  spdlog::details::log_msg formatted;
+  formatted.logger_name = msg.logger_name;
+  formatted.level = msg.level;
+  formatted.time = msg.time;
+  formatted.thread_id = msg.thread_id;
+  formatted.msg_id = msg.msg_id;
+  deferred->Write(formatted);
+  std::atomic_load(&LogFormatter())->format(formatted);
+  DeferredMessage::Scope scope(nullptr);
+  Dispatch(formatted);
+}
+
+void FanOutSink::Dispatch(const spdlog::details::log_msg &msg) {
+  ReadGuard guard(*this);
+  std::size_t index = 0;
+  auto registered = false;
+  auto index_known = false;
+  for (auto const &branch : *branches_.load()) {
+    if (msg.level < branch.level_) continue;
+    if (!branch.all_ids_) {
+      // Only look the logger up when a branch needs it. Unlike
+      // Registry::FindLogger(), an unknown address is not searched by name,
+      // which would take the Registry lock for every message.
+      if (!index_known) {
+        registered = msg.logger_name != nullptr &&
+                     NameIndex().Find(msg.logger_name, index);
+        index_known = true;
+      }
+      if (!registered || index >= branch.ids_.size() || !branch.ids_[index]) {
+        continue;
+      }
+    }
+    branch.sink_->log(msg);
+  }
+}
+
+void FanOutSink::flush() {
+  ReadGuard guard(*this);
+  for (auto const &branch : *branches_.load()) branch.sink_->flush();
+}
+
 // ---------------------------------------------------------------------------
 // Logger
 // ---------------------------------------------------------------------------
 
-Logger::Logger(std::string name, logging::Id id, spdlog::sink_ptr sink) : id_(id) {
-  logger_ = std::make_shared<spdlog::logger>(name, sink);
-  logger_->set_pattern(DEFAULT_LOG_FORMAT);
+Logger::Logger(std::string name, LoggerHandle handle, spdlog::sink_ptr sink)
+    : handle_(handle) {
+  logger_ = std::make_shared<RegisteredLogger>(name, sink);
+  logger_->set_formatter(std::atomic_load(&LogFormatter()));
   logger_->set_level(spdlog::level::trace);
   // Ensure that critical errors, especially ASSERT/PANIC, get flushed
   logger_->flush_on(spdlog::level::critical);
 }
 
-spdlog::logger &Registry::GetLogger(Id id) {
-  std::lock_guard<std::recursive_mutex> lock(loggers_mutex_);
-  return *(Loggers()[static_cast<int>(id)].logger_);
-}
-
 // ---------------------------------------------------------------------------
 // Registry
 // ---------------------------------------------------------------------------
 
 void Registry::PushSink(spdlog::sink_ptr sink) {
   std::lock_guard<std::mutex> lock(sinks_mutex_);
-  auto &sinks = Sinks();
   // Push the current sink on the stack and use the new one
-  sinks.emplace(delegating_sink()->SwapSink(sink));
+  Sinks().emplace(fan_out_sink()->SwapSink(CURRENT_BRANCH, std::move(sink)));
 }
 
 void Registry::PopSink() {
@@ -89,21 +360,122 @@ void Registry::PopSink() {
       !sinks.empty() &&
       "call to PopSink() not matching a previous call to PushSink()");
   if (!sinks.empty()) {
-    auto &sink = sinks.top();
-    // Assign this previous sink to the delegating sink
-    delegating_sink()->SwapSink(sink);
+    // Make the previous sink the current one again
+    fan_out_sink()->SwapSink(CURRENT_BRANCH, sinks.top());
     sinks.pop();
   }
 }
 
+FanOutSink::BranchId Registry::AddSink(spdlog::sink_ptr sink,
+                                       spdlog::level::level_enum level,
+                                       const FanOutSink::LoggerIds &ids) {
+  return fan_out_sink()->AddSink(std::move(sink), level, ids);
+}
+
+void Registry::RemoveSink(FanOutSink::BranchId branch) {
+  ASAP_ASSERT(branch != CURRENT_BRANCH &&
+              "the current sink is only changed with PushSink()/PopSink()");
+  if (branch == CURRENT_BRANCH) return;
+  auto sink = fan_out_sink()->RemoveSink(branch);
+  if (sink) sink->flush();
+}
+
+void Registry::SetSinkLevel(FanOutSink::BranchId branch,
+                            spdlog::level::level_enum level) {
+  fan_out_sink()->SetBranchLevel(branch, level);
+}
+
+void Registry::EnableAsync(std::size_t queue_size,
+                           AsyncSink::OverflowPolicy policy) {
+  std::lock_guard<std::mutex> lock(sinks_mutex_);
+  auto &async = async_sink();
+  if (async) return;
+  // Put the async sink right in front of the fan out sink
+  async = std::make_shared<AsyncSink>(fan_out_sink(), queue_size, policy);
+  signal_async_sink.store(async.get());
+  defer_formatting_.store(true, std::memory_order_relaxed);
+  auto &buffer = thread_buffer_sink();
+  if (buffer) {
+    buffer->SwapSink(async);
+  } else {
+    root_sink()->SwapSink(ROOT_BRANCH, async);
+  }
+}
+
+void Registry::DisableAsync() {
+  std::lock_guard<std::mutex> lock(sinks_mutex_);
+  auto &async = async_sink();
+  if (!async) return;
+  signal_async_sink.store(nullptr);
+  defer_formatting_.store(false, std::memory_order_relaxed);
+  // Once stopped, the async sink logs synchronously to its delegate, so the
+  // order of messages is preserved while we unplug it.
+  async->Stop();
+  auto &buffer = thread_buffer_sink();
+  if (buffer) {
+    buffer->SwapSink(fan_out_sink());
+  } else {
+    root_sink()->SwapSink(ROOT_BRANCH, fan_out_sink());
+  }
+  async.reset();
+}
+
+std::shared_ptr<AsyncSink> Registry::AsyncBackend() {
+  std::lock_guard<std::mutex> lock(sinks_mutex_);
+  return async_sink();
+}
+
+bool Registry::FlushFromSignal(std::chrono::milliseconds timeout) {
+  auto *async = signal_async_sink.load();
+  return async == nullptr || async->FlushFromSignal(timeout);
+}
+
+void Registry::EnableThreadBuffering(std::size_t batch_size,
+                                     std::chrono::milliseconds max_delay) {
+  std::lock_guard<std::mutex> lock(sinks_mutex_);
+  auto &buffer = thread_buffer_sink();
+  if (buffer) return;
+  // Put the buffering sink first, it hands batches over to the rest. Errors
+  // are handed over right away, so that they survive a crash
+  buffer = std::make_shared<ThreadBufferSink>(root_sink()->Sink(ROOT_BRANCH),
+                                              batch_size, max_delay,
+                                              spdlog::level::err);
+  sequence_messages_.store(true, std::memory_order_relaxed);
+  root_sink()->SwapSink(ROOT_BRANCH, buffer);
+}
+
+void Registry::DisableThreadBuffering() {
+  std::lock_guard<std::mutex> lock(sinks_mutex_);
+  auto &buffer = thread_buffer_sink();
+  if (!buffer) return;
+  // Messages logged meanwhile go either to a batch that Stop() hands over,
+  // or directly to the rest of the sinks
+  root_sink()->SwapSink(ROOT_BRANCH, buffer->Delegate());
+  sequence_messages_.store(false, std::memory_order_relaxed);
+  buffer->Stop();
+  buffer.reset();
+}
+
+std::shared_ptr<ThreadBufferSink> &Registry::thread_buffer_sink() {
+  static std::shared_ptr<ThreadBufferSink> sink;
+  return sink;
+}
+
+std::shared_ptr<AsyncSink> &Registry::async_sink() {
+  static std::shared_ptr<AsyncSink> sink;
+  return sink;
+}
+
 std::stack<spdlog::sink_ptr> &Registry::Sinks() {
   static std::stack<spdlog::sink_ptr> sinks;
   return sinks;
 }
 
 void Registry::SetLogLevel(spdlog::level::level_enum log_level) {
-  std::lock_guard<std::recursive_mutex> lock(loggers_mutex_);
-  auto &loggers = Loggers();
+  LoggerTable();  // the predefined loggers are registered
+  std::lock_guard<std::mutex> lock(loggers_mutex_);
+  log_level_ = log_level;
+  auto &loggers = all_loggers_();
   std::for_each(loggers.begin(), loggers.end(), [log_level](Logger &log) {
     // Thread safe
     log.Level(log_level);
@@ -111,36 +483,112 @@ void Registry::SetLogLevel(spdlog::level::level_enum log_level) {
 }
 
 void Registry::SetLogFormat(const std::string &log_format) {
-  std::lock_guard<std::recursive_mutex> lock(loggers_mutex_);
-  auto &loggers = Loggers();
-  std::for_each(loggers.begin(), loggers.end(), [log_format](Logger &log) {
+  spdlog::formatter_ptr formatter =
+      std::make_shared<spdlog::pattern_formatter>(log_format);
+  LoggerTable();  // the predefined loggers are registered
+  // Loggers registered meanwhile would get the previous formatter
+  std::lock_guard<std::mutex> lock(loggers_mutex_);
+  auto &loggers = all_loggers_();
+  std::for_each(loggers.begin(), loggers.end(), [&formatter](Logger &log) {
     // Not thread safe
     std::lock_guard<std::mutex> log_lock(*log.logger_mutex_.get());
-    log.logger_->set_pattern(log_format);
+    log.logger_->set_formatter(formatter);
   });
+  std::atomic_store(&LogFormatter(), formatter);
 }
 
-std::vector<Logger> &Registry::Loggers() {
-  static auto &all_loggers_static = all_loggers_();
-  return all_loggers_static;
+LoggerHandle Registry::RegisterLogger(const std::string &name) {
+  auto &table = LoggerTable();
+  std::lock_guard<std::mutex> lock(loggers_mutex_);
+  for (auto const &log : all_loggers_()) {
+    if (log.Name() == name) return log.Handle();
+  }
+  return AddLogger(table, name);
 }
 
-std::vector<Logger> &Registry::all_loggers_() {
-  static auto *all_loggers = new std::vector<Logger>();
-  for (auto id = Id::MISC; id < Id::INVALID_; ++id) {
-    auto name = LoggerName(id);
-    all_loggers->emplace_back(Logger(name, id, delegating_sink()));
+bool Registry::FindLogger(const std::string &name, LoggerHandle &handle) {
+  LoggerTable();  // the predefined loggers are registered
+  std::size_t index;
+  if (NameIndex().Find(&name, index)) {
+    handle = LoggerHandle(index);
+    return true;
   }
+  std::lock_guard<std::mutex> lock(loggers_mutex_);
+  for (auto const &log : all_loggers_()) {
+    if (log.Name() == name) {
+      handle = log.Handle();
+      return true;
+    }
+  }
+  return false;
+}
+
+spdlog::formatter_ptr Registry::Formatter() {
+  return std::atomic_load(&LogFormatter());
+}
+
+std::vector<Logger *> Registry::Loggers() {
+  LoggerTable();  // the predefined loggers are registered
+  std::lock_guard<std::mutex> lock(loggers_mutex_);
+  std::vector<Logger *> loggers;
+  for (auto &log : all_loggers_()) loggers.push_back(&log);
+  return loggers;
+}
+
+std::deque<Logger> &Registry::all_loggers_() {
+  static auto *all_loggers = new std::deque<Logger>();
   return *all_loggers;
 }
 
-std::shared_ptr<DelegatingSink> &Registry::delegating_sink() {
-  static auto sink_static = std::shared_ptr<DelegatingSink>(delegating_sink_());
+LoggerHandle Registry::AddLogger(logger_table_type &table,
+                                 const std::string &name) {
+  auto &loggers = all_loggers_();
+  if (loggers.size() == MAX_LOGGERS) {
+    throw std::runtime_error("too many loggers, cannot register '" + name +
+                             "'");
+  }
+  LoggerHandle handle(loggers.size());
+  loggers.emplace_back(Logger(name, handle, root_sink()));
+  auto &log = loggers.back();
+  log.Level(log_level_);
+  NameIndex().Insert(&log.Name(), handle.Index());
+  table[handle.Index()].store(log.logger_.get(), std::memory_order_release);
+  return handle;
+}
+
+Registry::logger_table_type &Registry::logger_table_() {
+  static auto *table = new logger_table_type();
+  std::lock_guard<std::mutex> lock(loggers_mutex_);
+  for (auto id = Id::MISC; id < Id::INVALID_; ++id) {
+    auto handle = AddLogger(*table, LoggerName(id));
+    ASAP_ASSERT(handle == LoggerHandle(id));
+    (void)handle;
+  }
+  return *table;
+}
+
+std::shared_ptr<FanOutSink> &Registry::root_sink() {
+  static auto sink_static = std::shared_ptr<FanOutSink>(root_sink_());
   return sink_static;
 }
 
-DelegatingSink *Registry::delegating_sink_() {
-  // Add a default console sink
+FanOutSink *Registry::root_sink_() {
+  // Deferred messages are formatted by the fan out sink, after the
+  // asynchronous and thread buffering sinks
+  static auto *sink = new FanOutSink(false);
+  auto branch = sink->AddSink(fan_out_sink());
+  ASAP_ASSERT(branch == ROOT_BRANCH);
+  (void)branch;
+  return sink;
+}
+
+std::shared_ptr<FanOutSink> &Registry::fan_out_sink() {
+  static auto sink_static = std::shared_ptr<FanOutSink>(fan_out_sink_());
+  return sink_static;
+}
+
+FanOutSink *Registry::fan_out_sink_() {
+  // Add a default console sink, as the current sink
 #if defined _WIN32 && !defined(__cplusplus_winrt)
   auto default_sink =
       std::make_shared<spdlog::sinks::wincolor_stdout_sink_mt>();
@@ -149,27 +597,12 @@ DelegatingSink *Registry::delegating_sink_() {
       std::make_shared<spdlog::sinks::ansicolor_stdout_sink_mt>();
 #endif
 
-  static auto *sink = new DelegatingSink(default_sink);
+  static auto *sink = new FanOutSink();
+  auto branch = sink->AddSink(default_sink);
+  ASAP_ASSERT(branch == CURRENT_BRANCH);
+  (void)branch;
   return sink;
 }
 
-
-// ---------------------------------------------------------------------------
-// Helper for file name and line number formatting
-// ---------------------------------------------------------------------------
-
-std::string FormatFileAndLine(char const *file, char const *line) {
-  constexpr static int FILE_MAX_LENGTH = 70;
-  std::ostringstream ostr;
-  std::string fstr(file);
-  if (fstr.length() > FILE_MAX_LENGTH) {
-    fstr = fstr.substr(0, 7).append("...").append(fstr.substr(
-        fstr.length() - FILE_MAX_LENGTH + 10, FILE_MAX_LENGTH - 10));
-  }
-  ostr << "[" << std::setw(FILE_MAX_LENGTH) << std::right << fstr << ":"
-       << std::setw(5) << std::setfill('0') << std::right << line << "] ";
-  return ostr.str();
-}
-
 }  // namespace logging
 }  // namespace asap
@@ -0,0 +1,185 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/profiler.h>
+
+#include <algorithm>  // for std::max
+#include <chrono>     // for the profiler clock
+#include <memory>     // for std::unique_ptr
+#include <mutex>      // for the buffers registry
+
+namespace asap {
+
+// ---------------------------------------------------------------------------
+// Static members initialization
+// ---------------------------------------------------------------------------
+
+const std::size_t Profiler::ZONES_PER_THREAD = 4096;
+std::atomic<bool> Profiler::enabled_{false};
+
+// ---------------------------------------------------------------------------
+// ThreadBuffer
+// ---------------------------------------------------------------------------
+
+/*!
+ * @brief The ring buffer of the zones of a thread.
+ *
+ * Only the owning thread writes, and the snapshots read concurrently, as with
+ * a seqlock: the writer announces the zone it is about to overwrite in
+ * started_ before writing the slot, and publishes it in written_ after. A
+ * reader copies the published slots, then discards the ones that may have
+ * been overwritten meanwhile. The fields of the slots are atomics, accessed
+ * with relaxed operations, which are plain loads and stores on most
+ * platforms.
+ */
+class Profiler::ThreadBuffer {
+ public:
+  explicit ThreadBuffer(std::size_t index)
+      : name_("thread " + std::to_string(index)),
+        index_(index),
+        slots_(new Slot[ZONES_PER_THREAD]) {}
+
+  void Record(const char *name, std::int64_t begin, std::int64_t end,
+              int depth) {
+    // Only this thread modifies the counters
+    auto count = written_.load(std::memory_order_relaxed);
+    started_.store(count + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto &slot = slots_[count % ZONES_PER_THREAD];
+    slot.name_.store(name, std::memory_order_relaxed);
+    slot.begin_.store(begin, std::memory_order_relaxed);
+    slot.end_.store(end, std::memory_order_relaxed);
+    slot.depth_.store(depth, std::memory_order_relaxed);
+    written_.store(count + 1, std::memory_order_release);
+  }
+
+  /// Copy the recorded zones, oldest first. Can be called from any thread.
+  void CopyTo(std::vector<ProfileZone> &zones) const {
+    auto end = written_.load(std::memory_order_acquire);
+    auto first = std::max(cleared_.load(std::memory_order_relaxed),
+                          end > ZONES_PER_THREAD ? end - ZONES_PER_THREAD
+                                                 : std::uint64_t{0});
+    if (first >= end) return;
+    std::vector<ProfileZone> copied;
+    copied.reserve(end - first);
+    for (auto ii = first; ii < end; ++ii) {
+      auto const &slot = slots_[ii % ZONES_PER_THREAD];
+      copied.push_back({slot.name_.load(std::memory_order_relaxed),
+                        slot.begin_.load(std::memory_order_relaxed),
+                        slot.end_.load(std::memory_order_relaxed),
+                        slot.depth_.load(std::memory_order_relaxed)});
+    }
+    // Zones overwritten by the writer while they were copied are dropped
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto started = started_.load(std::memory_order_relaxed);
+    auto valid_first =
+        started > ZONES_PER_THREAD ? started - ZONES_PER_THREAD : 0;
+    auto skip = valid_first > first ? valid_first - first : 0;
+    if (skip >= copied.size()) return;
+    zones.insert(zones.end(), copied.begin() + static_cast<long>(skip),
+                 copied.end());
+  }
+
+  /// Forget the zones recorded so far. Can be called from any thread.
+  void Clear() {
+    cleared_.store(written_.load(std::memory_order_acquire),
+                   std::memory_order_relaxed);
+  }
+
+  std::size_t Index() const { return index_; }
+
+  /// Guarded by the registry mutex.
+  std::string name_;
+
+ private:
+  struct Slot {
+    std::atomic<const char *> name_{nullptr};
+    std::atomic<std::int64_t> begin_{0};
+    std::atomic<std::int64_t> end_{0};
+    std::atomic<int> depth_{0};
+  };
+
+  std::size_t index_;
+  std::unique_ptr<Slot[]> slots_;
+  /// Number of zones the writer started to write.
+  std::atomic<std::uint64_t> started_{0};
+  /// Number of zones written.
+  std::atomic<std::uint64_t> written_{0};
+  /// Number of zones written when last cleared.
+  std::atomic<std::uint64_t> cleared_{0};
+};
+
+// ---------------------------------------------------------------------------
+// Profiler
+// ---------------------------------------------------------------------------
+
+struct Profiler::Registry {
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+};
+
+namespace {
+/// Number of zones the calling thread is in.
+thread_local int zone_depth = 0;
+}  // namespace
+
+Profiler::Registry &Profiler::Buffers() {
+  // Never destroyed, as threads may still record zones while the program
+  // exits
+  static auto *registry = new Registry();
+  return *registry;
+}
+
+Profiler::ThreadBuffer &Profiler::CurrentThreadBuffer() {
+  thread_local ThreadBuffer *buffer = nullptr;
+  if (buffer == nullptr) {
+    auto &registry = Buffers();
+    std::lock_guard<std::mutex> lock(registry.mutex_);
+    registry.buffers_.emplace_back(
+        new ThreadBuffer(registry.buffers_.size()));
+    buffer = registry.buffers_.back().get();
+  }
+  return *buffer;
+}
+
+std::int64_t Profiler::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Profiler::SetThreadName(std::string name) {
+  auto &buffer = CurrentThreadBuffer();
+  std::lock_guard<std::mutex> lock(Buffers().mutex_);
+  buffer.name_ = std::move(name);
+}
+
+std::vector<ThreadProfile> Profiler::Snapshot() {
+  auto &registry = Buffers();
+  std::lock_guard<std::mutex> lock(registry.mutex_);
+  std::vector<ThreadProfile> profiles;
+  profiles.reserve(registry.buffers_.size());
+  for (auto const &buffer : registry.buffers_) {
+    profiles.push_back({buffer->Index(), buffer->name_, {}});
+    buffer->CopyTo(profiles.back().zones);
+  }
+  return profiles;
+}
+
+void Profiler::Clear() {
+  auto &registry = Buffers();
+  std::lock_guard<std::mutex> lock(registry.mutex_);
+  for (auto &buffer : registry.buffers_) buffer->Clear();
+}
+
+int Profiler::EnterZone() { return zone_depth++; }
+
+void Profiler::LeaveZone(const char *name, std::int64_t begin, int depth) {
+  auto end = Now();
+  zone_depth = depth;
+  CurrentThreadBuffer().Record(name, begin, end, depth);
+}
+
+}  // namespace asap
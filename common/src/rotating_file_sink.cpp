@@ -0,0 +1,258 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/rotating_file_sink.h>
+
+#include <algorithm>  // for std::count, std::max, std::min
+#include <cerrno>     // for errno
+#include <cstring>    // for std::strerror
+#include <stdexcept>  // for std::runtime_error
+
+#if ASAP_HAVE_ZLIB
+#include <zlib.h>
+#endif  // ASAP_HAVE_ZLIB
+
+namespace asap {
+namespace logging {
+
+namespace {
+
+/// Extension added to the compressed archives.
+const char *const COMPRESSED_EXTENSION = ".gz";
+
+/// Split a path in its part before the extension and its extension.
+void SplitExtension(const std::string &path, std::string &stem,
+                    std::string &extension) {
+  auto dot = path.find_last_of('.');
+  auto separator = path.find_last_of("/\\");
+  if (dot == std::string::npos ||
+      (separator != std::string::npos && dot < separator)) {
+    stem = path;
+    extension.clear();
+  } else {
+    stem = path.substr(0, dot);
+    extension = path.substr(dot);
+  }
+}
+
+#if ASAP_HAVE_ZLIB
+/// Compress a file with gzip, return false if anything failed.
+bool CompressFile(const std::string &source, const std::string &target) {
+  auto *input = std::fopen(source.c_str(), "rb");
+  if (input == nullptr) return false;
+  auto output = gzopen(target.c_str(), "wb6");
+  if (output == nullptr) {
+    std::fclose(input);
+    return false;
+  }
+  std::vector<char> chunk(64 * 1024);
+  auto ok = true;
+  std::size_t read;
+  while (ok && (read = std::fread(chunk.data(), 1, chunk.size(), input)) > 0) {
+    ok = gzwrite(output, chunk.data(), static_cast<unsigned>(read)) ==
+         static_cast<int>(read);
+  }
+  ok = !std::ferror(input) && ok;
+  std::fclose(input);
+  ok = gzclose(output) == Z_OK && ok;
+  if (!ok) std::remove(target.c_str());
+  return ok;
+}
+#endif  // ASAP_HAVE_ZLIB
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// RotatingFileSink
+// ---------------------------------------------------------------------------
+
+RotatingFileSink::RotatingFileSink(Options options)
+    : options_(std::move(options)),
+      compress_(options_.compress && CompressionSupported()) {
+  buffer_.reserve(options_.buffer_size);
+  if (!OpenFile()) {
+    throw std::runtime_error("could not open log file " + options_.path +
+                             ": " + std::strerror(errno));
+  }
+  worker_ = std::thread(&RotatingFileSink::Work, this);
+}
+
+RotatingFileSink::~RotatingFileSink() {
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_one();
+  worker_.join();
+
+  WriteBuffer();
+  if (file_ != nullptr) std::fclose(file_);
+}
+
+bool RotatingFileSink::CompressionSupported() {
+#if ASAP_HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif  // ASAP_HAVE_ZLIB
+}
+
+std::string RotatingFileSink::ArchivePath(std::size_t index) const {
+  return ArchivePath(index, compress_);
+}
+
+std::string RotatingFileSink::ArchivePath(std::size_t index,
+                                          bool compressed) const {
+  std::string stem;
+  std::string extension;
+  SplitExtension(options_.path, stem, extension);
+  auto path = stem + "." + std::to_string(index) + extension;
+  if (compressed) path += COMPRESSED_EXTENSION;
+  return path;
+}
+
+void RotatingFileSink::WaitForArchives() {
+  std::unique_lock<std::mutex> lock(work_mutex_);
+  archived_cv_.wait(lock,
+                    [this]() { return segments_.empty() && !archiving_; });
+}
+
+bool RotatingFileSink::OpenFile() {
+  file_start_ = spdlog::log_clock::now();
+  file_size_ = 0;
+  file_ = std::fopen(options_.path.c_str(), "ab");
+  if (file_ == nullptr) return false;
+  // Writes are already batched in buffer_
+  std::setvbuf(file_, nullptr, _IONBF, 0);
+  std::fseek(file_, 0, SEEK_END);
+  auto size = std::ftell(file_);
+  file_size_ = size > 0 ? static_cast<std::size_t>(size) : 0;
+  return true;
+}
+
+void RotatingFileSink::WriteBuffer() {
+  if (buffer_.empty()) return;
+  // Retry opening the file if it could not be opened when rotating, rather
+  // than let the buffer grow
+  if (file_ == nullptr && !OpenFile()) {
+    dropped_.fetch_add(buffered_, std::memory_order_relaxed);
+  } else {
+    auto written = std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    if (written < buffer_.size()) {
+      // Drop the messages not completely written, they end with an eol
+      std::size_t lost = std::count(buffer_.begin() + written, buffer_.end(),
+                                    spdlog::details::os::default_eol[0]);
+      dropped_.fetch_add(std::max<std::size_t>(lost, 1),
+                         std::memory_order_relaxed);
+      file_size_ -= std::min(file_size_, buffer_.size() - written);
+      std::clearerr(file_);
+    }
+  }
+  buffer_.clear();
+  buffered_ = 0;
+}
+
+void RotatingFileSink::_sink_it(const spdlog::details::log_msg &msg) {
+  auto size = msg.formatted.size();
+  if (file_size_ > 0) {
+    auto too_big = file_size_ + size > options_.max_size;
+    auto too_old = options_.max_age.count() > 0 &&
+                   msg.time - file_start_ >= options_.max_age;
+    if (too_big || too_old) Rotate();
+  }
+
+  if (buffer_.size() + size > options_.buffer_size) WriteBuffer();
+  buffer_.insert(buffer_.end(), msg.formatted.data(),
+                 msg.formatted.data() + size);
+  ++buffered_;
+  file_size_ += size;
+  if (msg.level >= options_.write_through_level) WriteBuffer();
+}
+
+void RotatingFileSink::_flush() { WriteBuffer(); }
+
+void RotatingFileSink::Rotate() {
+  WriteBuffer();
+  // No file to rotate since the last rotation failed to open one
+  if (file_ == nullptr) {
+    OpenFile();
+    return;
+  }
+  std::fclose(file_);
+  file_ = nullptr;
+
+  // Only rename the file here, the archive is made in the background
+  std::string stem;
+  std::string extension;
+  SplitExtension(options_.path, stem, extension);
+  auto segment = stem + ".pending-" + std::to_string(++rotations_) + extension;
+  if (std::rename(options_.path.c_str(), segment.c_str()) == 0) {
+    {
+      std::lock_guard<std::mutex> lock(work_mutex_);
+      segments_.push_back(std::move(segment));
+    }
+    work_cv_.notify_one();
+  }
+  OpenFile();
+}
+
+void RotatingFileSink::Work() {
+  std::unique_lock<std::mutex> lock(work_mutex_);
+  auto has_work = [this]() { return stop_ || !segments_.empty(); };
+  for (;;) {
+    if (segments_.empty()) {
+      if (stop_) break;
+      if (options_.flush_interval.count() > 0) {
+        if (!work_cv_.wait_for(lock, options_.flush_interval, has_work)) {
+          lock.unlock();
+          flush();
+          lock.lock();
+        }
+      } else {
+        work_cv_.wait(lock, has_work);
+      }
+      continue;
+    }
+
+    auto segment = std::move(segments_.front());
+    segments_.pop_front();
+    archiving_ = true;
+    lock.unlock();
+    Archive(segment);
+    lock.lock();
+    archiving_ = false;
+    archived_cv_.notify_all();
+  }
+}
+
+void RotatingFileSink::Archive(const std::string &segment) {
+  if (options_.max_files == 0) {
+    std::remove(segment.c_str());
+    return;
+  }
+
+  // Make room for the new archive. An archive is kept uncompressed when its
+  // compression failed, so both forms are shifted and pruned
+  for (auto compressed : {false, compress_}) {
+    std::remove(ArchivePath(options_.max_files, compressed).c_str());
+    for (auto index = options_.max_files - 1; index > 0; --index) {
+      std::rename(ArchivePath(index, compressed).c_str(),
+                  ArchivePath(index + 1, compressed).c_str());
+    }
+    if (!compress_) break;
+  }
+
+#if ASAP_HAVE_ZLIB
+  if (compress_ && CompressFile(segment, ArchivePath(1, true))) {
+    std::remove(segment.c_str());
+    return;
+  }
+#endif  // ASAP_HAVE_ZLIB
+  // Not compressed, or the compression failed: keep the file as is
+  std::rename(segment.c_str(), ArchivePath(1, false).c_str());
+}
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,837 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/symbolizer.h>
+
+#include <algorithm>  // for std::sort, std::upper_bound
+#include <cinttypes>  // for SCNx64
+#include <cstdio>     // for std::sscanf, std::rename
+#include <fstream>    // for the cache file
+#include <sstream>    // for reading the maps
+#include <stdexcept>  // for std::runtime_error
+
+#include <boost/core/demangle.hpp>
+
+#include <common/config.h>
+
+#if defined ASAP_LINUX
+#include <cstring>  // for std::memcmp, std::memcpy
+
+#include <elf.h>
+#include <fcntl.h>     // for open
+#include <sys/mman.h>  // for mmap
+#include <sys/stat.h>  // for stat
+#include <unistd.h>    // for close
+#endif                 // ASAP_LINUX
+
+namespace asap {
+
+// ---------------------------------------------------------------------------
+// ModuleMap
+// ---------------------------------------------------------------------------
+
+namespace {
+
+/// The rest of a line after a position, without its line ending.
+std::string RestOfLine(const std::string &line, int position) {
+  auto rest = line.substr(static_cast<std::size_t>(position));
+  auto end = rest.find_last_not_of("\r\n");
+  rest.erase(end == std::string::npos ? 0 : end + 1);
+  return rest;
+}
+
+}  // namespace
+
+void ModuleMap::Add(Mapping mapping) {
+  mappings_.push_back(std::move(mapping));
+}
+
+void ModuleMap::AddProcMaps(const std::string &maps) {
+  std::istringstream lines(maps);
+  std::string line;
+  while (std::getline(lines, line)) {
+    // start-end perms offset dev inode path
+    Mapping mapping;
+    char perms[5] = {};
+    int path_position = 0;
+    if (std::sscanf(line.c_str(),
+                    "%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %*s %*s %n",
+                    &mapping.start, &mapping.end, perms, &mapping.offset,
+                    &path_position) < 4 ||
+        path_position == 0) {
+      continue;
+    }
+    mapping.path = RestOfLine(line, path_position);
+    // Only code from module files has frames to symbolize
+    if (perms[2] != 'x' || mapping.path.empty() || mapping.path[0] != '/') {
+      continue;
+    }
+    Add(std::move(mapping));
+  }
+}
+
+bool ModuleMap::AddModuleLine(const std::string &line) {
+  Mapping mapping;
+  int path_position = 0;
+  if (std::sscanf(line.c_str(),
+                  " module %" SCNx64 "-%" SCNx64 " %" SCNx64 " %n",
+                  &mapping.start, &mapping.end, &mapping.offset,
+                  &path_position) < 3 ||
+      path_position == 0) {
+    return false;
+  }
+  mapping.path = RestOfLine(line, path_position);
+  Add(std::move(mapping));
+  return true;
+}
+
+ModuleMap::Mapping const *ModuleMap::Find(std::uint64_t address) const {
+  for (auto const &mapping : mappings_) {
+    if (address >= mapping.start && address < mapping.end) return &mapping;
+  }
+  return nullptr;
+}
+
+bool ParseFrameLine(const std::string &line, int &index,
+                    std::uint64_t &address) {
+  return std::sscanf(line.c_str(), " frame %d %" SCNx64, &index, &address) ==
+         2;
+}
+
+// ---------------------------------------------------------------------------
+// Symbolizer::Module
+// ---------------------------------------------------------------------------
+
+#if defined ASAP_LINUX
+
+namespace {
+
+/// @name DWARF constants used by the line tables
+//@{
+constexpr std::uint8_t DW_LNS_copy = 1;
+constexpr std::uint8_t DW_LNS_advance_pc = 2;
+constexpr std::uint8_t DW_LNS_advance_line = 3;
+constexpr std::uint8_t DW_LNS_set_file = 4;
+constexpr std::uint8_t DW_LNS_const_add_pc = 8;
+constexpr std::uint8_t DW_LNS_fixed_advance_pc = 9;
+constexpr std::uint8_t DW_LNE_end_sequence = 1;
+constexpr std::uint8_t DW_LNE_set_address = 2;
+constexpr std::uint8_t DW_LNE_define_file = 3;
+constexpr std::uint64_t DW_LNCT_path = 1;
+constexpr std::uint64_t DW_LNCT_directory_index = 2;
+constexpr std::uint64_t DW_FORM_block = 0x09;
+constexpr std::uint64_t DW_FORM_data1 = 0x0b;
+constexpr std::uint64_t DW_FORM_data2 = 0x05;
+constexpr std::uint64_t DW_FORM_data4 = 0x06;
+constexpr std::uint64_t DW_FORM_data8 = 0x07;
+constexpr std::uint64_t DW_FORM_data16 = 0x1e;
+constexpr std::uint64_t DW_FORM_line_strp = 0x1f;
+constexpr std::uint64_t DW_FORM_string = 0x08;
+constexpr std::uint64_t DW_FORM_strp = 0x0e;
+constexpr std::uint64_t DW_FORM_udata = 0x0f;
+//@}
+
+/// Bytes of a section.
+struct Section {
+  std::uint8_t const *data;
+  std::size_t size;
+};
+
+/*!
+ * @brief Reads values from a section, in the byte order of the machine.
+ *
+ * Reading past the end reads zeros and clears ok.
+ */
+class Reader {
+ public:
+  explicit Reader(Section section)
+      : position_(section.data), end_(section.data + section.size) {}
+
+  std::size_t Remaining() const {
+    return static_cast<std::size_t>(end_ - position_);
+  }
+  bool Ok() const { return ok_; }
+
+  /// A reader of the next bytes, which are skipped.
+  Reader Sub(std::size_t size) {
+    Section section{position_, 0};
+    if (Skip(size)) section.size = size;
+    return Reader(section);
+  }
+
+  bool Skip(std::size_t size) {
+    if (size > Remaining()) {
+      ok_ = false;
+      position_ = end_;
+      return false;
+    }
+    position_ += size;
+    return true;
+  }
+
+  template <typename T>
+  T Read() {
+    T value{};
+    auto const *position = position_;
+    if (Skip(sizeof(T))) std::memcpy(&value, position, sizeof(T));
+    return value;
+  }
+
+  std::uint64_t Offset(bool dwarf64) {
+    return dwarf64 ? Read<std::uint64_t>() : Read<std::uint32_t>();
+  }
+
+  std::uint64_t Uleb() {
+    std::uint64_t value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      auto byte = Read<std::uint8_t>();
+      if (shift < 64) value |= std::uint64_t(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0 || !ok_) return value;
+    }
+  }
+
+  std::int64_t Sleb() {
+    std::int64_t value = 0;
+    unsigned shift = 0;
+    std::uint8_t byte;
+    do {
+      byte = Read<std::uint8_t>();
+      if (shift < 64) value |= std::int64_t(byte & 0x7f) << shift;
+      shift += 7;
+    } while ((byte & 0x80) != 0 && ok_);
+    if (shift < 64 && (byte & 0x40) != 0) value |= -(std::int64_t(1) << shift);
+    return value;
+  }
+
+  /// A null terminated string, empty if there is none.
+  std::string String() {
+    auto const *start = position_;
+    while (position_ < end_ && *position_ != 0) ++position_;
+    if (position_ == end_) {
+      ok_ = false;
+      return std::string();
+    }
+    std::string text(reinterpret_cast<char const *>(start),
+                     static_cast<std::size_t>(position_ - start));
+    ++position_;
+    return text;
+  }
+
+ private:
+  std::uint8_t const *position_;
+  std::uint8_t const *end_;
+  bool ok_{true};
+};
+
+/// The null terminated string at an offset of a section, empty if none.
+std::string StringAt(Section section, std::uint64_t offset) {
+  if (offset >= section.size) return std::string();
+  Reader reader(section);
+  reader.Skip(static_cast<std::size_t>(offset));
+  return reader.String();
+}
+
+}  // namespace
+
+/*!
+ * @brief An ELF module file, mapped in memory, with its symbol table and line
+ * table sorted by address.
+ */
+class Symbolizer::Module : private asap::NonCopiable {
+ public:
+  explicit Module(const std::string &path);
+  ~Module();
+
+  bool Valid() const { return !segments_.empty(); }
+
+  /*!
+   * @brief Resolve the code at an offset of the module file.
+   */
+  void Resolve(std::uint64_t file_offset, CachedFrame &frame) const;
+
+ private:
+  struct Segment {
+    std::uint64_t offset;
+    std::uint64_t file_size;
+    std::uint64_t address;
+  };
+  struct Symbol {
+    std::uint64_t address;
+    std::uint64_t size;
+    char const *name;
+  };
+  struct Row {
+    std::uint64_t address;
+    std::uint32_t file;
+    int line;
+    bool end_sequence;
+  };
+  /// Line table parsing context of a unit.
+  struct LineUnit {
+    bool dwarf64;
+    std::uint16_t version;
+    std::uint8_t address_size;
+    std::vector<std::string> directories;
+    /// Index in files_ of the unit files.
+    std::vector<std::uint32_t> files;
+  };
+
+  static constexpr std::uint32_t NO_FILE = 0xffffffff;
+
+  Section FindSection(char const *name) const;
+  void LoadSymbols();
+  void LoadLines();
+  void LoadLineUnit(Reader unit, bool dwarf64);
+  bool ReadFileEntries(Reader &reader, LineUnit &unit, bool directories);
+  void RunLineProgram(Reader program, LineUnit &unit,
+                      std::uint8_t min_instruction_length,
+                      std::int8_t line_base, std::uint8_t line_range,
+                      std::uint8_t opcode_base,
+                      const std::vector<std::uint8_t> &opcode_lengths);
+  std::uint32_t AddFile(const LineUnit &unit, std::uint64_t directory,
+                        const std::string &name);
+
+  std::uint8_t const *data_{nullptr};
+  std::size_t size_{0};
+  Elf64_Ehdr const *header_{nullptr};
+  std::vector<Segment> segments_;
+  std::vector<Symbol> symbols_;
+  std::vector<std::string> files_;
+  std::map<std::string, std::uint32_t> file_indices_;
+  /// The string sections referred to by the line tables.
+  Section line_strings_{nullptr, 0};
+  Section strings_{nullptr, 0};
+  std::vector<Row> rows_;
+};
+
+constexpr std::uint32_t Symbolizer::Module::NO_FILE;
+
+Symbolizer::Module::Module(const std::string &path) {
+  auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+  struct stat status {};
+  if (::fstat(fd, &status) == 0 &&
+      static_cast<std::size_t>(status.st_size) >= sizeof(Elf64_Ehdr)) {
+    auto *data = ::mmap(nullptr, static_cast<std::size_t>(status.st_size),
+                        PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      data_ = static_cast<std::uint8_t const *>(data);
+      size_ = static_cast<std::size_t>(status.st_size);
+    }
+  }
+  ::close(fd);
+  if (data_ == nullptr) return;
+
+  // Only the ELF files of this machine
+  header_ = reinterpret_cast<Elf64_Ehdr const *>(data_);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  constexpr unsigned char byte_order = ELFDATA2LSB;
+#else
+  constexpr unsigned char byte_order = ELFDATA2MSB;
+#endif
+  if (std::memcmp(header_->e_ident, ELFMAG, SELFMAG) != 0 ||
+      header_->e_ident[EI_CLASS] != ELFCLASS64 ||
+      header_->e_ident[EI_DATA] != byte_order ||
+      header_->e_phoff + std::uint64_t(header_->e_phnum) * sizeof(Elf64_Phdr) >
+          size_ ||
+      header_->e_shoff + std::uint64_t(header_->e_shnum) * sizeof(Elf64_Shdr) >
+          size_ ||
+      (header_->e_shnum > 0 && header_->e_shstrndx >= header_->e_shnum)) {
+    return;
+  }
+
+  auto const *program_headers =
+      reinterpret_cast<Elf64_Phdr const *>(data_ + header_->e_phoff);
+  for (auto index = 0; index < header_->e_phnum; ++index) {
+    auto const &program_header = program_headers[index];
+    if (program_header.p_type != PT_LOAD) continue;
+    segments_.push_back({program_header.p_offset, program_header.p_filesz,
+                         program_header.p_vaddr});
+  }
+
+  LoadSymbols();
+  LoadLines();
+}
+
+Symbolizer::Module::~Module() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<std::uint8_t *>(data_), size_);
+  }
+}
+
+Section Symbolizer::Module::FindSection(char const *name) const {
+  if (header_->e_shnum == 0) return Section{nullptr, 0};
+  auto const *section_headers =
+      reinterpret_cast<Elf64_Shdr const *>(data_ + header_->e_shoff);
+  auto const &names_header = section_headers[header_->e_shstrndx];
+  if (names_header.sh_offset + names_header.sh_size > size_) {
+    return Section{nullptr, 0};
+  }
+  Section names{data_ + names_header.sh_offset,
+                static_cast<std::size_t>(names_header.sh_size)};
+  for (auto index = 0; index < header_->e_shnum; ++index) {
+    auto const &section_header = section_headers[index];
+    if (section_header.sh_type == SHT_NOBITS ||
+        (section_header.sh_flags & SHF_COMPRESSED) != 0 ||
+        section_header.sh_offset + section_header.sh_size > size_ ||
+        StringAt(names, section_header.sh_name) != name) {
+      continue;
+    }
+    return Section{data_ + section_header.sh_offset,
+                   static_cast<std::size_t>(section_header.sh_size)};
+  }
+  return Section{nullptr, 0};
+}
+
+void Symbolizer::Module::LoadSymbols() {
+  // The full symbol table when not stripped, the exported symbols otherwise
+  auto const *section_headers =
+      reinterpret_cast<Elf64_Shdr const *>(data_ + header_->e_shoff);
+  Elf64_Shdr const *table = nullptr;
+  for (auto index = 0; index < header_->e_shnum; ++index) {
+    auto const &section_header = section_headers[index];
+    if (section_header.sh_type == SHT_SYMTAB ||
+        (section_header.sh_type == SHT_DYNSYM && table == nullptr)) {
+      table = &section_header;
+    }
+  }
+  if (table == nullptr || table->sh_link >= header_->e_shnum ||
+      table->sh_offset + table->sh_size > size_) {
+    return;
+  }
+  auto const &names = section_headers[table->sh_link];
+  if (names.sh_offset + names.sh_size > size_) return;
+
+  auto const *symbols =
+      reinterpret_cast<Elf64_Sym const *>(data_ + table->sh_offset);
+  auto count = table->sh_size / sizeof(Elf64_Sym);
+  for (std::size_t index = 0; index < count; ++index) {
+    auto const &symbol = symbols[index];
+    auto type = ELF64_ST_TYPE(symbol.st_info);
+    if ((type != STT_FUNC && type != STT_GNU_IFUNC) ||
+        symbol.st_shndx == SHN_UNDEF || symbol.st_value == 0 ||
+        symbol.st_name >= names.sh_size) {
+      continue;
+    }
+    symbols_.push_back({symbol.st_value, symbol.st_size,
+                        reinterpret_cast<char const *>(
+                            data_ + names.sh_offset + symbol.st_name)});
+  }
+  std::sort(symbols_.begin(), symbols_.end(),
+            [](const Symbol &left, const Symbol &right) {
+              return left.address < right.address;
+            });
+}
+
+void Symbolizer::Module::LoadLines() {
+  line_strings_ = FindSection(".debug_line_str");
+  strings_ = FindSection(".debug_str");
+  Reader reader(FindSection(".debug_line"));
+  while (reader.Remaining() > 0) {
+    auto length = std::uint64_t(reader.Read<std::uint32_t>());
+    auto dwarf64 = length == 0xffffffff;
+    if (dwarf64) length = reader.Read<std::uint64_t>();
+    if (!reader.Ok() || length > reader.Remaining()) break;
+    LoadLineUnit(reader.Sub(static_cast<std::size_t>(length)), dwarf64);
+  }
+
+  // Sequences ending at an address come before those starting there
+  std::stable_sort(rows_.begin(), rows_.end(),
+                   [](const Row &left, const Row &right) {
+                     return left.address < right.address ||
+                            (left.address == right.address &&
+                             left.end_sequence && !right.end_sequence);
+                   });
+  file_indices_.clear();
+}
+
+void Symbolizer::Module::LoadLineUnit(Reader reader, bool dwarf64) {
+  LineUnit unit{dwarf64, reader.Read<std::uint16_t>(), 8, {}, {}};
+  if (unit.version < 2 || unit.version > 5) return;
+  if (unit.version >= 5) {
+    unit.address_size = reader.Read<std::uint8_t>();
+    reader.Read<std::uint8_t>();  // segment selector size
+  }
+  auto header_length = reader.Offset(dwarf64);
+  if (!reader.Ok() || header_length > reader.Remaining()) return;
+  auto program = reader;
+  program.Skip(static_cast<std::size_t>(header_length));
+
+  auto min_instruction_length = reader.Read<std::uint8_t>();
+  if (unit.version >= 4) {
+    reader.Read<std::uint8_t>();  // maximum operations per instruction
+  }
+  reader.Read<std::uint8_t>();  // default is_stmt
+  auto line_base = reader.Read<std::int8_t>();
+  auto line_range = reader.Read<std::uint8_t>();
+  auto opcode_base = reader.Read<std::uint8_t>();
+  if (line_range == 0 || opcode_base == 0) return;
+  std::vector<std::uint8_t> opcode_lengths(opcode_base);
+  for (std::size_t opcode = 1; opcode < opcode_base; ++opcode) {
+    opcode_lengths[opcode] = reader.Read<std::uint8_t>();
+  }
+
+  if (unit.version < 5) {
+    // Directory 0 is the compilation directory, which is not in the table,
+    // and file 0 does not exist
+    unit.directories.emplace_back();
+    for (auto directory = reader.String(); !directory.empty();
+         directory = reader.String()) {
+      unit.directories.push_back(std::move(directory));
+    }
+    unit.files.push_back(NO_FILE);
+    for (auto name = reader.String(); !name.empty(); name = reader.String()) {
+      auto directory = reader.Uleb();
+      reader.Uleb();  // modification time
+      reader.Uleb();  // size
+      unit.files.push_back(AddFile(unit, directory, name));
+    }
+  } else if (!ReadFileEntries(reader, unit, true) ||
+             !ReadFileEntries(reader, unit, false)) {
+    return;
+  }
+  if (!reader.Ok()) return;
+
+  RunLineProgram(program, unit, min_instruction_length, line_base, line_range,
+                 opcode_base, opcode_lengths);
+}
+
+bool Symbolizer::Module::ReadFileEntries(Reader &reader, LineUnit &unit,
+                                         bool directories) {
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> formats(
+      reader.Read<std::uint8_t>());
+  for (auto &format : formats) {
+    format.first = reader.Uleb();   // content type
+    format.second = reader.Uleb();  // form
+  }
+  auto count = reader.Uleb();
+  for (std::uint64_t entry = 0; entry < count && reader.Ok(); ++entry) {
+    std::string path;
+    std::uint64_t directory = 0;
+    for (auto const &format : formats) {
+      std::string text;
+      std::uint64_t number = 0;
+      switch (format.second) {
+        case DW_FORM_string:
+          text = reader.String();
+          break;
+        case DW_FORM_line_strp:
+          text = StringAt(line_strings_, reader.Offset(unit.dwarf64));
+          break;
+        case DW_FORM_strp:
+          text = StringAt(strings_, reader.Offset(unit.dwarf64));
+          break;
+        case DW_FORM_udata:
+          number = reader.Uleb();
+          break;
+        case DW_FORM_data1:
+          number = reader.Read<std::uint8_t>();
+          break;
+        case DW_FORM_data2:
+          number = reader.Read<std::uint16_t>();
+          break;
+        case DW_FORM_data4:
+          number = reader.Read<std::uint32_t>();
+          break;
+        case DW_FORM_data8:
+          number = reader.Read<std::uint64_t>();
+          break;
+        case DW_FORM_data16:
+          reader.Skip(16);
+          break;
+        case DW_FORM_block:
+          reader.Skip(static_cast<std::size_t>(reader.Uleb()));
+          break;
+        default:
+          // Forms needing the compilation unit, e.g. DW_FORM_strx
+          return false;
+      }
+      if (format.first == DW_LNCT_path) path = std::move(text);
+      if (format.first == DW_LNCT_directory_index) directory = number;
+    }
+    if (directories) {
+      unit.directories.push_back(std::move(path));
+    } else {
+      unit.files.push_back(AddFile(unit, directory, path));
+    }
+  }
+  return reader.Ok();
+}
+
+void Symbolizer::Module::RunLineProgram(
+    Reader program, LineUnit &unit, std::uint8_t min_instruction_length,
+    std::int8_t line_base, std::uint8_t line_range, std::uint8_t opcode_base,
+    const std::vector<std::uint8_t> &opcode_lengths) {
+  std::uint64_t address = 0;
+  std::uint64_t file = 1;
+  std::int64_t line = 1;
+  auto sequence_start = rows_.size();
+  auto add_row = [&](bool end_sequence) {
+    rows_.push_back({address,
+                     file < unit.files.size()
+                         ? unit.files[static_cast<std::size_t>(file)]
+                         : NO_FILE,
+                     static_cast<int>(line), end_sequence});
+  };
+
+  while (program.Remaining() > 0 && program.Ok()) {
+    auto opcode = program.Read<std::uint8_t>();
+    if (opcode >= opcode_base) {
+      // Special opcode: advance both the address and the line, add a row
+      auto adjusted = opcode - opcode_base;
+      address += std::uint64_t(adjusted / line_range) * min_instruction_length;
+      line += line_base + adjusted % line_range;
+      add_row(false);
+    } else if (opcode == 0) {
+      auto length = program.Uleb();
+      if (length == 0 || length > program.Remaining()) break;
+      auto extended = program.Sub(static_cast<std::size_t>(length));
+      switch (extended.Read<std::uint8_t>()) {
+        case DW_LNE_end_sequence:
+          add_row(true);
+          // Code removed by the linker is left at address 0, and would hide
+          // the functions really there
+          if (rows_[sequence_start].address == 0) rows_.resize(sequence_start);
+          sequence_start = rows_.size();
+          address = 0;
+          file = 1;
+          line = 1;
+          break;
+        case DW_LNE_set_address:
+          address = length - 1 == 4 ? extended.Read<std::uint32_t>()
+                                    : extended.Read<std::uint64_t>();
+          break;
+        case DW_LNE_define_file: {
+          auto name = extended.String();
+          auto directory = extended.Uleb();
+          unit.files.push_back(AddFile(unit, directory, name));
+          break;
+        }
+        default:
+          break;
+      }
+    } else {
+      switch (opcode) {
+        case DW_LNS_copy:
+          add_row(false);
+          break;
+        case DW_LNS_advance_pc:
+          address += program.Uleb() * min_instruction_length;
+          break;
+        case DW_LNS_advance_line:
+          line += program.Sleb();
+          break;
+        case DW_LNS_set_file:
+          file = program.Uleb();
+          break;
+        case DW_LNS_const_add_pc:
+          address += std::uint64_t((255 - opcode_base) / line_range) *
+                     min_instruction_length;
+          break;
+        case DW_LNS_fixed_advance_pc:
+          address += program.Read<std::uint16_t>();
+          break;
+        default:
+          // Opcodes changing nothing this table keeps
+          for (auto operand = 0; operand < opcode_lengths[opcode]; ++operand) {
+            program.Uleb();
+          }
+          break;
+      }
+    }
+  }
+  // An unterminated sequence is not usable
+  rows_.resize(sequence_start);
+}
+
+std::uint32_t Symbolizer::Module::AddFile(const LineUnit &unit,
+                                          std::uint64_t directory,
+                                          const std::string &name) {
+  auto path = name;
+  if (!name.empty() && name[0] != '/' && directory < unit.directories.size() &&
+      !unit.directories[static_cast<std::size_t>(directory)].empty()) {
+    path = unit.directories[static_cast<std::size_t>(directory)] + "/" + name;
+  }
+  auto inserted = file_indices_.emplace(
+      path, static_cast<std::uint32_t>(files_.size()));
+  if (inserted.second) files_.push_back(path);
+  return inserted.first->second;
+}
+
+void Symbolizer::Module::Resolve(std::uint64_t file_offset,
+                                 CachedFrame &frame) const {
+  auto segment = std::find_if(
+      segments_.begin(), segments_.end(), [file_offset](const Segment &item) {
+        return file_offset >= item.offset &&
+               file_offset < item.offset + item.file_size;
+      });
+  if (segment == segments_.end()) return;
+  auto address = file_offset - segment->offset + segment->address;
+  frame.module_address = address;
+
+  auto symbol = std::upper_bound(
+      symbols_.begin(), symbols_.end(), address,
+      [](std::uint64_t value, const Symbol &item) {
+        return value < item.address;
+      });
+  if (symbol != symbols_.begin()) {
+    --symbol;
+    if (symbol->size == 0 || address < symbol->address + symbol->size) {
+      frame.function = boost::core::demangle(symbol->name);
+    }
+  }
+
+  auto row = std::upper_bound(
+      rows_.begin(), rows_.end(), address,
+      [](std::uint64_t value, const Row &item) {
+        return value < item.address;
+      });
+  if (row != rows_.begin()) {
+    --row;
+    if (!row->end_sequence && row->file != NO_FILE) {
+      frame.file = files_[row->file];
+      frame.line = row->line;
+    }
+  }
+}
+
+#else  // ASAP_LINUX
+
+class Symbolizer::Module {
+ public:
+  explicit Module(const std::string &) {}
+  bool Valid() const { return false; }
+  void Resolve(std::uint64_t, CachedFrame &) const {}
+};
+
+#endif  // ASAP_LINUX
+
+// ---------------------------------------------------------------------------
+// Symbolizer
+// ---------------------------------------------------------------------------
+
+namespace {
+/// First line of the cache files.
+const char *const CACHE_HEADER = "asap-symbolize cache 1";
+}  // namespace
+
+Symbolizer::Symbolizer(std::string cache_path)
+    : cache_path_(std::move(cache_path)) {
+  LoadCache();
+}
+
+Symbolizer::~Symbolizer() = default;
+
+SymbolizedFrame Symbolizer::Symbolize(const ModuleMap &modules,
+                                      std::uint64_t address,
+                                      bool return_address) {
+  SymbolizedFrame frame;
+  frame.address = address;
+  // The call instruction is before the return address
+  auto call_address = return_address && address > 0 ? address - 1 : address;
+  auto const *mapping = modules.Find(call_address);
+  if (mapping == nullptr) return frame;
+  frame.module = mapping->path;
+  auto const &key = ModuleKey(mapping->path);
+  if (key.empty()) return frame;
+
+  auto file_offset = call_address - mapping->start + mapping->offset;
+  auto cached = cache_.find(std::make_pair(key, file_offset));
+  if (cached == cache_.end()) {
+    CachedFrame resolved{0, std::string(), std::string(), 0};
+    auto *module = GetModule(mapping->path);
+    if (module != nullptr) module->Resolve(file_offset, resolved);
+    cached = cache_.emplace(std::make_pair(key, file_offset), resolved).first;
+    cache_changed_ = true;
+  }
+  frame.module_address = cached->second.module_address;
+  frame.function = cached->second.function;
+  frame.file = cached->second.file;
+  frame.line = cached->second.line;
+  return frame;
+}
+
+const std::string &Symbolizer::ModuleKey(const std::string &path) {
+  auto found = module_keys_.find(path);
+  if (found != module_keys_.end()) return found->second;
+
+  std::string key;
+#if defined ASAP_LINUX
+  struct stat status {};
+  if (::stat(path.c_str(), &status) == 0) {
+    key = path + ":" + std::to_string(status.st_size) + ":" +
+          std::to_string(status.st_mtim.tv_sec) + "." +
+          std::to_string(status.st_mtim.tv_nsec);
+  }
+#endif  // ASAP_LINUX
+  return module_keys_.emplace(path, std::move(key)).first->second;
+}
+
+Symbolizer::Module *Symbolizer::GetModule(const std::string &path) {
+  auto found = modules_.find(path);
+  if (found == modules_.end()) {
+    std::unique_ptr<Module> module(new Module(path));
+    if (!module->Valid()) module.reset();
+    found = modules_.emplace(path, std::move(module)).first;
+  }
+  return found->second.get();
+}
+
+void Symbolizer::LoadCache() {
+  if (cache_path_.empty()) return;
+  std::ifstream file(cache_path_);
+  std::string line;
+  if (!std::getline(file, line) || line != CACHE_HEADER) return;
+
+  // key offset module_address line file function, separated by tabs
+  while (std::getline(file, line)) {
+    std::vector<std::string> fields;
+    std::string::size_type start = 0;
+    for (auto tab = line.find('\t'); fields.size() < 5;
+         tab = line.find('\t', start)) {
+      if (tab == std::string::npos) break;
+      fields.push_back(line.substr(start, tab - start));
+      start = tab + 1;
+    }
+    if (fields.size() < 5) continue;
+    fields.push_back(line.substr(start));
+    try {
+      CachedFrame frame{std::stoull(fields[2], nullptr, 16), fields[5],
+                        fields[4], std::stoi(fields[3])};
+      cache_[std::make_pair(fields[0], std::stoull(fields[1], nullptr, 16))] =
+          std::move(frame);
+    } catch (const std::exception &) {
+      // A corrupted entry is resolved again
+    }
+  }
+}
+
+void Symbolizer::SaveCache() {
+  if (cache_path_.empty() || !cache_changed_) return;
+
+  // Replace the previous cache at once, never leaving a partial one
+  auto temporary_path = cache_path_ + ".tmp";
+  {
+    std::ofstream file(temporary_path, std::ios::trunc);
+    file << CACHE_HEADER << '\n' << std::hex;
+    for (auto const &entry : cache_) {
+      file << entry.first.first << '\t' << entry.first.second << '\t'
+           << entry.second.module_address << '\t' << std::dec
+           << entry.second.line << std::hex << '\t' << entry.second.file
+           << '\t' << entry.second.function << '\n';
+    }
+    if (!file.flush()) {
+      throw std::runtime_error("cannot write the symbolizer cache " +
+                               temporary_path);
+    }
+  }
+  if (std::rename(temporary_path.c_str(), cache_path_.c_str()) != 0) {
+    throw std::runtime_error("cannot replace the symbolizer cache " +
+                             cache_path_);
+  }
+  cache_changed_ = false;
+}
+
+}  // namespace asap
@@ -0,0 +1,267 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <common/thread_buffer_sink.h>
+
+#include <algorithm>  // for std::remove_if
+#include <atomic>     // for the sink ids
+
+namespace asap {
+namespace logging {
+
+// ---------------------------------------------------------------------------
+// Static members initialization
+// ---------------------------------------------------------------------------
+
+const std::size_t ThreadBufferSink::DEFAULT_BATCH_SIZE = 128;
+const std::chrono::milliseconds ThreadBufferSink::DEFAULT_MAX_DELAY(50);
+
+namespace {
+
+/// Source of the unique ids of the sinks, used to find the batches of a
+/// sink among the batches of a thread.
+std::atomic<std::uint64_t> next_sink_id{0};
+
+/// The state of the sink whose batch the calling thread is handing over, if
+/// any. A delegate logging from there gets its messages delivered directly.
+thread_local const void *handing_off = nullptr;
+
+/// Marks the calling thread as handing a batch over for its lifetime.
+class HandOffScope {
+ public:
+  explicit HandOffScope(const void *core) : previous_(handing_off) {
+    handing_off = core;
+  }
+  ~HandOffScope() { handing_off = previous_; }
+  HandOffScope(const HandOffScope &) = delete;
+  HandOffScope &operator=(const HandOffScope &) = delete;
+
+ private:
+  const void *previous_;
+};
+
+}  // namespace
+
+/// The messages of one thread waiting to be handed over.
+struct ThreadBufferSink::Batch {
+  /// Only contended when another thread flushes the batch.
+  std::mutex mutex_;
+  /// Records are reused, the batch holds the first size_ ones.
+  std::vector<MessageRecord> records_;
+  std::size_t size_{0};
+  std::uint64_t sink_id_{0};
+  std::weak_ptr<Core> core_;
+};
+
+/// The state of the sink needed to hand batches over.
+struct ThreadBufferSink::Core {
+  std::uint64_t id_{next_sink_id.fetch_add(1)};
+
+  /// Held while handing a batch over, so that the delegate gets whole
+  /// batches.
+  std::mutex handoff_mutex_;
+  spdlog::sink_ptr delegate_;
+  /// Reused for all the handed over messages.
+  spdlog::details::log_msg msg_;
+  DeferredMessage deferred_;
+
+  std::mutex batches_mutex_;
+  std::vector<std::shared_ptr<Batch>> batches_;
+
+  /// Deliver the messages of a batch to the delegate, called with the batch
+  /// mutex held.
+  void HandOff(Batch &batch) {
+    if (batch.size_ == 0) return;
+    auto count = batch.size_;
+    batch.size_ = 0;
+    std::lock_guard<std::mutex> lock(handoff_mutex_);
+    HandOffScope scope(this);
+    for (std::size_t index = 0; index < count; ++index) {
+      auto const *source = batch.records_[index].Extract(msg_, deferred_);
+      if (delegate_ && delegate_->should_log(msg_.level)) {
+        SourceLocation::Scope source_scope(source);
+        DeferredMessage::Scope deferred_scope(
+            deferred_.Empty() ? nullptr : &deferred_);
+        delegate_->log(msg_);
+      }
+    }
+  }
+
+  /// Copy the list of batches, to go through them without holding
+  /// batches_mutex_.
+  std::vector<std::shared_ptr<Batch>> Batches() {
+    std::lock_guard<std::mutex> lock(batches_mutex_);
+    return batches_;
+  }
+
+  void Register(std::shared_ptr<Batch> batch) {
+    std::lock_guard<std::mutex> lock(batches_mutex_);
+    batches_.push_back(std::move(batch));
+  }
+
+  void Unregister(const Batch *batch) {
+    std::lock_guard<std::mutex> lock(batches_mutex_);
+    batches_.erase(std::remove_if(batches_.begin(), batches_.end(),
+                                  [batch](const std::shared_ptr<Batch> &entry) {
+                                    return entry.get() == batch;
+                                  }),
+                   batches_.end());
+  }
+};
+
+/// The batches of a thread, one per sink, handed over when the thread exits.
+class ThreadBufferSink::ThreadBatches {
+ public:
+  ~ThreadBatches() {
+    for (auto &batch : batches_) {
+      auto core = batch->core_.lock();
+      if (!core) continue;
+      {
+        std::lock_guard<std::mutex> lock(batch->mutex_);
+        core->HandOff(*batch);
+      }
+      core->Unregister(batch.get());
+    }
+  }
+
+  Batch *Find(std::uint64_t sink_id) const {
+    for (auto const &batch : batches_) {
+      if (batch->sink_id_ == sink_id) return batch.get();
+    }
+    return nullptr;
+  }
+
+  void Add(std::shared_ptr<Batch> batch) {
+    // Forget the batches of the sinks that are gone
+    batches_.erase(std::remove_if(batches_.begin(), batches_.end(),
+                                  [](const std::shared_ptr<Batch> &entry) {
+                                    return entry->core_.expired();
+                                  }),
+                   batches_.end());
+    batches_.push_back(std::move(batch));
+  }
+
+ private:
+  std::vector<std::shared_ptr<Batch>> batches_;
+};
+
+// ---------------------------------------------------------------------------
+// ThreadBufferSink
+// ---------------------------------------------------------------------------
+
+ThreadBufferSink::ThreadBufferSink(spdlog::sink_ptr delegate,
+                                   std::size_t batch_size,
+                                   std::chrono::milliseconds max_delay,
+                                   spdlog::level::level_enum handoff_level)
+    : batch_size_(std::max<std::size_t>(batch_size, 1)),
+      max_delay_(max_delay),
+      handoff_level_(handoff_level),
+      core_(std::make_shared<Core>()) {
+  core_->delegate_ = std::move(delegate);
+  if (max_delay_.count() > 0) {
+    flusher_ = std::thread([this]() { FlushIdle(); });
+  }
+}
+
+ThreadBufferSink::~ThreadBufferSink() { Stop(); }
+
+ThreadBufferSink::Batch &ThreadBufferSink::LocalBatch() {
+  static thread_local ThreadBatches thread_batches;
+  // Most of the time, the same sink is used again
+  static thread_local Batch *last_batch = nullptr;
+  static thread_local std::uint64_t last_sink_id = 0;
+
+  if (last_batch != nullptr && last_sink_id == core_->id_) return *last_batch;
+
+  auto *batch = thread_batches.Find(core_->id_);
+  if (batch == nullptr) {
+    auto created = std::make_shared<Batch>();
+    created->records_.reserve(batch_size_);
+    created->sink_id_ = core_->id_;
+    created->core_ = core_;
+    batch = created.get();
+    core_->Register(created);
+    thread_batches.Add(std::move(created));
+  }
+  last_batch = batch;
+  last_sink_id = core_->id_;
+  return *batch;
+}
+
+void ThreadBufferSink::log(const spdlog::details::log_msg &msg) {
+  if (handing_off == core_.get()) {
+    // Logged by the delegate while it receives a batch, on this thread: the
+    // handoff mutex is already held
+    if (core_->delegate_) core_->delegate_->log(msg);
+    return;
+  }
+
+  auto &batch = LocalBatch();
+  std::lock_guard<std::mutex> lock(batch.mutex_);
+  if (batch.size_ == batch.records_.size()) batch.records_.emplace_back();
+  auto &record = batch.records_[batch.size_++];
+  record.Assign(msg, SourceLocation::Current(), DeferredMessage::Current());
+
+  if (batch.size_ >= batch_size_ || msg.level >= handoff_level_ ||
+      msg.time - batch.records_.front().time_ >= max_delay_) {
+    core_->HandOff(batch);
+  }
+}
+
+void ThreadBufferSink::flush() {
+  if (handing_off != core_.get()) {
+    for (auto &batch : core_->Batches()) {
+      std::lock_guard<std::mutex> lock(batch->mutex_);
+      core_->HandOff(*batch);
+    }
+    std::lock_guard<std::mutex> lock(core_->handoff_mutex_);
+    HandOffScope scope(core_.get());
+    if (core_->delegate_) core_->delegate_->flush();
+  } else if (core_->delegate_) {
+    core_->delegate_->flush();
+  }
+}
+
+spdlog::sink_ptr ThreadBufferSink::SwapSink(spdlog::sink_ptr sink) {
+  flush();
+  std::lock_guard<std::mutex> lock(core_->handoff_mutex_);
+  std::swap(core_->delegate_, sink);
+  return sink;
+}
+
+spdlog::sink_ptr ThreadBufferSink::Delegate() {
+  std::lock_guard<std::mutex> lock(core_->handoff_mutex_);
+  return core_->delegate_;
+}
+
+void ThreadBufferSink::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_one();
+  if (flusher_.joinable()) flusher_.join();
+  flush();
+}
+
+void ThreadBufferSink::FlushIdle() {
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_cv_.wait_for(lock, max_delay_, [this]() { return stop_; })) {
+    lock.unlock();
+    auto now = spdlog::log_clock::now();
+    for (auto &batch : core_->Batches()) {
+      // Leave the batches being filled or flushed alone
+      std::unique_lock<std::mutex> batch_lock(batch->mutex_, std::try_to_lock);
+      if (batch_lock && batch->size_ > 0 &&
+          now - batch->records_.front().time_ >= max_delay_) {
+        core_->HandOff(*batch);
+      }
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace logging
+}  // namespace asap
@@ -5,6 +5,14 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>  // for std::sort, std::adjacent_find
+#include <cstdint>
+#include <cstring>  // for std::strcmp
+#include <sstream>  // for ASAP_ASSERT_VAL
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <common/assert.h>
 
 #if 0
@@ -101,3 +109,126 @@ TEST(AssertTests, TestAssertFailVal) {
 }
 #endif // 0
 
+namespace asap {
+
+namespace {
+/// The hits of a site, 0 if it is not in the hot asserts.
+std::uint64_t HotAssertHits(assert_site const &site) {
+  for (auto const &hot : hot_asserts()) {
+    if (hot.site == &site) return hot.hits;
+  }
+  return 0;
+}
+}  // namespace
+
+namespace {
+/// Counts how many times it is formatted.
+struct FormatCounter {
+  int formatted{0};
+};
+std::ostream &operator<<(std::ostream &out, FormatCounter &counter) {
+  return out << ++counter.formatted;
+}
+}  // namespace
+
+TEST_CASE("TestPassingAssertsDoNotFormat", "[common][assert]") {
+  FormatCounter counter;
+  auto hot_count = hot_asserts().size();
+  for (auto ii = 0; ii < 10; ++ii) {
+    ASAP_ASSERT(ii < 10);
+    ASAP_ASSERT_PRECOND(ii >= 0);
+    ASAP_ASSERT_VAL(ii < 10, counter);
+  }
+  REQUIRE(counter.formatted == 0);
+  REQUIRE(hot_asserts().size() == hot_count);
+}
+
+TEST_CASE("TestAssertSiteCountsFailures", "[common][assert]") {
+  static assert_site rare("rare", __FILE__, ASAP_FUNCTION, __LINE__, 0);
+  static assert_site frequent("frequent", __FILE__, ASAP_FUNCTION, __LINE__,
+                              0);
+  static assert_site never("never", __FILE__, ASAP_FUNCTION, __LINE__, 0);
+
+  // The number of the failure, if reported
+  REQUIRE(assert_hit(rare) == 1);
+  for (auto hit = 0; hit < 5; ++hit) assert_hit(frequent);
+  REQUIRE(HotAssertHits(rare) == 1);
+  REQUIRE(HotAssertHits(frequent) == 5);
+  // Only the sites which failed
+  REQUIRE(HotAssertHits(never) == 0);
+
+  // Hottest first
+  auto hot = hot_asserts();
+  REQUIRE(hot.size() >= 2);
+  for (std::size_t index = 1; index < hot.size(); ++index) {
+    REQUIRE(hot[index - 1].hits >= hot[index].hits);
+  }
+  REQUIRE(hot_asserts(1).size() == 1);
+
+  char text[4096];
+  print_hot_asserts(text, sizeof(text));
+  REQUIRE(std::string(text).find("5 failures: frequent") != std::string::npos);
+}
+
+TEST_CASE("TestAssertSiteConcurrentFailures", "[common][assert]") {
+  static assert_site site("concurrent", __FILE__, ASAP_FUNCTION, __LINE__, 0);
+  constexpr auto THREADS = 4;
+  constexpr auto HITS = 10000;
+  std::vector<std::thread> threads;
+  std::vector<std::vector<std::uint64_t>> numbers(THREADS);
+  for (auto thread = 0; thread < THREADS; ++thread) {
+    threads.emplace_back([&numbers, thread]() {
+      for (auto hit = 0; hit < HITS; ++hit) {
+        auto number = assert_hit(site);
+        if (number != 0) {
+          numbers[static_cast<std::size_t>(thread)].push_back(number);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  REQUIRE(site.hits.load() == THREADS * HITS);
+  // Each reported failure has its own number
+  std::vector<std::uint64_t> all;
+  for (auto const &thread_numbers : numbers) {
+    all.insert(all.end(), thread_numbers.begin(), thread_numbers.end());
+  }
+  std::sort(all.begin(), all.end());
+  REQUIRE(std::adjacent_find(all.begin(), all.end()) == all.end());
+  // Listed once
+  auto listed = 0;
+  for (auto const &hot : hot_asserts()) {
+    if (hot.site == &site) ++listed;
+  }
+  REQUIRE(listed == 1);
+}
+
+TEST_CASE("TestAssertReportsRing", "[common][assert]") {
+  static assert_site site("reported", __FILE__, ASAP_FUNCTION, __LINE__, 0);
+  // More reports than the ring keeps
+  for (std::uint64_t hit = 1; hit <= ASSERT_REPORTS_CAPACITY + 10; ++hit) {
+    record_assert_report(site, hit, std::to_string(hit).c_str());
+  }
+
+  auto reports = recent_assert_reports();
+  REQUIRE(reports.size() == ASSERT_REPORTS_CAPACITY);
+  // The latest ones, oldest first
+  for (std::size_t index = 0; index < reports.size(); ++index) {
+    auto const &report = reports[index];
+    REQUIRE(report.site == &site);
+    REQUIRE(report.hit == index + 11);
+    REQUIRE(std::to_string(report.hit) == report.value);
+    REQUIRE(report.thread == std::this_thread::get_id());
+#if ASAP_USE_EXECINFO
+    REQUIRE(report.frame_count > 0);
+#endif  // ASAP_USE_EXECINFO
+  }
+
+  // Long values are truncated
+  record_assert_report(site, 1, std::string(1000, 'x').c_str());
+  REQUIRE(std::strlen(recent_assert_reports().back().value) ==
+          ASSERT_REPORT_VALUE_LENGTH);
+}
+
+}  // namespace asap
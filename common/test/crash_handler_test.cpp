@@ -0,0 +1,164 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>  // for std::find
+#include <cstdio>     // for std::remove
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <common/config.h>
+#include <common/crash_handler.h>
+
+#if !defined ASAP_WINDOWS
+#include <csignal>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif  // !ASAP_WINDOWS
+
+namespace asap {
+
+#if !defined ASAP_WINDOWS
+
+namespace {
+const char *const RECORD_PATH = "common_test_crash.dump";
+
+bool FileExists(const std::string &path) {
+  return std::ifstream(path).good();
+}
+
+bool ReadRecord(CrashRecord &record) {
+  std::ifstream file(RECORD_PATH, std::ios::binary);
+  return CrashRecord::Read(file, record);
+}
+
+volatile int overflow_limit = -1;
+
+/// Recurse until the stack overflows.
+int Overflow(int depth) {
+  volatile char frame[1024];
+  frame[0] = static_cast<char>(depth);
+  if (depth == overflow_limit) return 0;
+  return Overflow(depth + 1) + frame[0];
+}
+}  // namespace
+
+TEST_CASE("TestCrashRecordWriteRead", "[common][crash_handler]") {
+  auto fd = ::open(RECORD_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  REQUIRE(fd >= 0);
+  CrashHandler::SetCrashMessage("test message");
+  CrashHandler::WriteRecord(fd, SIGSEGV, 1, reinterpret_cast<void *>(0x42));
+  ::close(fd);
+  CrashHandler::SetCrashMessage("");
+
+  CrashRecord record;
+  REQUIRE(ReadRecord(record));
+  REQUIRE(record.complete);
+  REQUIRE(record.signal.signal == SIGSEGV);
+  REQUIRE(record.signal.code == 1);
+  REQUIRE(record.signal.address == 0x42);
+  REQUIRE(record.signal.pid == ::getpid());
+  REQUIRE(record.message == "test message");
+  REQUIRE(record.instruction == 0);
+#if ASAP_USE_EXECINFO
+  REQUIRE_FALSE(record.frames.empty());
+#endif  // ASAP_USE_EXECINFO
+#if defined ASAP_LINUX
+  // The module map has the test executable in it
+  REQUIRE(record.maps.find("r-xp") != std::string::npos);
+#endif  // ASAP_LINUX
+
+  // Not a crash record
+  std::ofstream(RECORD_PATH) << "not a crash record";
+  REQUIRE_FALSE(ReadRecord(record));
+  std::remove(RECORD_PATH);
+}
+
+TEST_CASE("TestCrashHandlerRecordsCrash", "[common][crash_handler]") {
+  std::remove(RECORD_PATH);
+  auto pid = ::fork();
+  REQUIRE(pid >= 0);
+  if (pid == 0) {
+    // Without the test framework handler, which would report a failure
+    std::signal(SIGSEGV, SIG_DFL);
+    if (!CrashHandler::Install(RECORD_PATH)) ::_exit(1);
+    CrashHandler::SetCrashMessage("crash test");
+    // The record is still written when no file descriptor is left
+    while (::open("/dev/null", O_RDONLY) >= 0) {
+    }
+    // A real fault, at an address the compiler does not know to be invalid
+    auto address = reinterpret_cast<volatile int *>(
+        static_cast<std::uintptr_t>(::getpid() > 0 ? 0x10 : 0x20));
+    *address = 1;
+    ::_exit(0);
+  }
+
+  int status = 0;
+  REQUIRE(::waitpid(pid, &status, 0) == pid);
+  // The signal still terminates the process once recorded
+  REQUIRE(WIFSIGNALED(status));
+  REQUIRE(WTERMSIG(status) == SIGSEGV);
+
+  CrashRecord record;
+  REQUIRE(ReadRecord(record));
+  REQUIRE(record.complete);
+  REQUIRE(record.signal.signal == SIGSEGV);
+  REQUIRE(record.signal.address == 0x10);
+  REQUIRE(record.signal.pid == pid);
+  REQUIRE(record.message == "crash test");
+#if ASAP_USE_EXECINFO && defined ASAP_LINUX && defined __x86_64__
+  // The faulting instruction is one of the frames
+  REQUIRE(std::find(record.frames.begin(), record.frames.end(),
+                    record.instruction) != record.frames.end());
+#endif
+  std::remove(RECORD_PATH);
+}
+
+TEST_CASE("TestCrashHandlerRecordsThreadStackOverflow",
+          "[common][crash_handler]") {
+  std::remove(RECORD_PATH);
+  auto pid = ::fork();
+  REQUIRE(pid >= 0);
+  if (pid == 0) {
+    std::signal(SIGSEGV, SIG_DFL);
+    if (!CrashHandler::Install(RECORD_PATH)) ::_exit(1);
+    std::thread([]() {
+      // The handler needs a stack of its own in this thread too
+      if (!CrashHandler::InstallThreadStack()) ::_exit(1);
+      Overflow(0);
+    }).join();
+    ::_exit(0);
+  }
+
+  int status = 0;
+  REQUIRE(::waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFSIGNALED(status));
+  REQUIRE(WTERMSIG(status) == SIGSEGV);
+
+  CrashRecord record;
+  REQUIRE(ReadRecord(record));
+  REQUIRE(record.complete);
+  REQUIRE(record.signal.signal == SIGSEGV);
+  std::remove(RECORD_PATH);
+}
+
+TEST_CASE("TestCrashHandlerUninstall", "[common][crash_handler]") {
+  std::remove(RECORD_PATH);
+  REQUIRE(CrashHandler::Install(RECORD_PATH));
+  // Nothing recorded, nothing left behind
+  REQUIRE_FALSE(FileExists(RECORD_PATH));
+  CrashHandler::Uninstall();
+  REQUIRE_FALSE(FileExists(RECORD_PATH));
+
+  REQUIRE_FALSE(CrashHandler::Install("no/such/directory/crash.dump"));
+}
+
+#endif  // !ASAP_WINDOWS
+
+}  // namespace asap
@@ -0,0 +1,114 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <common/dedup_sink.h>
+
+namespace asap {
+namespace logging {
+
+namespace {
+/// A sink that keeps the text of the messages.
+class TextSink : public spdlog::sinks::sink {
+ public:
+  void log(const spdlog::details::log_msg &msg) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    texts_.emplace_back(msg.raw.data(), msg.raw.size());
+    loggers_.push_back(msg.logger_name);
+  }
+  void flush() override { ++flushed_; }
+
+  /// Wait until the sink has received the given number of messages.
+  bool WaitForTexts(std::size_t count) {
+    for (auto ii = 0; ii < 1000; ++ii) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (texts_.size() >= count) return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+  }
+
+  std::mutex mutex_;
+  std::vector<std::string> texts_;
+  std::vector<const std::string *> loggers_;
+  int flushed_{0};
+};
+}  // namespace
+
+TEST_CASE("TestDedupSinkCollapsesRepeats", "[common][logging][dedup_sink]") {
+  auto text_sink = std::make_shared<TextSink>();
+  auto sink = std::make_shared<DedupSink>(text_sink);
+  spdlog::logger logger("dedup", sink);
+  spdlog::logger other_logger("other", sink);
+
+  logger.info("first");
+  for (auto ii = 0; ii < 5; ++ii) logger.error("storm");
+  logger.info("first");
+  // Different level, logger or text: not repeats
+  logger.info("storm");
+  other_logger.info("storm");
+  other_logger.info("storm");
+  REQUIRE(text_sink->texts_ ==
+          std::vector<std::string>({"first", "storm",
+                                    "last message repeated 4 times", "first",
+                                    "storm", "storm"}));
+
+  // Reports refer to the logger of the repeated message, as messages do
+  REQUIRE(text_sink->loggers_[2] == &logger.name());
+  REQUIRE(text_sink->loggers_[5] == &other_logger.name());
+
+  // Pending repeats are reported when flushed
+  logger.flush();
+  REQUIRE(text_sink->texts_.back() == "last message repeated 1 time");
+  REQUIRE(text_sink->loggers_.back() == &other_logger.name());
+  REQUIRE(text_sink->flushed_ == 1);
+  REQUIRE(sink->Collapsed() == 5);
+}
+
+TEST_CASE("TestDedupSinkReportsLongRuns", "[common][logging][dedup_sink]") {
+  auto text_sink = std::make_shared<TextSink>();
+  auto sink =
+      std::make_shared<DedupSink>(text_sink, std::chrono::milliseconds(20));
+  {
+    spdlog::logger logger("dedup", sink);
+
+    // A storm that stops is reported after the delay, without anything else
+    // being logged
+    logger.error("storm");
+    logger.error("storm");
+    logger.error("storm");
+    REQUIRE(text_sink->WaitForTexts(2));
+    {
+      std::lock_guard<std::mutex> lock(text_sink->mutex_);
+      REQUIRE(text_sink->texts_ ==
+              std::vector<std::string>(
+                  {"storm", "last message repeated 2 times"}));
+      REQUIRE(text_sink->loggers_.back() == &logger.name());
+    }
+
+    // A never ending storm is reported periodically
+    logger.error("storm");
+    REQUIRE(text_sink->WaitForTexts(3));
+    logger.error("storm");
+    REQUIRE(sink->Collapsed() == 4);
+  }
+
+  // And when the sink goes away, after its loggers
+  sink.reset();
+  REQUIRE(text_sink->texts_.back() == "last message repeated 1 time");
+  REQUIRE(text_sink->loggers_.back()->empty());
+}
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,143 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// The logging macros of this file defer the formatting of the messages
+#ifndef ASAP_LOG_DEFERRED_FORMAT
+#define ASAP_LOG_DEFERRED_FORMAT 1
+#endif  // ASAP_LOG_DEFERRED_FORMAT
+
+#include <catch2/catch.hpp>
+
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <common/logging.h>
+
+namespace asap {
+namespace logging {
+
+namespace {
+
+/// A sink that keeps the text of the messages, and whether they still had
+/// their formatting deferred when they reached it.
+class TextSink : public spdlog::sinks::sink {
+ public:
+  void log(const spdlog::details::log_msg &msg) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    texts_.emplace_back(msg.raw.data(), msg.raw.size());
+    if (DeferredMessage::Current() != nullptr) ++deferred_;
+  }
+  void flush() override {}
+
+  bool EndsWith(const std::string &suffix) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (texts_.empty()) return false;
+    auto const &text = texts_.back();
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) ==
+               0;
+  }
+
+  std::mutex mutex_;
+  std::vector<std::string> texts_;
+  int deferred_{0};
+};
+
+/// Not supported for deferred formatting.
+struct Point {
+  int x;
+  int y;
+};
+std::ostream &operator<<(std::ostream &out, const Point &point) {
+  return out << "(" << point.x << ", " << point.y << ")";
+}
+
+}  // namespace
+
+TEST_CASE("TestDeferredMessageWrite", "[common][logging][deferred]") {
+  static_assert(DeferredArgsSupported<int, double, bool, char, std::string,
+                                      char const *, StaticString>::value,
+                "numbers and strings are supported");
+  static_assert(!DeferredArgsSupported<int, Point>::value,
+                "other types are not supported");
+
+  DeferredMessage deferred;
+  REQUIRE(deferred.Empty());
+
+  std::string text("text");
+  char buffer[16] = "buffer";
+  char const *pointer = "pointer";
+  deferred.Encode("{}{} {} {} {} {} {} {}", StaticString("prefix "), 42,
+                  2.5, true, 'c', text, buffer, pointer);
+  REQUIRE_FALSE(deferred.Empty());
+  // The arguments are copied
+  text = "changed";
+  buffer[0] = 'X';
+
+  spdlog::details::log_msg msg;
+  deferred.Write(msg);
+  REQUIRE(std::string(msg.raw.data(), msg.raw.size()) ==
+          "prefix 42 2.5 true c text buffer pointer");
+
+  // Without arguments, the message is not a format string
+  DeferredMessage copy;
+  copy.Assign(deferred);
+  deferred.Encode("{} as is");
+  deferred.Write(msg);
+  REQUIRE(std::string(msg.raw.data(), msg.raw.size()) == "{} as is");
+  copy.Write(msg);
+  REQUIRE(std::string(msg.raw.data(), msg.raw.size()) ==
+          "prefix 42 2.5 true c text buffer pointer");
+
+  // Formatting errors end up in the message
+  deferred.Encode("{} {}", 1);
+  deferred.Write(msg);
+  REQUIRE(std::string(msg.raw.data(), msg.raw.size())
+              .find("[*** LOG ERROR ***]") == 0);
+}
+
+TEST_CASE("TestDeferredLogging", "[common][logging][deferred]") {
+  auto sink = std::make_shared<TextSink>();
+  Registry::PushSink(sink);
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+
+  SECTION("synchronous") { REQUIRE_FALSE(Registry::DeferFormatting()); }
+  SECTION("asynchronous") {
+    Registry::EnableAsync();
+    REQUIRE(Registry::DeferFormatting());
+  }
+  SECTION("asynchronous and buffered") {
+    Registry::EnableAsync();
+    Registry::EnableThreadBuffering();
+    REQUIRE(Registry::DeferFormatting());
+  }
+
+  ASLOG_TO_LOGGER(test_logger, info, "deferred {} {}", 42,
+                  std::string("text"));
+  test_logger.flush();
+  REQUIRE(sink->EndsWith("deferred 42 text"));
+
+  // Formatted right away, with the same result
+  ASLOG_TO_LOGGER(test_logger, info, "eager {}", Point{1, 2});
+  test_logger.flush();
+  REQUIRE(sink->EndsWith("eager (1, 2)"));
+
+  ASLOG_TO_LOGGER(test_logger, critical, "critical {}", 7);
+  REQUIRE(sink->EndsWith("critical 7"));
+
+  // The sinks only ever see formatted messages
+  REQUIRE(sink->texts_.size() == 3);
+  REQUIRE(sink->deferred_ == 0);
+
+  Registry::DisableThreadBuffering();
+  Registry::DisableAsync();
+  REQUIRE_FALSE(Registry::DeferFormatting());
+  Registry::PopSink();
+}
+
+}  // namespace logging
+}  // namespace asap
@@ -0,0 +1,71 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>  // for std::remove
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <common/journal.h>
+#include <common/logging.h>
+
+namespace asap {
+namespace logging {
+
+namespace {
+const char *const JOURNAL_PATH = "common_test.journal";
+}  // namespace
+
+TEST_CASE("TestJournalWriteAndRead", "[common][logging][journal]") {
+  constexpr int RECORDS = 5000;
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+  auto line = 0;
+  {
+    // Small blocks to exercise the block transitions
+    auto sink = std::make_shared<JournalSink>(JOURNAL_PATH, 64 * 1024);
+    Registry::PushSink(sink);
+    for (auto ii = 0; ii < RECORDS; ++ii) {
+      line = __LINE__ + 1;
+      ASLOG_TO_LOGGER(test_logger, info, "journal record {}", ii);
+    }
+    // Not logged through the macros, so without a source location
+    test_logger.warn("raw message");
+    Registry::PopSink();
+  }
+
+  JournalReader reader(JOURNAL_PATH);
+  REQUIRE(reader.Size() == RECORDS + 1);
+  for (auto ii : {0, 1, 700, RECORDS - 1}) {
+    auto entry = reader.At(static_cast<std::size_t>(ii));
+    REQUIRE(std::string(entry.message, entry.message_size) ==
+            "journal record " + std::to_string(ii));
+    REQUIRE(entry.level == spdlog::level::info);
+    REQUIRE(std::string(entry.logger) == test_logger.name());
+    REQUIRE(std::string(entry.file) == __FILE__);
+    REQUIRE(entry.line == line);
+    REQUIRE(entry.function != nullptr);
+  }
+  auto last = reader.At(RECORDS);
+  REQUIRE(std::string(last.message, last.message_size) == "raw message");
+  REQUIRE(last.level == spdlog::level::warn);
+  REQUIRE(last.file == nullptr);
+  REQUIRE(last.function == nullptr);
+
+  std::remove(JOURNAL_PATH);
+}
+
+TEST_CASE("TestJournalInvalidFile", "[common][logging][journal]") {
+  {
+    std::ofstream file(JOURNAL_PATH);
+    file << "this is not a journal";
+  }
+  REQUIRE_THROWS_AS(JournalReader(JOURNAL_PATH), std::runtime_error);
+  std::remove(JOURNAL_PATH);
+}
+
+}  // namespace logging
+}  // namespace asap
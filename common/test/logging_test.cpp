@@ -5,6 +5,14 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <common/logging.h>
 
 
@@ -45,17 +53,68 @@ TEST_CASE("TestLogWithPrefix", "[common][logging]") {
   AS_DO_LOG(test_logger, debug, "message {} {} {} {}", 1, 3, 3, 4);
 }
 
+TEST_CASE("TestSourceLocationPrefix", "[common][logging]") {
+  constexpr SourceLocationPrefix short_prefix("dir/file.cpp", 42);
+  REQUIRE(std::string(short_prefix.c_str()) ==
+          "[" + std::string(58, ' ') + "dir/file.cpp:00042] ");
+
+  constexpr SourceLocationPrefix long_prefix(
+      "/home/user/projects/asap/very/long/path/to/some/deeply/nested/source/"
+      "file.cpp",
+      123456);
+  REQUIRE(std::string(long_prefix.c_str()) ==
+          "[/home/u...ts/asap/very/long/path/to/some/deeply/nested/source/"
+          "file.cpp:123456] ");
+}
+
 class MockSink : public spdlog::sinks::sink {
 public:
   void log(const spdlog::details::log_msg &) override {
     ++called_;
   }
-  void flush() override {}
+  void flush() override { ++flushed_; }
   void Reset() { called_ = 0; }
 
   int called_{0};
+  int flushed_{0};
 };
 
+TEST_CASE("TestCompileTimeLevel", "[common][logging]") {
+  auto *mock = new MockSink();
+  auto sink_ptr = std::shared_ptr<spdlog::sinks::sink>(mock);
+  Registry::PushSink(sink_ptr);
+
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+  auto saved_level = test_logger.level();
+  test_logger.set_level(spdlog::level::trace);
+
+  int evaluated = 0;
+  auto count = [&evaluated]() { return ++evaluated; };
+
+#pragma push_macro("ASAP_LOG_ACTIVE_LEVEL")
+#undef ASAP_LOG_ACTIVE_LEVEL
+#define ASAP_LOG_ACTIVE_LEVEL 2  // info
+  // Below the threshold: compiled out, arguments not evaluated
+  ASLOG_TO_LOGGER(test_logger, trace, "{}", count());
+  ASLOG_TO_LOGGER(test_logger, debug, "{}", count());
+  REQUIRE(evaluated == 0);
+  REQUIRE(mock->called_ == 0);
+  // At or above the threshold: logged
+  ASLOG_TO_LOGGER(test_logger, info, "{}", count());
+  ASLOG_TO_LOGGER(test_logger, warn, "{}", count());
+  REQUIRE(evaluated == 2);
+  REQUIRE(mock->called_ == 2);
+  // Runtime filtering still applies above the threshold
+  test_logger.set_level(spdlog::level::err);
+  ASLOG_TO_LOGGER(test_logger, warn, "{}", count());
+  REQUIRE(evaluated == 2);
+  REQUIRE(mock->called_ == 2);
+#pragma pop_macro("ASAP_LOG_ACTIVE_LEVEL")
+
+  test_logger.set_level(saved_level);
+  Registry::PopSink();
+}
+
 TEST_CASE("TestLogPushSink", "[common][logging]") {
   auto *first_mock = new MockSink();
   auto *second_mock = new MockSink();
@@ -95,5 +154,515 @@ TEST_CASE("TestLogPushSink", "[common][logging]") {
   second_mock->Reset();
 }
 
+TEST_CASE("TestLogAddSink", "[common][logging]") {
+  auto current_mock = std::make_shared<MockSink>();
+  auto all_mock = std::make_shared<MockSink>();
+  auto filtered_mock = std::make_shared<MockSink>();
+  Registry::PushSink(current_mock);
+  auto all_branch = Registry::AddSink(all_mock);
+  // Only the warnings of the testing logger
+  auto filtered_branch =
+      Registry::AddSink(filtered_mock, spdlog::level::warn, {Id::TESTING});
+
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+  auto &misc_logger = Registry::GetLogger(Id::MISC);
+  ASLOG_TO_LOGGER(test_logger, debug, "message");
+  ASLOG_TO_LOGGER(test_logger, warn, "message");
+  ASLOG_TO_LOGGER(misc_logger, warn, "message");
+  REQUIRE(current_mock->called_ == 3);
+  REQUIRE(all_mock->called_ == 3);
+  REQUIRE(filtered_mock->called_ == 1);
+
+  // Added sinks are kept when the current sink changes
+  auto pushed_mock = std::make_shared<MockSink>();
+  Registry::PushSink(pushed_mock);
+  Registry::SetSinkLevel(filtered_branch, spdlog::level::debug);
+  ASLOG_TO_LOGGER(test_logger, debug, "message");
+  REQUIRE(current_mock->called_ == 3);
+  REQUIRE(pushed_mock->called_ == 1);
+  REQUIRE(all_mock->called_ == 4);
+  REQUIRE(filtered_mock->called_ == 2);
+  Registry::PopSink();
+
+  Registry::RemoveSink(all_branch);
+  Registry::RemoveSink(filtered_branch);
+  ASLOG_TO_LOGGER(test_logger, warn, "message");
+  REQUIRE(current_mock->called_ == 4);
+  REQUIRE(all_mock->called_ == 4);
+  REQUIRE(filtered_mock->called_ == 2);
+  Registry::PopSink();
+}
+
+TEST_CASE("TestFanOutSinkUnknownLogger", "[common][logging]") {
+  FanOutSink fan_out;
+  auto all_mock = std::make_shared<MockSink>();
+  auto filtered_mock = std::make_shared<MockSink>();
+  fan_out.AddSink(all_mock);
+  fan_out.AddSink(filtered_mock, spdlog::level::trace, {Id::TESTING});
+
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+  spdlog::details::log_msg msg;
+  msg.level = spdlog::level::info;
+  msg.logger_name = &test_logger.name();
+  fan_out.log(msg);
+  REQUIRE(all_mock->called_ == 1);
+  REQUIRE(filtered_mock->called_ == 1);
+
+  // Messages are matched to their logger by the address of the name only
+  auto copied_name = test_logger.name();
+  msg.logger_name = &copied_name;
+  fan_out.log(msg);
+  msg.logger_name = nullptr;
+  fan_out.log(msg);
+  REQUIRE(all_mock->called_ == 3);
+  REQUIRE(filtered_mock->called_ == 1);
+}
+
+TEST_CASE("TestLogAddSinkWhileLogging", "[common][logging]") {
+  class CountingSink : public spdlog::sinks::sink {
+   public:
+    void log(const spdlog::details::log_msg &) override { ++called_; }
+    void flush() override {}
+    std::atomic<int> called_{0};
+  };
+
+  auto current = std::make_shared<CountingSink>();
+  Registry::PushSink(current);
+
+  constexpr int THREADS = 4;
+  constexpr int MESSAGES = 2000;
+  std::vector<std::thread> threads;
+  for (auto ii = 0; ii < THREADS; ++ii) {
+    threads.emplace_back([]() {
+      auto &test_logger = Registry::GetLogger(Id::TESTING);
+      for (auto jj = 0; jj < MESSAGES; ++jj) {
+        ASLOG_TO_LOGGER(test_logger, info, "message {}", jj);
+      }
+    });
+  }
+  // Branches come and go without disturbing the logging threads
+  auto added = std::make_shared<CountingSink>();
+  for (auto ii = 0; ii < 100; ++ii) {
+    Registry::RemoveSink(Registry::AddSink(added));
+  }
+  for (auto &thread : threads) thread.join();
+
+  REQUIRE(current->called_ == THREADS * MESSAGES);
+  REQUIRE(added->called_ <= THREADS * MESSAGES);
+  // Only referenced here once removed
+  REQUIRE(added.use_count() == 1);
+  Registry::PopSink();
+}
+
+namespace {
+struct RegisteredLogger {
+  static constexpr char const *LOGGER_NAME = "registered";
+};
+}  // namespace
+
+TEST_CASE("TestRegisterLogger", "[common][logging]") {
+  // Predefined loggers are registered first, in the Id order
+  auto loggers = Registry::Loggers();
+  REQUIRE(loggers.size() >= static_cast<std::size_t>(Id::INVALID_));
+  REQUIRE(loggers[static_cast<std::size_t>(Id::TESTING)]->Handle() ==
+          LoggerHandle(Id::TESTING));
+
+  auto handle = Registry::RegisterLogger("registered");
+  REQUIRE(Registry::RegisterLogger("registered") == handle);
+  REQUIRE(handle.Index() >= static_cast<std::size_t>(Id::INVALID_));
+  auto &logger = Registry::GetLogger(handle);
+  REQUIRE(logger.name() == "registered");
+
+  // Found by address as well as by name
+  LoggerHandle found(Id::MISC);
+  REQUIRE(Registry::FindLogger(logger.name(), found));
+  REQUIRE(found == handle);
+  found = LoggerHandle(Id::MISC);
+  REQUIRE(Registry::FindLogger(std::string("registered"), found));
+  REQUIRE(found == handle);
+  REQUIRE_FALSE(Registry::FindLogger("not registered", found));
+
+  // Mixins cache the same logger
+  class Foo : NamedLoggable<RegisteredLogger> {
+   public:
+    static spdlog::logger &Logger() { return ASLOGGER(); }
+  };
+  REQUIRE(&Foo::Logger() == &logger);
+
+  // Loggers registered later get the current level
+  Registry::SetLogLevel(spdlog::level::warn);
+  auto &late_logger =
+      Registry::GetLogger(Registry::RegisterLogger("registered later"));
+  REQUIRE(late_logger.level() == spdlog::level::warn);
+  Registry::SetLogLevel(spdlog::level::trace);
+  REQUIRE(late_logger.level() == spdlog::level::trace);
+
+  // Added sinks can be restricted to registered loggers
+  auto current_mock = std::make_shared<MockSink>();
+  auto filtered_mock = std::make_shared<MockSink>();
+  Registry::PushSink(current_mock);
+  auto filtered_branch =
+      Registry::AddSink(filtered_mock, spdlog::level::trace, {handle});
+  ASLOG_TO_LOGGER(logger, debug, "message");
+  ASLOG_TO_LOGGER(late_logger, debug, "message");
+  ASLOG_MISC(debug, "message");
+  REQUIRE(current_mock->called_ == 3);
+  REQUIRE(filtered_mock->called_ == 1);
+  Registry::RemoveSink(filtered_branch);
+  Registry::PopSink();
+}
+
+TEST_CASE("TestRegisterLoggerWhileLogging", "[common][logging]") {
+  auto mock = std::make_shared<MockSink>();
+  Registry::PushSink(mock);
+  auto branch = Registry::AddSink(std::make_shared<MockSink>(),
+                                  spdlog::level::trace, {Id::TESTING});
+
+  std::atomic<bool> stop{false};
+  std::thread logging([&stop]() {
+    auto &test_logger = Registry::GetLogger(Id::TESTING);
+    while (!stop.load()) ASLOG_TO_LOGGER(test_logger, trace, "message");
+  });
+  std::vector<LoggerHandle> handles;
+  for (auto ii = 0; ii < 32; ++ii) {
+    handles.push_back(
+        Registry::RegisterLogger("concurrent " + std::to_string(ii)));
+  }
+  stop.store(true);
+  logging.join();
+
+  for (auto ii = 0; ii < 32; ++ii) {
+    REQUIRE(Registry::GetLogger(handles[static_cast<std::size_t>(ii)]).name() ==
+            "concurrent " + std::to_string(ii));
+  }
+  Registry::RemoveSink(branch);
+  Registry::PopSink();
+}
+
+TEST_CASE("TestRateLimitedLogging", "[common][logging]") {
+  auto mock = std::make_shared<MockSink>();
+  Registry::PushSink(mock);
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+
+  for (auto ii = 0; ii < 10; ++ii) {
+    ASLOG_TO_LOGGER_EVERY_N(test_logger, debug, 4, "every 4 {}", ii);
+  }
+  // 1st, 5th and 9th
+  REQUIRE(mock->called_ == 3);
+  mock->Reset();
+
+  for (auto ii = 0; ii < 10; ++ii) {
+    ASLOG_TO_LOGGER_ONCE(test_logger, debug, "once {}", ii);
+  }
+  REQUIRE(mock->called_ == 1);
+  mock->Reset();
+
+  auto log_every_ms = [&test_logger]() {
+    ASLOG_TO_LOGGER_EVERY_MS(test_logger, debug, 20, "every 20ms");
+  };
+  log_every_ms();
+  log_every_ms();
+  REQUIRE(mock->called_ == 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  log_every_ms();
+  log_every_ms();
+  REQUIRE(mock->called_ == 2);
+  mock->Reset();
+
+  // Each statement has its own limiter, and suppressed calls do not count
+  auto saved_level = test_logger.level();
+  test_logger.set_level(spdlog::level::info);
+  ASLOG_TO_LOGGER_ONCE(test_logger, debug, "first statement");
+  ASLOG_TO_LOGGER_ONCE(test_logger, info, "second statement");
+  REQUIRE(mock->called_ == 1);
+  test_logger.set_level(saved_level);
+  mock->Reset();
+
+  // The logger expression is evaluated once
+  auto evaluated = 0;
+  auto get_logger = [&test_logger, &evaluated]() -> spdlog::logger & {
+    ++evaluated;
+    return test_logger;
+  };
+  ASLOG_TO_LOGGER_ONCE(get_logger(), debug, "evaluated once");
+  REQUIRE(evaluated == 1);
+  REQUIRE(mock->called_ == 1);
+
+  // The limiters are shared by the threads
+  EveryNLimiter limiter;
+  std::atomic<int> allowed{0};
+  std::vector<std::thread> threads;
+  for (auto ii = 0; ii < 4; ++ii) {
+    threads.emplace_back([&limiter, &allowed]() {
+      for (auto jj = 0; jj < 1000; ++jj) {
+        if (limiter.Allow(10)) ++allowed;
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  REQUIRE(allowed == 400);
+
+  Registry::PopSink();
+}
+
+TEST_CASE("TestAsyncLogging", "[common][logging]") {
+  auto *mock = new MockSink();
+  auto sink_ptr = std::shared_ptr<spdlog::sinks::sink>(mock);
+
+  Registry::EnableAsync();
+  REQUIRE(Registry::AsyncBackend() != nullptr);
+  Registry::PushSink(sink_ptr);
+
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+  std::thread th1([&test_logger]() {
+    for (auto ii = 0; ii < 100; ++ii)
+      ASLOG_TO_LOGGER(test_logger, debug, "Logging from thread 1: {}", ii);
+  });
+  std::thread th2([&test_logger]() {
+    for (auto ii = 0; ii < 100; ++ii)
+      ASLOG_TO_LOGGER(test_logger, debug, "Logging from thread 2: {}", ii);
+  });
+  th1.join();
+  th2.join();
+
+  // Flushing waits for all pending messages to be processed
+  test_logger.flush();
+  REQUIRE(mock->called_ == 200);
+
+  Registry::PopSink();
+  Registry::DisableAsync();
+  REQUIRE(Registry::AsyncBackend() == nullptr);
+
+  ASLOG_TO_LOGGER(test_logger, debug, "message");
+  REQUIRE(mock->called_ == 200);
+}
+
+TEST_CASE("TestAsyncFlushFromSignal", "[common][logging]") {
+  auto mock = std::make_shared<MockSink>();
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+
+  // Nothing to flush when logging is synchronous
+  REQUIRE(Registry::FlushFromSignal(std::chrono::milliseconds(0)));
+
+  Registry::EnableAsync();
+  Registry::PushSink(mock);
+  for (auto ii = 0; ii < 100; ++ii) {
+    ASLOG_TO_LOGGER(test_logger, debug, "message {}", ii);
+  }
+  // Pending messages are delivered and the sink is flushed by the drain
+  // thread, without the locks of flush()
+  REQUIRE(Registry::FlushFromSignal(std::chrono::milliseconds(5000)));
+  REQUIRE(mock->called_ == 100);
+  REQUIRE(mock->flushed_ == 1);
+
+  Registry::PopSink();
+  Registry::DisableAsync();
+}
+
+TEST_CASE("TestThreadBuffering", "[common][logging]") {
+  class SequenceSink : public spdlog::sinks::sink {
+   public:
+    void log(const spdlog::details::log_msg &msg) override {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ids_.push_back(msg.msg_id);
+      formatted_.emplace_back(msg.formatted.data(), msg.formatted.size());
+    }
+    void flush() override {}
+    std::size_t Count() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return ids_.size();
+    }
+    std::mutex mutex_;
+    std::vector<std::size_t> ids_;
+    std::vector<std::string> formatted_;
+  };
+
+  auto sink = std::make_shared<SequenceSink>();
+  Registry::PushSink(sink);
+  // The text of the messages is the sequence number alone
+  Registry::SetLogFormat("%i");
+  // Long enough for the batches not to be handed over by the flusher thread
+  Registry::EnableThreadBuffering(16, std::chrono::seconds(60));
+
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+  ASLOG_TO_LOGGER(test_logger, info, "buffered");
+  REQUIRE(sink->Count() == 0);
+  // Critical messages are handed over right away, with their batch
+  ASLOG_TO_LOGGER(test_logger, critical, "handed over");
+  REQUIRE(sink->Count() == 2);
+
+  // Batches are handed over when full and when their thread exits
+  constexpr std::size_t THREADS = 4;
+  constexpr std::size_t MESSAGES = 100;
+  std::vector<std::thread> threads;
+  for (std::size_t ii = 0; ii < THREADS; ++ii) {
+    threads.emplace_back([&test_logger]() {
+      for (std::size_t jj = 0; jj < MESSAGES; ++jj)
+        ASLOG_TO_LOGGER(test_logger, info, "message {}", jj);
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  REQUIRE(sink->Count() == 2 + THREADS * MESSAGES);
+
+  // The sequence numbers give a total order of the messages
+  ASLOG_TO_LOGGER(test_logger, info, "flushed");
+  test_logger.flush();
+  auto ids = sink->ids_;
+  REQUIRE(ids.size() == 3 + THREADS * MESSAGES);
+  // They are known when the messages are formatted
+  for (std::size_t ii = 0; ii < ids.size(); ++ii) {
+    REQUIRE(std::stoull(sink->formatted_[ii]) == ids[ii]);
+  }
+  std::sort(ids.begin(), ids.end());
+  for (std::size_t ii = 1; ii < ids.size(); ++ii) {
+    REQUIRE(ids[ii] == ids[0] + ii);
+  }
+
+  Registry::DisableThreadBuffering();
+  ASLOG_TO_LOGGER(test_logger, info, "direct");
+  REQUIRE(sink->Count() == 4 + THREADS * MESSAGES);
+  Registry::SetLogFormat(Logger::DEFAULT_LOG_FORMAT);
+  Registry::PopSink();
+}
+
+/// A sink that remembers the source location and the text of the last
+/// message, without its location prefix.
+class LocationSink : public spdlog::sinks::sink {
+public:
+  void log(const spdlog::details::log_msg &msg) override {
+    source_ = SourceLocation::Current();
+    auto skip = source_ ? source_->PrefixLength() : 0;
+    text_ = std::string(msg.raw.data() + skip, msg.raw.size() - skip);
+  }
+  void flush() override {}
+
+  SourceLocation const *source_{nullptr};
+  std::string text_;
+};
+
+TEST_CASE("TestSourceLocation", "[common][logging]") {
+  auto sink = std::make_shared<LocationSink>();
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+
+  auto check = [&sink, &test_logger](bool async) {
+    if (async) Registry::EnableAsync();
+    Registry::PushSink(sink);
+    auto line = __LINE__ + 1;
+    ASLOG_TO_LOGGER(test_logger, debug, "located {}", 42);
+    test_logger.flush();
+    Registry::PopSink();
+    if (async) Registry::DisableAsync();
+
+    REQUIRE(sink->source_ != nullptr);
+    REQUIRE(std::string(sink->source_->File()) == __FILE__);
+    REQUIRE(sink->source_->Line() == line);
+    REQUIRE(!std::string(sink->source_->Function()).empty());
+    REQUIRE(sink->text_ == "located 42");
+  };
+  check(false);
+  check(true);
+
+  // Nothing is published outside of a logging call
+  REQUIRE(SourceLocation::Current() == nullptr);
+}
+
+/// A sink that blocks the first message it receives until released, and
+/// remembers the text of all messages.
+class GatedSink : public spdlog::sinks::sink {
+ public:
+  void log(const spdlog::details::log_msg &msg) override {
+    if (!entered_.exchange(true)) {
+      while (!released_.load()) std::this_thread::yield();
+    }
+    messages_.push_back(msg.raw.str());
+  }
+  void flush() override {}
+  void WaitUntilEntered() {
+    while (!entered_.load()) std::this_thread::yield();
+  }
+  void Release() { released_.store(true); }
+
+  std::vector<std::string> messages_;
+  std::atomic<bool> entered_{false};
+  std::atomic<bool> released_{false};
+};
+
+void LogWithOverflow(AsyncSink &async, GatedSink &gated) {
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+  auto log = [&async, &test_logger](int value) {
+    spdlog::details::log_msg msg(&test_logger.name(), spdlog::level::info);
+    msg.raw << std::to_string(value);
+    async.log(msg);
+  };
+
+  // Block the drain thread on the first message then fill the ring buffer
+  // (capacity is 4) and overflow it by 3
+  log(0);
+  gated.WaitUntilEntered();
+  for (auto ii = 1; ii <= 7; ++ii) log(ii);
+  gated.Release();
+  async.flush();
+}
+
+TEST_CASE("TestAsyncOverflowDropNewest", "[common][logging]") {
+  auto gated = std::make_shared<GatedSink>();
+  AsyncSink async(gated, 4, AsyncSink::OverflowPolicy::DROP_NEWEST);
+  LogWithOverflow(async, *gated);
+
+  REQUIRE(async.DroppedNewest() == 3);
+  REQUIRE(async.DroppedOldest() == 0);
+  REQUIRE(gated->messages_ ==
+          std::vector<std::string>{"0", "1", "2", "3", "4"});
+}
+
+TEST_CASE("TestAsyncOverflowDropOldest", "[common][logging]") {
+  auto gated = std::make_shared<GatedSink>();
+  AsyncSink async(gated, 4, AsyncSink::OverflowPolicy::DROP_OLDEST);
+  LogWithOverflow(async, *gated);
+
+  REQUIRE(async.DroppedNewest() == 0);
+  REQUIRE(async.DroppedOldest() == 3);
+  REQUIRE(gated->messages_ ==
+          std::vector<std::string>{"0", "4", "5", "6", "7"});
+}
+
+TEST_CASE("TestAsyncOverflowBlock", "[common][logging]") {
+  auto gated = std::make_shared<GatedSink>();
+  AsyncSink async(gated, 4, AsyncSink::OverflowPolicy::BLOCK);
+  std::thread releaser([&gated]() {
+    gated->WaitUntilEntered();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gated->Release();
+  });
+  LogWithOverflow(async, *gated);
+  releaser.join();
+
+  REQUIRE(async.DroppedNewest() == 0);
+  REQUIRE(async.DroppedOldest() == 0);
+  REQUIRE(gated->messages_.size() == 8);
+}
+
+TEST_CASE("TestAsyncStopWhileLogging", "[common][logging]") {
+  auto mock = std::make_shared<MockSink>();
+  AsyncSink async(mock, 16, AsyncSink::OverflowPolicy::BLOCK);
+  auto &test_logger = Registry::GetLogger(Id::TESTING);
+  constexpr int THREADS = 4;
+  constexpr int MESSAGES = 2000;
+  std::atomic<int> started{0};
+  std::vector<std::thread> threads;
+  for (auto ii = 0; ii < THREADS; ++ii) {
+    threads.emplace_back([&async, &test_logger, &started]() {
+      spdlog::details::log_msg msg(&test_logger.name(), spdlog::level::info);
+      started.fetch_add(1);
+      for (auto jj = 0; jj < MESSAGES; ++jj) async.log(msg);
+    });
+  }
+  while (started.load() < THREADS) std::this_thread::yield();
+  // Messages enqueued while stopping are still delivered
+  async.Stop();
+  for (auto &thread : threads) thread.join();
+  REQUIRE(mock->called_ == THREADS * MESSAGES);
+}
+
 }  // namespace logging
 }  // namespace asap
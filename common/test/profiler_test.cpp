@@ -0,0 +1,111 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <common/profiler.h>
+
+namespace asap {
+
+namespace {
+/// The zones recorded by the thread with the given name.
+std::vector<ProfileZone> ZonesOf(const std::string &thread_name) {
+  for (auto &profile : Profiler::Snapshot()) {
+    if (profile.thread_name == thread_name) return profile.zones;
+  }
+  return {};
+}
+}  // namespace
+
+#if ASAP_USE_PROFILER
+
+TEST_CASE("TestProfileScopesNest", "[common][profiler]") {
+  Profiler::Enable();
+  std::thread([]() {
+    Profiler::SetThreadName("nest");
+    ASAP_PROFILE_SCOPE("outer");
+    { ASAP_PROFILE_SCOPE("inner"); }
+    { ASAP_PROFILE_SCOPE("inner"); }
+  }).join();
+  Profiler::Enable(false);
+
+  auto zones = ZonesOf("nest");
+  REQUIRE(zones.size() == 3);
+  // Zones are recorded when they end
+  REQUIRE(std::string(zones[0].name) == "inner");
+  REQUIRE(std::string(zones[1].name) == "inner");
+  REQUIRE(std::string(zones[2].name) == "outer");
+  REQUIRE(zones[0].depth == 1);
+  REQUIRE(zones[1].depth == 1);
+  REQUIRE(zones[2].depth == 0);
+  REQUIRE(zones[0].end <= zones[1].begin);
+  REQUIRE(zones[2].begin <= zones[0].begin);
+  REQUIRE(zones[1].end <= zones[2].end);
+}
+
+TEST_CASE("TestDisabledProfilerRecordsNothing", "[common][profiler]") {
+  Profiler::Enable(false);
+  std::thread([]() {
+    Profiler::SetThreadName("disabled");
+    ASAP_PROFILE_SCOPE("zone");
+  }).join();
+  REQUIRE(ZonesOf("disabled").empty());
+}
+
+TEST_CASE("TestProfilerKeepsMostRecentZones", "[common][profiler]") {
+  Profiler::Enable();
+  std::thread([]() {
+    Profiler::SetThreadName("ring");
+    for (std::size_t ii = 0; ii < Profiler::ZONES_PER_THREAD + 10; ++ii) {
+      ASAP_PROFILE_SCOPE("zone");
+    }
+    ASAP_PROFILE_SCOPE("last");
+  }).join();
+  Profiler::Enable(false);
+
+  auto zones = ZonesOf("ring");
+  REQUIRE(zones.size() == Profiler::ZONES_PER_THREAD);
+  REQUIRE(std::string(zones.back().name) == "last");
+  for (std::size_t ii = 1; ii < zones.size(); ++ii) {
+    REQUIRE(zones[ii - 1].end <= zones[ii].end);
+  }
+
+  Profiler::Clear();
+  REQUIRE(ZonesOf("ring").empty());
+}
+
+TEST_CASE("TestProfilerSnapshotWhileRecording", "[common][profiler]") {
+  Profiler::Enable();
+  std::atomic<bool> stop{false};
+  std::thread writer([&stop]() {
+    Profiler::SetThreadName("writer");
+    while (!stop.load()) {
+      ASAP_PROFILE_SCOPE("outer");
+      ASAP_PROFILE_SCOPE("inner");
+    }
+  });
+
+  // Snapshots never see partially overwritten zones
+  for (auto ii = 0; ii < 100; ++ii) {
+    for (auto const &zone : ZonesOf("writer")) {
+      auto name = std::string(zone.name);
+      REQUIRE((name == "outer" || name == "inner"));
+      REQUIRE(zone.depth == (name == "outer" ? 0 : 1));
+      REQUIRE(zone.begin <= zone.end);
+    }
+  }
+  stop = true;
+  writer.join();
+  Profiler::Enable(false);
+}
+
+#endif  // ASAP_USE_PROFILER
+
+}  // namespace asap
@@ -0,0 +1,91 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <catch2/catch.hpp>
+
+#include <string>
+
+#include <common/record_store.h>
+
+namespace asap {
+
+namespace {
+using Store = RecordStore<int>;
+
+std::size_t Push(Store &store, int header, const std::string &text) {
+  return store.Push(header, text.data(), text.size());
+}
+
+std::string TextAt(const Store &store, std::size_t seq) {
+  return std::string(store.TextAt(seq), store.TextSizeAt(seq));
+}
+}  // namespace
+
+TEST_CASE("TestRecordStorePushAndRead", "[common][record_store]") {
+  Store store(1000, 1 << 20, 64);
+  for (auto ii = 0; ii < 100; ++ii) {
+    REQUIRE(Push(store, ii, "record " + std::to_string(ii)) ==
+            static_cast<std::size_t>(ii));
+  }
+  REQUIRE(store.Size() == 100);
+  REQUIRE(store.FirstSequence() == 0);
+  REQUIRE(store.EndSequence() == 100);
+  for (std::size_t seq = 0; seq < 100; ++seq) {
+    REQUIRE(store.HeaderAt(seq) == static_cast<int>(seq));
+    REQUIRE(TextAt(store, seq) == "record " + std::to_string(seq));
+  }
+}
+
+TEST_CASE("TestRecordStoreRecordLimit", "[common][record_store]") {
+  Store store(10, 1 << 20, 64);
+  for (auto ii = 0; ii < 25; ++ii) Push(store, ii, std::to_string(ii));
+  REQUIRE(store.Size() == 10);
+  REQUIRE(store.FirstSequence() == 15);
+  REQUIRE_FALSE(store.Contains(14));
+  REQUIRE(store.HeaderAt(15) == 15);
+  REQUIRE(TextAt(store, 24) == "24");
+
+  store.SetLimits(3, 1 << 20);
+  REQUIRE(store.Size() == 3);
+  REQUIRE(store.FirstSequence() == 22);
+  REQUIRE(TextAt(store, 22) == "22");
+}
+
+TEST_CASE("TestRecordStoreMemoryLimit", "[common][record_store]") {
+  // 4 blocks of 64 bytes, each holding 4 records of 16 bytes
+  Store store(1000, 256, 64);
+  auto text = std::string(16, 'x');
+  for (auto ii = 0; ii < 100; ++ii) Push(store, ii, text);
+  REQUIRE(store.Size() <= 16);
+  REQUIRE(store.Size() > 12);
+  REQUIRE(store.EndSequence() == 100);
+  REQUIRE(store.HeaderAt(99) == 99);
+
+  // Oversized records get their own block, and are kept even alone
+  auto big = std::string(1000, 'y');
+  auto seq = Push(store, -1, big);
+  REQUIRE(store.Size() == 1);
+  REQUIRE(TextAt(store, seq) == big);
+  Push(store, -2, text);
+  REQUIRE(store.Size() == 1);
+  REQUIRE(store.HeaderAt(store.FirstSequence()) == -2);
+}
+
+TEST_CASE("TestRecordStoreClear", "[common][record_store]") {
+  Store store(1000, 1 << 20, 64);
+  for (auto ii = 0; ii < 50; ++ii) Push(store, ii, "some text");
+  store.Clear();
+  REQUIRE(store.Empty());
+  REQUIRE(store.FirstSequence() == 50);
+  REQUIRE(store.EndSequence() == 50);
+  REQUIRE_FALSE(store.Contains(49));
+
+  // Sequence numbers are not reused
+  REQUIRE(Push(store, 7, "after clear") == 50);
+  REQUIRE(TextAt(store, 50) == "after clear");
+  REQUIRE(store.HeaderAt(50) == 7);
+}
+
+}  // namespace asap
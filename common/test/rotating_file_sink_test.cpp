@@ -0,0 +1,227 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>  // for std::remove
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include <common/config.h>
+#include <common/rotating_file_sink.h>
+
+#if !defined ASAP_WINDOWS
+#include <sys/stat.h>  // for mkdir
+#endif
+
+namespace asap {
+namespace logging {
+
+namespace {
+const char *const LOG_PATH = "common_test_rotating.log";
+
+bool FileExists(const std::string &path) {
+  return std::ifstream(path).good();
+}
+
+std::string ReadFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+void RemoveFiles(const RotatingFileSink &sink, std::size_t archives) {
+  std::remove(LOG_PATH);
+  for (std::size_t index = 1; index <= archives + 1; ++index) {
+    std::remove(sink.ArchivePath(index).c_str());
+  }
+}
+
+RotatingFileSink::Options TestOptions(std::size_t max_files, bool compress) {
+  RotatingFileSink::Options options;
+  options.path = LOG_PATH;
+  options.max_size = 1000;
+  options.max_files = max_files;
+  options.compress = compress;
+  options.buffer_size = 256;
+  options.flush_interval = std::chrono::milliseconds(0);
+  return options;
+}
+}  // namespace
+
+TEST_CASE("TestRotatingFileSinkKeepsAllMessages",
+          "[common][logging][rotating_file_sink]") {
+  std::remove(LOG_PATH);
+  auto sink = std::make_shared<RotatingFileSink>(TestOptions(100, false));
+  std::string expected;
+  {
+    spdlog::logger logger("rotating", sink);
+    logger.set_pattern("%v");
+    for (auto ii = 0; ii < 200; ++ii) {
+      auto message = "rotating file sink message " + std::to_string(ii);
+      logger.info(message);
+      expected += message + spdlog::details::os::default_eol;
+    }
+    logger.flush();
+  }
+  sink->WaitForArchives();
+
+  // Archives are numbered from the most recent one
+  std::string contents;
+  std::size_t archives = 0;
+  while (FileExists(sink->ArchivePath(archives + 1))) ++archives;
+  REQUIRE(archives > 1);
+  for (auto index = archives; index > 0; --index) {
+    auto archive = ReadFile(sink->ArchivePath(index));
+    REQUIRE(archive.size() <= 1000);
+    contents += archive;
+  }
+  contents += ReadFile(LOG_PATH);
+  REQUIRE(contents == expected);
+
+  RemoveFiles(*sink, archives);
+}
+
+TEST_CASE("TestRotatingFileSinkMaxFiles",
+          "[common][logging][rotating_file_sink]") {
+  std::remove(LOG_PATH);
+  auto compress = RotatingFileSink::CompressionSupported();
+  auto sink = std::make_shared<RotatingFileSink>(TestOptions(3, compress));
+  {
+    spdlog::logger logger("rotating", sink);
+    logger.set_pattern("%v");
+    for (auto ii = 0; ii < 200; ++ii) {
+      logger.info("rotating file sink message {}", ii);
+    }
+    logger.flush();
+  }
+  sink->WaitForArchives();
+
+  for (std::size_t index = 1; index <= 3; ++index) {
+    REQUIRE(FileExists(sink->ArchivePath(index)));
+    if (compress) {
+      // gzip magic number
+      auto archive = ReadFile(sink->ArchivePath(index));
+      REQUIRE(archive.size() > 2);
+      REQUIRE(static_cast<unsigned char>(archive[0]) == 0x1f);
+      REQUIRE(static_cast<unsigned char>(archive[1]) == 0x8b);
+    }
+  }
+  REQUIRE_FALSE(FileExists(sink->ArchivePath(4)));
+
+  RemoveFiles(*sink, 3);
+}
+
+TEST_CASE("TestRotatingFileSinkShiftsUncompressedArchives",
+          "[common][logging][rotating_file_sink]") {
+  if (!RotatingFileSink::CompressionSupported()) return;
+  std::remove(LOG_PATH);
+  auto sink = std::make_shared<RotatingFileSink>(TestOptions(2, true));
+  // Left by a compression that failed
+  auto plain = sink->ArchivePath(1);
+  plain.resize(plain.size() - std::string(".gz").size());
+  std::ofstream(plain) << "uncompressed archive\n";
+  {
+    spdlog::logger logger("rotating", sink);
+    logger.set_pattern("%v");
+    for (auto ii = 0; ii < 200; ++ii) {
+      logger.info("rotating file sink message {}", ii);
+    }
+    logger.flush();
+  }
+  sink->WaitForArchives();
+
+  // Shifted like the compressed archives, then pruned
+  REQUIRE_FALSE(FileExists(plain));
+  auto shifted = sink->ArchivePath(2);
+  shifted.resize(shifted.size() - std::string(".gz").size());
+  REQUIRE_FALSE(FileExists(shifted));
+  REQUIRE(FileExists(sink->ArchivePath(2)));
+
+  RemoveFiles(*sink, 2);
+}
+
+TEST_CASE("TestRotatingFileSinkWritesErrorsThrough",
+          "[common][logging][rotating_file_sink]") {
+  std::remove(LOG_PATH);
+  auto options = TestOptions(0, false);
+  options.buffer_size = 64 * 1024;
+  auto sink = std::make_shared<RotatingFileSink>(options);
+  spdlog::logger logger("rotating", sink);
+  logger.set_pattern("%v");
+
+  logger.info("buffered");
+  REQUIRE(ReadFile(LOG_PATH).empty());
+  // Written with the messages buffered before it, without flushing
+  logger.error("written through");
+  auto eol = std::string(spdlog::details::os::default_eol);
+  REQUIRE(ReadFile(LOG_PATH) == "buffered" + eol + "written through" + eol);
+
+  std::remove(LOG_PATH);
+}
+
+#if defined __linux__
+TEST_CASE("TestRotatingFileSinkDropsShortWrites",
+          "[common][logging][rotating_file_sink]") {
+  // Writes to /dev/full always fail for lack of space
+  auto options = TestOptions(0, false);
+  options.path = "/dev/full";
+  options.max_size = std::numeric_limits<std::size_t>::max();
+  auto sink = std::make_shared<RotatingFileSink>(options);
+  spdlog::logger logger("rotating", sink);
+  logger.set_pattern("%v");
+  for (auto ii = 0; ii < 10; ++ii) {
+    logger.info("rotating file sink message {}", ii);
+  }
+  logger.flush();
+  REQUIRE(sink->Dropped() == 10);
+}
+#endif  // __linux__
+
+#if !defined ASAP_WINDOWS
+TEST_CASE("TestRotatingFileSinkDropsWithoutFile",
+          "[common][logging][rotating_file_sink]") {
+  const std::string dir = "common_test_rotating_dir";
+  ::mkdir(dir.c_str(), 0755);
+  auto options = TestOptions(0, false);
+  options.path = dir + "/app.log";
+  std::remove(options.path.c_str());
+  auto sink = std::make_shared<RotatingFileSink>(options);
+  spdlog::logger logger("rotating", sink);
+  logger.set_pattern("%v");
+  auto log = [&logger](int count) {
+    for (auto ii = 0; ii < count; ++ii) {
+      logger.info("rotating file sink message {}", ii);
+    }
+  };
+
+  // The new file cannot be opened when rotating
+  log(10);
+  logger.flush();
+  std::remove(options.path.c_str());
+  std::remove(dir.c_str());
+  log(100);
+  logger.flush();
+  REQUIRE(sink->Dropped() > 0);
+
+  // Opening is retried when writing the buffer
+  ::mkdir(dir.c_str(), 0755);
+  auto dropped = sink->Dropped();
+  log(10);
+  logger.flush();
+  REQUIRE(sink->Dropped() == dropped);
+  REQUIRE(FileExists(options.path));
+
+  sink->WaitForArchives();
+  std::remove(options.path.c_str());
+  std::remove(dir.c_str());
+}
+#endif  // ASAP_WINDOWS
+
+}  // namespace logging
+}  // namespace asap
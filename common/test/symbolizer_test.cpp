@@ -0,0 +1,142 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>  // for std::remove
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <common/assert.h>
+#include <common/config.h>
+#include <common/symbolizer.h>
+
+namespace asap {
+
+namespace {
+const char *const CACHE_PATH = "common_test_symbolizer.cache";
+
+std::string ReadFile(const char *path) {
+  std::ifstream file(path);
+  std::ostringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+}  // namespace
+
+TEST_CASE("TestModuleMapParsing", "[common][symbolizer]") {
+  ModuleMap modules;
+  modules.AddProcMaps(
+      "00400000-00452000 r-xp 00001000 08:02 173521      /usr/bin/dbus daemon\n"
+      "00651000-00652000 rw-p 00051000 08:02 173521      /usr/bin/dbus daemon\n"
+      "7fff4c000000-7fff4c021000 r-xp 00000000 00:00 0 \n"
+      "7ffff7dd1000-7ffff7dd2000 r-xp 00000000 00:00 0   [vdso]\n");
+  REQUIRE(modules.AddModuleLine("module 0x7f00-0x8000 0x300 /lib/libc.so.6"));
+  REQUIRE_FALSE(modules.AddModuleLine("frame 1 0x7f10"));
+
+  // Only executable mappings of files
+  auto const *mapping = modules.Find(0x400010);
+  REQUIRE(mapping != nullptr);
+  REQUIRE(mapping->path == "/usr/bin/dbus daemon");
+  REQUIRE(mapping->offset == 0x1000);
+  REQUIRE(modules.Find(0x651000) == nullptr);
+  REQUIRE(modules.Find(0x7fff4c000010) == nullptr);
+  REQUIRE(modules.Find(0x7ffff7dd1010) == nullptr);
+  mapping = modules.Find(0x7f10);
+  REQUIRE(mapping != nullptr);
+  REQUIRE(mapping->path == "/lib/libc.so.6");
+  REQUIRE(mapping->offset == 0x300);
+
+  int index = 0;
+  std::uint64_t address = 0;
+  REQUIRE(ParseFrameLine("frame 3 0x7f10", index, address));
+  REQUIRE(index == 3);
+  REQUIRE(address == 0x7f10);
+  REQUIRE_FALSE(ParseFrameLine("module 0x7f00-0x8000 0x300 /lib/libc.so.6",
+                               index, address));
+}
+
+#if defined ASAP_LINUX
+
+namespace {
+// Not inlined, so that it has its own frame and symbol
+#if defined __GNUC__
+__attribute__((noinline))
+#endif
+std::string PrintRawBacktrace() {
+  char text[8192];
+  print_backtrace_raw(text, sizeof(text), 1);
+  return text;
+}
+}  // namespace
+
+TEST_CASE("TestSymbolizeRawBacktrace", "[common][symbolizer]") {
+#if ASAP_USE_ASSERTS && ASAP_USE_EXECINFO
+  std::istringstream report(PrintRawBacktrace());
+  ModuleMap modules;
+  std::string line;
+  int index = 0;
+  std::uint64_t address = 0;
+  while (std::getline(report, line)) {
+    if (!modules.AddModuleLine(line)) {
+      REQUIRE(ParseFrameLine(line, index, address));
+    }
+  }
+  REQUIRE_FALSE(modules.Empty());
+  REQUIRE(index == 1);
+
+  // The only frame is in the caller of print_backtrace_raw()
+  Symbolizer symbolizer;
+  auto frame = symbolizer.Symbolize(modules, address);
+  REQUIRE(frame.address == address);
+  REQUIRE_FALSE(frame.module.empty());
+  REQUIRE(frame.function.find("PrintRawBacktrace") != std::string::npos);
+  // Line tables are only there with debug information
+  if (!frame.file.empty()) {
+    REQUIRE(frame.file.find("symbolizer_test.cpp") != std::string::npos);
+    REQUIRE(frame.line > 0);
+  }
+#endif  // ASAP_USE_ASSERTS && ASAP_USE_EXECINFO
+}
+
+TEST_CASE("TestSymbolizerCache", "[common][symbolizer]") {
+  std::remove(CACHE_PATH);
+  ModuleMap modules;
+  modules.AddProcMaps(ReadFile("/proc/self/maps"));
+  // A return address in this function
+  auto address = reinterpret_cast<std::uintptr_t>(&ReadFile) + 1;
+
+  SymbolizedFrame frame;
+  {
+    Symbolizer symbolizer(CACHE_PATH);
+    frame = symbolizer.Symbolize(modules, address);
+    REQUIRE(frame.function.find("ReadFile") != std::string::npos);
+    REQUIRE(symbolizer.ModulesLoaded() == 1);
+    // Loaded once
+    symbolizer.Symbolize(modules, address);
+    REQUIRE(symbolizer.ModulesLoaded() == 1);
+    symbolizer.SaveCache();
+  }
+
+  // The next symbolizer does not need to read the module again
+  Symbolizer symbolizer(CACHE_PATH);
+  auto cached = symbolizer.Symbolize(modules, address);
+  REQUIRE(symbolizer.ModulesLoaded() == 0);
+  REQUIRE(cached.function == frame.function);
+  REQUIRE(cached.file == frame.file);
+  REQUIRE(cached.line == frame.line);
+  REQUIRE(cached.module_address == frame.module_address);
+
+  // Unknown addresses are left unresolved
+  auto unknown = symbolizer.Symbolize(modules, 0x10);
+  REQUIRE(unknown.module.empty());
+  REQUIRE(unknown.function.empty());
+  std::remove(CACHE_PATH);
+}
+
+#endif  // ASAP_LINUX
+
+}  // namespace asap
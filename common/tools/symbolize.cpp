@@ -0,0 +1,173 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+/*!
+ * @file symbolize.cpp
+ *
+ * asap-symbolize: resolves the frames of raw backtraces (see
+ * asap::print_backtrace_raw()) and of crash records (see asap::CrashHandler)
+ * to function, source file and line.
+ *
+ * Text reports (e.g. a log with a failed assertion) are copied to the output
+ * with their frame lines symbolized. Crash records are printed with their
+ * signal, message and symbolized frames. The results are cached, so that the
+ * modules do not have to be read again for the same frames.
+ */
+
+#include <cstdlib>  // for std::getenv
+#include <cstring>  // for std::memcmp
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include <common/crash_handler.h>
+#include <common/symbolizer.h>
+
+namespace bpo = boost::program_options;
+
+namespace {
+
+void PrintFrame(std::ostream &out, int index,
+                const asap::SymbolizedFrame &frame) {
+  out << "#" << std::setw(2) << std::left << index << std::right << " 0x"
+      << std::hex << std::setw(16) << std::setfill('0') << frame.address
+      << std::setfill(' ') << std::dec << " in "
+      << (frame.function.empty() ? "??" : frame.function);
+  if (!frame.file.empty()) out << " at " << frame.file << ":" << frame.line;
+  if (!frame.module.empty()) {
+    out << " (" << frame.module << "+0x" << std::hex << frame.module_address
+        << std::dec << ")";
+  }
+  out << "\n";
+}
+
+/// Copy a text report, with its frame lines symbolized.
+void SymbolizeText(std::istream &in, std::ostream &out,
+                   asap::Symbolizer &symbolizer) {
+  asap::ModuleMap modules;
+  auto in_frames = false;
+  std::string line;
+  while (std::getline(in, line)) {
+    int index = 0;
+    std::uint64_t address = 0;
+    if (asap::ParseFrameLine(line, index, address)) {
+      PrintFrame(out, index, symbolizer.Symbolize(modules, address));
+      in_frames = true;
+      continue;
+    }
+    // A new backtrace starts with its own modules
+    asap::ModuleMap next_modules;
+    if (in_frames && next_modules.AddModuleLine(line)) {
+      modules = std::move(next_modules);
+      in_frames = false;
+      continue;
+    }
+    if (modules.AddModuleLine(line)) continue;
+    out << line << "\n";
+  }
+}
+
+void SymbolizeCrashRecord(const asap::CrashRecord &record, std::ostream &out,
+                          asap::Symbolizer &symbolizer) {
+  out << "signal " << record.signal.signal << " (code " << record.signal.code
+      << ") at 0x" << std::hex << record.signal.address << std::dec
+      << " in process " << record.signal.pid << ", thread "
+      << record.signal.tid << "\n";
+  if (!record.message.empty()) out << record.message << "\n";
+  if (!record.complete) out << "(incomplete record)\n";
+
+  asap::ModuleMap modules;
+  modules.AddProcMaps(record.maps);
+  auto index = 0;
+  for (auto address : record.frames) {
+    PrintFrame(out, index++,
+               symbolizer.Symbolize(modules, address,
+                                    address != record.instruction));
+  }
+}
+
+/// Symbolize a crash record or a text report.
+bool SymbolizeStream(std::istream &in, std::ostream &out,
+                     asap::Symbolizer &symbolizer) {
+  char magic[sizeof(asap::crash_record::MAGIC)] = {};
+  in.read(magic, sizeof(magic));
+  auto is_record = in.gcount() == sizeof(magic) &&
+                   std::memcmp(magic, asap::crash_record::MAGIC,
+                               sizeof(magic)) == 0;
+  in.clear();
+  in.seekg(0);
+
+  if (is_record) {
+    asap::CrashRecord record;
+    if (!asap::CrashRecord::Read(in, record)) return false;
+    SymbolizeCrashRecord(record, out, symbolizer);
+  } else {
+    SymbolizeText(in, out, symbolizer);
+  }
+  return true;
+}
+
+std::string DefaultCachePath() {
+  auto const *home = std::getenv("HOME");
+  if (home == nullptr) return std::string();
+  return std::string(home) + "/.asap-symbolize.cache";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string cache_path;
+  std::vector<std::string> reports;
+  try {
+    bpo::options_description desc("Allowed options");
+    // clang-format off
+    desc.add_options()
+        ("help", "show the help message")
+        ("cache,c", bpo::value<std::string>(&cache_path)
+             ->default_value(DefaultCachePath()),
+         "cache file of the symbolized frames, empty for no cache")
+        ("report", bpo::value<std::vector<std::string>>(&reports),
+         "raw backtrace report or crash record to symbolize");
+    // clang-format on
+    bpo::positional_options_description positional;
+    positional.add("report", -1);
+
+    bpo::variables_map bpo_vm;
+    bpo::store(bpo::command_line_parser(argc, argv)
+                   .options(desc)
+                   .positional(positional)
+                   .run(),
+               bpo_vm);
+    if (bpo_vm.count("help") || bpo_vm.count("report") == 0) {
+      std::cout << "Usage: asap-symbolize [options] <report>...\n" << desc;
+      return bpo_vm.count("help") ? 0 : 1;
+    }
+    bpo::notify(bpo_vm);
+  } catch (std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  asap::Symbolizer symbolizer(cache_path);
+  auto status = 0;
+  for (auto const &report : reports) {
+    std::ifstream in(report, std::ios::binary);
+    if (!in || !SymbolizeStream(in, std::cout, symbolizer)) {
+      std::cerr << "Error: cannot read " << report << std::endl;
+      status = 1;
+    }
+  }
+
+  try {
+    symbolizer.SaveCache();
+  } catch (std::exception &e) {
+    std::cerr << "Warning: " << e.what() << std::endl;
+  }
+  return status;
+}